@@ -6,10 +6,26 @@
  * See the header for further information.
  */
 
+/* The monotonic clock used for latency histograms is a POSIX feature,
+ * which must be requested before any header is included */
+#ifdef RFDICT_TIMING
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "rfdict.h"
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef RFDICT_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef RFDICT_TIMING
+#include <time.h>
+#endif
+
 /*
  * ASCII constants.
  */
@@ -18,10 +34,304 @@
 #define ASCII_LOWER_A (0x61)    /* a */
 #define ASCII_LOWER_Z (0x7a)    /* z */
 
+/*
+ * The number of node size classes.
+ * 
+ * Nodes are allocated in size classes, where size class c holds nodes
+ * that occupy (RFDICT_CLASS_MIN << c) bytes, including the key data.
+ * The largest size class must be able to hold a node with a key of
+ * length RFDICT_MAXKEY.
+ */
+#define RFDICT_NCLASS (16)
+
+/*
+ * The size in bytes of a node in the smallest size class.
+ * 
+ * This is the size of a cache line on common processors.  Blocks of
+ * node storage are aligned to this size, so a node in the smallest
+ * class, which holds keys of up to about twenty bytes inline, lies
+ * within a single cache line.
+ */
+#define RFDICT_CLASS_MIN (64)
+
+/*
+ * Set operation modes for rfdict_setop().
+ */
+#define RFDICT_SETOP_INTERSECT  (1)
+#define RFDICT_SETOP_DIFFERENCE (2)
+#define RFDICT_SETOP_SYMDIFF    (3)
+
+/*
+ * The maximum capacity of a delta table.
+ */
+#define RFDICT_DELTA_MAXCAP (1L << 24)
+
+/*
+ * The default number of bytes of node storage in a block.
+ * 
+ * Blocks are larger than this only if a single node does not fit.
+ */
+#define RFDICT_BLOCK_SIZE (65536)
+
+/*
+ * The offset in bytes from the start of a block to its node storage.
+ * 
+ * This must be at least the size of the RFDICT_BLOCK structure, and it
+ * is a multiple of the smallest size class so that all nodes within
+ * the block have the same alignment as the block itself, which is
+ * aligned to the smallest size class.
+ */
+#define RFDICT_BLOCK_HEAD (RFDICT_CLASS_MIN)
+
+/*
+ * The size in bytes of a page in a disk dictionary file.
+ */
+#define RFDICT_DISK_PAGE (8192)
+
+/*
+ * The minimum number of pages in the buffer pool of a disk dictionary.
+ * 
+ * This must be enough for all the pages that are pinned at the same
+ * time during an insertion.
+ */
+#define RFDICT_DISK_MINPOOL (8)
+
+/*
+ * The maximum depth of the B+tree in a disk dictionary.
+ * 
+ * Each page holds at least seven entries, so this is far more than any
+ * file could ever reach.
+ */
+#define RFDICT_DISK_MAXDEPTH (40)
+
+/*
+ * Disk dictionary page types.
+ */
+#define RFDICT_DISK_LEAF     (1)
+#define RFDICT_DISK_INTERNAL (2)
+
+/*
+ * Byte offsets of the fields in the header page (page zero) of a disk
+ * dictionary file.
+ * 
+ * The header page begins with an eight-byte signature, followed by a
+ * four-byte format version, a four-byte page size, a one-byte case
+ * sensitivity flag, and then three eight-byte fields: the page number
+ * of the root page (zero if the dictionary is empty), the total number
+ * of pages in the file including the header, and the number of keys.
+ * All integers are stored big endian.
+ */
+#define RFDICT_DISK_HDR_SIG     (0)
+#define RFDICT_DISK_HDR_VERSION (8)
+#define RFDICT_DISK_HDR_PAGE    (12)
+#define RFDICT_DISK_HDR_SENS    (16)
+#define RFDICT_DISK_HDR_ROOT    (24)
+#define RFDICT_DISK_HDR_NPAGES  (32)
+#define RFDICT_DISK_HDR_NKEYS   (40)
+
+/*
+ * The disk dictionary file signature and format version.
+ */
+#define RFDICT_DISK_SIG     "RFDICTBT"
+#define RFDICT_DISK_VERSION (1)
+
+/*
+ * Byte offsets of the fields in a B+tree page of a disk dictionary.
+ * 
+ * Each B+tree page begins with a one-byte page type, an unused byte, a
+ * two-byte count of entries, a two-byte offset of the start of the
+ * entry heap, two unused bytes, and an eight-byte link.  For leaf
+ * pages, the link is the page number of the next leaf page in key
+ * order, or zero for the last leaf.  For internal pages, the link is
+ * the page number of the leftmost child.
+ * 
+ * The slot array follows, which has a two-byte page offset of an entry
+ * for each entry, in ascending key order.  The entries themselves are
+ * stored in the heap, which grows down from the end of the page.  Each
+ * entry is a two-byte key length, the key bytes (without terminating
+ * null), and an eight-byte payload.  In leaf pages, the payload is the
+ * value of the key.  In internal pages, the payload is the page number
+ * of the child holding all keys that are greater than or equal to the
+ * entry key and less than the next entry key.
+ * 
+ * All integers are stored big endian.  Keys are stored case-mapped in
+ * case-insensitive dictionaries, and they are ordered by comparing
+ * them as unsigned bytes, so that the file format does not depend on
+ * the platform.
+ */
+#define RFDICT_DISK_PG_TYPE  (0)
+#define RFDICT_DISK_PG_COUNT (2)
+#define RFDICT_DISK_PG_HEAP  (4)
+#define RFDICT_DISK_PG_LINK  (8)
+#define RFDICT_DISK_PG_SLOTS (16)
+
+/*
+ * The number of filter bits per key in the filter of a frozen image.
+ */
+#define RFDICT_FILTER_BITS (10)
+
+/*
+ * The number of hash functions of the filter of a frozen image.
+ */
+#define RFDICT_FILTER_HASHES (7)
+
+/*
+ * The number of bits in an unsigned long, which is the word size of
+ * packed value arrays.
+ */
+#define RFDICT_WORD_BITS ((int) (CHAR_BIT * sizeof(unsigned long)))
+
+/*
+ * The number of words in each block of a bit vector with a rank
+ * directory.  The directory stores the number of one bits before each
+ * block.
+ */
+#define RFDICT_RANK_WORDS (8)
+
+/*
+ * The sampling interval of the select directory of a bit vector.  The
+ * directory stores the block containing every zero bit whose number is
+ * a multiple of this interval.
+ */
+#define RFDICT_SELECT_SAMPLE (512)
+
+/*
+ * The layout of the image of a finite state transducer.
+ * 
+ * The image starts with a header, followed by the node data.  All
+ * header fields are stored big endian.  The signature is eight bytes,
+ * the version and sensitivity flag are four bytes, and the rest are
+ * eight bytes.
+ */
+#define RFDICT_FST_SIG          "RFDICTFS"
+#define RFDICT_FST_VERSION      (1)
+#define RFDICT_FST_HDR_SIG      (0)
+#define RFDICT_FST_HDR_VERSION  (8)
+#define RFDICT_FST_HDR_SENS     (12)
+#define RFDICT_FST_HDR_COUNT    (16)
+#define RFDICT_FST_HDR_MAXLEN   (24)
+#define RFDICT_FST_HDR_ROOT     (32)
+#define RFDICT_FST_HDR_DATALEN  (40)
+#define RFDICT_FST_HDR_SIZE     (48)
+
+/*
+ * Flags in the first byte of a transducer node, set if the node is
+ * final, and if the node has exactly one arc, in which case the number
+ * of arcs is not stored.
+ */
+#define RFDICT_FST_FINAL  (1)
+#define RFDICT_FST_ONEARC (2)
+
+/*
+ * The maximum length in bytes of an encoded variable-length integer.
+ */
+#define RFDICT_FST_MAXVAR ((RFDICT_WORD_BITS + 6) / 7)
+
+/*
+ * The maximum number of sorted runs of an LSM dictionary.
+ * 
+ * Runs are merged so that each run is more than twice as large as the
+ * next newer run, so the number of runs is logarithmic in the number of
+ * keys and never gets near this limit.
+ */
+#define RFDICT_LSM_MAXRUNS (64)
+
+/*
+ * Limits on patterns for rfdict_match(), which are the deepest nesting
+ * of parentheses, and the greatest number of states of the compiled
+ * automaton.  Patterns that exceed either limit are rejected.
+ */
+#define RFDICT_RE_MAXNEST   (256)
+#define RFDICT_RE_MAXSTATES (4096)
+
+/*
+ * Types of pattern automaton node, which either match one byte from a
+ * set, or match nothing.
+ */
+#define RFDICT_RE_SET (1)
+#define RFDICT_RE_EPS (2)
+
+/*
+ * The deepest tree that rfdict_verify() accepts.
+ * 
+ * No path in a red-black tree is more than twice as long as any other,
+ * so a valid tree with fewer than 2^63 nodes is never deeper than this.
+ */
+#define RFDICT_VERIFY_MAXDEPTH (128)
+
+/*
+ * The most parts that rfdict_verify() splits a tree into.
+ */
+#define RFDICT_VERIFY_MAXPARTS (64)
+
+/*
+ * The phases of a background freeze, which first counts the key bytes
+ * and then copies the keys, then has a complete image waiting to be
+ * switched over to, and then serves lookups from it, and the number of
+ * nodes an adaptive dictionary advances its freeze by on each
+ * operation.
+ */
+#define RFDICT_FREEZE_COUNT (1)
+#define RFDICT_FREEZE_COPY  (2)
+#define RFDICT_FREEZE_BUILT (3)
+#define RFDICT_FREEZE_READY (4)
+#define RFDICT_FREEZE_STEP  (64)
+
+/*
+ * The number of operations between workload decisions of an adaptive
+ * dictionary, and the number of nodes or keys that each operation
+ * migrates while the dictionary changes representation.
+ */
+#define RFDICT_ADAPT_WINDOW (1024)
+#define RFDICT_ADAPT_STEP   (64)
+
+/*
+ * Limits of a key compression codec.
+ * 
+ * RFDICT_CODEC_GRAMS is the most grams that training selects, each of
+ * two up to RFDICT_CODEC_GRAMLEN bytes.  RFDICT_CODEC_BITS is the
+ * longest code, which keeps every input byte within four bytes of
+ * output.  Training scales the code frequencies down so that their
+ * total is at most RFDICT_CODEC_WEIGHT, which bounds the code lengths
+ * well below RFDICT_CODEC_BITS.
+ */
+#define RFDICT_CODEC_GRAMS  (4096)
+#define RFDICT_CODEC_GRAMLEN (4)
+#define RFDICT_CODEC_BITS   (28)
+#define RFDICT_CODEC_WEIGHT (1048576L)
+
 /* Structure prototypes */
 struct RFDICT_NODE_TAG;
 typedef struct RFDICT_NODE_TAG RFDICT_NODE;
 
+struct RFDICT_BLOCK_TAG;
+typedef struct RFDICT_BLOCK_TAG RFDICT_BLOCK;
+
+/*
+ * The RFDICT_TIMER structure.
+ * 
+ * A dictionary with latency histograms enabled holds one of these.
+ */
+typedef struct {
+  
+  /*
+   * The sampling interval.
+   */
+  long sample;
+  
+  /*
+   * The number of operations left until the next timed operation, and
+   * the histogram, of each type of operation, indexed by the RFDICT_OP_
+   * constants in the header.
+   * 
+   * Each type counts down separately, so that operations of different
+   * types that alternate are all sampled.
+   */
+  long aCountdown[RFDICT_NOPS];
+  RFDICT_HISTOGRAM aHist[RFDICT_NOPS];
+  
+} RFDICT_TIMER;
+
 /*
  * The RFDICT structure.
  * 
@@ -35,8 +345,7 @@ struct RFDICT_TAG {
    * 
    * If the dictionary is empty, this shall be a NULL pointer.
    * 
-   * All nodes are dynamically allocated, and must be freed before this
-   * structure is freed.
+   * All nodes are allocated within the blocks of the dictionary.
    */
   RFDICT_NODE *pRoot;
   
@@ -47,6 +356,154 @@ struct RFDICT_TAG {
    * comparisons shall be case-insensitive.
    */
   int sensitive;
+  
+  /*
+   * Free lists of recycled nodes, one for each size class.
+   * 
+   * Each entry is NULL if there are no recycled nodes in that size
+   * class.  Otherwise, it points to the first recycled node, and the
+   * rest of the list is linked through the pParent pointers of the
+   * recycled nodes.  The other fields of recycled nodes are undefined.
+   * 
+   * Nodes are placed on these lists when keys are removed, and
+   * rfdict_insert() takes nodes from these lists before allocating new
+   * ones.  Recycled nodes are stored within the blocks of the
+   * dictionary, like all other nodes.
+   */
+  RFDICT_NODE *apFree[RFDICT_NCLASS];
+  
+  /*
+   * The blocks of node storage.
+   * 
+   * This is NULL if no blocks have been allocated yet.  Otherwise, it
+   * points to the most recently allocated block, which is the block
+   * that new nodes are taken from, and the rest of the blocks are
+   * linked through their pNext pointers.
+   * 
+   * All blocks are dynamically allocated, and must be freed before this
+   * structure is freed.
+   */
+  RFDICT_BLOCK *pBlock;
+  
+  /*
+   * Spare blocks of node storage that are empty.
+   * 
+   * This is NULL if there are no spare blocks.  Otherwise, it points to
+   * the first spare block, and the rest are linked through their pNext
+   * pointers.  rfdict_clear() turns all blocks into spare blocks, and
+   * they are reused before any new blocks are allocated.
+   * 
+   * Spare blocks must be freed before this structure is freed.
+   */
+  RFDICT_BLOCK *pSpare;
+  
+  /*
+   * The number of keys in the dictionary.
+   */
+  long count;
+  
+  /*
+   * The node epoch.
+   * 
+   * This is incremented whenever nodes are taken out of the tree, by
+   * rfdict_remove() or rfdict_clear().  Cursors record the epoch when
+   * they are set, so that a cursor pointing to a node that may no
+   * longer be in the tree is never followed.
+   */
+  unsigned long epoch;
+  
+  /*
+   * The number of freeze handles still building an image of this
+   * dictionary.
+   * 
+   * While this is non-zero, every call that may change a key or a
+   * value faults, including rfdict_get_ref() and
+   * rfdict_longest_prefix(), which hand out pointers through which a
+   * value may be written.  The calls only read the count, so lookups
+   * may still run at the same time as each other.
+   */
+  long freezes;
+  
+  /*
+   * The total size in bytes of all the nodes in the tree, not counting
+   * recycled nodes.
+   * 
+   * Each node counts the full size of its size class.
+   */
+  size_t nbytes;
+  
+  /*
+   * The string pool that holds the keys, or NULL if the keys are held
+   * within the nodes.
+   * 
+   * The dictionary holds a handle to the pool, and one reference to
+   * the pooled key of each node in the tree.
+   */
+  RFDICT_POOL *pPool;
+  
+  /*
+   * The latency histograms, or NULL if they are not enabled.
+   */
+  RFDICT_TIMER *pTimer;
+  
+  /*
+   * The key width in bytes, or zero if the keys are null-terminated
+   * strings.
+   * 
+   * Fixed-width keys are copied into the nodes at exactly this width,
+   * followed by a null that is not part of the key, and are compared
+   * by rfdict_fixcmp().
+   */
+  size_t width;
+  
+  /*
+   * The codec that compresses the keys, or NULL if the keys are not
+   * compressed.
+   * 
+   * The dictionary holds a handle to the codec.  The nodes hold the
+   * compressed keys, which compare in the same order as the keys.
+   */
+  RFDICT_CODEC *pCodec;
+};
+
+/*
+ * The RFDICT_BLOCK structure.
+ * 
+ * (Structure prototype given earlier.)
+ * 
+ * A block is a single dynamic allocation that holds many nodes.  The
+ * node storage begins RFDICT_BLOCK_HEAD bytes from the start of the
+ * block.  Nodes are carved from the storage sequentially, and are never
+ * freed individually.
+ * 
+ * The block starts at the first multiple of RFDICT_CLASS_MIN within
+ * its allocation, so that no node in the smallest size class straddles
+ * two cache lines.
+ */
+struct RFDICT_BLOCK_TAG {
+  
+  /*
+   * The start of the allocation that holds the block, which is passed
+   * to free().
+   */
+  void *pAlloc;
+  
+  /*
+   * The next block in the dictionary's list, or NULL if this is the
+   * last block.
+   */
+  RFDICT_BLOCK *pNext;
+  
+  /*
+   * The number of bytes of node storage in the block.
+   */
+  size_t cap;
+  
+  /*
+   * The number of bytes of node storage that have been carved into
+   * nodes so far.
+   */
+  size_t used;
 };
 
 /*
@@ -90,6 +547,15 @@ struct RFDICT_NODE_TAG {
    */
   long val;
   
+  /*
+   * Pointer to the string key of this node.
+   * 
+   * This points to the key field of this node, unless the dictionary
+   * has a string pool, in which case it points to the shared copy of
+   * the key in the pool and the key field is not used.
+   */
+  const char *pKey;
+  
   /*
    * The red color flag.
    * 
@@ -112,6 +578,10 @@ struct RFDICT_NODE_TAG {
    *     node's root path.  A node is an "exit node" if its left or
    *     right pointer is NULL, or both are NULL.  All exit nodes in the
    *     tree must have the same black depth.
+   * 
+   * This is placed just before the key field, so that the key data
+   * follows it directly and keys of up to about twenty bytes fit in a
+   * node of the smallest size class.
    */
   char red;
   
@@ -122,7 +592,9 @@ struct RFDICT_NODE_TAG {
    * 
    * The actual string data is allocated beyond the end of the
    * structure.  This field must therefore be the last field in the
-   * structure.
+   * structure.  The total size of the node is always rounded up to the
+   * size of its size class (see rfdict_class), so that the node can be
+   * recycled for any other key in the same class.
    * 
    * If case-insensitive comparisons are desired, the key string should
    * already have its letters transformed to make everything uppercase
@@ -132,739 +604,12915 @@ struct RFDICT_NODE_TAG {
   
 };
 
-/* Function prototypes */
-static int rfdict_keycmp(
-    const char * pKey1,
-    const char * pKey2,
-    int          sensitive);
-static RFDICT_NODE *rfdict_find(RFDICT *pDict, const char *pKey);
-static int rfdict_isred(RFDICT_NODE *pNode);
-static int rfdict_isblack(RFDICT_NODE *pNode);
-static void rfdict_rol(RFDICT_NODE *pNode, RFDICT *pDict);
-static void rfdict_ror(RFDICT_NODE *pNode, RFDICT *pDict);
-
 /*
- * Perform a case-insensitive or case-sensitive string comparison.
- * 
- * pKey1 and pKey2 point to the null-terminated strings to compare.
- * Neither may be NULL, but both may point to the same string.
- * 
- * If sensitive is non-zero, then this function calls through to the
- * standard library strcmp() function to perform the comparison.  If
- * sensitive is zero, then the strings will be compared such that 
- * lowercase ASCII letters (0x61-0x7a) are mapped to uppercase ASCII
- * letters (0x41-0x5a).
- * 
- * Parameters:
- * 
- *   pKey1 - the first null-terminated key
- * 
- *   pKey2 - the second null-terminated key
+ * The RFDICT_DELTA structure.
  * 
- *   sensitive - non-zero for case-sensitive comparison, zero for
- *   case-insensitive comparison
- * 
- * Return:
+ * Structure prototype defined in the header.
  * 
- *   less than zero, equal to zero, or greater than zero, as key1 is
- *   less than, equal to, or greater than key2
+ * This is an open-addressing hash table that maps value pointers
+ * (obtained from rfdict_get_ref) to pending increments.
  */
-static int rfdict_keycmp(
-    const char * pKey1,
-    const char * pKey2,
-    int          sensitive) {
+struct RFDICT_DELTA_TAG {
   
-  int result = 0;
-  int i = 0;
-  int c1 = 0;
-  int c2 = 0;
+  /*
+   * The maximum number of distinct value pointers the table may hold.
+   * 
+   * This is in range 1 up to RFDICT_DELTA_MAXCAP.
+   */
+  long cap;
   
-  /* Check parameters */
-  if ((pKey1 == NULL) || (pKey2 == NULL)) {
-    abort();
-  }
+  /*
+   * The number of slots in the hash table.
+   * 
+   * This is a power of two that is at least twice the capacity, so
+   * the table never gets more than half full.
+   */
+  long slots;
   
-  /* Do the comparison */
-  if (sensitive) {
-    /* Case-sensitive comparison -- call through to strcmp() */
-    result = strcmp(pKey1, pKey2);
-    
-  } else {
-    /* Case-insensitive comparison -- search for the first pair of
-     * bytes that are not equal (case-insensitive), or for the first
-     * terminating null */
-    for(i = 0; (pKey1[i] != 0) && (pKey2[i] != 0); i++) {
-      
-      /* Get the characters */
-      c1 = pKey1[i];
-      c2 = pKey2[i];
-      
-      /* Case mapping */
-      if ((c1 >= ASCII_LOWER_A) && (c1 <= ASCII_LOWER_Z)) {
+  /*
+   * The number of distinct value pointers currently in the table.
+   * 
+   * This is in range zero up to cap.
+   */
+  long count;
+  
+  /*
+   * The value pointer of each slot, or NULL if the slot is empty.
+   * 
+   * This array has slots elements.
+   */
+  long **ppRef;
+  
+  /*
+   * The pending increment of each slot.
+   * 
+   * This array has slots elements.  Only elements whose slot is in use
+   * are meaningful.
+   */
+  long *pAmount;
+  
+  /*
+   * The indices of the slots that are in use, in the order they were
+   * filled.
+   * 
+   * This array has cap elements, of which the first count are
+   * meaningful.  It allows a flush to visit only the slots in use.
+   */
+  long *pUsed;
+};
+
+/*
+ * The RFDICT_DISK_FRAME structure.
+ * 
+ * A frame of the buffer pool of a disk dictionary, which holds the
+ * contents of one page of the file in memory.
+ */
+typedef struct {
+  
+  /*
+   * The page number held in this frame, or -1 if the frame is empty.
+   */
+  long pgno;
+  
+  /*
+   * Non-zero if the page data has been modified and must be written
+   * back to the file before the frame is reused.
+   */
+  int dirty;
+  
+  /*
+   * The number of users of the page.
+   * 
+   * Frames with a pin count greater than zero may not be reused for a
+   * different page.
+   */
+  int pins;
+  
+  /*
+   * The frame indices of the neighbors of this frame in the LRU list.
+   * 
+   * lru_prev is the next more recently used frame, or -1 if this is the
+   * most recently used frame.  lru_next is the next less recently used
+   * frame, or -1 if this is the least recently used frame.
+   */
+  long lru_prev;
+  long lru_next;
+  
+  /*
+   * The frame index of the next frame in the same hash chain, or -1 if
+   * this is the end of the chain.
+   */
+  long hash_next;
+  
+  /*
+   * Pointer to the page data, which has RFDICT_DISK_PAGE bytes.
+   */
+  unsigned char *pData;
+  
+} RFDICT_DISK_FRAME;
+
+/*
+ * The RFDICT_DISK structure.
+ * 
+ * Structure prototype defined in the header.
+ */
+struct RFDICT_DISK_TAG {
+  
+  /*
+   * The file holding the dictionary, opened for binary update.
+   */
+  FILE *pFile;
+  
+  /*
+   * Case sensitivity flag.
+   * 
+   * If non-zero, comparisons shall be case-sensitive.  If zero,
+   * comparisons shall be case-insensitive.
+   */
+  int sensitive;
+  
+  /*
+   * The error flag.
+   * 
+   * This is set to non-zero when an I/O error happens, or when the file
+   * turns out to be corrupt.  Once it is set, all further operations
+   * fail without accessing the file.
+   */
+  int failed;
+  
+  /*
+   * Non-zero if the header fields below have changed since the header
+   * page was last written.
+   */
+  int hdr_dirty;
+  
+  /*
+   * The page number of the root page, or zero if the dictionary is
+   * empty.
+   */
+  long root;
+  
+  /*
+   * The total number of pages in the file, including the header page.
+   */
+  long npages;
+  
+  /*
+   * The number of keys in the dictionary.
+   */
+  long nkeys;
+  
+  /*
+   * The number of frames in the buffer pool.
+   */
+  long nframes;
+  
+  /*
+   * The frames of the buffer pool.
+   */
+  RFDICT_DISK_FRAME *pFrames;
+  
+  /*
+   * The page data of all the frames, in one allocation.
+   */
+  unsigned char *pPool;
+  
+  /*
+   * The hash table that maps page numbers to frames.
+   * 
+   * Each element is the frame index of the first frame in the chain, or
+   * -1 if the chain is empty.  The number of elements is hash_size,
+   * which is a power of two.
+   */
+  long *pHash;
+  long hash_size;
+  
+  /*
+   * The frame indices of the most recently used and least recently used
+   * frames.
+   */
+  long lru_head;
+  long lru_tail;
+  
+  /*
+   * The case-mapped search key of the current operation, and its length.
+   */
+  unsigned char qkey[RFDICT_DISK_MAXKEY + 1];
+  int qlen;
+  
+  /*
+   * Scratch buffers used while splitting pages.
+   * 
+   * The scratch page receives a copy of the entries of the page being
+   * split plus the new entry, which may be more than fit in one page.
+   * The separator buffer receives the key that is pushed up to the
+   * parent page.
+   */
+  unsigned char scratch[2 * RFDICT_DISK_PAGE];
+  int scratch_off[RFDICT_DISK_PAGE / 12 + 2];
+  unsigned char sep[RFDICT_DISK_MAXKEY];
+  int seplen;
+};
+
+/*
+ * Packed array of long values.
+ * 
+ * The value at index i is base + i * step + r, computed in unsigned
+ * arithmetic, where r is the bits-wide field that starts at bit
+ * i * bits of pWord.  Fields may straddle two words.  mask has the low
+ * bits bits set.
+ * 
+ * If the values are non-decreasing, base is the first value and step
+ * is the smallest difference between neighboring values, so that dense
+ * IDs assigned in order need few or no bits.  Otherwise, base is the
+ * smallest value and step is zero.
+ * 
+ * pWord always has a spare word at the end, so that extraction can
+ * unconditionally read the word following the field.
+ */
+typedef struct {
+  long count;
+  unsigned long base;
+  unsigned long step;
+  int bits;
+  unsigned long mask;
+  unsigned long *pWord;
+} RFDICT_PACK;
+
+/*
+ * The RFDICT_FROZEN structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * A frozen image holds all keys in ascending key order in a single
+ * array of key data, with parallel arrays of key offsets and values, so
+ * that lookups are a binary search over contiguous memory.
+ */
+struct RFDICT_FROZEN_TAG {
+  
+  /*
+   * Case sensitivity flag, the same as for RFDICT.
+   */
+  int sensitive;
+  
+  /*
+   * The number of keys.
+   */
+  long count;
+  
+  /*
+   * The total number of bytes of key data, including the terminating
+   * nulls.
+   */
+  size_t keybytes;
+  
+  /*
+   * The key width, the same as for RFDICT.
+   */
+  size_t width;
+  
+  /*
+   * The codec of the keys, the same as for RFDICT, with a handle held
+   * by the image.
+   */
+  RFDICT_CODEC *pCodec;
+  
+  /*
+   * The key data.
+   * 
+   * All keys are stored one after the other, each with its terminating
+   * null, in ascending key order.  Keys are case-mapped in the same way
+   * as in RFDICT nodes.  Fixed-width keys are stored without nulls, so
+   * that key i starts at i times the width.  This is NULL if there are
+   * no keys.
+   */
+  char *pKeys;
+  
+  /*
+   * The offset of each key within the key data.
+   * 
+   * This array has count elements, or is NULL if there are no keys or
+   * they have a fixed width.
+   */
+  size_t *pOffset;
+  
+  /*
+   * The packed values, one for each key in key order.
+   */
+  RFDICT_PACK val;
+  
+  /*
+   * The number of bits in the membership filter, or zero if the image
+   * has no filter.
+   */
+  unsigned long nbits;
+  
+  /*
+   * The membership filter.
+   * 
+   * This is a Bloom filter over the keys, which may report false
+   * positives but never false negatives.  It is NULL if nbits is zero.
+   */
+  unsigned char *pFilter;
+};
+
+/*
+ * The RFDICT_LSM structure.
+ * 
+ * Structure prototype defined in the header.
+ */
+struct RFDICT_LSM_TAG {
+  
+  /*
+   * Case sensitivity flag, the same as for RFDICT.
+   */
+  int sensitive;
+  
+  /*
+   * The memtable, which receives all new keys.
+   */
+  RFDICT *pMem;
+  
+  /*
+   * The number of keys the memtable holds before it is flushed.
+   */
+  long memcap;
+  
+  /*
+   * The sorted runs, newest first.
+   * 
+   * Each run is a frozen image with a filter.  Since keys can not be
+   * inserted twice, the memtable and all the runs hold disjoint sets of
+   * keys.
+   */
+  RFDICT_FROZEN *apRun[RFDICT_LSM_MAXRUNS];
+  int nruns;
+  
+  /*
+   * The index of the newer of the two runs being merged, or -1 if no
+   * merge is in progress.
+   * 
+   * A merge combines apRun[merge_at] and apRun[merge_at + 1] into the
+   * output image pOut.  It is performed a few keys at a time during
+   * insertions, or on its own thread if threads are enabled.  The input
+   * runs remain in the list and serve lookups until the merge is
+   * complete, when the output replaces them.
+   */
+  int merge_at;
+  
+  /*
+   * The output image of the merge in progress, or NULL.
+   * 
+   * The values of the output are collected in pMergeVal, which has one
+   * element for each key of the output, and packed when the merge is
+   * complete.
+   */
+  RFDICT_FROZEN *pOut;
+  long *pMergeVal;
+  
+  /*
+   * The merge positions: the next key index in the newer input run, the
+   * next key index in the older input run, and the next key index and
+   * key data offset in the output image.
+   */
+  long ia;
+  long ib;
+  long io;
+  size_t ko;
+  
+#ifdef RFDICT_THREADS
+  /*
+   * The thread performing the merge in progress, if running is
+   * non-zero.
+   * 
+   * While the thread runs, it owns pOut, pMergeVal and the merge
+   * positions, and only reads the input runs.  Everything else belongs
+   * to the caller, and the output is installed by the caller after
+   * joining the thread.
+   */
+  pthread_t worker;
+  int running;
+#endif
+};
+
+/*
+ * Bit vector with rank and select directories.
+ * 
+ * Bit i is stored in word (i / RFDICT_WORD_BITS) of pWord, at bit
+ * position (i % RFDICT_WORD_BITS) counting from the least significant
+ * bit.  Bits past the end of the vector in the last word are zero.
+ * 
+ * pRank has one entry for each block of RFDICT_RANK_WORDS words plus
+ * one, giving the number of one bits before the block.  pSel0 is NULL
+ * unless the vector supports select queries for zero bits, in which
+ * case entry j gives the block that contains zero bit number
+ * (j * RFDICT_SELECT_SAMPLE).
+ */
+typedef struct {
+  unsigned long nbits;
+  unsigned long nwords;
+  unsigned long nzero;
+  unsigned long *pWord;
+  unsigned long *pRank;
+  unsigned long *pSel0;
+} RFDICT_BITS;
+
+/*
+ * The RFDICT_LOUDS structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * The keys are stored in a byte-wise trie, encoded in level-order unary
+ * degree sequence (LOUDS) form.  Nodes are numbered in breadth-first
+ * order, with the root as node zero.  For each node in order, the tree
+ * vector holds one bit set for each child followed by one bit clear.
+ * The children of a node therefore have consecutive numbers, and the
+ * number of the first child is one more than the number of set bits
+ * that precede the bits of the node.
+ */
+struct RFDICT_LOUDS_TAG {
+  
+  /*
+   * Case sensitivity flag, the same as for RFDICT.
+   */
+  int sensitive;
+  
+  /*
+   * The number of keys and the number of trie nodes.
+   */
+  long count;
+  long nodes;
+  
+  /*
+   * The tree vector, with select support.
+   */
+  RFDICT_BITS tree;
+  
+  /*
+   * The label of each node except the root.
+   * 
+   * The byte that leads to node v from its parent is at index (v - 1).
+   * Labels are case-mapped in the same way as keys in RFDICT nodes.
+   */
+  unsigned char *pLabel;
+  
+  /*
+   * The terminal vector, which has one bit for each node, set if a key
+   * ends at that node.
+   */
+  RFDICT_BITS term;
+  
+  /*
+   * The values of the keys, in node order.
+   * 
+   * The value of the key ending at node v has the index given by the
+   * number of set bits before bit v of the terminal vector.
+   */
+  RFDICT_PACK val;
+};
+
+/*
+ * A transducer node that is still being built.
+ * 
+ * The arcs have labels pLabel, outputs pOut, and target node offsets
+ * pTarget, each with narcs elements and room for cap.  The target of
+ * the last arc is not known until the node it leads to is complete.
+ * fout is the final output, only meaningful if final is non-zero.
+ */
+typedef struct {
+  int narcs;
+  int cap;
+  unsigned char *pLabel;
+  unsigned long *pOut;
+  size_t *pTarget;
+  int final;
+  unsigned long fout;
+} RFDICT_FST_STATE;
+
+/*
+ * The state of building a transducer.
+ */
+typedef struct {
+  
+  /*
+   * The image being built, with the header at the start, and its
+   * length and capacity in bytes.
+   */
+  unsigned char *pImage;
+  size_t len;
+  size_t cap;
+  
+  /*
+   * The canonical encodings of the nodes written so far, and their
+   * total length and capacity in bytes.
+   * 
+   * The canonical encoding is the same as the stored encoding, except
+   * that the number of arcs is always present, and target offsets are
+   * absolute, so that it does not depend on where the node is stored.
+   */
+  unsigned char *pCanon;
+  size_t canon_len;
+  size_t canon_cap;
+  
+  /*
+   * Hash table of the nodes written so far, used to share identical
+   * nodes.
+   * 
+   * Each slot holds the offset and length of the canonical encoding of
+   * a node, or a length of zero if the slot is empty, and the offset of
+   * the node within the node data.  The number of slots is a power of
+   * two.
+   */
+  size_t *pSlotOff;
+  size_t *pSlotLen;
+  size_t *pSlotNode;
+  size_t slots;
+  size_t used;
+  
+  /*
+   * Buffer for encoding a node, and its capacity.
+   */
+  unsigned char *pScratch;
+  size_t scratch_cap;
+} RFDICT_FST_BUILD;
+
+/*
+ * The RFDICT_FST structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * A finite state transducer stores the keys as paths of labeled arcs
+ * from the root node to final nodes.  Each arc and each final node has
+ * an output, and the value of a key is the sum of the outputs along
+ * its path plus the final output of the node it ends at.  Values are
+ * mapped to unsigned numbers in an order-preserving way, and outputs
+ * are pushed as close to the root as possible, so common prefixes and
+ * common suffixes of keys with their outputs are both shared.
+ * 
+ * Each node is encoded as a flags byte, the number of arcs unless the
+ * node has exactly one, and the final output if the node is final,
+ * followed by each arc as a label byte, an output, and the distance
+ * back from the start of the node to the start of the target node.
+ * Numbers are variable-length integers with seven bits per byte, least
+ * significant group first, and the high bit set on all bytes but the
+ * last.  Arcs are in ascending order of label.  Offsets are relative to
+ * the start of the node data.  Since every arc leads to a node stored
+ * earlier, the graph can not have cycles even if the image is
+ * corrupt.
+ */
+struct RFDICT_FST_TAG {
+  
+  /*
+   * The image, including the header, and its length.
+   */
+  const unsigned char *pImage;
+  size_t len;
+  
+  /*
+   * Non-zero if the image is owned by this structure and should be
+   * freed with it.
+   */
+  int owned;
+  
+  /*
+   * Fields decoded from the header.
+   */
+  int sensitive;
+  long count;
+  long maxlen;
+  size_t root;
+  
+  /*
+   * The node data, which follows the header, and its length.
+   */
+  const unsigned char *pData;
+  size_t dlen;
+};
+
+/*
+ * The RFDICT_SCANNER structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * The scanner is an Aho-Corasick automaton over a byte-wise trie of the
+ * keys.  Nodes are numbered in breadth-first order with the root as
+ * node zero, so the children of each node have consecutive numbers,
+ * and the children of successive nodes follow each other.  Node zero
+ * is never a child, so zero also stands for "no node" in child lookups
+ * and dictionary links.
+ */
+struct RFDICT_SCANNER_TAG {
+  
+  /*
+   * Case sensitivity flag, the same as for RFDICT.
+   */
+  int sensitive;
+  
+  /*
+   * The number of nodes, and the number of keys that can be reported.
+   */
+  long nodes;
+  long count;
+  
+  /*
+   * The children of node v are the nodes from pFirst[v] up to but not
+   * including pFirst[v + 1].  This array has (nodes + 1) elements.
+   */
+  long *pFirst;
+  
+  /*
+   * The label of the arc leading to each node, case-mapped in the same
+   * way as keys in RFDICT nodes.  The label of the root is unused.
+   */
+  unsigned char *pLabel;
+  
+  /*
+   * The failure link of each node, which is the node for the longest
+   * proper suffix of the node's string that is also in the trie.
+   */
+  long *pFail;
+  
+  /*
+   * The key index of each node, or -1 if no key ends at the node.
+   */
+  long *pTerm;
+  
+  /*
+   * The dictionary link of each node, which is the nearest node along
+   * the chain of failure links at which a key ends, or zero if none.
+   */
+  long *pDict;
+  
+  /*
+   * The length and the value of each key, by key index.
+   */
+  RFDICT_PACK len;
+  RFDICT_PACK val;
+  
+  /*
+   * The child of the root for each byte value, or zero if none.  This
+   * is a full table since the root is visited most often.
+   */
+  long aRoot[256];
+};
+
+/*
+ * A node of the nondeterministic automaton for a pattern.
+ * 
+ * Set nodes match one byte that is in aSet, which has one bit for each
+ * byte value, and then go to out1.  Empty nodes go to out1 and out2
+ * without matching anything.  Links that are not used are -1.
+ */
+typedef struct {
+  int type;
+  long out1;
+  long out2;
+  unsigned char aSet[32];
+} RFDICT_RE_NODE;
+
+/*
+ * The state of compiling a pattern for rfdict_match().
+ */
+typedef struct {
+  
+  /*
+   * Case sensitivity flag of the dictionary.
+   */
+  int sensitive;
+  
+  /*
+   * The pattern, its length, the position of the parser, and the
+   * current depth of parentheses.
+   */
+  const unsigned char *pPat;
+  size_t len;
+  size_t pos;
+  int depth;
+  
+  /*
+   * The nodes of the nondeterministic automaton, their number and
+   * capacity, the start node, and the final node.
+   */
+  RFDICT_RE_NODE *pNode;
+  long nodes;
+  long cap;
+  long start;
+  long final;
+  
+  /*
+   * Work arrays with one element per node, for computing sets of nodes.
+   * Nodes that are in the set being computed have a mark equal to gen.
+   */
+  long *pMark;
+  long *pStack;
+  long *pMove;
+  long *pPrevMove;
+  long gen;
+  
+  /*
+   * The states of the deterministic automaton, each of which is a sorted
+   * list of the set nodes and the final node it stands for.  The lists
+   * are stored one after another in pList.  State s has the list of
+   * pCount[s] nodes starting at pList[pOffset[s]].
+   */
+  long *pList;
+  long list_len;
+  long list_cap;
+  long *pOffset;
+  long *pCount;
+  long dstates;
+  long dcap;
+  
+  /*
+   * The transitions of the deterministic automaton, with 256 for each
+   * state, where -1 means that no key can match, and a flag for each
+   * state that is non-zero if a key that ends there matches.  State
+   * zero is the start state.
+   */
+  long *pTrans;
+  int *pAccept;
+  
+  /*
+   * Hash table from node lists to states, holding -1 in empty slots.
+   * The number of slots is a power of two.
+   */
+  long *pSlot;
+  long slots;
+} RFDICT_RE;
+
+/*
+ * A string in a string pool.
+ * 
+ * The string data is allocated beyond the end of the structure, so the
+ * str field must be the last field.  The entry of a pooled string can
+ * be found from a pointer to its data by subtracting the offset of the
+ * str field.
+ */
+typedef struct RFDICT_POOL_ENTRY_TAG {
+  
+  /*
+   * The next entry in the same hash chain, or NULL.
+   */
+  struct RFDICT_POOL_ENTRY_TAG *pNext;
+  
+  /*
+   * The pool this entry belongs to.
+   */
+  RFDICT_POOL *pPool;
+  
+  /*
+   * The hash of the string.
+   */
+  unsigned long hash;
+  
+  /*
+   * The number of dictionary nodes that use this string.  The entry is
+   * freed when this drops to zero.
+   */
+  long refs;
+  
+  /*
+   * The null-terminated string.
+   */
+  char str[1];
+  
+} RFDICT_POOL_ENTRY;
+
+/*
+ * The RFDICT_POOL structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * A string pool is a chained hash table of reference-counted strings.
+ */
+struct RFDICT_POOL_TAG {
+  
+  /*
+   * The hash chains, which have a power-of-two number of slots.
+   */
+  RFDICT_POOL_ENTRY **ppSlot;
+  unsigned long slots;
+  
+  /*
+   * The number of distinct strings in the pool, and their total length
+   * in bytes including terminating nulls.
+   */
+  long count;
+  size_t nbytes;
+  
+  /*
+   * The number of handles to the pool, which is one for the client
+   * until it calls rfdict_pool_free(), plus one for each dictionary
+   * using the pool.  The pool is freed when this drops to zero.
+   */
+  long refs;
+};
+
+/*
+ * The result of verifying one part of a tree for rfdict_verify().
+ */
+typedef struct {
+  
+  /*
+   * The root of the subtree to verify.
+   */
+  RFDICT_NODE *pRoot;
+  
+  /*
+   * The dictionary that the subtree belongs to.
+   */
+  RFDICT *pDict;
+  
+  /*
+   * Non-zero if the subtree is valid.
+   */
+  int ok;
+  
+  /*
+   * The number of nodes in the subtree, and the total size of the
+   * nodes in bytes.
+   */
+  long count;
+  size_t nbytes;
+  
+  /*
+   * The black height of the subtree, which is the number of black
+   * nodes on each path from the root of the subtree down to a missing
+   * child, including the root.
+   */
+  int black;
+  
+  /*
+   * The least and greatest keys in the subtree.
+   */
+  const char *pFirst;
+  const char *pLast;
+  
+} RFDICT_VERIFY_PART;
+
+/*
+ * The RFDICT_FREEZE structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * A freeze handle builds a frozen image of a dictionary, and serves
+ * lookups from the dictionary until the image is complete and from the
+ * image afterwards.  If threads are enabled, the image is built on a
+ * thread of its own; otherwise, or if the thread can not be started,
+ * it is built a few nodes at a time during calls to
+ * rfdict_freeze_step().  Lookups never change the handle.
+ */
+struct RFDICT_FREEZE_TAG {
+  
+  /*
+   * The dictionary being frozen, which is NULL once the image is ready.
+   */
+  RFDICT *pDict;
+  
+  /*
+   * The count and node epoch of the dictionary when the freeze began,
+   * which must not change until the image is ready.
+   */
+  long count;
+  unsigned long epoch;
+  
+  /*
+   * The insert policy, one of the RFDICT_FREEZE_ constants in the
+   * header.
+   */
+  int policy;
+  
+  /*
+   * The build phase, one of the RFDICT_FREEZE_ phase constants.
+   */
+  int phase;
+  
+  /*
+   * The next node to visit in the current phase, or NULL at the end
+   * of the phase, and the index of that node.
+   */
+  RFDICT_NODE *pNode;
+  long i;
+  
+  /*
+   * The number of key bytes counted or copied so far.
+   */
+  size_t keybytes;
+  
+  /*
+   * The image being built and its values, which are packed into the
+   * image at the end.
+   */
+  RFDICT_FROZEN *pBuild;
+  long *pVal;
+  
+  /*
+   * The image that lookups use, which is NULL until it is ready.
+   */
+  RFDICT_FROZEN *pReady;
+  
+  /*
+   * The dictionary of keys inserted since the freeze began, or NULL if
+   * inserts are rejected.
+   */
+  RFDICT *pPending;
+  
+#ifdef RFDICT_THREADS
+  /*
+   * The thread building the image, if running is non-zero.
+   * 
+   * While the thread runs, it owns the build phase, position and image,
+   * and only reads the dictionary.  Everything else belongs to the
+   * caller, and the image is switched over to by the caller after
+   * joining the thread.  The thread sets finished, under lock, once the
+   * image is built, so that the caller can tell without waiting.
+   */
+  pthread_t worker;
+  pthread_mutex_t lock;
+  int running;
+  int finished;
+#endif
+};
+
+/*
+ * The RFDICT_ADAPT structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * An adaptive dictionary holds its keys in one of three
+ * representations.  With RFDICT_ENGINE_TREE, the keys are in the tree
+ * pTree.  With RFDICT_ENGINE_HASH, they are in pTree as well, and
+ * the open addressing table ppSlot points to every node of the tree.
+ * With RFDICT_ENGINE_FROZEN, they are in the freeze handle pFreeze,
+ * which holds a frozen image and the keys inserted after freezing.
+ * 
+ * Moving between representations is done a few nodes at a time during
+ * each operation, and no new move is started until the last one is
+ * complete.
+ */
+struct RFDICT_ADAPT_TAG {
+  
+  /*
+   * Case sensitivity flag, the same as for RFDICT.
+   */
+  int sensitive;
+  
+  /*
+   * The lookups per insert at which the hash and frozen engines are
+   * chosen, or zero if they are not used.
+   */
+  long hash_ratio;
+  long freeze_ratio;
+  
+  /*
+   * The engine in use or being moved to, one of the RFDICT_ENGINE_
+   * constants in the header.
+   */
+  int engine;
+  
+  /*
+   * The tree, or NULL if the frozen engine is in use and the image is
+   * complete.
+   * 
+   * While the frozen engine is being built, this is the tree being
+   * frozen, and it is freed as soon as the image is complete.  While
+   * the frozen engine is being moved back to the tree engine, this is
+   * the new tree, which receives the keys of the image.
+   */
+  RFDICT *pTree;
+  
+  /*
+   * The hash table, which has a power of two number of slots, each
+   * either NULL or pointing to a node of the tree, and the number of
+   * slots in use.  ppSlot is NULL if the hash engine is not in use.
+   */
+  RFDICT_NODE **ppSlot;
+  unsigned long slots;
+  unsigned long filled;
+  
+  /*
+   * The next node of the tree to add to the hash table, or NULL if the
+   * table is complete.
+   * 
+   * Lookups use the tree until the table is complete.  New nodes that
+   * sort before this node are added to the table right away, and the
+   * rest are added when the walk reaches them.
+   */
+  RFDICT_NODE *pIndex;
+  
+  /*
+   * The freeze handle, or NULL if the frozen engine is not in use.
+   */
+  RFDICT_FREEZE *pFreeze;
+  
+  /*
+   * The index of the next key of the image to move into the tree, or -1
+   * if the frozen engine is not being moved back to the tree.
+   */
+  long thaw;
+  
+  /*
+   * The lookups and inserts in the current window.
+   */
+  long reads;
+  long writes;
+  
+  /*
+   * Statistics reported by rfdict_adapt_stats().
+   */
+  RFDICT_ADAPT_STATS stats;
+};
+
+/*
+ * The RFDICT_CODEC structure.
+ * 
+ * Structure prototype defined in the header.
+ * 
+ * The codec divides the space of strings into intervals, each of which
+ * holds only strings that begin with the same symbol, and gives the
+ * intervals codes whose order as bit strings is the order of the
+ * intervals.  The symbols are all single bytes plus the trained grams.
+ * 
+ * The intervals are found from the symbols arranged as a tree, in which
+ * the parent of each gram is the longest other symbol that is a prefix
+ * of it.  The strings beginning with a symbol s form an interval, which
+ * is divided by the intervals of the children of s, leaving one gap
+ * before each child and one after the last.  Each gap gets a code that
+ * consumes s; the intervals of the children are divided in turn.
+ * 
+ * A string is encoded by taking the longest symbol that is a prefix of
+ * it, emitting the code of the gap of that symbol the string falls in,
+ * and carrying on after the symbol.  Two strings that get the same code
+ * start with the same symbol, so the rest of them decides their order,
+ * and strings with different codes are ordered by their intervals.  A
+ * string whose codes are a prefix of the codes of another is a prefix
+ * of it.  So comparing the codes gives the same order as comparing the
+ * strings.
+ * 
+ * The code of index zero is the lowest code and is never emitted.  The
+ * codes are packed seven bits to a byte, with the top bit of every
+ * byte set so that no byte is null, and the last byte is padded with
+ * zero bits, which only decode to code zero.
+ */
+struct RFDICT_CODEC_TAG {
+  
+  /*
+   * Case sensitivity flag.
+   * 
+   * If zero, lowercase letters are mapped to uppercase before keys are
+   * encoded.
+   */
+  int sensitive;
+  
+  /*
+   * The number of handles to the codec, which is one for the client
+   * until it calls rfdict_codec_free(), plus one for each dictionary
+   * and frozen image using the codec.
+   */
+  long refs;
+  
+  /*
+   * The number of symbols, including the unused symbol zero.
+   * 
+   * Symbols 1 to 255 are the single bytes, and the grams follow in
+   * ascending order.
+   */
+  long nsym;
+  
+  /*
+   * The bytes of each symbol, RFDICT_CODEC_GRAMLEN for each, padded
+   * with nulls, and the length of each symbol.
+   */
+  unsigned char *pSymStr;
+  unsigned char *pSymLen;
+  
+  /*
+   * The hash table of grams, which has a power-of-two number of slots,
+   * each holding a gram symbol or zero if empty.
+   */
+  long *pSlot;
+  unsigned long slots;
+  
+  /*
+   * The children of each symbol.
+   * 
+   * The children of symbol s are elements pChildAt[s] up to
+   * pChildAt[s + 1] - 1 of pChild, in ascending order.  pChildAt has
+   * nsym + 1 elements.
+   */
+  long *pChild;
+  long *pChildAt;
+  
+  /*
+   * The code index of each gap, where gap g of symbol s is element
+   * pChildAt[s] + s + g.
+   */
+  long *pGap;
+  
+  /*
+   * The number of codes, and for each code, its bits, its length in
+   * bits, and its symbol.
+   */
+  long ncode;
+  unsigned long *pCode;
+  unsigned char *pLen;
+  long *pCodeSym;
+};
+
+/* Function prototypes */
+static int rfdict_keycmp(
+    const char * pKey1,
+    const char * pKey2,
+    int          sensitive);
+static int rfdict_lcpcmp(
+    const char * pKey1,
+    const char * pKey2,
+    int          sensitive,
+    size_t       limit,
+    size_t     * pLcp);
+static unsigned long rfdict_fixword(const unsigned char *p);
+static int rfdict_fixcmp(
+    const char * pKey1,
+    const char * pKey2,
+    size_t       width,
+    size_t     * pLcp);
+static int rfdict_dictcmp(
+    RFDICT     * pDict,
+    const char * pKey1,
+    const char * pKey2);
+static RFDICT_NODE *rfdict_find(RFDICT *pDict, const char *pKey);
+static int rfdict_isred(RFDICT_NODE *pNode);
+static int rfdict_isblack(RFDICT_NODE *pNode);
+static void rfdict_rol(RFDICT_NODE *pNode, RFDICT *pDict);
+static void rfdict_ror(RFDICT_NODE *pNode, RFDICT *pDict);
+static int rfdict_class(size_t slen);
+static RFDICT_BLOCK *rfdict_newblock(
+    RFDICT * pDict,
+    size_t   need,
+    size_t   cap);
+static RFDICT_NODE *rfdict_newnode(RFDICT *pDict, size_t slen);
+static void rfdict_recycle(RFDICT *pDict, RFDICT_NODE *pNode);
+static void rfdict_transplant(
+    RFDICT      * pDict,
+    RFDICT_NODE * pOld,
+    RFDICT_NODE * pNew);
+static void rfdict_fixdel(
+    RFDICT      * pDict,
+    RFDICT_NODE * pNode,
+    RFDICT_NODE * pParent);
+static void rfdict_fixins(RFDICT *pDict, RFDICT_NODE *pNode);
+static RFDICT_NODE *rfdict_finger(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  *  pHint,
+    RFDICT_NODE  ** ppLast);
+static RFDICT_NODE *rfdict_first(RFDICT *pDict);
+static RFDICT_NODE *rfdict_next(RFDICT_NODE *pNode);
+static RFDICT_NODE *rfdict_build_sub(
+    RFDICT       *  pDict,
+    RFDICT_NODE  ** ppSorted,
+    long            lo,
+    long            hi,
+    int             depth,
+    int             red_depth);
+static RFDICT *rfdict_build(
+    int             sensitive,
+    size_t          width,
+    RFDICT_CODEC *  pCodec,
+    RFDICT_POOL  *  pPool,
+    RFDICT_NODE  ** ppSorted,
+    long            n);
+static RFDICT *rfdict_setop(
+    RFDICT         * pA,
+    RFDICT         * pB,
+    int              mode,
+    rfdict_fp_visit  fp,
+    void           * pCustom);
+static void rfdict_disk_put16(unsigned char *p, unsigned int v);
+static unsigned int rfdict_disk_get16(const unsigned char *p);
+static void rfdict_disk_put64(unsigned char *p, long v);
+static long rfdict_disk_get64(const unsigned char *p);
+static void rfdict_disk_setkey(RFDICT_DISK *pDisk, const char *pKey);
+static int rfdict_disk_cmp(
+    const unsigned char * pKey,
+    int                   klen,
+    const unsigned char * pEntry);
+static int rfdict_disk_rdwr(
+    RFDICT_DISK   * pDisk,
+    long            pgno,
+    unsigned char * pBuf,
+    int             write);
+static void rfdict_disk_lru_remove(RFDICT_DISK *pDisk, long f);
+static void rfdict_disk_lru_push(RFDICT_DISK *pDisk, long f);
+static long rfdict_disk_fetch(RFDICT_DISK *pDisk, long pgno, int fresh);
+static void rfdict_disk_unpin(RFDICT_DISK *pDisk, long f, int dirty);
+static int rfdict_disk_check(RFDICT_DISK *pDisk, const unsigned char *pg);
+static unsigned char *rfdict_disk_entry(unsigned char *pg, int slot);
+static unsigned char *rfdict_disk_payload(unsigned char *pEntry);
+static int rfdict_disk_search(
+    unsigned char       * pg,
+    const unsigned char * pKey,
+    int                   klen,
+    int                 * pFound);
+static long rfdict_disk_child(RFDICT_DISK *pDisk, unsigned char *pg);
+static void rfdict_disk_initpage(unsigned char *pg, int type, long link);
+static int rfdict_disk_place(
+    unsigned char       * pg,
+    int                   slot,
+    const unsigned char * pKey,
+    int                   klen,
+    long                  payload);
+static int rfdict_disk_split(
+    RFDICT_DISK         * pDisk,
+    unsigned char       * pg,
+    int                   slot,
+    const unsigned char * pKey,
+    int                   klen,
+    long                  payload,
+    long                * pRight);
+static int rfdict_disk_writehdr(RFDICT_DISK *pDisk);
+static RFDICT_DISK *rfdict_disk_new(FILE *pFile, long pool_pages);
+static int rfdict_disk_release(RFDICT_DISK *pDisk);
+static RFDICT_NODE *rfdict_seek(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  ** ppParent,
+    int          *  pDir);
+static RFDICT_NODE *rfdict_attach(
+    RFDICT      * pDict,
+    const char  * pKey,
+    long          val,
+    RFDICT_NODE * pParent,
+    int           dir);
+static void rfdict_hash(
+    const char    * pKey,
+    int             sensitive,
+    unsigned long * ph1,
+    unsigned long * ph2);
+static RFDICT_FROZEN *rfdict_frozen_new(
+    int           sensitive,
+    size_t        width,
+    long          count,
+    size_t        keybytes,
+    unsigned long nbits);
+static void rfdict_filter_add(RFDICT_FROZEN *pFrozen, const char *pKey);
+static int rfdict_filter_test(RFDICT_FROZEN *pFrozen, const char *pKey);
+static long rfdict_frozen_find(RFDICT_FROZEN *pFrozen, const char *pKey);
+static long rfdict_tolong(unsigned long u);
+static void rfdict_pack_init(
+    RFDICT_PACK * pPack,
+    const long  * pVal,
+    long          count);
+static long rfdict_pack_get(RFDICT_PACK *pPack, long i);
+static RFDICT_FROZEN *rfdict_frozen_build(RFDICT *pDict, int filter);
+static void rfdict_lsm_schedule(RFDICT_LSM *pLsm, int force);
+static void rfdict_lsm_move(RFDICT_LSM *pLsm, long n);
+#ifdef RFDICT_THREADS
+static void *rfdict_lsm_thread(void *pArg);
+#endif
+static void rfdict_lsm_step(RFDICT_LSM *pLsm, long n);
+static void rfdict_lsm_flush(RFDICT_LSM *pLsm);
+static int rfdict_textcmp(
+    const char * pText,
+    size_t       len,
+    const char * pKey,
+    int          sensitive,
+    size_t     * pLcp);
+static int rfdict_popcount(unsigned long w);
+static void rfdict_bits_alloc(RFDICT_BITS *pBits, unsigned long nbits);
+static void rfdict_bits_index(RFDICT_BITS *pBits, int sel0);
+static unsigned long rfdict_bits_rank1(
+    RFDICT_BITS   * pBits,
+    unsigned long   pos);
+static unsigned long rfdict_bits_select0(
+    RFDICT_BITS   * pBits,
+    unsigned long   k);
+static void rfdict_bits_release(RFDICT_BITS *pBits);
+static unsigned long rfdict_fst_tou(long v);
+static int rfdict_fst_putvar(unsigned char *p, unsigned long v);
+static int rfdict_fst_getvar(
+    RFDICT_FST    * pFst,
+    size_t        * pPos,
+    unsigned long * pv);
+static void rfdict_fst_reserve(RFDICT_FST_BUILD *pBuild, size_t extra);
+static void rfdict_fst_addarc(RFDICT_FST_STATE *pState, int label);
+static size_t rfdict_fst_compile(
+    RFDICT_FST_BUILD * pBuild,
+    RFDICT_FST_STATE * pState);
+static int rfdict_fst_node(
+    RFDICT_FST    * pFst,
+    size_t          pos,
+    int           * pFinal,
+    unsigned long * pFout,
+    unsigned long * pNarcs,
+    size_t        * pArcs);
+static int rfdict_fst_arc(
+    RFDICT_FST    * pFst,
+    size_t          node,
+    size_t        * pPos,
+    int           * pLabel,
+    unsigned long * pOut,
+    size_t        * pTarget);
+static long rfdict_scan_child(RFDICT_SCANNER *pScanner, long v, int c);
+static RFDICT_NODE *rfdict_bound(
+    RFDICT      * pDict,
+    const char  * pPrefix,
+    size_t        plen,
+    int           strict);
+static int rfdict_fuzzy_row(
+    int         * pRow,
+    const int   * pPrev,
+    long          d,
+    int           c,
+    const char  * pQuery,
+    long          n,
+    int           k);
+static long rfdict_re_node(RFDICT_RE *pRe, int type);
+static void rfdict_re_add(RFDICT_RE *pRe, long node, int c);
+static int rfdict_re_class(RFDICT_RE *pRe, long node);
+static int rfdict_re_atom(RFDICT_RE *pRe, long *pStart, long *pEnd);
+static int rfdict_re_cat(RFDICT_RE *pRe, long *pStart, long *pEnd);
+static int rfdict_re_alt(RFDICT_RE *pRe, long *pStart, long *pEnd);
+static long rfdict_re_state(RFDICT_RE *pRe, const long *pSeed, long nseed);
+static int rfdict_re_compile(RFDICT_RE *pRe);
+static void rfdict_re_release(RFDICT_RE *pRe);
+static const char *rfdict_pool_acquire(
+    RFDICT_POOL * pPool,
+    const char  * pKey,
+    int           fold);
+static void rfdict_pool_release(const char *pKey);
+static void rfdict_pool_drop(RFDICT_POOL *pPool);
+static void rfdict_setkey(
+    RFDICT      * pDict,
+    RFDICT_NODE * pNode,
+    const char  * pKey,
+    int           pooled);
+static int rfdict_nodeclass(RFDICT *pDict, RFDICT_NODE *pNode);
+static size_t rfdict_nodesize(RFDICT *pDict, const char *pKey);
+static void rfdict_release_keys(RFDICT *pDict);
+static int rfdict_verify_node(RFDICT *pDict, RFDICT_NODE *pNode);
+static void rfdict_verify_walk(
+    RFDICT_VERIFY_PART * pPart,
+    int                  limit,
+    RFDICT_VERIFY_PART * pSub,
+    long                 nsub);
+#ifdef RFDICT_THREADS
+static void *rfdict_verify_thread(void *pArg);
+#endif
+static void rfdict_freeze_move(RFDICT_FREEZE *pFreeze, long n);
+#ifdef RFDICT_THREADS
+static void *rfdict_freeze_thread(void *pArg);
+#endif
+static RFDICT_NODE **rfdict_adapt_slot(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey);
+static void rfdict_adapt_index(RFDICT_ADAPT *pAdapt, int rebuild);
+static void rfdict_adapt_move(RFDICT_ADAPT *pAdapt, int engine);
+static void rfdict_adapt_step(RFDICT_ADAPT *pAdapt);
+static void rfdict_adapt_note(RFDICT_ADAPT *pAdapt, int write);
+static int rfdict_histogram_index(unsigned long ns);
+static unsigned long rfdict_clock(void);
+static int rfdict_timer_start(
+    RFDICT        * pDict,
+    int             op,
+    unsigned long * pStart);
+static void rfdict_timer_stop(RFDICT *pDict, int op, unsigned long start);
+static unsigned long rfdict_codec_hash(
+    const unsigned char * pGram,
+    int                   len);
+static long rfdict_codec_find(
+    RFDICT_CODEC        * pCodec,
+    const unsigned char * pGram,
+    int                   len);
+static long rfdict_codec_next(
+    RFDICT_CODEC * pCodec,
+    const char   * pKey,
+    size_t       * pUsed);
+static void rfdict_codec_visit(
+    RFDICT_CODEC * pCodec,
+    long           s,
+    long         * pNext);
+static void rfdict_codec_split(
+    RFDICT_CODEC        * pCodec,
+    const unsigned long * pSum,
+    long                  lo,
+    long                  hi,
+    unsigned long         code,
+    int                   len);
+static void rfdict_codec_drop(RFDICT_CODEC *pCodec);
+static int rfdict_put(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val,
+    int          replace);
+static int rfdict_coded_put(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val,
+    int          replace);
+static RFDICT_NODE *rfdict_coded_find(RFDICT *pDict, const char *pKey);
+static RFDICT_NODE *rfdict_coded_finger(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  *  pHint,
+    RFDICT_NODE  ** ppLast);
+static long rfdict_coded_frozen_find(
+    RFDICT_FROZEN * pFrozen,
+    const char    * pKey);
+
+/*
+ * Perform a case-insensitive or case-sensitive string comparison.
+ * 
+ * pKey1 and pKey2 point to the null-terminated strings to compare.
+ * Neither may be NULL, but both may point to the same string.
+ * 
+ * If sensitive is non-zero, then this function calls through to the
+ * standard library strcmp() function to perform the comparison.  If
+ * sensitive is zero, then the strings will be compared such that 
+ * lowercase ASCII letters (0x61-0x7a) are mapped to uppercase ASCII
+ * letters (0x41-0x5a).
+ * 
+ * In both cases, bytes are compared as unsigned values, so every key
+ * sorts before all longer keys that it is a prefix of.
+ * 
+ * Parameters:
+ * 
+ *   pKey1 - the first null-terminated key
+ * 
+ *   pKey2 - the second null-terminated key
+ * 
+ *   sensitive - non-zero for case-sensitive comparison, zero for
+ *   case-insensitive comparison
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as key1 is
+ *   less than, equal to, or greater than key2
+ */
+static int rfdict_keycmp(
+    const char * pKey1,
+    const char * pKey2,
+    int          sensitive) {
+  
+  int result = 0;
+  int i = 0;
+  int c1 = 0;
+  int c2 = 0;
+  
+  /* Check parameters */
+  if ((pKey1 == NULL) || (pKey2 == NULL)) {
+    abort();
+  }
+  
+  /* Do the comparison */
+  if (sensitive) {
+    /* Case-sensitive comparison -- call through to strcmp() */
+    result = strcmp(pKey1, pKey2);
+    
+  } else {
+    /* Case-insensitive comparison -- search for the first pair of
+     * bytes that are not equal (case-insensitive), or for the first
+     * terminating null */
+    for(i = 0; (pKey1[i] != 0) && (pKey2[i] != 0); i++) {
+      
+      /* Get the characters */
+      c1 = (int) ((unsigned char) pKey1[i]);
+      c2 = (int) ((unsigned char) pKey2[i]);
+      
+      /* Case mapping */
+      if ((c1 >= ASCII_LOWER_A) && (c1 <= ASCII_LOWER_Z)) {
+        c1 -= (ASCII_LOWER_A - ASCII_UPPER_A);
+      }
+      if ((c2 >= ASCII_LOWER_A) && (c2 <= ASCII_LOWER_Z)) {
+        c2 -= (ASCII_LOWER_A - ASCII_UPPER_A);
+      }
+      
+      /* Comparison */
+      if (c1 != c2) {
+        break;
+      }
+    }
+    
+    /* If we stopped on null termination, fetch the characters */
+    if ((pKey1[i] == 0) || (pKey2[i] == 0)) {
+      c1 = (int) ((unsigned char) pKey1[i]);
+      c2 = (int) ((unsigned char) pKey2[i]);
+    }
+    
+    /* Result is comparison of c1 and c2 */
+    if (c1 == c2) {
+      result = 0;
+    } else if (c1 > c2) {
+      result = 1;
+    } else if (c1 < c2) {
+      result = -1;
+    } else {
+      abort();  /* shouldn't happen */
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Compare two keys that are known to share a common prefix, and find
+ * the length of their longest common prefix.
+ * 
+ * The comparison starts at the offset given in *pLcp, so the bytes
+ * before it are not read again.  Bytes are compared in the same way as
+ * rfdict_keycmp(), but no further than limit bytes, beyond which the
+ * keys are treated as equal.
+ * 
+ * In a binary search tree, every key in the subtree reached so far lies
+ * between the nearest lower and upper bounds on the path, so it shares
+ * at least the shorter of the prefixes that the search key shares with
+ * those bounds.  Descents track both prefixes and start each
+ * comparison at the shorter one, which saves reading long shared
+ * prefixes again at every level.
+ * 
+ * Parameters:
+ * 
+ *   pKey1 - the first key
+ * 
+ *   pKey2 - the second key
+ * 
+ *   sensitive - non-zero for case-sensitive comparison, zero for
+ *   case-insensitive comparison
+ * 
+ *   limit - the most bytes to compare
+ * 
+ *   pLcp - on input, the number of leading bytes known to be equal;
+ *   receives the length of the common prefix
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as key1 is
+ *   less than, equal to, or greater than key2
+ */
+static int rfdict_lcpcmp(
+    const char * pKey1,
+    const char * pKey2,
+    int          sensitive,
+    size_t       limit,
+    size_t     * pLcp) {
+  
+  size_t i = 0;
+  int c1 = 0;
+  int c2 = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pKey1 == NULL) || (pKey2 == NULL) || (pLcp == NULL)) {
+    abort();
+  }
+  
+  /* Skip the bytes that are equal without case mapping, up to the
+   * first difference, the terminating null, or the limit */
+  for(i = *pLcp;
+      (i < limit) && (pKey1[i] == pKey2[i]) && (pKey1[i] != 0);
+      i++);
+  
+  /* Compare the bytes there, and if they only differ in case, carry on
+   * with case mapping */
+  for( ; i < limit; i++) {
+    c1 = (int) ((unsigned char) pKey1[i]);
+    c2 = (int) ((unsigned char) pKey2[i]);
+    if (!sensitive) {
+      if ((c1 >= ASCII_LOWER_A) && (c1 <= ASCII_LOWER_Z)) {
         c1 -= (ASCII_LOWER_A - ASCII_UPPER_A);
       }
-      if ((c2 >= ASCII_LOWER_A) && (c2 >= ASCII_LOWER_Z)) {
-        c2 -= (ASCII_LOWER_A - ASCII_UPPER_A);
+      if ((c2 >= ASCII_LOWER_A) && (c2 <= ASCII_LOWER_Z)) {
+        c2 -= (ASCII_LOWER_A - ASCII_UPPER_A);
+      }
+    }
+    if (c1 != c2) {
+      result = c1 - c2;
+      break;
+    }
+    if (c1 == 0) {
+      break;
+    }
+  }
+  
+  *pLcp = i;
+  return result;
+}
+
+/*
+ * Load an unsigned long from bytes stored big endian.
+ * 
+ * As many bytes are read as there are in an unsigned long, which is
+ * taken to be a multiple of four.  The bytes are combined four at a
+ * time with explicit shifts, which compilers turn into a single load
+ * and byte swap where the target allows unaligned loads.
+ * 
+ * Parameters:
+ * 
+ *   p - pointer to the bytes to read
+ * 
+ * Return:
+ * 
+ *   the value
+ */
+static unsigned long rfdict_fixword(const unsigned char *p) {
+  
+  unsigned long w = 0;
+  size_t i = 0;
+  
+  /* Check parameters */
+  if (p == NULL) {
+    abort();
+  }
+  
+  /* The double shift avoids a shift by the full width when an unsigned
+   * long is only four bytes */
+  for(i = 0; i < sizeof(unsigned long); i += 4) {
+    w = ((w << 16) << 16) |
+          (((unsigned long) p[i]) << 24) |
+          (((unsigned long) p[i + 1]) << 16) |
+          (((unsigned long) p[i + 2]) << 8) |
+          ((unsigned long) p[i + 3]);
+  }
+  
+  return w;
+}
+
+/*
+ * Compare two fixed-width binary keys.
+ * 
+ * The keys are compared as unsigned big-endian words the size of an
+ * unsigned long, and then any bytes left over one at a time, which
+ * gives the same order as memcmp() over the full width.  The words are
+ * loaded by rfdict_fixword(), so the keys need not be aligned.
+ * 
+ * As with rfdict_lcpcmp(), the comparison starts at the offset given in
+ * *pLcp, and the offset reached is returned there.  All bytes before
+ * the returned offset are equal, though it may fall short of the first
+ * byte that differs by up to a word.
+ * 
+ * Parameters:
+ * 
+ *   pKey1 - the first key
+ * 
+ *   pKey2 - the second key
+ * 
+ *   width - the key width in bytes
+ * 
+ *   pLcp - on input, the number of leading bytes known to be equal;
+ *   receives the number of leading bytes found to be equal
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as key1 is
+ *   less than, equal to, or greater than key2
+ */
+static int rfdict_fixcmp(
+    const char * pKey1,
+    const char * pKey2,
+    size_t       width,
+    size_t     * pLcp) {
+  
+  const unsigned char *p1 = NULL;
+  const unsigned char *p2 = NULL;
+  unsigned long w1 = 0;
+  unsigned long w2 = 0;
+  size_t i = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pKey1 == NULL) || (pKey2 == NULL) || (pLcp == NULL)) {
+    abort();
+  }
+  
+  p1 = (const unsigned char *) pKey1;
+  p2 = (const unsigned char *) pKey2;
+  
+  /* Compare whole words until one differs */
+  for(i = *pLcp;
+      i + sizeof(unsigned long) <= width;
+      i += sizeof(unsigned long)) {
+    w1 = rfdict_fixword(p1 + i);
+    w2 = rfdict_fixword(p2 + i);
+    if (w1 != w2) {
+      break;
+    }
+  }
+  
+  /* Result is from the word that differs, else from the bytes left */
+  if (w1 < w2) {
+    result = -1;
+  } else if (w1 > w2) {
+    result = 1;
+  } else {
+    for( ; i < width; i++) {
+      if (p1[i] != p2[i]) {
+        result = ((int) p1[i]) - ((int) p2[i]);
+        break;
+      }
+    }
+  }
+  
+  *pLcp = i;
+  return result;
+}
+
+/*
+ * Compare two keys in the order of a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey1 - the first key
+ * 
+ *   pKey2 - the second key
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as key1 is
+ *   less than, equal to, or greater than key2
+ */
+static int rfdict_dictcmp(
+    RFDICT     * pDict,
+    const char * pKey1,
+    const char * pKey2) {
+  
+  size_t lcp = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  if (pDict->width > 0) {
+    result = rfdict_fixcmp(pKey1, pKey2, pDict->width, &lcp);
+  } else {
+    result = rfdict_keycmp(pKey1, pKey2, pDict->sensitive);
+  }
+  
+  return result;
+}
+
+/*
+ * Find a node in the dictionary matching the given key.
+ * 
+ * NULL is returned if no node in the dictionary matches that key.
+ * Comparisons are case-sensitive or case-insensitive depending on the
+ * setting of the sensitive flag in the dictionary.
+ * 
+ * pDict is the dictionary to search.
+ * 
+ * pKey is the null-terminated key to find.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key to search for
+ * 
+ * Return:
+ * 
+ *   the dictionary node matching the key, or NULL if no node matches
+ *   the key
+ */
+static RFDICT_NODE *rfdict_find(RFDICT *pDict, const char *pKey) {
+  
+  RFDICT_NODE *pCurrent = NULL;
+  size_t lcp_lo = 0;
+  size_t lcp_hi = 0;
+  size_t lcp = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Start at root (or NULL if dictionary is empty) */
+  pCurrent = pDict->pRoot;
+  
+  /* Search until node found or we've gone through everything */
+  while (pCurrent != NULL) {
+    
+    /* Compare to current node, skipping the prefix shared with both
+     * bounds */
+    if (lcp_lo < lcp_hi) {
+      lcp = lcp_lo;
+    } else {
+      lcp = lcp_hi;
+    }
+    if (pDict->width > 0) {
+      retval = rfdict_fixcmp(pKey, pCurrent->pKey, pDict->width, &lcp);
+    } else {
+      retval = rfdict_lcpcmp(
+                pKey, pCurrent->pKey, pDict->sensitive,
+                RFDICT_MAXKEY + 1, &lcp);
+    }
+    
+    /* Done if equal, else go down appropriate branch */
+    if (retval == 0) {
+      /* Equal -- done */
+      break;
+    
+    } else if (retval < 0) {
+      /* Key less than current node, which becomes the upper bound */
+      lcp_hi = lcp;
+      pCurrent = pCurrent->pLeft;
+      
+    } else if (retval > 0) {
+      /* Key greater than current node, which becomes the lower bound */
+      lcp_lo = lcp;
+      pCurrent = pCurrent->pRight;
+      
+    } else {
+      abort();  /* shouldn't happen */
+    }
+  }
+  
+  /* Return the matching node or NULL */
+  return pCurrent;
+}
+
+/*
+ * Check whether a given node is red.
+ * 
+ * NULL may be passed.  This function returns non-zero only if the
+ * passed node is not NULL and it is red.
+ * 
+ * Parameters:
+ * 
+ *   pNode - the node to check, or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if the node exists and is red, zero otherwise
+ */
+static int rfdict_isred(RFDICT_NODE *pNode) {
+  
+  int result = 0;
+  
+  if (pNode != NULL) {
+    if (pNode->red) {
+      result = 1;
+    } else {
+      result = 0;
+    }
+  
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Check whether a given node is black or doesn't exist.
+ * 
+ * NULL may be passed.  This function returns non-zero if the passed
+ * node is not NULL and it is black, or if the passed node is NULL.
+ * 
+ * Parameters:
+ * 
+ *   pNode - the node to check, or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if the node does not exist or it exists and is black, zero
+ *   otherwise
+ */
+static int rfdict_isblack(RFDICT_NODE *pNode) {
+  
+  int result = 0;
+  
+  if (pNode != NULL) {
+    if (pNode->red) {
+      result = 0;
+    } else {
+      result = 1;
+    }
+  
+  } else {
+    result = 1;
+  }
+  
+  return result;
+}
+
+/*
+ * Rotate a node left.
+ * 
+ * The provided node may not be NULL.  The right child of the node must
+ * exist or a fault will occur.
+ * 
+ * Let N be the provided node, and R be its right child.  R's left
+ * subtree becomes N's right subtree, and N becomes R's left child.
+ * Both nodes swap parents in the process.
+ * 
+ * If the provided node was originally the root node of the dictionary,
+ * the dictionary is updated so that R becomes the new root.
+ * 
+ * Parameters:
+ * 
+ *   pNode - the node to rotate
+ * 
+ *   pDict - the dictionary
+ */
+static void rfdict_rol(RFDICT_NODE *pNode, RFDICT *pDict) {
+  
+  RFDICT_NODE *pR = NULL;
+  
+  /* Check parameter */
+  if ((pNode == NULL) || (pDict == NULL)) {
+    abort();
+  }
+  if (pNode->pRight == NULL) {
+    abort();
+  }
+  
+  /* Define right child */
+  pR = pNode->pRight;
+  
+  /* Perform rotation */
+  pNode->pRight = pR->pLeft;
+  pR->pLeft = pNode;
+  
+  /* Update parent of the swapped subtree, if it isn't empty */
+  if (pNode->pRight != NULL) {
+    (pNode->pRight)->pParent = pNode;
+  }
+  
+  /* Swap parents of the two nodes */
+  pR->pParent = pNode->pParent;
+  pNode->pParent = pR;
+  
+  /* Update new parent, or root node */
+  if (pR->pParent != NULL) {
+    /* Update parent */
+    if ((pR->pParent)->pLeft == pNode) {
+      (pR->pParent)->pLeft = pR;
+      
+    } else if ((pR->pParent)->pRight == pNode) {
+      (pR->pParent)->pRight = pR;
+      
+    } else {
+      abort();  /* shouldn't happen */
+    }
+  
+  } else {
+    /* Update root */
+    pDict->pRoot = pR;
+  }
+}
+
+/*
+ * Rotate a node right.
+ * 
+ * The provided node may not be NULL.  The left child of the node must
+ * exist or a fault will occur.
+ * 
+ * Let N be the provided node, and L be its left child.  L's right
+ * subtree becomes N's left subtree, and N becomes L's right child.
+ * Both nodes swap parents in the process.
+ * 
+ * If the provided node was originally the root node of the dictionary,
+ * the dictionary is updated so that L becomes the new root.
+ * 
+ * Parameters:
+ * 
+ *   pNode - the node to rotate
+ * 
+ *   pDict - the dictionary
+ */
+static void rfdict_ror(RFDICT_NODE *pNode, RFDICT *pDict) {
+  
+  RFDICT_NODE *pL = NULL;
+  
+  /* Check parameters */
+  if ((pNode == NULL) || (pDict == NULL)) {
+    abort();
+  }
+  if (pNode->pLeft == NULL) {
+    abort();
+  }
+  
+  /* Define left child */
+  pL = pNode->pLeft;
+  
+  /* Perform rotation */
+  pNode->pLeft = pL->pRight;
+  pL->pRight = pNode;
+  
+  /* Update parent of the swapped subtree, if it isn't empty */
+  if (pNode->pLeft != NULL) {
+    (pNode->pLeft)->pParent = pNode;
+  }
+  
+  /* Swap parents of the two nodes */
+  pL->pParent = pNode->pParent;
+  pNode->pParent = pL;
+  
+  /* Update new parent, or root node */
+  if (pL->pParent != NULL) {
+    /* Update parent */
+    if ((pL->pParent)->pLeft == pNode) {
+      (pL->pParent)->pLeft = pL;
+      
+    } else if ((pL->pParent)->pRight == pNode) {
+      (pL->pParent)->pRight = pL;
+      
+    } else {
+      abort();  /* shouldn't happen */
+    }
+  
+  } else {
+    /* Update root */
+    pDict->pRoot = pL;
+  }
+}
+
+/*
+ * Determine the size class of a node holding a key of a given length.
+ * 
+ * slen is the length of the key in bytes, not including the
+ * terminating null.  It may not exceed RFDICT_MAXKEY or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   slen - the key length
+ * 
+ * Return:
+ * 
+ *   the size class index, in range zero up to RFDICT_NCLASS - 1
+ */
+static int rfdict_class(size_t slen) {
+  
+  int c = 0;
+  
+  /* Check parameter */
+  if (slen > RFDICT_MAXKEY) {
+    abort();
+  }
+  
+  /* Find the smallest class that has room for the node fields and the
+   * key with its terminating null */
+  for(c = 0; c < RFDICT_NCLASS; c++) {
+    if (((size_t) (RFDICT_CLASS_MIN << c)) >=
+          offsetof(RFDICT_NODE, key) + slen + 1) {
+      break;
+    }
+  }
+  
+  /* Make sure we found a class */
+  if (c >= RFDICT_NCLASS) {
+    abort();
+  }
+  
+  /* Return the class */
+  return c;
+}
+
+/*
+ * Get a new, empty block of node storage and make it the current block
+ * of the dictionary.
+ * 
+ * If one of the spare blocks of the dictionary has at least need bytes
+ * of storage, it is reused.  Otherwise, a block with cap bytes of
+ * storage is allocated.
+ * 
+ * Any storage left over at the end of the previous current block is
+ * carved into nodes of the largest size classes that fit, and these
+ * are placed on the free lists so that the storage is not wasted.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   need - the minimum number of bytes of node storage required
+ * 
+ *   cap - the number of bytes of node storage in the block, if a new
+ *   block must be allocated, which must be a multiple of
+ *   RFDICT_CLASS_MIN and at least need
+ * 
+ * Return:
+ * 
+ *   the new block
+ */
+static RFDICT_BLOCK *rfdict_newblock(
+    RFDICT * pDict,
+    size_t   need,
+    size_t   cap) {
+  
+  RFDICT_BLOCK *pBlock = NULL;
+  RFDICT_BLOCK *pPrev = NULL;
+  RFDICT_NODE *pNode = NULL;
+  char *pAlloc = NULL;
+  size_t nsize = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  if (((cap % RFDICT_CLASS_MIN) != 0) || (cap < need)) {
+    abort();
+  }
+  if (sizeof(RFDICT_BLOCK) > RFDICT_BLOCK_HEAD) {
+    abort();
+  }
+  
+  /* Recycle leftover storage of the current block, if any */
+  pBlock = pDict->pBlock;
+  if (pBlock != NULL) {
+    for(c = RFDICT_NCLASS - 1; c >= 0; c--) {
+      nsize = (size_t) (RFDICT_CLASS_MIN << c);
+      while (pBlock->cap - pBlock->used >= nsize) {
+        pNode = (RFDICT_NODE *)
+                  (((char *) pBlock) + RFDICT_BLOCK_HEAD + pBlock->used);
+        pBlock->used += nsize;
+        
+        pNode->pParent = (pDict->apFree)[c];
+        pNode->pLeft = NULL;
+        pNode->pRight = NULL;
+        (pDict->apFree)[c] = pNode;
+      }
+    }
+  }
+  
+  /* Look for a spare block that is big enough */
+  pPrev = NULL;
+  for(pBlock = pDict->pSpare; pBlock != NULL; pBlock = pBlock->pNext) {
+    if (pBlock->cap >= need) {
+      break;
+    }
+    pPrev = pBlock;
+  }
+  
+  if (pBlock != NULL) {
+    /* Unlink the spare block */
+    if (pPrev != NULL) {
+      pPrev->pNext = pBlock->pNext;
+    } else {
+      pDict->pSpare = pBlock->pNext;
+    }
+    
+  } else {
+    /* Allocate a new block, with room to align it to a cache line;
+     * only the low bits of the address matter, so the conversion to an
+     * integer may truncate */
+    pAlloc = (char *) malloc(RFDICT_BLOCK_HEAD + cap +
+                              (RFDICT_CLASS_MIN - 1));
+    if (pAlloc == NULL) {
+      abort();
+    }
+    pBlock = (RFDICT_BLOCK *) (pAlloc +
+                ((RFDICT_CLASS_MIN -
+                  (((unsigned long) pAlloc) % RFDICT_CLASS_MIN)) %
+                    RFDICT_CLASS_MIN));
+    memset(pBlock, 0, sizeof(RFDICT_BLOCK));
+    pBlock->pAlloc = pAlloc;
+    pBlock->cap = cap;
+  }
+  
+  /* Initialize and link in at start of list */
+  pBlock->used = 0;
+  pBlock->pNext = pDict->pBlock;
+  pDict->pBlock = pBlock;
+  
+  /* Return the block */
+  return pBlock;
+}
+
+/*
+ * Get a new node with room for a key of a given length.
+ * 
+ * The node is taken from the free list of the appropriate size class
+ * if possible.  Otherwise, a new node of the full class size is carved
+ * from the current block, allocating a new block if necessary.
+ * 
+ * The returned node is cleared to all zero.  It is not linked into the
+ * tree.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   slen - the length of the key the node will hold, not including the
+ *   terminating null
+ * 
+ * Return:
+ * 
+ *   the new node
+ */
+static RFDICT_NODE *rfdict_newnode(RFDICT *pDict, size_t slen) {
+  
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_BLOCK *pBlock = NULL;
+  size_t nsize = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Determine size class and node size */
+  c = rfdict_class(slen);
+  nsize = (size_t) (RFDICT_CLASS_MIN << c);
+  
+  /* Take a recycled node if available; else, carve a new one */
+  if ((pDict->apFree)[c] != NULL) {
+    pNode = (pDict->apFree)[c];
+    (pDict->apFree)[c] = pNode->pParent;
+    
+  } else {
+    /* Get a block with enough room */
+    pBlock = pDict->pBlock;
+    if (pBlock != NULL) {
+      if (pBlock->cap - pBlock->used < nsize) {
+        pBlock = NULL;
+      }
+    }
+    if (pBlock == NULL) {
+      if (nsize > RFDICT_BLOCK_SIZE) {
+        pBlock = rfdict_newblock(pDict, nsize, nsize);
+      } else {
+        pBlock = rfdict_newblock(pDict, nsize, RFDICT_BLOCK_SIZE);
+      }
+    }
+    
+    /* Carve the node */
+    pNode = (RFDICT_NODE *)
+              (((char *) pBlock) + RFDICT_BLOCK_HEAD + pBlock->used);
+    pBlock->used += nsize;
+  }
+  
+  /* Clear the node */
+  memset(pNode, 0, nsize);
+  
+  /* Return the node */
+  return pNode;
+}
+
+/*
+ * Place a node that is no longer in use onto the free list of its size
+ * class.
+ * 
+ * The node must not be linked into the tree anymore.  Its key must
+ * still be intact, because it is used to determine the size class.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the node to recycle
+ */
+static void rfdict_recycle(RFDICT *pDict, RFDICT_NODE *pNode) {
+  
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pNode == NULL)) {
+    abort();
+  }
+  
+  /* Determine size class from the key, and release the key if it is
+   * in a pool */
+  c = rfdict_nodeclass(pDict, pNode);
+  if (pNode->pKey != &((pNode->key)[0])) {
+    rfdict_pool_release(pNode->pKey);
+  }
+  
+  /* Push onto the free list */
+  pNode->pParent = (pDict->apFree)[c];
+  pNode->pLeft = NULL;
+  pNode->pRight = NULL;
+  (pDict->apFree)[c] = pNode;
+}
+
+/*
+ * Replace the subtree rooted at one node with the subtree rooted at
+ * another node.
+ * 
+ * pOld is the node whose position in the tree will be taken.  It may
+ * not be NULL.  Its parent's child pointer (or the root pointer of the
+ * dictionary) is updated to point to pNew.
+ * 
+ * pNew is the node that takes the position, or NULL to make the
+ * position empty.  If it is not NULL, its parent pointer is updated.
+ * 
+ * The child pointers of both nodes and the parent pointer of pOld are
+ * not changed.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pOld - the node to replace
+ * 
+ *   pNew - the replacement node, or NULL
+ */
+static void rfdict_transplant(
+    RFDICT      * pDict,
+    RFDICT_NODE * pOld,
+    RFDICT_NODE * pNew) {
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pOld == NULL)) {
+    abort();
+  }
+  
+  /* Update the parent, or the root */
+  if (pOld->pParent == NULL) {
+    pDict->pRoot = pNew;
+    
+  } else if ((pOld->pParent)->pLeft == pOld) {
+    (pOld->pParent)->pLeft = pNew;
+    
+  } else if ((pOld->pParent)->pRight == pOld) {
+    (pOld->pParent)->pRight = pNew;
+    
+  } else {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Update the parent pointer of the new node */
+  if (pNew != NULL) {
+    pNew->pParent = pOld->pParent;
+  }
+}
+
+/*
+ * Rebalance the tree after a black node has been removed.
+ * 
+ * pNode is the node that took the place of the removed black node, or
+ * NULL if the position is now empty.  The black depth of all exit
+ * nodes through this position is one less than elsewhere in the tree.
+ * 
+ * pParent is the parent of the position, or NULL if the position is
+ * the root of the tree.  This parameter is necessary because pNode may
+ * be NULL.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the node in the deficient position, or NULL
+ * 
+ *   pParent - the parent of the deficient position, or NULL
+ */
+static void rfdict_fixdel(
+    RFDICT      * pDict,
+    RFDICT_NODE * pNode,
+    RFDICT_NODE * pParent) {
+  
+  RFDICT_NODE *pSib = NULL;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* 
+   * Keep going until we reach the root or a red node.  A red node can
+   * simply be recolored black to restore the missing black depth.
+   * Otherwise, the sibling subtree must contain at least one black node
+   * on each path, so the sibling always exists.
+   */
+  while ((pNode != pDict->pRoot) && rfdict_isblack(pNode)) {
+    
+    /* Parent must exist if we are not at the root */
+    if (pParent == NULL) {
+      abort();
+    }
+    
+    if (pNode == pParent->pLeft) {
+      /* Deficient position is left child -- get sibling */
+      pSib = pParent->pRight;
+      if (pSib == NULL) {
+        abort();  /* shouldn't happen */
+      }
+      
+      /* If sibling is red, rotate it up so that the sibling is black */
+      if (pSib->red) {
+        pSib->red = 0;
+        pParent->red = 1;
+        rfdict_rol(pParent, pDict);
+        pSib = pParent->pRight;
+      }
+      
+      if (rfdict_isblack(pSib->pLeft) && rfdict_isblack(pSib->pRight)) {
+        /* Sibling has no red children, so recolor sibling red and move
+         * the deficiency up to the parent */
+        pSib->red = 1;
+        pNode = pParent;
+        pParent = pNode->pParent;
+        
+      } else {
+        /* Make sure the far child of the sibling is red */
+        if (rfdict_isblack(pSib->pRight)) {
+          (pSib->pLeft)->red = 0;
+          pSib->red = 1;
+          rfdict_ror(pSib, pDict);
+          pSib = pParent->pRight;
+        }
+        
+        /* Rotate the sibling up, which fixes the deficiency */
+        pSib->red = pParent->red;
+        pParent->red = 0;
+        (pSib->pRight)->red = 0;
+        rfdict_rol(pParent, pDict);
+        pNode = pDict->pRoot;
+        pParent = NULL;
+      }
+      
+    } else {
+      /* Deficient position is right child -- get sibling */
+      pSib = pParent->pLeft;
+      if (pSib == NULL) {
+        abort();  /* shouldn't happen */
+      }
+      
+      /* If sibling is red, rotate it up so that the sibling is black */
+      if (pSib->red) {
+        pSib->red = 0;
+        pParent->red = 1;
+        rfdict_ror(pParent, pDict);
+        pSib = pParent->pLeft;
+      }
+      
+      if (rfdict_isblack(pSib->pLeft) && rfdict_isblack(pSib->pRight)) {
+        /* Sibling has no red children, so recolor sibling red and move
+         * the deficiency up to the parent */
+        pSib->red = 1;
+        pNode = pParent;
+        pParent = pNode->pParent;
+        
+      } else {
+        /* Make sure the far child of the sibling is red */
+        if (rfdict_isblack(pSib->pLeft)) {
+          (pSib->pRight)->red = 0;
+          pSib->red = 1;
+          rfdict_rol(pSib, pDict);
+          pSib = pParent->pLeft;
+        }
+        
+        /* Rotate the sibling up, which fixes the deficiency */
+        pSib->red = pParent->red;
+        pParent->red = 0;
+        (pSib->pLeft)->red = 0;
+        rfdict_ror(pParent, pDict);
+        pNode = pDict->pRoot;
+        pParent = NULL;
+      }
+    }
+  }
+  
+  /* Node where we stopped (if any) is colored black */
+  if (pNode != NULL) {
+    pNode->red = 0;
+  }
+}
+
+/*
+ * Rebalance the tree after a new node has been linked into it.
+ * 
+ * pNode is the new node.  It must be red, unless it is the root node,
+ * in which case it must be black.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the new node
+ */
+static void rfdict_fixins(RFDICT *pDict, RFDICT_NODE *pNode) {
+  
+  RFDICT_NODE *pParent = NULL;
+  RFDICT_NODE *pGrand = NULL;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pNode == NULL)) {
+    abort();
+  }
+  
+  /* 
+   * If new node is red, it is not the root of the tree.  In this case,
+   * check whether the parent is red.  If the parent is red, then the
+   * tree needs to be rebalanced because red nodes are not allowed to
+   * have red parents.
+   * 
+   * If the parent is red, then the parent of the parent (the
+   * grandparent) must also exist, because root nodes are black, and so
+   * the parent couldn't be a root node.  The grandparent must
+   * furthermore be black, because red nodes can't have red parents.
+   * 
+   * The first case we're going to handle is the (black) grandparent
+   * with two red children.  In this case, change both of the
+   * grandparent's children to black and change the grandparent to red.
+   * Set the grandparent as the new current node and apply the
+   * rebalancing procedures again, unless the new current nde is the
+   * root node, in which case color it black and no further rebalancing.
+   */
+  if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
+    
+    /* Get the grandparent node, which much exist */
+    pGrand = (pNode->pParent)->pParent;
+    if (pGrand == NULL) {
+      abort();
+    }
+    
+    /* Rebalance while both of grandparent's children are red */
+    while(rfdict_isred(pGrand->pLeft) &&
+          rfdict_isred(pGrand->pRight)) {
+      
+      /* Set grandparent's children to black color */
+      (pGrand->pLeft)->red = 0;
+      (pGrand->pRight)->red = 0;
+      
+      /* If grandparent is the root node, set it to black; else, set
+       * it to red */
+      if (pGrand->pParent == NULL) {
+        pGrand->red = 0;
+      } else {
+        pGrand->red = 1;
+      }
+      
+      /* Set new node to grandparent node to continue process */
+      pNode = pGrand;
+      
+      /* If new node is red and its parent is red, update grandparent
+       * and continue rebalancing loop; else, done with this
+       * rebalancing step */
+      if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
+        pGrand = (pNode->pParent)->pParent;
+        if (pGrand == NULL) {
+          abort();
+        }
+      } else {
+        break;
+      }
+    }
+  }
+  
+  /* 
+   * We've now handled all rebalancing cases where the grandparent has
+   * two red children.
+   * 
+   * We now must handle the cases where the grandparent has one black
+   * child, or a child that is missing.  We'll handle these cases with
+   * rotations, and unlike the former rebalancing case, we don't need to
+   * process this in a loop going back up to the root.
+   * 
+   * We only need to rebalance if the parent of the current node is red.
+   * If the parent of the current node is black, then there is no
+   * violation of the red node rules to fix.
+   */
+  if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
+    
+    /* Get the grandparent node, which much exist */
+    pGrand = (pNode->pParent)->pParent;
+    if (pGrand == NULL) {
+      abort();
+    }
+    
+    /* Rebalance if one of the grandparent's children is black or
+     * missing */
+    if (rfdict_isblack(pGrand->pLeft) ||
+        rfdict_isblack(pGrand->pRight)) {
+      
+      /* Get parent node */
+      pParent = pNode->pParent;
+      
+      /* Handle rebalancing cases */
+      if ((pNode == pParent->pRight) && (pParent == pGrand->pLeft)) {
+        /* New node is right child of parent and parent is left child
+         * of grandparent */
+        pNode->red = 0;
+        pGrand->red = 1;
+        rfdict_rol(pParent, pDict);
+        rfdict_ror(pGrand, pDict);
+        
+      } else if ((pNode == pParent->pLeft) &&
+                  (pParent == pGrand->pRight)) {
+        /* New node is left child of parent and parent is right child
+         * of grandparent */
+        pNode->red = 0;
+        pGrand->red = 1;
+        rfdict_ror(pParent, pDict);
+        rfdict_rol(pGrand, pDict);
+        
+      } else if ((pNode == pParent->pLeft) &&
+                  (pParent == pGrand->pLeft)) {
+          /* New node is left child of parent and parent is left child
+           * of grandparent */
+          pParent->red = 0;
+          pGrand->red = 1;
+          rfdict_ror(pGrand, pDict);
+          
+      } else if ((pNode == pParent->pRight) &&
+                  (pParent == pGrand->pRight)) {
+          /* New node is right child of parent and parent is right
+           * child of grandparent */
+          pParent->red = 0;
+          pGrand->red = 1;
+          rfdict_rol(pGrand, pDict);
+          
+      } else {
+        abort();  /* shouldn't happen */
+      }
+      
+    }
+  }
+}
+
+/*
+ * Search the dictionary for a key, and determine where the key would
+ * be linked into the tree if it is not present.
+ * 
+ * This performs a single descent from the root of the tree.  If a node
+ * matching the key is found, it is returned.  Otherwise, NULL is
+ * returned, *ppParent is set to the node that the key would be linked
+ * beneath (or NULL if the dictionary is empty), and *pDir is set to
+ * less than zero if the key would be the left child of that node or
+ * greater than zero if it would be the right child.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key to search for
+ * 
+ *   ppParent - receives the attachment parent if the key is not found
+ * 
+ *   pDir - receives the attachment direction if the key is not found
+ * 
+ * Return:
+ * 
+ *   the dictionary node matching the key, or NULL if no node matches
+ *   the key
+ */
+static RFDICT_NODE *rfdict_seek(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  ** ppParent,
+    int          *  pDir) {
+  
+  RFDICT_NODE *pCurrent = NULL;
+  RFDICT_NODE *pParent = NULL;
+  size_t lcp_lo = 0;
+  size_t lcp_hi = 0;
+  size_t lcp = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) ||
+      (ppParent == NULL) || (pDir == NULL)) {
+    abort();
+  }
+  
+  /* Descend from the root until we find the key or run out of tree */
+  pCurrent = pDict->pRoot;
+  while (pCurrent != NULL) {
+    
+    /* Compare to current node, skipping the prefix shared with both
+     * bounds */
+    if (lcp_lo < lcp_hi) {
+      lcp = lcp_lo;
+    } else {
+      lcp = lcp_hi;
+    }
+    if (pDict->width > 0) {
+      retval = rfdict_fixcmp(pKey, pCurrent->pKey, pDict->width, &lcp);
+    } else {
+      retval = rfdict_lcpcmp(
+                pKey, pCurrent->pKey, pDict->sensitive,
+                RFDICT_MAXKEY + 1, &lcp);
+    }
+    
+    /* Done if equal, else go down appropriate branch */
+    if (retval == 0) {
+      break;
+      
+    } else if (retval < 0) {
+      lcp_hi = lcp;
+      pParent = pCurrent;
+      pCurrent = pCurrent->pLeft;
+      
+    } else if (retval > 0) {
+      lcp_lo = lcp;
+      pParent = pCurrent;
+      pCurrent = pCurrent->pRight;
+      
+    } else {
+      abort();  /* shouldn't happen */
+    }
+  }
+  
+  /* Report attachment point if not found */
+  if (pCurrent == NULL) {
+    *ppParent = pParent;
+    *pDir = retval;
+  }
+  
+  /* Return the matching node or NULL */
+  return pCurrent;
+}
+
+/*
+ * Create a new node for a key and link it into the tree.
+ * 
+ * The key must not already be present in the dictionary.  pParent and
+ * dir must be the attachment point reported by rfdict_seek() for this
+ * key, with no modifications to the dictionary in between.
+ * 
+ * The length of the key may not exceed RFDICT_MAXKEY or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key to insert
+ * 
+ *   val - the value to associate with the key
+ * 
+ *   pParent - the attachment parent, or NULL if dictionary is empty
+ * 
+ *   dir - the attachment direction
+ * 
+ * Return:
+ * 
+ *   the new node
+ */
+static RFDICT_NODE *rfdict_attach(
+    RFDICT      * pDict,
+    const char  * pKey,
+    long          val,
+    RFDICT_NODE * pParent,
+    int           dir) {
+  
+  size_t slen = 0;
+  RFDICT_NODE *pNode = NULL;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  if ((pParent == NULL) != (pDict->pRoot == NULL)) {
+    abort();
+  }
+  
+  /* Get size of key, not including terminating null */
+  if (pDict->width > 0) {
+    slen = pDict->width;
+  } else {
+    slen = strlen(pKey);
+  }
+  
+  /* Make sure key size isn't too large */
+  if (slen > RFDICT_MAXKEY) {
+    abort();
+  }
+  
+  /* Get a new node, recycling a removed node if possible; keys in a
+   * pool take no room in the node */
+  if (pDict->pPool != NULL) {
+    slen = 0;
+  }
+  pNode = rfdict_newnode(pDict, slen);
+  
+  /* Initialize node */
+  pNode->pParent = NULL;
+  pNode->pLeft = NULL;
+  pNode->pRight = NULL;
+  pNode->val = val;
+  pNode->red = 0;
+  rfdict_setkey(pDict, pNode, pKey, 0);
+  
+  /* Link the new node into the tree */
+  if (pParent == NULL) {
+    /* Search tree is currently empty, so set the color of the node to
+     * black and set it as the root node */
+    pDict->pRoot = pNode;
+    pNode->red = 0;
+    
+  } else if (dir < 0) {
+    /* Set the node in the left branch of parent, and set color to
+     * red */
+    if (pParent->pLeft != NULL) {
+      abort();
+    }
+    pParent->pLeft = pNode;
+    pNode->pParent = pParent;
+    pNode->red = 1;
+    
+  } else if (dir > 0) {
+    /* Set the node in the right branch of parent, and set color to
+     * red */
+    if (pParent->pRight != NULL) {
+      abort();
+    }
+    pParent->pRight = pNode;
+    pNode->pParent = pParent;
+    pNode->red = 1;
+    
+  } else {
+    abort();  /* equal keys can't be attached */
+  }
+  
+  /* Rebalance the tree */
+  rfdict_fixins(pDict, pNode);
+  
+  /* Update statistics */
+  (pDict->count)++;
+  pDict->nbytes += (size_t) (RFDICT_CLASS_MIN << rfdict_class(slen));
+  
+  /* Return the new node */
+  return pNode;
+}
+
+/*
+ * Find a node in the dictionary matching the given key, starting from
+ * a hint node.
+ * 
+ * This is a finger search.  Instead of descending from the root, the
+ * search climbs from the hint node through the parent pointers only
+ * until it reaches an ancestor whose subtree must contain the key, and
+ * then descends from there.  The cost is therefore logarithmic in the
+ * distance (in key order) between the hint and the key, rather than in
+ * the size of the dictionary.
+ * 
+ * pHint may be NULL, in which case the search starts from the root.
+ * Otherwise, it must be a node that is currently in the tree.
+ * 
+ * ppLast receives the last node that was visited by the search, which
+ * is the matching node if found, or otherwise the node that would be
+ * the parent of the key if it were inserted.  It receives NULL if the
+ * dictionary is empty.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key to search for
+ * 
+ *   pHint - the node to start from, or NULL
+ * 
+ *   ppLast - receives the last node visited
+ * 
+ * Return:
+ * 
+ *   the dictionary node matching the key, or NULL if no node matches
+ *   the key
+ */
+static RFDICT_NODE *rfdict_finger(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  *  pHint,
+    RFDICT_NODE  ** ppLast) {
+  
+  RFDICT_NODE *pCurrent = NULL;
+  RFDICT_NODE *pParent = NULL;
+  RFDICT_NODE *pLast = NULL;
+  int retval = 0;
+  int found = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (ppLast == NULL)) {
+    abort();
+  }
+  
+  /* Determine the subtree to descend from */
+  if (pHint == NULL) {
+    /* No hint, so start at the root */
+    pCurrent = pDict->pRoot;
+    
+  } else {
+    /* Compare to the hint */
+    retval = rfdict_dictcmp(
+              pDict, pKey, pHint->pKey);
+    pCurrent = pHint;
+    
+    if (retval == 0) {
+      /* Hint is the match */
+      found = 1;
+      
+    } else {
+      /* 
+       * Climb from the hint.  If the key is greater than the hint,
+       * ancestors reached from a right child have keys less than the
+       * hint and can be skipped.  An ancestor reached from a left child
+       * is the upper bound of the subtree we came from, which also
+       * contains the hint.  If the key is less than that bound, it must
+       * be in the subtree we came from.  The case where the key is less
+       * than the hint is symmetric.
+       */
+      while (pCurrent->pParent != NULL) {
+        pParent = pCurrent->pParent;
+        
+        /* Skip ancestors that are on the wrong side of the hint */
+        if (((retval > 0) && (pParent->pRight == pCurrent)) ||
+            ((retval < 0) && (pParent->pLeft == pCurrent))) {
+          pCurrent = pParent;
+          continue;
+        }
+        
+        /* Check the key against the bound */
+        if (retval > 0) {
+          retval = rfdict_dictcmp(
+                    pDict, pKey, pParent->pKey);
+          if (retval <= 0) {
+            if (retval == 0) {
+              pCurrent = pParent;
+              found = 1;
+            }
+            break;
+          }
+          
+        } else {
+          retval = rfdict_dictcmp(
+                    pDict, pKey, pParent->pKey);
+          if (retval >= 0) {
+            if (retval == 0) {
+              pCurrent = pParent;
+              found = 1;
+            }
+            break;
+          }
+        }
+        
+        /* Key is beyond the bound, so keep climbing */
+        pCurrent = pParent;
+      }
+    }
+  }
+  
+  /* Descend from the subtree root we determined */
+  if (!found) {
+    while (pCurrent != NULL) {
+      pLast = pCurrent;
+      
+      /* Compare to current node */
+      retval = rfdict_dictcmp(
+                pDict, pKey, pCurrent->pKey);
+      
+      /* Done if equal, else go down appropriate branch */
+      if (retval == 0) {
+        break;
+        
+      } else if (retval < 0) {
+        pCurrent = pCurrent->pLeft;
+        
+      } else if (retval > 0) {
+        pCurrent = pCurrent->pRight;
+        
+      } else {
+        abort();  /* shouldn't happen */
+      }
+    }
+    
+  } else {
+    pLast = pCurrent;
+  }
+  
+  /* Report last node and return the matching node or NULL */
+  *ppLast = pLast;
+  return pCurrent;
+}
+
+/*
+ * Get the node with the least key in a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ * Return:
+ * 
+ *   the first node in key order, or NULL if the dictionary is empty
+ */
+static RFDICT_NODE *rfdict_first(RFDICT *pDict) {
+  
+  RFDICT_NODE *pNode = NULL;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Leftmost node */
+  pNode = pDict->pRoot;
+  if (pNode != NULL) {
+    while (pNode->pLeft != NULL) {
+      pNode = pNode->pLeft;
+    }
+  }
+  
+  return pNode;
+}
+
+/*
+ * Get the in-order successor of a node.
+ * 
+ * Parameters:
+ * 
+ *   pNode - the node, which may not be NULL
+ * 
+ * Return:
+ * 
+ *   the node with the next greater key, or NULL if this is the last
+ *   node
+ */
+static RFDICT_NODE *rfdict_next(RFDICT_NODE *pNode) {
+  
+  /* Check parameters */
+  if (pNode == NULL) {
+    abort();
+  }
+  
+  if (pNode->pRight != NULL) {
+    /* Leftmost node of right subtree */
+    pNode = pNode->pRight;
+    while (pNode->pLeft != NULL) {
+      pNode = pNode->pLeft;
+    }
+    
+  } else {
+    /* Climb until we come up from a left child */
+    while ((pNode->pParent != NULL) &&
+            ((pNode->pParent)->pRight == pNode)) {
+      pNode = pNode->pParent;
+    }
+    pNode = pNode->pParent;
+  }
+  
+  return pNode;
+}
+
+/*
+ * Build a balanced subtree from a range of a sorted node array.
+ * 
+ * Copies of the nodes in the range lo up to hi (exclusive) are carved
+ * from the current block of pDict, which must have enough room.  The
+ * middle node becomes the root of the subtree, and the halves on
+ * either side become its subtrees, so that the depths of all exit
+ * nodes differ by at most one.  Nodes at red_depth are colored red and
+ * all others black, which satisfies the red-black rules if red_depth
+ * is the depth of the deepest node.
+ * 
+ * This function is recursive, but the recursive depth is only the
+ * logarithm of the number of nodes.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary to build into
+ * 
+ *   ppSorted - the array of source nodes, in ascending key order
+ * 
+ *   lo - the first index of the range
+ * 
+ *   hi - one beyond the last index of the range
+ * 
+ *   depth - the depth of the root of this subtree, zero for the root
+ * 
+ *   red_depth - the depth at which nodes are colored red
+ * 
+ * Return:
+ * 
+ *   the root of the subtree, or NULL if the range is empty
+ */
+static RFDICT_NODE *rfdict_build_sub(
+    RFDICT       *  pDict,
+    RFDICT_NODE  ** ppSorted,
+    long            lo,
+    long            hi,
+    int             depth,
+    int             red_depth) {
+  
+  RFDICT_NODE *pSrc = NULL;
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_BLOCK *pBlock = NULL;
+  size_t nsize = 0;
+  long mid = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (ppSorted == NULL) || (lo < 0) || (hi < lo)) {
+    abort();
+  }
+  
+  /* Only build if range not empty */
+  if (lo < hi) {
+    
+    /* Carve a copy of the middle node, keeping its pre-order position
+     * in the block so that each node is followed by its left subtree */
+    mid = lo + ((hi - lo) / 2);
+    pSrc = ppSorted[mid];
+    nsize = rfdict_nodesize(pDict, pSrc->pKey);
+    pBlock = pDict->pBlock;
+    if (pBlock->cap - pBlock->used < nsize) {
+      abort();
+    }
+    pNode = (RFDICT_NODE *)
+              (((char *) pBlock) + RFDICT_BLOCK_HEAD + pBlock->used);
+    pBlock->used += nsize;
+    memset(pNode, 0, nsize);
+    pNode->val = pSrc->val;
+    rfdict_setkey(pDict, pNode, pSrc->pKey,
+                  (pSrc->pKey != &((pSrc->key)[0])));
+    
+    pNode->pParent = NULL;
+    if (depth == red_depth) {
+      pNode->red = 1;
+    } else {
+      pNode->red = 0;
+    }
+    
+    /* Build the subtrees */
+    pNode->pLeft = rfdict_build_sub(
+                    pDict, ppSorted, lo, mid, depth + 1, red_depth);
+    pNode->pRight = rfdict_build_sub(
+                    pDict, ppSorted, mid + 1, hi, depth + 1, red_depth);
+    if (pNode->pLeft != NULL) {
+      (pNode->pLeft)->pParent = pNode;
+    }
+    if (pNode->pRight != NULL) {
+      (pNode->pRight)->pParent = pNode;
+    }
+    
+    /* Update statistics */
+    (pDict->count)++;
+    pDict->nbytes += nsize;
+  }
+  
+  return pNode;
+}
+
+/*
+ * Build a new dictionary from an array of nodes in ascending key
+ * order.
+ * 
+ * The keys and values of the nodes are copied into a single block of
+ * the new dictionary, and the tree is built balanced in linear time.
+ * The keys must be strictly ascending according to rfdict_keycmp()
+ * with the given sensitive flag, or rfdict_fixcmp() if width is not
+ * zero, and they must already be case-mapped if the dictionary is
+ * case-insensitive.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - the case sensitivity flag of the new dictionary
+ * 
+ *   width - the key width of the new dictionary
+ * 
+ *   pCodec - the codec of the new dictionary, or NULL
+ * 
+ *   pPool - the string pool of the new dictionary, or NULL
+ * 
+ *   ppSorted - the array of source nodes
+ * 
+ *   n - the number of source nodes
+ * 
+ * Return:
+ * 
+ *   the new dictionary
+ */
+static RFDICT *rfdict_build(
+    int             sensitive,
+    size_t          width,
+    RFDICT_CODEC *  pCodec,
+    RFDICT_POOL  *  pPool,
+    RFDICT_NODE  ** ppSorted,
+    long            n) {
+  
+  RFDICT *pDict = NULL;
+  size_t total = 0;
+  long i = 0;
+  long full = 0;
+  int red_depth = 0;
+  
+  /* Check parameters */
+  if (n < 0) {
+    abort();
+  }
+  if ((n > 0) && (ppSorted == NULL)) {
+    abort();
+  }
+  
+  /* Allocate new dictionary */
+  pDict = rfdict_alloc_pooled(sensitive, pPool);
+  pDict->width = width;
+  if (pCodec != NULL) {
+    (pCodec->refs)++;
+    pDict->pCodec = pCodec;
+  }
+  
+  /* Only build tree if there are nodes */
+  if (n > 0) {
+    
+    /* Allocate a single block for all nodes */
+    for(i = 0; i < n; i++) {
+      total += rfdict_nodesize(pDict, ppSorted[i]->pKey);
+    }
+    rfdict_newblock(pDict, total, total);
+    
+    /* Splitting at the middle puts the deepest nodes at depth
+     * floor(log2(n)); a single node is the root, which must stay black,
+     * so there is no red level then */
+    red_depth = 0;
+    for(full = 1; full * 2 <= n; full = full * 2) {
+      red_depth++;
+    }
+    if (n == 1) {
+      red_depth = -1;
+    }
+    
+    /* Build the tree */
+    pDict->pRoot = rfdict_build_sub(pDict, ppSorted, 0, n, 0, red_depth);
+  }
+  
+  /* Return the new dictionary */
+  return pDict;
+}
+
+/*
+ * Perform a set operation between two dictionaries.
+ * 
+ * This is the shared implementation of rfdict_intersect(),
+ * rfdict_difference() and rfdict_symdiff(), which are documented in
+ * the header.  mode is one of the RFDICT_SETOP constants.
+ * 
+ * Both dictionaries are walked simultaneously in key order, so the
+ * operation takes time proportional to the total number of keys.
+ * 
+ * Parameters:
+ * 
+ *   pA - the first dictionary
+ * 
+ *   pB - the second dictionary
+ * 
+ *   mode - the set operation
+ * 
+ *   fp - the callback, or NULL to build a new dictionary
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   the new dictionary, or NULL if a callback was given
+ */
+static RFDICT *rfdict_setop(
+    RFDICT         * pA,
+    RFDICT         * pB,
+    int              mode,
+    rfdict_fp_visit  fp,
+    void           * pCustom) {
+  
+  RFDICT *pResult = NULL;
+  RFDICT_NODE **ppOut = NULL;
+  RFDICT_NODE *pNodeA = NULL;
+  RFDICT_NODE *pNodeB = NULL;
+  RFDICT_NODE *pEmit = NULL;
+  long bound = 0;
+  long n = 0;
+  int retval = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  if ((mode != RFDICT_SETOP_INTERSECT) &&
+      (mode != RFDICT_SETOP_DIFFERENCE) &&
+      (mode != RFDICT_SETOP_SYMDIFF)) {
+    abort();
+  }
+  
+  /* Both dictionaries must order keys the same way */
+  if (((pA->sensitive != 0) != (pB->sensitive != 0)) ||
+      (pA->width != pB->width) || (pA->pCodec != pB->pCodec)) {
+    abort();
+  }
+  
+  /* If building a dictionary, allocate an array for the largest
+   * possible result */
+  if (fp == NULL) {
+    if (mode == RFDICT_SETOP_INTERSECT) {
+      bound = pA->count;
+      if (pB->count < bound) {
+        bound = pB->count;
+      }
+    } else if (mode == RFDICT_SETOP_DIFFERENCE) {
+      bound = pA->count;
+    } else {
+      bound = pA->count + pB->count;
+    }
+    if (bound > 0) {
+      ppOut = (RFDICT_NODE **) malloc(
+                  ((size_t) bound) * sizeof(RFDICT_NODE *));
+      if (ppOut == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Walk both dictionaries in key order; keys in the second dictionary
+   * only matter for the symmetric difference once the first dictionary
+   * is exhausted */
+  pNodeA = rfdict_first(pA);
+  pNodeB = rfdict_first(pB);
+  while (status && ((pNodeA != NULL) ||
+          ((pNodeB != NULL) && (mode == RFDICT_SETOP_SYMDIFF)))) {
+    
+    /* Compare the current keys, treating an exhausted dictionary as
+     * greater than everything */
+    if (pNodeA == NULL) {
+      retval = 1;
+    } else if (pNodeB == NULL) {
+      retval = -1;
+    } else {
+      retval = rfdict_dictcmp(pA, pNodeA->pKey, pNodeB->pKey);
+    }
+    
+    /* Determine which node (if any) is in the result, and advance */
+    pEmit = NULL;
+    if (retval < 0) {
+      /* Key only in first dictionary */
+      if (mode != RFDICT_SETOP_INTERSECT) {
+        pEmit = pNodeA;
+      }
+      pNodeA = rfdict_next(pNodeA);
+      
+    } else if (retval > 0) {
+      /* Key only in second dictionary */
+      if (mode == RFDICT_SETOP_SYMDIFF) {
+        pEmit = pNodeB;
+      }
+      pNodeB = rfdict_next(pNodeB);
+      
+    } else {
+      /* Key in both dictionaries */
+      if (mode == RFDICT_SETOP_INTERSECT) {
+        pEmit = pNodeA;
+      }
+      pNodeA = rfdict_next(pNodeA);
+      pNodeB = rfdict_next(pNodeB);
+    }
+    
+    /* Report or record the node */
+    if (pEmit != NULL) {
+      if (fp != NULL) {
+        if (!fp(pCustom, pEmit->pKey, pEmit->val)) {
+          status = 0;
+        }
+      } else {
+        if (n >= bound) {
+          abort();  /* shouldn't happen */
+        }
+        ppOut[n] = pEmit;
+        n++;
+      }
+    }
+  }
+  
+  /* Build the result dictionary if requested */
+  if (fp == NULL) {
+    pResult = rfdict_build(
+                pA->sensitive, pA->width, pA->pCodec, pA->pPool, ppOut, n);
+  }
+  
+  /* Release array */
+  free(ppOut);
+  ppOut = NULL;
+  
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * Store a 16-bit unsigned integer big endian.
+ * 
+ * Parameters:
+ * 
+ *   p - pointer to the two bytes to write
+ * 
+ *   v - the value, in range zero up to 65535
+ */
+static void rfdict_disk_put16(unsigned char *p, unsigned int v) {
+  if ((p == NULL) || (v > 0xffffU)) {
+    abort();
+  }
+  p[0] = (unsigned char) ((v >> 8) & 0xff);
+  p[1] = (unsigned char) (v & 0xff);
+}
+
+/*
+ * Load a 16-bit unsigned integer stored big endian.
+ * 
+ * Parameters:
+ * 
+ *   p - pointer to the two bytes to read
+ * 
+ * Return:
+ * 
+ *   the value
+ */
+static unsigned int rfdict_disk_get16(const unsigned char *p) {
+  if (p == NULL) {
+    abort();
+  }
+  return (((unsigned int) p[0]) << 8) | ((unsigned int) p[1]);
+}
+
+/*
+ * Store a signed integer as a 64-bit two's complement integer big
+ * endian.
+ * 
+ * This works whether or not a long has 64 bits.  Narrower values are
+ * sign-extended.
+ * 
+ * Parameters:
+ * 
+ *   p - pointer to the eight bytes to write
+ * 
+ *   v - the value
+ */
+static void rfdict_disk_put64(unsigned char *p, long v) {
+  
+  unsigned long u = 0;
+  unsigned char fill = 0;
+  int i = 0;
+  int bits = 0;
+  
+  if (p == NULL) {
+    abort();
+  }
+  
+  u = (unsigned long) v;
+  if (v < 0) {
+    fill = 0xff;
+  } else {
+    fill = 0;
+  }
+  
+  for(i = 7; i >= 0; i--) {
+    if (bits < ((int) (sizeof(unsigned long) * 8))) {
+      p[i] = (unsigned char) (u & 0xff);
+      u >>= 8;
+      bits += 8;
+    } else {
+      p[i] = fill;
+    }
+  }
+}
+
+/*
+ * Load a 64-bit two's complement integer stored big endian.
+ * 
+ * If a long has fewer than 64 bits, the stored value must be in range
+ * of a long, or the result is wrong.
+ * 
+ * Parameters:
+ * 
+ *   p - pointer to the eight bytes to read
+ * 
+ * Return:
+ * 
+ *   the value
+ */
+static long rfdict_disk_get64(const unsigned char *p) {
+  
+  unsigned long u = 0;
+  long result = 0;
+  int i = 0;
+  
+  if (p == NULL) {
+    abort();
+  }
+  
+  /* Accumulate the bits; upper bytes shift out if a long is narrow,
+   * which is fine since they are only sign extension then */
+  for(i = 0; i < 8; i++) {
+    u = (u << 8) | ((unsigned long) p[i]);
+  }
+  
+  /* Convert to signed without relying on implementation-defined
+   * conversions */
+  if (p[0] & 0x80) {
+    result = -((long) (~u)) - 1;
+  } else {
+    result = (long) u;
+  }
+  
+  return result;
+}
+
+/*
+ * Set the search key of a disk dictionary.
+ * 
+ * The key is copied into the qkey buffer, mapping lowercase letters to
+ * uppercase if the dictionary is case-insensitive.  The length of the
+ * key may not exceed RFDICT_DISK_MAXKEY or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pKey - the null-terminated key
+ */
+static void rfdict_disk_setkey(RFDICT_DISK *pDisk, const char *pKey) {
+  
+  size_t slen = 0;
+  size_t i = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  slen = strlen(pKey);
+  if (slen > RFDICT_DISK_MAXKEY) {
+    abort();
+  }
+  
+  /* Copy with case mapping */
+  for(i = 0; i < slen; i++) {
+    c = (int) ((unsigned char) pKey[i]);
+    if ((!(pDisk->sensitive)) &&
+          (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    (pDisk->qkey)[i] = (unsigned char) c;
+  }
+  (pDisk->qkey)[slen] = 0;
+  pDisk->qlen = (int) slen;
+}
+
+/*
+ * Compare a key to the key of a page entry.
+ * 
+ * Keys are compared as unsigned bytes, and a key that is a proper
+ * prefix of another key is less than it.
+ * 
+ * Parameters:
+ * 
+ *   pKey - the key bytes
+ * 
+ *   klen - the number of key bytes
+ * 
+ *   pEntry - pointer to the page entry
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as the key is
+ *   less than, equal to, or greater than the entry key
+ */
+static int rfdict_disk_cmp(
+    const unsigned char * pKey,
+    int                   klen,
+    const unsigned char * pEntry) {
+  
+  int elen = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pKey == NULL) || (klen < 0) || (pEntry == NULL)) {
+    abort();
+  }
+  
+  /* Compare the common length, then the lengths */
+  elen = (int) rfdict_disk_get16(pEntry);
+  if (klen < elen) {
+    result = memcmp(pKey, pEntry + 2, (size_t) klen);
+  } else {
+    result = memcmp(pKey, pEntry + 2, (size_t) elen);
+  }
+  if (result == 0) {
+    if (klen < elen) {
+      result = -1;
+    } else if (klen > elen) {
+      result = 1;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Read or write a page of a disk dictionary file.
+ * 
+ * If the transfer fails, the error flag of the dictionary is set.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pgno - the page number
+ * 
+ *   pBuf - the page data buffer
+ * 
+ *   write - non-zero to write the page, zero to read it
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the transfer failed
+ */
+static int rfdict_disk_rdwr(
+    RFDICT_DISK   * pDisk,
+    long            pgno,
+    unsigned char * pBuf,
+    int             write) {
+  
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pgno < 0) || (pBuf == NULL)) {
+    abort();
+  }
+  
+  /* Make sure the file offset is in range of a long */
+  if (pgno > LONG_MAX / RFDICT_DISK_PAGE) {
+    status = 0;
+  }
+  
+  /* Seek to the page */
+  if (status) {
+    if (fseek(pDisk->pFile, pgno * RFDICT_DISK_PAGE, SEEK_SET)) {
+      status = 0;
+    }
+  }
+  
+  /* Transfer the page */
+  if (status) {
+    if (write) {
+      if (fwrite(pBuf, 1, RFDICT_DISK_PAGE, pDisk->pFile) !=
+            RFDICT_DISK_PAGE) {
+        status = 0;
+      }
+    } else {
+      if (fread(pBuf, 1, RFDICT_DISK_PAGE, pDisk->pFile) !=
+            RFDICT_DISK_PAGE) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Set error flag on failure */
+  if (!status) {
+    pDisk->failed = 1;
+  }
+  
+  return status;
+}
+
+/*
+ * Unlink a frame from the LRU list of the buffer pool.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   f - the frame index
+ */
+static void rfdict_disk_lru_remove(RFDICT_DISK *pDisk, long f) {
+  
+  RFDICT_DISK_FRAME *pf = NULL;
+  
+  if ((pDisk == NULL) || (f < 0) || (f >= pDisk->nframes)) {
+    abort();
+  }
+  pf = &((pDisk->pFrames)[f]);
+  
+  if (pf->lru_prev >= 0) {
+    (pDisk->pFrames)[pf->lru_prev].lru_next = pf->lru_next;
+  } else {
+    pDisk->lru_head = pf->lru_next;
+  }
+  
+  if (pf->lru_next >= 0) {
+    (pDisk->pFrames)[pf->lru_next].lru_prev = pf->lru_prev;
+  } else {
+    pDisk->lru_tail = pf->lru_prev;
+  }
+  
+  pf->lru_prev = -1;
+  pf->lru_next = -1;
+}
+
+/*
+ * Link a frame at the most recently used end of the LRU list of the
+ * buffer pool.
+ * 
+ * The frame must not currently be in the list.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   f - the frame index
+ */
+static void rfdict_disk_lru_push(RFDICT_DISK *pDisk, long f) {
+  
+  RFDICT_DISK_FRAME *pf = NULL;
+  
+  if ((pDisk == NULL) || (f < 0) || (f >= pDisk->nframes)) {
+    abort();
+  }
+  pf = &((pDisk->pFrames)[f]);
+  
+  pf->lru_prev = -1;
+  pf->lru_next = pDisk->lru_head;
+  if (pDisk->lru_head >= 0) {
+    (pDisk->pFrames)[pDisk->lru_head].lru_prev = f;
+  } else {
+    pDisk->lru_tail = f;
+  }
+  pDisk->lru_head = f;
+}
+
+/*
+ * Get a page of a disk dictionary into the buffer pool and pin it.
+ * 
+ * If the page is already in the pool, its frame is used.  Otherwise,
+ * the least recently used frame that is not pinned is reused, writing
+ * its page back to the file first if it is dirty.
+ * 
+ * If fresh is non-zero, the page is a newly allocated page, so it is
+ * not read from the file but rather cleared to all zero, and the frame
+ * is marked dirty.
+ * 
+ * The frame must be released with rfdict_disk_unpin() when the caller
+ * is done with it.  If an I/O error occurs, the error flag is set and
+ * -1 is returned.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pgno - the page number, which must be greater than zero
+ * 
+ *   fresh - non-zero if this is a newly allocated page
+ * 
+ * Return:
+ * 
+ *   the frame index holding the page, or -1 if there was an error
+ */
+static long rfdict_disk_fetch(RFDICT_DISK *pDisk, long pgno, int fresh) {
+  
+  RFDICT_DISK_FRAME *pf = NULL;
+  long f = 0;
+  long h = 0;
+  long *pLink = NULL;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pgno < 1)) {
+    abort();
+  }
+  
+  /* Don't access the file if error flag set, and treat references to
+   * pages beyond the end of the file as corruption */
+  if (pDisk->failed) {
+    return -1;
+  }
+  if (pgno >= pDisk->npages) {
+    pDisk->failed = 1;
+    return -1;
+  }
+  
+  /* Look for the page in the pool */
+  h = pgno & (pDisk->hash_size - 1);
+  for(f = (pDisk->pHash)[h];
+      f >= 0;
+      f = (pDisk->pFrames)[f].hash_next) {
+    if ((pDisk->pFrames)[f].pgno == pgno) {
+      break;
+    }
+  }
+  
+  if (f < 0) {
+    /* Not in pool -- find the least recently used unpinned frame */
+    for(f = pDisk->lru_tail; f >= 0; f = (pDisk->pFrames)[f].lru_prev) {
+      if ((pDisk->pFrames)[f].pins < 1) {
+        break;
+      }
+    }
+    if (f < 0) {
+      abort();  /* shouldn't happen, pool is larger than pin count */
+    }
+    pf = &((pDisk->pFrames)[f]);
+    
+    /* Write the old page back if dirty */
+    if (pf->dirty) {
+      if (!rfdict_disk_rdwr(pDisk, pf->pgno, pf->pData, 1)) {
+        return -1;
+      }
+      pf->dirty = 0;
+    }
+    
+    /* Unlink the old page from its hash chain */
+    if (pf->pgno >= 0) {
+      pLink = &((pDisk->pHash)[pf->pgno & (pDisk->hash_size - 1)]);
+      while (*pLink != f) {
+        pLink = &((pDisk->pFrames)[*pLink].hash_next);
+      }
+      *pLink = pf->hash_next;
+      pf->hash_next = -1;
+      pf->pgno = -1;
+    }
+    
+    /* Load the new page */
+    if (fresh) {
+      memset(pf->pData, 0, RFDICT_DISK_PAGE);
+      pf->dirty = 1;
+    } else {
+      if (!rfdict_disk_rdwr(pDisk, pgno, pf->pData, 0)) {
+        return -1;
+      }
+    }
+    
+    /* Link the frame into the hash chain of the new page */
+    pf->pgno = pgno;
+    pf->hash_next = (pDisk->pHash)[h];
+    (pDisk->pHash)[h] = f;
+  }
+  
+  /* Pin the frame and make it most recently used */
+  pf = &((pDisk->pFrames)[f]);
+  (pf->pins)++;
+  rfdict_disk_lru_remove(pDisk, f);
+  rfdict_disk_lru_push(pDisk, f);
+  
+  return f;
+}
+
+/*
+ * Release a frame that was pinned with rfdict_disk_fetch().
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   f - the frame index
+ * 
+ *   dirty - non-zero if the page data was modified
+ */
+static void rfdict_disk_unpin(RFDICT_DISK *pDisk, long f, int dirty) {
+  
+  RFDICT_DISK_FRAME *pf = NULL;
+  
+  if ((pDisk == NULL) || (f < 0) || (f >= pDisk->nframes)) {
+    abort();
+  }
+  pf = &((pDisk->pFrames)[f]);
+  if (pf->pins < 1) {
+    abort();
+  }
+  
+  (pf->pins)--;
+  if (dirty) {
+    pf->dirty = 1;
+  }
+}
+
+/*
+ * Check that a B+tree page of a disk dictionary has a valid structure.
+ * 
+ * This makes sure that the page type is valid, and that all the slots
+ * and entries lie within the page, so that they can be accessed
+ * without checks.  If the page is invalid, the error flag is set.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pg - the page data
+ * 
+ * Return:
+ * 
+ *   non-zero if the page is valid, zero if not
+ */
+static int rfdict_disk_check(RFDICT_DISK *pDisk, const unsigned char *pg) {
+  
+  unsigned int count = 0;
+  unsigned int heap = 0;
+  unsigned int off = 0;
+  unsigned int i = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pg == NULL)) {
+    abort();
+  }
+  
+  /* Check type and layout */
+  if ((pg[RFDICT_DISK_PG_TYPE] != RFDICT_DISK_LEAF) &&
+      (pg[RFDICT_DISK_PG_TYPE] != RFDICT_DISK_INTERNAL)) {
+    status = 0;
+  }
+  if (status) {
+    count = rfdict_disk_get16(pg + RFDICT_DISK_PG_COUNT);
+    heap = rfdict_disk_get16(pg + RFDICT_DISK_PG_HEAP);
+    if ((heap > RFDICT_DISK_PAGE) ||
+        (RFDICT_DISK_PG_SLOTS + 2 * count > heap)) {
+      status = 0;
+    }
+  }
+  
+  /* Check each entry */
+  for(i = 0; status && (i < count); i++) {
+    off = rfdict_disk_get16(pg + RFDICT_DISK_PG_SLOTS + 2 * i);
+    if ((off < heap) || (off + 2 + 8 > RFDICT_DISK_PAGE)) {
+      status = 0;
+    } else if (off + 2 + rfdict_disk_get16(pg + off) + 8 >
+                RFDICT_DISK_PAGE) {
+      status = 0;
+    }
+  }
+  
+  if (!status) {
+    pDisk->failed = 1;
+  }
+  return status;
+}
+
+/*
+ * Get a pointer to an entry of a B+tree page.
+ * 
+ * Parameters:
+ * 
+ *   pg - the page data
+ * 
+ *   slot - the slot index of the entry
+ * 
+ * Return:
+ * 
+ *   pointer to the entry
+ */
+static unsigned char *rfdict_disk_entry(unsigned char *pg, int slot) {
+  if ((pg == NULL) || (slot < 0)) {
+    abort();
+  }
+  return pg + rfdict_disk_get16(pg + RFDICT_DISK_PG_SLOTS + 2 * slot);
+}
+
+/*
+ * Get a pointer to the payload of an entry.
+ * 
+ * Parameters:
+ * 
+ *   pEntry - the entry
+ * 
+ * Return:
+ * 
+ *   pointer to the eight-byte payload
+ */
+static unsigned char *rfdict_disk_payload(unsigned char *pEntry) {
+  if (pEntry == NULL) {
+    abort();
+  }
+  return pEntry + 2 + rfdict_disk_get16(pEntry);
+}
+
+/*
+ * Binary search a B+tree page for a key.
+ * 
+ * Parameters:
+ * 
+ *   pg - the page data
+ * 
+ *   pKey - the key bytes
+ * 
+ *   klen - the number of key bytes
+ * 
+ *   pFound - receives non-zero if an entry with the key was found, zero
+ *   otherwise
+ * 
+ * Return:
+ * 
+ *   the slot index of the first entry whose key is greater than or
+ *   equal to the given key, or the entry count if there is none
+ */
+static int rfdict_disk_search(
+    unsigned char       * pg,
+    const unsigned char * pKey,
+    int                   klen,
+    int                 * pFound) {
+  
+  int lo = 0;
+  int hi = 0;
+  int mid = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pg == NULL) || (pKey == NULL) || (pFound == NULL)) {
+    abort();
+  }
+  
+  /* Find the lower bound */
+  *pFound = 0;
+  lo = 0;
+  hi = (int) rfdict_disk_get16(pg + RFDICT_DISK_PG_COUNT);
+  while (lo < hi) {
+    mid = lo + ((hi - lo) / 2);
+    retval = rfdict_disk_cmp(pKey, klen, rfdict_disk_entry(pg, mid));
+    if (retval > 0) {
+      lo = mid + 1;
+    } else {
+      if (retval == 0) {
+        *pFound = 1;
+      }
+      hi = mid;
+    }
+  }
+  
+  return lo;
+}
+
+/*
+ * Determine which child of an internal page may contain the search key
+ * of a disk dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pg - the internal page data
+ * 
+ * Return:
+ * 
+ *   the page number of the child
+ */
+static long rfdict_disk_child(RFDICT_DISK *pDisk, unsigned char *pg) {
+  
+  int slot = 0;
+  int found = 0;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pg == NULL)) {
+    abort();
+  }
+  
+  /* An entry equal to the key leads to the child holding the key; else
+   * the entry before the lower bound does, or the leftmost child if
+   * there is none */
+  slot = rfdict_disk_search(pg, pDisk->qkey, pDisk->qlen, &found);
+  if (found) {
+    result = rfdict_disk_get64(
+              rfdict_disk_payload(rfdict_disk_entry(pg, slot)));
+  } else if (slot > 0) {
+    result = rfdict_disk_get64(
+              rfdict_disk_payload(rfdict_disk_entry(pg, slot - 1)));
+  } else {
+    result = rfdict_disk_get64(pg + RFDICT_DISK_PG_LINK);
+  }
+  
+  return result;
+}
+
+/*
+ * Initialize an empty B+tree page.
+ * 
+ * Parameters:
+ * 
+ *   pg - the page data
+ * 
+ *   type - RFDICT_DISK_LEAF or RFDICT_DISK_INTERNAL
+ * 
+ *   link - the link field of the page
+ */
+static void rfdict_disk_initpage(unsigned char *pg, int type, long link) {
+  if (pg == NULL) {
+    abort();
+  }
+  memset(pg, 0, RFDICT_DISK_PAGE);
+  pg[RFDICT_DISK_PG_TYPE] = (unsigned char) type;
+  rfdict_disk_put16(pg + RFDICT_DISK_PG_COUNT, 0);
+  rfdict_disk_put16(pg + RFDICT_DISK_PG_HEAP, RFDICT_DISK_PAGE);
+  rfdict_disk_put64(pg + RFDICT_DISK_PG_LINK, link);
+}
+
+/*
+ * Insert an entry into a B+tree page, if there is room.
+ * 
+ * Parameters:
+ * 
+ *   pg - the page data
+ * 
+ *   slot - the slot index the new entry will have
+ * 
+ *   pKey - the key bytes
+ * 
+ *   klen - the number of key bytes
+ * 
+ *   payload - the payload of the entry
+ * 
+ * Return:
+ * 
+ *   non-zero if the entry was inserted, zero if there is not enough
+ *   room in the page
+ */
+static int rfdict_disk_place(
+    unsigned char       * pg,
+    int                   slot,
+    const unsigned char * pKey,
+    int                   klen,
+    long                  payload) {
+  
+  unsigned int count = 0;
+  unsigned int heap = 0;
+  unsigned int esize = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pg == NULL) || (pKey == NULL) || (klen < 0) ||
+      (klen > RFDICT_DISK_MAXKEY)) {
+    abort();
+  }
+  count = rfdict_disk_get16(pg + RFDICT_DISK_PG_COUNT);
+  heap = rfdict_disk_get16(pg + RFDICT_DISK_PG_HEAP);
+  if ((slot < 0) || (((unsigned int) slot) > count)) {
+    abort();
+  }
+  
+  /* Make sure there is room for the entry and its slot */
+  esize = 2 + ((unsigned int) klen) + 8;
+  if (RFDICT_DISK_PG_SLOTS + 2 * (count + 1) + esize > heap) {
+    status = 0;
+  }
+  
+  if (status) {
+    /* Write the entry at the top of the heap */
+    heap -= esize;
+    rfdict_disk_put16(pg + heap, (unsigned int) klen);
+    memcpy(pg + heap + 2, pKey, (size_t) klen);
+    rfdict_disk_put64(pg + heap + 2 + klen, payload);
+    
+    /* Open up the slot and point it to the entry */
+    memmove(pg + RFDICT_DISK_PG_SLOTS + 2 * (slot + 1),
+            pg + RFDICT_DISK_PG_SLOTS + 2 * slot,
+            2 * (count - ((unsigned int) slot)));
+    rfdict_disk_put16(pg + RFDICT_DISK_PG_SLOTS + 2 * slot, heap);
+    
+    /* Update header */
+    rfdict_disk_put16(pg + RFDICT_DISK_PG_COUNT, count + 1);
+    rfdict_disk_put16(pg + RFDICT_DISK_PG_HEAP, heap);
+  }
+  
+  return status;
+}
+
+/*
+ * Split a full B+tree page while inserting a new entry into it.
+ * 
+ * The entries of the page and the new entry are divided between the
+ * page and a newly allocated right sibling page, about half of the
+ * bytes each.  For a leaf page, the separator is a copy of the first
+ * key of the new sibling, and the leaf link chain is updated.  For an
+ * internal page, the middle entry is removed and its key becomes the
+ * separator, while its child becomes the leftmost child of the new
+ * sibling.
+ * 
+ * The separator key is stored in the sep buffer of the dictionary.  The
+ * new key may itself point into the sep buffer.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pg - the page data of the full page, which must stay pinned
+ * 
+ *   slot - the slot index the new entry would have
+ * 
+ *   pKey - the new key bytes
+ * 
+ *   klen - the number of new key bytes
+ * 
+ *   payload - the payload of the new entry
+ * 
+ *   pRight - receives the page number of the new sibling
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there was an I/O error
+ */
+static int rfdict_disk_split(
+    RFDICT_DISK         * pDisk,
+    unsigned char       * pg,
+    int                   slot,
+    const unsigned char * pKey,
+    int                   klen,
+    long                  payload,
+    long                * pRight) {
+  
+  unsigned char *pEntry = NULL;
+  unsigned char *pRpg = NULL;
+  unsigned char *pTarget = NULL;
+  unsigned char *ps = NULL;
+  long right = 0;
+  long old_link = 0;
+  long rf = 0;
+  int type = 0;
+  int count = 0;
+  int total = 0;
+  int n = 0;
+  int i = 0;
+  int j = 0;
+  int m = 0;
+  int acc = 0;
+  int esize = 0;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pg == NULL) || (pKey == NULL) ||
+      (klen < 0) || (pRight == NULL)) {
+    abort();
+  }
+  type = pg[RFDICT_DISK_PG_TYPE];
+  count = (int) rfdict_disk_get16(pg + RFDICT_DISK_PG_COUNT);
+  old_link = rfdict_disk_get64(pg + RFDICT_DISK_PG_LINK);
+  if ((slot < 0) || (slot > count)) {
+    abort();
+  }
+  
+  /* Copy all entries in order, with the new entry, into scratch */
+  n = count + 1;
+  ps = &((pDisk->scratch)[0]);
+  total = 0;
+  for(i = 0; i < n; i++) {
+    (pDisk->scratch_off)[i] = total;
+    if (i == slot) {
+      rfdict_disk_put16(ps + total, (unsigned int) klen);
+      memcpy(ps + total + 2, pKey, (size_t) klen);
+      rfdict_disk_put64(ps + total + 2 + klen, payload);
+      total += 2 + klen + 8;
+    } else {
+      if (i < slot) {
+        j = i;
+      } else {
+        j = i - 1;
+      }
+      pEntry = rfdict_disk_entry(pg, j);
+      esize = 2 + ((int) rfdict_disk_get16(pEntry)) + 8;
+      memcpy(ps + total, pEntry, (size_t) esize);
+      total += esize;
+    }
+  }
+  (pDisk->scratch_off)[n] = total;
+  
+  /* Choose split index where the left side reaches half the bytes,
+   * leaving at least one entry on each side, and also one entry to
+   * move up for internal pages */
+  acc = 0;
+  for(m = 0; m < n; m++) {
+    acc += (pDisk->scratch_off)[m + 1] - (pDisk->scratch_off)[m];
+    if (acc * 2 >= total) {
+      break;
+    }
+  }
+  if (m < 1) {
+    m = 1;
+  }
+  if (type == RFDICT_DISK_LEAF) {
+    if (m > n - 1) {
+      m = n - 1;
+    }
+  } else {
+    if (m > n - 2) {
+      m = n - 2;
+    }
+  }
+  if (m < 1) {
+    abort();  /* shouldn't happen, pages hold many entries */
+  }
+  
+  /* Allocate the new sibling page */
+  right = pDisk->npages;
+  (pDisk->npages)++;
+  pDisk->hdr_dirty = 1;
+  rf = rfdict_disk_fetch(pDisk, right, 1);
+  if (rf < 0) {
+    return 0;
+  }
+  pRpg = (pDisk->pFrames)[rf].pData;
+  
+  /* Copy the separator key */
+  pEntry = ps + (pDisk->scratch_off)[m];
+  pDisk->seplen = (int) rfdict_disk_get16(pEntry);
+  memcpy(&((pDisk->sep)[0]), pEntry + 2, (size_t) pDisk->seplen);
+  
+  /* Rebuild both pages */
+  if (type == RFDICT_DISK_LEAF) {
+    rfdict_disk_initpage(pg, RFDICT_DISK_LEAF, right);
+    rfdict_disk_initpage(pRpg, RFDICT_DISK_LEAF, old_link);
+  } else {
+    rfdict_disk_initpage(pg, RFDICT_DISK_INTERNAL, old_link);
+    rfdict_disk_initpage(pRpg, RFDICT_DISK_INTERNAL,
+      rfdict_disk_get64(pEntry + 2 + pDisk->seplen));
+  }
+  
+  for(i = 0; i < n; i++) {
+    /* The middle entry of an internal page moves up, so it is not
+     * copied into either page */
+    if ((type == RFDICT_DISK_INTERNAL) && (i == m)) {
+      continue;
+    }
+    pEntry = ps + (pDisk->scratch_off)[i];
+    esize = (int) rfdict_disk_get16(pEntry);
+    if (i < m) {
+      pTarget = pg;
+    } else {
+      pTarget = pRpg;
+    }
+    if (!rfdict_disk_place(
+          pTarget,
+          (int) rfdict_disk_get16(pTarget + RFDICT_DISK_PG_COUNT),
+          pEntry + 2,
+          esize,
+          rfdict_disk_get64(pEntry + 2 + esize))) {
+      abort();  /* shouldn't happen, halves always fit */
+    }
+  }
+  
+  /* Release the new page */
+  rfdict_disk_unpin(pDisk, rf, 1);
+  *pRight = right;
+  
+  return 1;
+}
+
+/*
+ * Write the header page of a disk dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there was an I/O error
+ */
+static int rfdict_disk_writehdr(RFDICT_DISK *pDisk) {
+  
+  unsigned char *pg = NULL;
+  int status = 1;
+  
+  /* Check parameters */
+  if (pDisk == NULL) {
+    abort();
+  }
+  
+  /* Use the split scratch buffer, which is not in use now */
+  pg = &((pDisk->scratch)[0]);
+  memset(pg, 0, RFDICT_DISK_PAGE);
+  
+  /* Fill in the header */
+  memcpy(pg + RFDICT_DISK_HDR_SIG, RFDICT_DISK_SIG, 8);
+  rfdict_disk_put16(pg + RFDICT_DISK_HDR_VERSION + 2,
+    RFDICT_DISK_VERSION);
+  rfdict_disk_put16(pg + RFDICT_DISK_HDR_PAGE, RFDICT_DISK_PAGE >> 16);
+  rfdict_disk_put16(pg + RFDICT_DISK_HDR_PAGE + 2,
+    RFDICT_DISK_PAGE & 0xffff);
+  if (pDisk->sensitive) {
+    pg[RFDICT_DISK_HDR_SENS] = 1;
+  } else {
+    pg[RFDICT_DISK_HDR_SENS] = 0;
+  }
+  rfdict_disk_put64(pg + RFDICT_DISK_HDR_ROOT, pDisk->root);
+  rfdict_disk_put64(pg + RFDICT_DISK_HDR_NPAGES, pDisk->npages);
+  rfdict_disk_put64(pg + RFDICT_DISK_HDR_NKEYS, pDisk->nkeys);
+  
+  /* Write it */
+  status = rfdict_disk_rdwr(pDisk, 0, pg, 1);
+  if (status) {
+    pDisk->hdr_dirty = 0;
+  }
+  
+  return status;
+}
+
+/*
+ * Allocate a disk dictionary structure for an open file.
+ * 
+ * The structure is initialized with an empty buffer pool and an empty
+ * tree.
+ * 
+ * Parameters:
+ * 
+ *   pFile - the open file
+ * 
+ *   pool_pages - the number of pages in the buffer pool
+ * 
+ * Return:
+ * 
+ *   the new structure
+ */
+static RFDICT_DISK *rfdict_disk_new(FILE *pFile, long pool_pages) {
+  
+  RFDICT_DISK *pDisk = NULL;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pFile == NULL) {
+    abort();
+  }
+  if ((pool_pages < RFDICT_DISK_MINPOOL) ||
+      (pool_pages > LONG_MAX / 2) ||
+      (((size_t) pool_pages) > ((size_t) -1) / RFDICT_DISK_PAGE)) {
+    abort();
+  }
+  
+  /* Allocate structure and clear it */
+  pDisk = (RFDICT_DISK *) malloc(sizeof(RFDICT_DISK));
+  if (pDisk == NULL) {
+    abort();
+  }
+  memset(pDisk, 0, sizeof(RFDICT_DISK));
+  
+  pDisk->pFile = pFile;
+  pDisk->sensitive = 0;
+  pDisk->failed = 0;
+  pDisk->hdr_dirty = 0;
+  pDisk->root = 0;
+  pDisk->npages = 1;
+  pDisk->nkeys = 0;
+  
+  /* Allocate the buffer pool, with all frames empty and linked in the
+   * LRU list */
+  pDisk->nframes = pool_pages;
+  pDisk->pFrames = (RFDICT_DISK_FRAME *) malloc(
+                    ((size_t) pool_pages) * sizeof(RFDICT_DISK_FRAME));
+  pDisk->pPool = (unsigned char *) malloc(
+                    ((size_t) pool_pages) * RFDICT_DISK_PAGE);
+  if ((pDisk->pFrames == NULL) || (pDisk->pPool == NULL)) {
+    abort();
+  }
+  
+  pDisk->lru_head = -1;
+  pDisk->lru_tail = -1;
+  for(i = 0; i < pool_pages; i++) {
+    (pDisk->pFrames)[i].pgno = -1;
+    (pDisk->pFrames)[i].dirty = 0;
+    (pDisk->pFrames)[i].pins = 0;
+    (pDisk->pFrames)[i].hash_next = -1;
+    (pDisk->pFrames)[i].pData =
+      pDisk->pPool + (((size_t) i) * RFDICT_DISK_PAGE);
+    rfdict_disk_lru_push(pDisk, i);
+  }
+  
+  /* Allocate the hash table, with at least as many chains as frames */
+  for(pDisk->hash_size = 1;
+      pDisk->hash_size < pool_pages;
+      pDisk->hash_size *= 2);
+  pDisk->pHash = (long *) malloc(
+                  ((size_t) pDisk->hash_size) * sizeof(long));
+  if (pDisk->pHash == NULL) {
+    abort();
+  }
+  for(i = 0; i < pDisk->hash_size; i++) {
+    (pDisk->pHash)[i] = -1;
+  }
+  
+  return pDisk;
+}
+
+/*
+ * Release a disk dictionary structure without writing anything.
+ * 
+ * The file is closed.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the structure to release
+ * 
+ * Return:
+ * 
+ *   non-zero if the file was closed successfully, zero otherwise
+ */
+static int rfdict_disk_release(RFDICT_DISK *pDisk) {
+  
+  int status = 1;
+  
+  if (pDisk == NULL) {
+    abort();
+  }
+  
+  if (fclose(pDisk->pFile)) {
+    status = 0;
+  }
+  free(pDisk->pFrames);
+  free(pDisk->pPool);
+  free(pDisk->pHash);
+  free(pDisk);
+  
+  return status;
+}
+
+/*
+ * Compute the two filter hashes of a key.
+ * 
+ * Lowercase letters are mapped to uppercase before hashing if
+ * sensitive is zero, so that keys that compare equal have equal
+ * hashes.
+ * 
+ * Parameters:
+ * 
+ *   pKey - the null-terminated key
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ *   ph1 - receives the first hash
+ * 
+ *   ph2 - receives the second hash, which is always odd
+ */
+static void rfdict_hash(
+    const char    * pKey,
+    int             sensitive,
+    unsigned long * ph1,
+    unsigned long * ph2) {
+  
+  unsigned long h1 = 0;
+  unsigned long h2 = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pKey == NULL) || (ph1 == NULL) || (ph2 == NULL)) {
+    abort();
+  }
+  
+  /* Two 32-bit FNV-1a hashes with different offset bases */
+  h1 = 2166136261UL;
+  h2 = 3332232259UL;
+  for( ; *pKey != 0; pKey++) {
+    c = (int) ((unsigned char) *pKey);
+    if ((!sensitive) && (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    h1 = ((h1 ^ ((unsigned long) c)) * 16777619UL) & 0xffffffffUL;
+    h2 = ((h2 ^ ((unsigned long) c)) * 16777619UL) & 0xffffffffUL;
+  }
+  
+  /* Mix the second hash further so the two are independent enough for
+   * double hashing */
+  h2 ^= h2 >> 15;
+  h2 = (h2 * 2246822519UL) & 0xffffffffUL;
+  h2 ^= h2 >> 13;
+  
+  *ph1 = h1;
+  *ph2 = h2 | 1;
+}
+
+/*
+ * Allocate a frozen image with room for a given number of keys.
+ * 
+ * The image is returned with its key arrays allocated but not filled
+ * in, and no values, which must be added with rfdict_pack_init().  If
+ * nbits is not zero, an all-clear filter with that many bits is
+ * allocated, rounded up to a whole number of bytes.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ *   width - the key width, or zero for string keys, which have no
+ *   offset array
+ * 
+ *   count - the number of keys
+ * 
+ *   keybytes - the total bytes of key data including nulls
+ * 
+ *   nbits - the number of filter bits, or zero for no filter
+ * 
+ * Return:
+ * 
+ *   the new image
+ */
+static RFDICT_FROZEN *rfdict_frozen_new(
+    int           sensitive,
+    size_t        width,
+    long          count,
+    size_t        keybytes,
+    unsigned long nbits) {
+  
+  RFDICT_FROZEN *pFrozen = NULL;
+  
+  /* Check parameters */
+  if (count < 0) {
+    abort();
+  }
+  
+  /* Allocate and clear structure */
+  pFrozen = (RFDICT_FROZEN *) malloc(sizeof(RFDICT_FROZEN));
+  if (pFrozen == NULL) {
+    abort();
+  }
+  memset(pFrozen, 0, sizeof(RFDICT_FROZEN));
+  
+  pFrozen->sensitive = sensitive;
+  pFrozen->count = count;
+  pFrozen->keybytes = keybytes;
+  pFrozen->width = width;
+  pFrozen->pKeys = NULL;
+  pFrozen->pOffset = NULL;
+  memset(&(pFrozen->val), 0, sizeof(RFDICT_PACK));
+  (pFrozen->val).pWord = NULL;
+  pFrozen->nbits = 0;
+  pFrozen->pFilter = NULL;
+  pFrozen->pCodec = NULL;
+  
+  /* Allocate arrays */
+  if (count > 0) {
+    pFrozen->pKeys = (char *) malloc(keybytes);
+    if (pFrozen->pKeys == NULL) {
+      abort();
+    }
+    if (width == 0) {
+      pFrozen->pOffset = (size_t *) malloc(
+                          ((size_t) count) * sizeof(size_t));
+      if (pFrozen->pOffset == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Allocate filter */
+  if (nbits > 0) {
+    nbits = (nbits + 7) & ~((unsigned long) 7);
+    pFrozen->nbits = nbits;
+    pFrozen->pFilter = (unsigned char *) malloc((size_t) (nbits / 8));
+    if (pFrozen->pFilter == NULL) {
+      abort();
+    }
+    memset(pFrozen->pFilter, 0, (size_t) (nbits / 8));
+  }
+  
+  return pFrozen;
+}
+
+/*
+ * Add a key to the filter of a frozen image.
+ * 
+ * The call is ignored if the image has no filter.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ *   pKey - the key
+ */
+static void rfdict_filter_add(RFDICT_FROZEN *pFrozen, const char *pKey) {
+  
+  unsigned long h1 = 0;
+  unsigned long h2 = 0;
+  unsigned long b = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Set the bits */
+  if (pFrozen->nbits > 0) {
+    rfdict_hash(pKey, pFrozen->sensitive, &h1, &h2);
+    for(i = 0; i < RFDICT_FILTER_HASHES; i++) {
+      b = (h1 + ((unsigned long) i) * h2) % pFrozen->nbits;
+      (pFrozen->pFilter)[b / 8] |= (unsigned char) (1 << (b % 8));
+    }
+  }
+}
+
+/*
+ * Check whether a key might be in a frozen image according to its
+ * filter.
+ * 
+ * If the image has no filter, this always returns non-zero.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ *   pKey - the key
+ * 
+ * Return:
+ * 
+ *   zero if the key is definitely not in the image, non-zero if it
+ *   might be
+ */
+static int rfdict_filter_test(RFDICT_FROZEN *pFrozen, const char *pKey) {
+  
+  unsigned long h1 = 0;
+  unsigned long h2 = 0;
+  unsigned long b = 0;
+  int i = 0;
+  int result = 1;
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Check the bits */
+  if (pFrozen->nbits > 0) {
+    rfdict_hash(pKey, pFrozen->sensitive, &h1, &h2);
+    for(i = 0; i < RFDICT_FILTER_HASHES; i++) {
+      b = (h1 + ((unsigned long) i) * h2) % pFrozen->nbits;
+      if (!((pFrozen->pFilter)[b / 8] & (1 << (b % 8)))) {
+        result = 0;
+        break;
+      }
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Find a key in a frozen image.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ *   pKey - the key
+ * 
+ * Return:
+ * 
+ *   the index of the key, or -1 if it is not present
+ */
+static long rfdict_frozen_find(RFDICT_FROZEN *pFrozen, const char *pKey) {
+  
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  long result = -1;
+  size_t lcp = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Binary search */
+  lo = 0;
+  hi = pFrozen->count;
+  while (lo < hi) {
+    mid = lo + ((hi - lo) / 2);
+    if (pFrozen->width > 0) {
+      lcp = 0;
+      retval = rfdict_fixcmp(
+                pKey,
+                pFrozen->pKeys + ((size_t) mid) * pFrozen->width,
+                pFrozen->width, &lcp);
+    } else {
+      retval = rfdict_keycmp(
+                pKey,
+                pFrozen->pKeys + (pFrozen->pOffset)[mid],
+                pFrozen->sensitive);
+    }
+    if (retval == 0) {
+      result = mid;
+      break;
+    } else if (retval < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Convert an unsigned long to a long, wrapping values above LONG_MAX
+ * around to negative values as in two's complement.
+ * 
+ * This does not rely on implementation-defined conversions.
+ * 
+ * Parameters:
+ * 
+ *   u - the unsigned value
+ * 
+ * Return:
+ * 
+ *   the signed value
+ */
+static long rfdict_tolong(unsigned long u) {
+  
+  long result = 0;
+  
+  if (u > (unsigned long) LONG_MAX) {
+    result = -((long) (~u)) - 1;
+  } else {
+    result = (long) u;
+  }
+  
+  return result;
+}
+
+/*
+ * Pack an array of values.
+ * 
+ * The encoding is chosen as described for the RFDICT_PACK structure,
+ * using the minimum field width.  The packed array must be released
+ * by freeing pWord.
+ * 
+ * Parameters:
+ * 
+ *   pPack - the packed array to initialize
+ * 
+ *   pVal - the values, or NULL if count is zero
+ * 
+ *   count - the number of values
+ */
+static void rfdict_pack_init(
+    RFDICT_PACK * pPack,
+    const long  * pVal,
+    long          count) {
+  
+  unsigned long u = 0;
+  unsigned long span = 0;
+  unsigned long pos = 0;
+  size_t words = 0;
+  size_t w = 0;
+  long vmin = 0;
+  long vmax = 0;
+  int monotone = 1;
+  int s = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pPack == NULL) || (count < 0)) {
+    abort();
+  }
+  if ((pVal == NULL) && (count > 0)) {
+    abort();
+  }
+  pPack->count = count;
+  
+  /* Choose base and step */
+  pPack->base = 0;
+  pPack->step = 0;
+  if (pPack->count > 0) {
+    for(i = 1; i < pPack->count; i++) {
+      if (pVal[i] < pVal[i - 1]) {
+        monotone = 0;
+        break;
+      }
+    }
+    
+    if (monotone) {
+      pPack->base = (unsigned long) pVal[0];
+      if (pPack->count > 1) {
+        pPack->step = ((unsigned long) pVal[1]) -
+                          ((unsigned long) pVal[0]);
+        for(i = 2; i < pPack->count; i++) {
+          u = ((unsigned long) pVal[i]) - ((unsigned long) pVal[i - 1]);
+          if (u < pPack->step) {
+            pPack->step = u;
+          }
+        }
+      }
+      
+      /* Residuals grow with the index, so the last is the largest */
+      span = ((unsigned long) pVal[pPack->count - 1]) - pPack->base
+              - ((unsigned long) (pPack->count - 1)) * pPack->step;
+      
+    } else {
+      vmin = pVal[0];
+      vmax = pVal[0];
+      for(i = 1; i < pPack->count; i++) {
+        if (pVal[i] < vmin) {
+          vmin = pVal[i];
+        }
+        if (pVal[i] > vmax) {
+          vmax = pVal[i];
+        }
+      }
+      pPack->base = (unsigned long) vmin;
+      span = ((unsigned long) vmax) - ((unsigned long) vmin);
+    }
+  }
+  
+  /* Determine field width */
+  pPack->bits = 0;
+  pPack->mask = 0;
+  for(u = span; u != 0; u >>= 1) {
+    (pPack->bits)++;
+    pPack->mask = (pPack->mask << 1) | 1;
+  }
+  
+  /* Allocate the fields, making sure the word after the last field
+   * exists */
+  words = (size_t) ((((unsigned long) pPack->count) *
+                      ((unsigned long) pPack->bits)) /
+                        RFDICT_WORD_BITS) + 2;
+  pPack->pWord = (unsigned long *) malloc(words * sizeof(unsigned long));
+  if (pPack->pWord == NULL) {
+    abort();
+  }
+  memset(pPack->pWord, 0, words * sizeof(unsigned long));
+  
+  /* Store the residuals */
+  if (pPack->bits > 0) {
+    for(i = 0; i < pPack->count; i++) {
+      u = ((unsigned long) pVal[i]) - pPack->base
+            - ((unsigned long) i) * pPack->step;
+      pos = ((unsigned long) i) * ((unsigned long) pPack->bits);
+      w = (size_t) (pos / RFDICT_WORD_BITS);
+      s = (int) (pos % RFDICT_WORD_BITS);
+      
+      (pPack->pWord)[w] |= u << s;
+      if (s + pPack->bits > RFDICT_WORD_BITS) {
+        (pPack->pWord)[w + 1] |= u >> (RFDICT_WORD_BITS - s);
+      }
+    }
+  }
+}
+
+/*
+ * Get the value at a given index of a packed array.
+ * 
+ * The field is extracted without branches by always combining the
+ * word it starts in with the following word, which is why the packed
+ * array has a spare word at the end.
+ * 
+ * Parameters:
+ * 
+ *   pPack - the packed array
+ * 
+ *   i - the index of the value
+ * 
+ * Return:
+ * 
+ *   the value
+ */
+static long rfdict_pack_get(RFDICT_PACK *pPack, long i) {
+  
+  unsigned long pos = 0;
+  unsigned long lo = 0;
+  unsigned long hi = 0;
+  size_t w = 0;
+  int s = 0;
+  
+  /* Check parameters */
+  if ((pPack == NULL) || (i < 0) || (i >= pPack->count)) {
+    abort();
+  }
+  
+  /* Extract the field; the double shift of the high word avoids a
+   * shift by the full word width when the field is word-aligned */
+  pos = ((unsigned long) i) * ((unsigned long) pPack->bits);
+  w = (size_t) (pos / RFDICT_WORD_BITS);
+  s = (int) (pos % RFDICT_WORD_BITS);
+  lo = (pPack->pWord)[w] >> s;
+  hi = ((pPack->pWord)[w + 1] << 1) << (RFDICT_WORD_BITS - 1 - s);
+  
+  return rfdict_tolong(pPack->base +
+                        ((unsigned long) i) * pPack->step +
+                        ((lo | hi) & pPack->mask));
+}
+
+/*
+ * Build a frozen image from the contents of a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   filter - non-zero to give the image a filter
+ * 
+ * Return:
+ * 
+ *   the new frozen image
+ */
+static RFDICT_FROZEN *rfdict_frozen_build(RFDICT *pDict, int filter) {
+  
+  RFDICT_FROZEN *pFrozen = NULL;
+  RFDICT_NODE *pNode = NULL;
+  long *pVal = NULL;
+  size_t keybytes = 0;
+  size_t slen = 0;
+  unsigned long nbits = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* The filter hashes strings, so fixed-width keys can't have one */
+  if (filter && (pDict->width > 0)) {
+    abort();
+  }
+  
+  /* Count key bytes */
+  if (pDict->width > 0) {
+    keybytes = ((size_t) pDict->count) * pDict->width;
+  } else {
+    for(pNode = rfdict_first(pDict);
+        pNode != NULL;
+        pNode = rfdict_next(pNode)) {
+      keybytes += strlen(pNode->pKey) + 1;
+    }
+  }
+  
+  /* Allocate the image */
+  if (filter && (pDict->count > 0)) {
+    nbits = ((unsigned long) pDict->count) * RFDICT_FILTER_BITS;
+  }
+  pFrozen = rfdict_frozen_new(
+              pDict->sensitive, pDict->width,
+              pDict->count, keybytes, nbits);
+  if (pDict->pCodec != NULL) {
+    ((pDict->pCodec)->refs)++;
+    pFrozen->pCodec = pDict->pCodec;
+  }
+  if (pDict->count > 0) {
+    pVal = (long *) malloc(((size_t) pDict->count) * sizeof(long));
+    if (pVal == NULL) {
+      abort();
+    }
+  }
+  
+  /* Copy the keys and values in order */
+  keybytes = 0;
+  i = 0;
+  for(pNode = rfdict_first(pDict);
+      pNode != NULL;
+      pNode = rfdict_next(pNode)) {
+    if (pDict->width > 0) {
+      memcpy(pFrozen->pKeys + keybytes, pNode->pKey, pDict->width);
+      keybytes += pDict->width;
+    } else {
+      slen = strlen(pNode->pKey) + 1;
+      memcpy(pFrozen->pKeys + keybytes, pNode->pKey, slen);
+      (pFrozen->pOffset)[i] = keybytes;
+      rfdict_filter_add(pFrozen, pNode->pKey);
+      keybytes += slen;
+    }
+    pVal[i] = pNode->val;
+    i++;
+  }
+  
+  /* Pack the values */
+  rfdict_pack_init(&(pFrozen->val), pVal, pFrozen->count);
+  free(pVal);
+  
+  return pFrozen;
+}
+
+/*
+ * Start a merge in an LSM dictionary if none is in progress and two
+ * adjacent runs are close enough in size.
+ * 
+ * Two runs are merged when the newer one is more than half as large as
+ * the older one.  Merging these pairs keeps each run more than twice
+ * as large as the next newer run, like the digits of a binary counter,
+ * so each key is merged a logarithmic number of times.
+ * 
+ * If force is non-zero, the two newest runs are merged regardless of
+ * their sizes, provided there are at least two runs.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ *   force - non-zero to merge the two newest runs
+ */
+static void rfdict_lsm_schedule(RFDICT_LSM *pLsm, int force) {
+  
+  RFDICT_FROZEN *pA = NULL;
+  RFDICT_FROZEN *pB = NULL;
+  unsigned long nbits = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pLsm == NULL) {
+    abort();
+  }
+  
+  /* Only if no merge in progress */
+  if (pLsm->merge_at < 0) {
+    
+    /* Find the newest pair that qualifies */
+    for(i = 0; i + 1 < pLsm->nruns; i++) {
+      if (force ||
+          ((pLsm->apRun)[i]->count * 2 > (pLsm->apRun)[i + 1]->count)) {
+        break;
+      }
+    }
+    
+    /* Set up the merge */
+    if (i + 1 < pLsm->nruns) {
+      pA = (pLsm->apRun)[i];
+      pB = (pLsm->apRun)[i + 1];
+      nbits = ((unsigned long) (pA->count + pB->count)) *
+                RFDICT_FILTER_BITS;
+      pLsm->pOut = rfdict_frozen_new(
+                    pLsm->sensitive,
+                    0,
+                    pA->count + pB->count,
+                    pA->keybytes + pB->keybytes,
+                    nbits);
+      pLsm->pMergeVal = (long *) malloc(
+                          ((size_t) (pA->count + pB->count)) *
+                            sizeof(long));
+      if (pLsm->pMergeVal == NULL) {
+        abort();
+      }
+      pLsm->merge_at = i;
+      pLsm->ia = 0;
+      pLsm->ib = 0;
+      pLsm->io = 0;
+      pLsm->ko = 0;
+      
+      /* Run the merge on its own thread if threads are enabled; if the
+       * thread can not be started, inserts pace the merge instead */
+#ifdef RFDICT_THREADS
+      if (pthread_create(
+            &(pLsm->worker), NULL, &rfdict_lsm_thread, pLsm) == 0) {
+        pLsm->running = 1;
+      }
+#endif
+    }
+  }
+}
+
+/*
+ * Move keys of the merge in progress in an LSM dictionary into the
+ * output image.
+ * 
+ * Up to n keys are moved.  Once the output is full, its values are
+ * packed.  The output does not replace the inputs here, so this may
+ * run on a thread of its own while the inputs serve lookups.
+ * 
+ * A merge must be in progress.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ *   n - the maximum number of keys to move
+ */
+static void rfdict_lsm_move(RFDICT_LSM *pLsm, long n) {
+  
+  RFDICT_FROZEN *pA = NULL;
+  RFDICT_FROZEN *pB = NULL;
+  RFDICT_FROZEN *pOut = NULL;
+  RFDICT_FROZEN *pSrc = NULL;
+  long si = 0;
+  size_t slen = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pLsm == NULL) || (n < 0)) {
+    abort();
+  }
+  if (pLsm->merge_at < 0) {
+    abort();
+  }
+  
+  pA = (pLsm->apRun)[pLsm->merge_at];
+  pB = (pLsm->apRun)[pLsm->merge_at + 1];
+  pOut = pLsm->pOut;
+  
+  /* Move keys in order */
+  for( ; (n > 0) && (pLsm->io < pOut->count); n--) {
+    
+    /* Pick the lesser key of the two inputs */
+    if (pLsm->ia >= pA->count) {
+      retval = 1;
+    } else if (pLsm->ib >= pB->count) {
+      retval = -1;
+    } else {
+      retval = rfdict_keycmp(
+                pA->pKeys + (pA->pOffset)[pLsm->ia],
+                pB->pKeys + (pB->pOffset)[pLsm->ib],
+                pLsm->sensitive);
+    }
+    if (retval < 0) {
+      pSrc = pA;
+      si = pLsm->ia;
+      (pLsm->ia)++;
+    } else if (retval > 0) {
+      pSrc = pB;
+      si = pLsm->ib;
+      (pLsm->ib)++;
+    } else {
+      abort();  /* shouldn't happen, runs are disjoint */
+    }
+    
+    /* Copy it to the output */
+    slen = strlen(pSrc->pKeys + (pSrc->pOffset)[si]) + 1;
+    memcpy(pOut->pKeys + pLsm->ko,
+            pSrc->pKeys + (pSrc->pOffset)[si], slen);
+    (pOut->pOffset)[pLsm->io] = pLsm->ko;
+    (pLsm->pMergeVal)[pLsm->io] = rfdict_pack_get(&(pSrc->val), si);
+    rfdict_filter_add(pOut, pOut->pKeys + pLsm->ko);
+    pLsm->ko += slen;
+    (pLsm->io)++;
+  }
+  
+  /* Pack the values once the output is full */
+  if ((pLsm->io >= pOut->count) && (pLsm->pMergeVal != NULL)) {
+    rfdict_pack_init(&(pOut->val), pLsm->pMergeVal, pOut->count);
+    free(pLsm->pMergeVal);
+    pLsm->pMergeVal = NULL;
+  }
+}
+
+#ifdef RFDICT_THREADS
+/*
+ * Thread entrypoint for performing a whole LSM merge.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the RFDICT_LSM whose merge to perform
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *rfdict_lsm_thread(void *pArg) {
+  rfdict_lsm_move((RFDICT_LSM *) pArg, LONG_MAX);
+  return NULL;
+}
+#endif
+
+/*
+ * Perform part of the merge in progress in an LSM dictionary.
+ * 
+ * Up to n keys are moved into the output image.  If this completes the
+ * merge, the output replaces the two input runs, and the next merge is
+ * scheduled if one is due.  The call is ignored if no merge is in
+ * progress.
+ * 
+ * If the merge is running on its own thread, it is left alone unless n
+ * is LONG_MAX, in which case the thread is waited for and the merge is
+ * completed.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ *   n - the maximum number of keys to move
+ */
+static void rfdict_lsm_step(RFDICT_LSM *pLsm, long n) {
+  
+  RFDICT_FROZEN *pA = NULL;
+  RFDICT_FROZEN *pB = NULL;
+  int busy = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pLsm == NULL) || (n < 0)) {
+    abort();
+  }
+  
+  /* Wait for a merge thread only if the merge must finish now, else
+   * leave the merge to it */
+#ifdef RFDICT_THREADS
+  if ((pLsm->merge_at >= 0) && pLsm->running) {
+    if (n < LONG_MAX) {
+      busy = 1;
+    } else {
+      if (pthread_join(pLsm->worker, NULL) != 0) {
+        abort();
+      }
+      pLsm->running = 0;
+    }
+  }
+#endif
+  
+  /* Only if merge in progress and not left to a thread */
+  if ((pLsm->merge_at >= 0) && (!busy)) {
+    
+    rfdict_lsm_move(pLsm, n);
+    
+    /* If merge complete, replace the inputs with the output */
+    if (pLsm->io >= (pLsm->pOut)->count) {
+      pA = (pLsm->apRun)[pLsm->merge_at];
+      pB = (pLsm->apRun)[pLsm->merge_at + 1];
+      
+      (pLsm->apRun)[pLsm->merge_at] = pLsm->pOut;
+      for(i = pLsm->merge_at + 1; i + 1 < pLsm->nruns; i++) {
+        (pLsm->apRun)[i] = (pLsm->apRun)[i + 1];
+      }
+      (pLsm->nruns)--;
+      (pLsm->apRun)[pLsm->nruns] = NULL;
+      
+      rfdict_frozen_free(pA);
+      rfdict_frozen_free(pB);
+      pLsm->pOut = NULL;
+      pLsm->merge_at = -1;
+      
+      rfdict_lsm_schedule(pLsm, 0);
+    }
+  }
+}
+
+/*
+ * Flush the memtable of an LSM dictionary into a new run.
+ * 
+ * Any merge in progress is completed first, so that at most one merge
+ * is ever outstanding.  The memtable is cleared, keeping its memory for
+ * the next round of insertions.  The call is ignored if the memtable
+ * is empty.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ */
+static void rfdict_lsm_flush(RFDICT_LSM *pLsm) {
+  
+  int i = 0;
+  
+  /* Check parameters */
+  if (pLsm == NULL) {
+    abort();
+  }
+  
+  if ((pLsm->pMem)->count > 0) {
+    
+    /* Finish the merge in progress */
+    while (pLsm->merge_at >= 0) {
+      rfdict_lsm_step(pLsm, LONG_MAX);
+    }
+    if (pLsm->nruns >= RFDICT_LSM_MAXRUNS) {
+      abort();  /* shouldn't happen */
+    }
+    
+    /* Add the new run at the front */
+    for(i = pLsm->nruns; i > 0; i--) {
+      (pLsm->apRun)[i] = (pLsm->apRun)[i - 1];
+    }
+    (pLsm->apRun)[0] = rfdict_frozen_build(pLsm->pMem, 1);
+    (pLsm->nruns)++;
+    
+    /* Empty the memtable and schedule a merge if one is due */
+    rfdict_clear(pLsm->pMem);
+    rfdict_lsm_schedule(pLsm, 0);
+  }
+}
+
+/*
+ * Compare text of a given length against a key.
+ * 
+ * The text is compared as if it were a null-terminated key of length
+ * len, in the same order as rfdict_keycmp().  The text may not contain
+ * null bytes within that length.  If sensitive is zero, lowercase
+ * letters in the text are mapped to uppercase; the key must already be
+ * mapped, as keys stored in case-insensitive dictionaries are.
+ * 
+ * Parameters:
+ * 
+ *   pText - the text
+ * 
+ *   len - the length of the text in bytes
+ * 
+ *   pKey - the null-terminated key
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ *   pLcp - receives the length of the longest common prefix of the
+ *   text and the key
+ * 
+ * Return:
+ * 
+ *   less than zero, equal to zero, or greater than zero, as the text is
+ *   less than, equal to, or greater than the key
+ */
+static int rfdict_textcmp(
+    const char * pText,
+    size_t       len,
+    const char * pKey,
+    int          sensitive,
+    size_t     * pLcp) {
+  
+  size_t i = 0;
+  int c1 = 0;
+  int c2 = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pText == NULL) || (pKey == NULL) || (pLcp == NULL)) {
+    abort();
+  }
+  
+  /* Find the first difference */
+  for(i = 0; (i < len) && (pKey[i] != 0); i++) {
+    c1 = (int) ((unsigned char) pText[i]);
+    c2 = (int) ((unsigned char) pKey[i]);
+    if ((!sensitive) && (c1 >= ASCII_LOWER_A) && (c1 <= ASCII_LOWER_Z)) {
+      c1 -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    if (c1 != c2) {
+      break;
+    }
+  }
+  *pLcp = i;
+  
+  /* Determine the result */
+  if ((i < len) && (pKey[i] != 0)) {
+    if (c1 < c2) {
+      result = -1;
+    } else {
+      result = 1;
+    }
+  } else if (i < len) {
+    result = 1;
+  } else if (pKey[i] != 0) {
+    result = -1;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Count the set bits in a word.
+ * 
+ * Parameters:
+ * 
+ *   w - the word
+ * 
+ * Return:
+ * 
+ *   the number of set bits
+ */
+static int rfdict_popcount(unsigned long w) {
+  
+  /* Sum bits in parallel within pairs, nibbles, and bytes, then add up
+   * the bytes with a multiplication; the masks are built to suit any
+   * width of unsigned long */
+  w = w - ((w >> 1) & (~0UL / 3));
+  w = (w & (~0UL / 15 * 3)) + ((w >> 2) & (~0UL / 15 * 3));
+  w = (w + (w >> 4)) & (~0UL / 255 * 15);
+  
+  return (int) ((w * (~0UL / 255)) >>
+                  ((sizeof(unsigned long) - 1) * CHAR_BIT));
+}
+
+/*
+ * Allocate a bit vector with all bits clear.
+ * 
+ * The directories are not built until rfdict_bits_index() is called.
+ * The vector must be released with rfdict_bits_release().
+ * 
+ * Parameters:
+ * 
+ *   pBits - the bit vector to initialize
+ * 
+ *   nbits - the number of bits
+ */
+static void rfdict_bits_alloc(RFDICT_BITS *pBits, unsigned long nbits) {
+  
+  /* Check parameters */
+  if (pBits == NULL) {
+    abort();
+  }
+  
+  pBits->nbits = nbits;
+  pBits->nwords = (nbits + RFDICT_WORD_BITS - 1) / RFDICT_WORD_BITS;
+  pBits->nzero = 0;
+  pBits->pRank = NULL;
+  pBits->pSel0 = NULL;
+  
+  /* Always allocate at least one word, so the array is never empty */
+  pBits->pWord = (unsigned long *) malloc(
+                    ((size_t) (pBits->nwords + 1)) *
+                      sizeof(unsigned long));
+  if (pBits->pWord == NULL) {
+    abort();
+  }
+  memset(pBits->pWord, 0,
+          ((size_t) (pBits->nwords + 1)) * sizeof(unsigned long));
+}
+
+/*
+ * Build the directories of a bit vector once all its bits are set.
+ * 
+ * Parameters:
+ * 
+ *   pBits - the bit vector
+ * 
+ *   sel0 - non-zero to also build the select directory for zero bits
+ */
+static void rfdict_bits_index(RFDICT_BITS *pBits, int sel0) {
+  
+  unsigned long nblock = 0;
+  unsigned long b = 0;
+  unsigned long w = 0;
+  unsigned long ones = 0;
+  unsigned long zeros = 0;
+  unsigned long j = 0;
+  unsigned long nsample = 0;
+  
+  /* Check parameters */
+  if ((pBits == NULL) || (pBits->pRank != NULL)) {
+    abort();
+  }
+  
+  /* Build the rank directory */
+  nblock = (pBits->nwords + RFDICT_RANK_WORDS - 1) / RFDICT_RANK_WORDS;
+  pBits->pRank = (unsigned long *) malloc(
+                    ((size_t) (nblock + 1)) * sizeof(unsigned long));
+  if (pBits->pRank == NULL) {
+    abort();
+  }
+  for(b = 0; b < nblock; b++) {
+    (pBits->pRank)[b] = ones;
+    for(w = b * RFDICT_RANK_WORDS;
+        (w < (b + 1) * RFDICT_RANK_WORDS) && (w < pBits->nwords);
+        w++) {
+      ones += (unsigned long) rfdict_popcount((pBits->pWord)[w]);
+    }
+  }
+  (pBits->pRank)[nblock] = ones;
+  pBits->nzero = pBits->nbits - ones;
+  
+  /* Build the select directory, noting the block of each sampled zero
+   * bit; zero bits before block b number (b * block bits) minus the
+   * rank of the block */
+  if (sel0) {
+    nsample = (pBits->nzero + RFDICT_SELECT_SAMPLE - 1) /
+                RFDICT_SELECT_SAMPLE;
+    pBits->pSel0 = (unsigned long *) malloc(
+                      ((size_t) (nsample + 1)) * sizeof(unsigned long));
+    if (pBits->pSel0 == NULL) {
+      abort();
+    }
+    
+    b = 0;
+    for(j = 0; j < nsample; j++) {
+      for( ; b + 1 < nblock; b++) {
+        zeros = (b + 1) * RFDICT_RANK_WORDS * RFDICT_WORD_BITS -
+                  (pBits->pRank)[b + 1];
+        if (zeros > j * RFDICT_SELECT_SAMPLE) {
+          break;
+        }
+      }
+      (pBits->pSel0)[j] = b;
+    }
+  }
+}
+
+/*
+ * Count the set bits before a given position in a bit vector.
+ * 
+ * Parameters:
+ * 
+ *   pBits - the bit vector, with its directories built
+ * 
+ *   pos - the position, which may equal the number of bits
+ * 
+ * Return:
+ * 
+ *   the number of set bits at positions less than pos
+ */
+static unsigned long rfdict_bits_rank1(
+    RFDICT_BITS   * pBits,
+    unsigned long   pos) {
+  
+  unsigned long result = 0;
+  unsigned long w = 0;
+  unsigned long wend = 0;
+  int s = 0;
+  
+  /* Check parameters */
+  if ((pBits == NULL) || (pos > pBits->nbits)) {
+    abort();
+  }
+  
+  /* Start from the directory, then count whole words and the partial
+   * word */
+  wend = pos / RFDICT_WORD_BITS;
+  w = (wend / RFDICT_RANK_WORDS) * RFDICT_RANK_WORDS;
+  result = (pBits->pRank)[wend / RFDICT_RANK_WORDS];
+  for( ; w < wend; w++) {
+    result += (unsigned long) rfdict_popcount((pBits->pWord)[w]);
+  }
+  s = (int) (pos % RFDICT_WORD_BITS);
+  if (s > 0) {
+    result += (unsigned long) rfdict_popcount(
+                (pBits->pWord)[wend] & ((1UL << s) - 1));
+  }
+  
+  return result;
+}
+
+/*
+ * Find the position of a given zero bit in a bit vector.
+ * 
+ * Parameters:
+ * 
+ *   pBits - the bit vector, with its select directory built
+ * 
+ *   k - the number of the zero bit, counting from zero, which must be
+ *   less than the number of zero bits in the vector
+ * 
+ * Return:
+ * 
+ *   the position of the zero bit
+ */
+static unsigned long rfdict_bits_select0(
+    RFDICT_BITS   * pBits,
+    unsigned long   k) {
+  
+  unsigned long b = 0;
+  unsigned long w = 0;
+  unsigned long zeros = 0;
+  unsigned long z = 0;
+  unsigned long word = 0;
+  int s = 0;
+  
+  /* Check parameters */
+  if ((pBits == NULL) || (pBits->pSel0 == NULL) || (k >= pBits->nzero)) {
+    abort();
+  }
+  
+  /* Find the block from the directory, moving forward while the next
+   * block starts at or before the zero bit */
+  b = (pBits->pSel0)[k / RFDICT_SELECT_SAMPLE];
+  zeros = b * RFDICT_RANK_WORDS * RFDICT_WORD_BITS - (pBits->pRank)[b];
+  while ((b + 1) * RFDICT_RANK_WORDS < pBits->nwords) {
+    z = (b + 1) * RFDICT_RANK_WORDS * RFDICT_WORD_BITS -
+          (pBits->pRank)[b + 1];
+    if (z > k) {
+      break;
+    }
+    b++;
+    zeros = z;
+  }
+  
+  /* Find the word; padding bits at the end are clear, but they can
+   * never be reached since k is less than the number of zero bits */
+  for(w = b * RFDICT_RANK_WORDS; w < pBits->nwords; w++) {
+    z = (unsigned long) (RFDICT_WORD_BITS -
+                          rfdict_popcount((pBits->pWord)[w]));
+    if (zeros + z > k) {
+      break;
+    }
+    zeros += z;
+  }
+  if (w >= pBits->nwords) {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Find the byte, then the bit */
+  word = ~((pBits->pWord)[w]);
+  for(s = 0; s < RFDICT_WORD_BITS - CHAR_BIT; s += CHAR_BIT) {
+    z = (unsigned long) rfdict_popcount(
+          (word >> s) & ((1UL << CHAR_BIT) - 1));
+    if (zeros + z > k) {
+      break;
+    }
+    zeros += z;
+  }
+  for( ; s < RFDICT_WORD_BITS; s++) {
+    if ((word >> s) & 1) {
+      if (zeros == k) {
+        break;
+      }
+      zeros++;
+    }
+  }
+  
+  return w * RFDICT_WORD_BITS + ((unsigned long) s);
+}
+
+/*
+ * Release the memory of a bit vector.
+ * 
+ * Parameters:
+ * 
+ *   pBits - the bit vector
+ */
+static void rfdict_bits_release(RFDICT_BITS *pBits) {
+  
+  if (pBits == NULL) {
+    abort();
+  }
+  
+  free(pBits->pWord);
+  free(pBits->pRank);
+  free(pBits->pSel0);
+  pBits->pWord = NULL;
+  pBits->pRank = NULL;
+  pBits->pSel0 = NULL;
+}
+
+/*
+ * Map a value to an unsigned transducer output.
+ * 
+ * The mapping preserves order, so that the smallest long maps to zero.
+ * The inverse is rfdict_tolong() of the output with the same bit
+ * flipped.
+ * 
+ * Parameters:
+ * 
+ *   v - the value
+ * 
+ * Return:
+ * 
+ *   the output
+ */
+static unsigned long rfdict_fst_tou(long v) {
+  return ((unsigned long) v) ^ (1UL << (RFDICT_WORD_BITS - 1));
+}
+
+/*
+ * Encode a variable-length integer.
+ * 
+ * Parameters:
+ * 
+ *   p - the buffer, with room for at least RFDICT_FST_MAXVAR bytes
+ * 
+ *   v - the value to encode
+ * 
+ * Return:
+ * 
+ *   the number of bytes written
+ */
+static int rfdict_fst_putvar(unsigned char *p, unsigned long v) {
+  
+  int result = 0;
+  
+  if (p == NULL) {
+    abort();
+  }
+  
+  for( ; v > 0x7f; v >>= 7) {
+    p[result] = (unsigned char) ((v & 0x7f) | 0x80);
+    result++;
+  }
+  p[result] = (unsigned char) v;
+  result++;
+  
+  return result;
+}
+
+/*
+ * Decode a variable-length integer from the node data of a transducer.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pPos - the offset to read from, which is advanced past the integer
+ * 
+ *   pv - receives the value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the integer runs past the end of
+ *   the node data or is too long
+ */
+static int rfdict_fst_getvar(
+    RFDICT_FST    * pFst,
+    size_t        * pPos,
+    unsigned long * pv) {
+  
+  unsigned long v = 0;
+  int shift = 0;
+  int c = 0;
+  int status = 0;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pPos == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Read groups until one without the continuation bit */
+  for(shift = 0; shift < RFDICT_WORD_BITS; shift += 7) {
+    if (*pPos >= pFst->dlen) {
+      break;
+    }
+    c = (int) (pFst->pData)[*pPos];
+    (*pPos)++;
+    v |= ((unsigned long) (c & 0x7f)) << shift;
+    if (!(c & 0x80)) {
+      status = 1;
+      break;
+    }
+  }
+  
+  *pv = v;
+  return status;
+}
+
+/*
+ * Make sure the image being built has room for more bytes.
+ * 
+ * Parameters:
+ * 
+ *   pBuild - the build state
+ * 
+ *   extra - the number of bytes to make room for
+ */
+static void rfdict_fst_reserve(RFDICT_FST_BUILD *pBuild, size_t extra) {
+  
+  size_t ncap = 0;
+  
+  /* Check parameters */
+  if (pBuild == NULL) {
+    abort();
+  }
+  
+  /* Grow by doubling */
+  if (pBuild->len + extra > pBuild->cap) {
+    ncap = pBuild->cap * 2;
+    if (ncap < pBuild->len + extra) {
+      ncap = pBuild->len + extra;
+    }
+    pBuild->pImage = (unsigned char *) realloc(pBuild->pImage, ncap);
+    if (pBuild->pImage == NULL) {
+      abort();
+    }
+    pBuild->cap = ncap;
+  }
+}
+
+/*
+ * Add an arc to a transducer node that is being built.
+ * 
+ * The new arc has an output of zero, and its target is set later.
+ * 
+ * Parameters:
+ * 
+ *   pState - the node
+ * 
+ *   label - the label of the arc
+ */
+static void rfdict_fst_addarc(RFDICT_FST_STATE *pState, int label) {
+  
+  /* Check parameters */
+  if ((pState == NULL) || (label < 1) || (label > 255)) {
+    abort();
+  }
+  
+  /* Grow the arrays if necessary */
+  if (pState->narcs >= pState->cap) {
+    if (pState->cap < 1) {
+      pState->cap = 4;
+    } else {
+      pState->cap *= 2;
+    }
+    pState->pLabel = (unsigned char *) realloc(
+                        pState->pLabel, (size_t) pState->cap);
+    pState->pOut = (unsigned long *) realloc(
+                        pState->pOut,
+                        ((size_t) pState->cap) * sizeof(unsigned long));
+    pState->pTarget = (size_t *) realloc(
+                        pState->pTarget,
+                        ((size_t) pState->cap) * sizeof(size_t));
+    if ((pState->pLabel == NULL) || (pState->pOut == NULL) ||
+        (pState->pTarget == NULL)) {
+      abort();
+    }
+  }
+  
+  (pState->pLabel)[pState->narcs] = (unsigned char) label;
+  (pState->pOut)[pState->narcs] = 0;
+  (pState->pTarget)[pState->narcs] = 0;
+  (pState->narcs)++;
+}
+
+/*
+ * Write a completed node to the transducer being built.
+ * 
+ * If an identical node has already been written, that node is shared
+ * instead.  The node being built is reset to empty, keeping its arrays
+ * for reuse.
+ * 
+ * Parameters:
+ * 
+ *   pBuild - the build state
+ * 
+ *   pState - the completed node
+ * 
+ * Return:
+ * 
+ *   the offset of the node within the node data
+ */
+static size_t rfdict_fst_compile(
+    RFDICT_FST_BUILD * pBuild,
+    RFDICT_FST_STATE * pState) {
+  
+  unsigned char *pEnc = NULL;
+  size_t *pOldOff = NULL;
+  size_t *pOldLen = NULL;
+  size_t *pOldNode = NULL;
+  size_t oldslots = 0;
+  size_t need = 0;
+  size_t elen = 0;
+  size_t h = 0;
+  size_t j = 0;
+  size_t k = 0;
+  size_t result = 0;
+  int flags = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pBuild == NULL) || (pState == NULL)) {
+    abort();
+  }
+  
+  /* Make sure the scratch buffer can hold an encoding */
+  need = ((size_t) (pState->narcs + 3)) * (2 * RFDICT_FST_MAXVAR + 1);
+  if (need > pBuild->scratch_cap) {
+    free(pBuild->pScratch);
+    pBuild->pScratch = (unsigned char *) malloc(need);
+    if (pBuild->pScratch == NULL) {
+      abort();
+    }
+    pBuild->scratch_cap = need;
+  }
+  
+  /* Encode the node in canonical form, with absolute target offsets,
+   * so that identical nodes have identical encodings */
+  pEnc = pBuild->pScratch;
+  pEnc[0] = (unsigned char) (pState->final ? RFDICT_FST_FINAL : 0);
+  elen = 1;
+  elen += rfdict_fst_putvar(pEnc + elen, (unsigned long) pState->narcs);
+  if (pState->final) {
+    elen += rfdict_fst_putvar(pEnc + elen, pState->fout);
+  }
+  for(i = 0; i < pState->narcs; i++) {
+    pEnc[elen] = (pState->pLabel)[i];
+    elen++;
+    elen += rfdict_fst_putvar(pEnc + elen, (pState->pOut)[i]);
+    elen += rfdict_fst_putvar(pEnc + elen,
+                              (unsigned long) (pState->pTarget)[i]);
+  }
+  
+  /* Hash the encoding */
+  h = 2166136261UL;
+  for(j = 0; j < elen; j++) {
+    h = (h ^ ((size_t) pEnc[j])) * 16777619UL;
+  }
+  
+  /* Look for an identical node */
+  h &= pBuild->slots - 1;
+  for( ; (pBuild->pSlotLen)[h] != 0; h = (h + 1) & (pBuild->slots - 1)) {
+    if (((pBuild->pSlotLen)[h] == elen) &&
+        (memcmp(pBuild->pCanon + (pBuild->pSlotOff)[h],
+                pEnc, elen) == 0)) {
+      break;
+    }
+  }
+  
+  if ((pBuild->pSlotLen)[h] != 0) {
+    /* Share the existing node */
+    result = (pBuild->pSlotNode)[h];
+    
+  } else {
+    /* Record the canonical encoding */
+    if (pBuild->canon_len + elen > pBuild->canon_cap) {
+      pBuild->canon_cap = pBuild->canon_cap * 2 + elen;
+      pBuild->pCanon = (unsigned char *) realloc(
+                          pBuild->pCanon, pBuild->canon_cap);
+      if (pBuild->pCanon == NULL) {
+        abort();
+      }
+    }
+    memcpy(pBuild->pCanon + pBuild->canon_len, pEnc, elen);
+    (pBuild->pSlotOff)[h] = pBuild->canon_len;
+    (pBuild->pSlotLen)[h] = elen;
+    pBuild->canon_len += elen;
+    
+    /* Append the node in its stored form, with targets given as the
+     * distance back from this node, which is small since the target is
+     * usually the node just written */
+    result = pBuild->len - RFDICT_FST_HDR_SIZE;
+    (pBuild->pSlotNode)[h] = result;
+    (pBuild->used)++;
+    
+    flags = 0;
+    if (pState->final) {
+      flags |= RFDICT_FST_FINAL;
+    }
+    if (pState->narcs == 1) {
+      flags |= RFDICT_FST_ONEARC;
+    }
+    pEnc[0] = (unsigned char) flags;
+    elen = 1;
+    if (pState->narcs != 1) {
+      elen += rfdict_fst_putvar(pEnc + elen, (unsigned long) pState->narcs);
+    }
+    if (pState->final) {
+      elen += rfdict_fst_putvar(pEnc + elen, pState->fout);
+    }
+    for(i = 0; i < pState->narcs; i++) {
+      pEnc[elen] = (pState->pLabel)[i];
+      elen++;
+      elen += rfdict_fst_putvar(pEnc + elen, (pState->pOut)[i]);
+      elen += rfdict_fst_putvar(pEnc + elen,
+                  (unsigned long) (result - (pState->pTarget)[i]));
+    }
+    
+    rfdict_fst_reserve(pBuild, elen);
+    memcpy(pBuild->pImage + pBuild->len, pEnc, elen);
+    pBuild->len += elen;
+    
+    /* Double the table if it is half full */
+    if (pBuild->used * 2 > pBuild->slots) {
+      pOldOff = pBuild->pSlotOff;
+      pOldLen = pBuild->pSlotLen;
+      pOldNode = pBuild->pSlotNode;
+      oldslots = pBuild->slots;
+      
+      pBuild->slots = oldslots * 2;
+      pBuild->pSlotOff = (size_t *) malloc(
+                            pBuild->slots * sizeof(size_t));
+      pBuild->pSlotLen = (size_t *) calloc(
+                            pBuild->slots, sizeof(size_t));
+      pBuild->pSlotNode = (size_t *) malloc(
+                            pBuild->slots * sizeof(size_t));
+      if ((pBuild->pSlotOff == NULL) || (pBuild->pSlotLen == NULL) ||
+          (pBuild->pSlotNode == NULL)) {
+        abort();
+      }
+      
+      for(j = 0; j < oldslots; j++) {
+        if (pOldLen[j] != 0) {
+          pEnc = pBuild->pCanon + pOldOff[j];
+          h = 2166136261UL;
+          for(k = 0; k < pOldLen[j]; k++) {
+            h = (h ^ ((size_t) pEnc[k])) * 16777619UL;
+          }
+          for(h &= pBuild->slots - 1;
+              (pBuild->pSlotLen)[h] != 0;
+              h = (h + 1) & (pBuild->slots - 1));
+          (pBuild->pSlotOff)[h] = pOldOff[j];
+          (pBuild->pSlotLen)[h] = pOldLen[j];
+          (pBuild->pSlotNode)[h] = pOldNode[j];
+        }
+      }
+      
+      free(pOldOff);
+      free(pOldLen);
+      free(pOldNode);
+    }
+  }
+  
+  /* Reset the node */
+  pState->narcs = 0;
+  pState->final = 0;
+  pState->fout = 0;
+  
+  return result;
+}
+
+/*
+ * Decode the header of a transducer node.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pos - the offset of the node within the node data
+ * 
+ *   pFinal - receives non-zero if the node is final
+ * 
+ *   pFout - receives the final output, or zero if not final
+ * 
+ *   pNarcs - receives the number of arcs
+ * 
+ *   pArcs - receives the offset of the first arc
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the node data is corrupt
+ */
+static int rfdict_fst_node(
+    RFDICT_FST    * pFst,
+    size_t          pos,
+    int           * pFinal,
+    unsigned long * pFout,
+    unsigned long * pNarcs,
+    size_t        * pArcs) {
+  
+  int flags = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pFinal == NULL) || (pFout == NULL) ||
+      (pNarcs == NULL) || (pArcs == NULL)) {
+    abort();
+  }
+  
+  /* Decode flags, arc count, and final output */
+  *pFinal = 0;
+  *pFout = 0;
+  *pNarcs = 0;
+  if (pos >= pFst->dlen) {
+    status = 0;
+  }
+  if (status) {
+    flags = (int) (pFst->pData)[pos];
+    *pFinal = flags & RFDICT_FST_FINAL;
+    pos++;
+    if (flags & RFDICT_FST_ONEARC) {
+      *pNarcs = 1;
+    } else {
+      status = rfdict_fst_getvar(pFst, &pos, pNarcs);
+    }
+  }
+  if (status && *pFinal) {
+    status = rfdict_fst_getvar(pFst, &pos, pFout);
+  }
+  
+  *pArcs = pos;
+  return status;
+}
+
+/*
+ * Decode an arc of a transducer node.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   node - the offset of the node the arc belongs to
+ * 
+ *   pPos - the offset of the arc, which is advanced to the next arc
+ * 
+ *   pLabel - receives the label
+ * 
+ *   pOut - receives the output
+ * 
+ *   pTarget - receives the offset of the target node
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the node data is corrupt
+ */
+static int rfdict_fst_arc(
+    RFDICT_FST    * pFst,
+    size_t          node,
+    size_t        * pPos,
+    int           * pLabel,
+    unsigned long * pOut,
+    size_t        * pTarget) {
+  
+  unsigned long dist = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pPos == NULL) || (pLabel == NULL) ||
+      (pOut == NULL) || (pTarget == NULL)) {
+    abort();
+  }
+  
+  /* Decode label, output, and target */
+  if (*pPos >= pFst->dlen) {
+    status = 0;
+  }
+  if (status) {
+    *pLabel = (int) (pFst->pData)[*pPos];
+    (*pPos)++;
+    status = rfdict_fst_getvar(pFst, pPos, pOut);
+  }
+  if (status) {
+    status = rfdict_fst_getvar(pFst, pPos, &dist);
+  }
+  if (status && ((dist < 1) || (dist > (unsigned long) node))) {
+    status = 0;
+  }
+  
+  *pTarget = node - (size_t) dist;
+  return status;
+}
+
+/*
+ * Find the child of a scanner node with a given label.
+ * 
+ * Parameters:
+ * 
+ *   pScanner - the scanner
+ * 
+ *   v - the node
+ * 
+ *   c - the label, already case-mapped if necessary
+ * 
+ * Return:
+ * 
+ *   the child node, or zero if there is none
+ */
+static long rfdict_scan_child(RFDICT_SCANNER *pScanner, long v, int c) {
+  
+  const unsigned char *pHit = NULL;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pScanner == NULL) || (v < 0) || (v >= pScanner->nodes)) {
+    abort();
+  }
+  
+  /* Use the table for the root, or search the labels otherwise */
+  if (v == 0) {
+    result = (pScanner->aRoot)[c & 0xff];
+  } else {
+    pHit = (const unsigned char *) memchr(
+              pScanner->pLabel + (pScanner->pFirst)[v],
+              c,
+              (size_t) ((pScanner->pFirst)[v + 1] -
+                          (pScanner->pFirst)[v]));
+    if (pHit != NULL) {
+      result = (long) (pHit - pScanner->pLabel);
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Find the first node whose key is at or after a prefix, or strictly
+ * after all keys that start with the prefix.
+ * 
+ * Only the first plen bytes of each key are compared with the prefix.
+ * The prefix must already be case-mapped in the same way as keys in the
+ * dictionary.  Since stored keys are ordered by their bytes compared as
+ * unsigned values in both case modes, the strict form skips every key
+ * that has the prefix.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pPrefix - the prefix, which need not be null-terminated
+ * 
+ *   plen - the length of the prefix in bytes
+ * 
+ *   strict - non-zero to skip keys that start with the prefix, zero to
+ *   include them
+ * 
+ * Return:
+ * 
+ *   the first node found, or NULL if there is none
+ */
+static RFDICT_NODE *rfdict_bound(
+    RFDICT      * pDict,
+    const char  * pPrefix,
+    size_t        plen,
+    int           strict) {
+  
+  RFDICT_NODE *pCurrent = NULL;
+  RFDICT_NODE *pResult = NULL;
+  size_t lcp_lo = 0;
+  size_t lcp_hi = 0;
+  size_t lcp = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pPrefix == NULL)) {
+    abort();
+  }
+  
+  /* Descend, remembering the last node that was in range, and
+   * skipping the prefix shared with both bounds */
+  pCurrent = pDict->pRoot;
+  while (pCurrent != NULL) {
+    if (lcp_lo < lcp_hi) {
+      lcp = lcp_lo;
+    } else {
+      lcp = lcp_hi;
+    }
+    retval = rfdict_lcpcmp(pCurrent->pKey, pPrefix, 1, plen, &lcp);
+    if ((retval > 0) || ((retval == 0) && (!strict))) {
+      lcp_hi = lcp;
+      pResult = pCurrent;
+      pCurrent = pCurrent->pLeft;
+    } else {
+      lcp_lo = lcp;
+      pCurrent = pCurrent->pRight;
+    }
+  }
+  
+  return pResult;
+}
+
+/*
+ * Compute one row of the Levenshtein automaton used by rfdict_fuzzy().
+ * 
+ * Row d holds the edit distances between the first d bytes of a
+ * candidate key and each prefix of the query, but only within the band
+ * of query lengths from (d - k) to (d + k), since outside of the band
+ * the distance always exceeds k.  Element t of row d is the distance
+ * to the first (d - k + t) bytes of the query.  Distances greater than
+ * k are all stored as (k + 1).
+ * 
+ * Parameters:
+ * 
+ *   pRow - the row to compute, with (2k + 1) elements
+ * 
+ *   pPrev - row (d - 1), or NULL to compute row zero
+ * 
+ *   d - the row number
+ * 
+ *   c - the byte of the candidate key at offset (d - 1)
+ * 
+ *   pQuery - the query, case-mapped if necessary
+ * 
+ *   n - the length of the query
+ * 
+ *   k - the maximum number of edits
+ * 
+ * Return:
+ * 
+ *   the minimum distance in the row
+ */
+static int rfdict_fuzzy_row(
+    int         * pRow,
+    const int   * pPrev,
+    long          d,
+    int           c,
+    const char  * pQuery,
+    long          n,
+    int           k) {
+  
+  long j = 0;
+  int t = 0;
+  int v = 0;
+  int x = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pRow == NULL) || (pQuery == NULL) || (d < 0) || (n < 0) ||
+      (k < 0)) {
+    abort();
+  }
+  if ((pPrev == NULL) && (d != 0)) {
+    abort();
+  }
+  
+  result = k + 1;
+  for(t = 0; t <= 2 * k; t++) {
+    j = d - k + t;
+    if ((j < 0) || (j > n)) {
+      /* Outside the query */
+      v = k + 1;
+      
+    } else if (pPrev == NULL) {
+      /* Insert j bytes */
+      v = (int) j;
+      
+    } else if (j == 0) {
+      /* Delete d bytes */
+      v = k + 1;
+      if (d <= k) {
+        v = (int) d;
+      }
+      
+    } else {
+      /* Substitute or match, delete, or insert */
+      v = pPrev[t];
+      if (((unsigned char) pQuery[j - 1]) != c) {
+        v++;
+      }
+      if (t < 2 * k) {
+        x = pPrev[t + 1] + 1;
+        if (x < v) {
+          v = x;
+        }
+      }
+      if (t > 0) {
+        x = pRow[t - 1] + 1;
+        if (x < v) {
+          v = x;
+        }
+      }
+      if (v > k + 1) {
+        v = k + 1;
+      }
+    }
+    
+    pRow[t] = v;
+    if (v < result) {
+      result = v;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Add a node to the automaton for a pattern.
+ * 
+ * The node has the given type, no links, and an empty set.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   type - the node type
+ * 
+ * Return:
+ * 
+ *   the index of the new node
+ */
+static long rfdict_re_node(RFDICT_RE *pRe, int type) {
+  
+  RFDICT_RE_NODE *pNew = NULL;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pRe == NULL) ||
+      ((type != RFDICT_RE_SET) && (type != RFDICT_RE_EPS))) {
+    abort();
+  }
+  
+  /* Grow the node array if necessary */
+  if (pRe->nodes >= pRe->cap) {
+    newcap = pRe->cap * 2;
+    if (newcap < 16) {
+      newcap = 16;
+    }
+    pNew = (RFDICT_RE_NODE *) realloc(
+              pRe->pNode, ((size_t) newcap) * sizeof(RFDICT_RE_NODE));
+    if (pNew == NULL) {
+      abort();
+    }
+    pRe->pNode = pNew;
+    pRe->cap = newcap;
+  }
+  
+  /* Initialize the node */
+  memset(&((pRe->pNode)[pRe->nodes]), 0, sizeof(RFDICT_RE_NODE));
+  ((pRe->pNode)[pRe->nodes]).type = type;
+  ((pRe->pNode)[pRe->nodes]).out1 = -1;
+  ((pRe->pNode)[pRe->nodes]).out2 = -1;
+  
+  (pRe->nodes)++;
+  return pRe->nodes - 1;
+}
+
+/*
+ * Add a byte to the set of a node of the automaton for a pattern.
+ * 
+ * In case-insensitive mode, lowercase letters are mapped to uppercase,
+ * since stored keys never contain lowercase letters.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   node - the set node
+ * 
+ *   c - the byte value
+ */
+static void rfdict_re_add(RFDICT_RE *pRe, long node, int c) {
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (node < 0) || (node >= pRe->nodes) ||
+      (c < 0) || (c > 255)) {
+    abort();
+  }
+  
+  if ((!(pRe->sensitive)) &&
+      (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+    c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+  }
+  (((pRe->pNode)[node]).aSet)[c >> 3] |= (unsigned char) (1 << (c & 7));
+}
+
+/*
+ * Parse a bracket expression of a pattern into the set of a node.
+ * 
+ * The parser must be just after the opening bracket, and is left just
+ * after the closing bracket.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   node - the set node
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the bracket expression is invalid
+ */
+static int rfdict_re_class(RFDICT_RE *pRe, long node) {
+  
+  int negate = 0;
+  int first = 1;
+  int lo = 0;
+  int hi = 0;
+  int c = 0;
+  int i = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (node < 0) || (node >= pRe->nodes)) {
+    abort();
+  }
+  
+  /* Check for negation */
+  if ((pRe->pos < pRe->len) && ((pRe->pPat)[pRe->pos] == '^')) {
+    negate = 1;
+    (pRe->pos)++;
+  }
+  
+  /* Parse the items up to the closing bracket, which is an ordinary
+   * byte if it comes first */
+  while (status) {
+    if (pRe->pos >= pRe->len) {
+      status = 0;
+      break;
+    }
+    c = (pRe->pPat)[pRe->pos];
+    if ((c == ']') && (!first)) {
+      (pRe->pos)++;
+      break;
+    }
+    first = 0;
+    
+    /* Get the low end of the item */
+    if (c == '\\') {
+      (pRe->pos)++;
+      if (pRe->pos >= pRe->len) {
+        status = 0;
+        break;
+      }
+      c = (pRe->pPat)[pRe->pos];
+    }
+    (pRe->pos)++;
+    lo = c;
+    hi = c;
+    
+    /* Get the high end if this is a range */
+    if ((pRe->pos + 1 < pRe->len) &&
+        ((pRe->pPat)[pRe->pos] == '-') &&
+        ((pRe->pPat)[pRe->pos + 1] != ']')) {
+      (pRe->pos)++;
+      c = (pRe->pPat)[pRe->pos];
+      if (c == '\\') {
+        (pRe->pos)++;
+        if (pRe->pos >= pRe->len) {
+          status = 0;
+          break;
+        }
+        c = (pRe->pPat)[pRe->pos];
+      }
+      (pRe->pos)++;
+      hi = c;
+      if (hi < lo) {
+        status = 0;
+        break;
+      }
+    }
+    
+    for(i = lo; i <= hi; i++) {
+      rfdict_re_add(pRe, node, i);
+    }
+  }
+  
+  /* Complement the set if negated; keys never contain a null byte */
+  if (status && negate) {
+    for(i = 0; i < 32; i++) {
+      (((pRe->pNode)[node]).aSet)[i] =
+        (unsigned char) ~((((pRe->pNode)[node]).aSet)[i]);
+    }
+    (((pRe->pNode)[node]).aSet)[0] &= (unsigned char) 0xfe;
+  }
+  
+  return status;
+}
+
+/*
+ * Parse an atom of a pattern with any repetition operators after it.
+ * 
+ * Each parsing function builds a fragment of the automaton with a start
+ * node and an end node.  The end node has no out1 link yet, so that it
+ * can be linked to whatever follows the fragment.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   pStart - receives the start node of the fragment
+ * 
+ *   pEnd - receives the end node of the fragment
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the pattern is invalid
+ */
+static int rfdict_re_atom(RFDICT_RE *pRe, long *pStart, long *pEnd) {
+  
+  long s = -1;
+  long e = -1;
+  long n = 0;
+  long m = 0;
+  int c = 0;
+  int i = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (pStart == NULL) || (pEnd == NULL)) {
+    abort();
+  }
+  if (pRe->pos >= pRe->len) {
+    abort();
+  }
+  
+  /* Parse the atom */
+  c = (pRe->pPat)[pRe->pos];
+  if (c == '(') {
+    /* Group */
+    (pRe->pos)++;
+    (pRe->depth)++;
+    if (pRe->depth > RFDICT_RE_MAXNEST) {
+      status = 0;
+    }
+    if (status) {
+      status = rfdict_re_alt(pRe, &s, &e);
+    }
+    if (status) {
+      if ((pRe->pos < pRe->len) && ((pRe->pPat)[pRe->pos] == ')')) {
+        (pRe->pos)++;
+        (pRe->depth)--;
+      } else {
+        status = 0;
+      }
+    }
+    
+  } else if (c == '[') {
+    /* Bracket expression */
+    (pRe->pos)++;
+    s = rfdict_re_node(pRe, RFDICT_RE_SET);
+    e = s;
+    status = rfdict_re_class(pRe, s);
+    
+  } else if (c == '.') {
+    /* Any byte */
+    (pRe->pos)++;
+    s = rfdict_re_node(pRe, RFDICT_RE_SET);
+    e = s;
+    for(i = 1; i < 256; i++) {
+      rfdict_re_add(pRe, s, i);
+    }
+    
+  } else if ((c == '*') || (c == '+') || (c == '?') ||
+              (c == '^') || (c == '$') || (c == ')') || (c == '|')) {
+    /* Operator out of place */
+    status = 0;
+    
+  } else {
+    /* Ordinary or escaped byte */
+    if (c == '\\') {
+      (pRe->pos)++;
+      if (pRe->pos >= pRe->len) {
+        status = 0;
+      } else {
+        c = (pRe->pPat)[pRe->pos];
+      }
+    }
+    if (status) {
+      (pRe->pos)++;
+      s = rfdict_re_node(pRe, RFDICT_RE_SET);
+      e = s;
+      rfdict_re_add(pRe, s, c);
+    }
+  }
+  
+  /* Apply repetition operators */
+  while (status && (pRe->pos < pRe->len)) {
+    c = (pRe->pPat)[pRe->pos];
+    if ((c != '*') && (c != '+') && (c != '?')) {
+      break;
+    }
+    (pRe->pos)++;
+    
+    n = rfdict_re_node(pRe, RFDICT_RE_EPS);
+    m = rfdict_re_node(pRe, RFDICT_RE_EPS);
+    ((pRe->pNode)[n]).out1 = s;
+    ((pRe->pNode)[n]).out2 = m;
+    if (c == '?') {
+      /* Either the fragment or nothing */
+      ((pRe->pNode)[e]).out1 = m;
+      s = n;
+    } else if (c == '*') {
+      /* Any number of the fragment */
+      ((pRe->pNode)[e]).out1 = n;
+      s = n;
+    } else {
+      /* The fragment, then any number more */
+      ((pRe->pNode)[e]).out1 = n;
+    }
+    e = m;
+  }
+  
+  *pStart = s;
+  *pEnd = e;
+  return status;
+}
+
+/*
+ * Parse a sequence of atoms of a pattern.
+ * 
+ * The sequence ends at the end of the pattern or at a bar or closing
+ * parenthesis, and may be empty.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   pStart - receives the start node of the fragment
+ * 
+ *   pEnd - receives the end node of the fragment
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the pattern is invalid
+ */
+static int rfdict_re_cat(RFDICT_RE *pRe, long *pStart, long *pEnd) {
+  
+  long s = -1;
+  long e = -1;
+  long s2 = -1;
+  long e2 = -1;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (pStart == NULL) || (pEnd == NULL)) {
+    abort();
+  }
+  
+  /* Link the atoms one after another */
+  while (status && (pRe->pos < pRe->len) &&
+          ((pRe->pPat)[pRe->pos] != '|') &&
+          ((pRe->pPat)[pRe->pos] != ')')) {
+    status = rfdict_re_atom(pRe, &s2, &e2);
+    if (status) {
+      if (s < 0) {
+        s = s2;
+      } else {
+        ((pRe->pNode)[e]).out1 = s2;
+      }
+      e = e2;
+    }
+  }
+  
+  /* Match nothing if the sequence is empty */
+  if (status && (s < 0)) {
+    s = rfdict_re_node(pRe, RFDICT_RE_EPS);
+    e = s;
+  }
+  
+  *pStart = s;
+  *pEnd = e;
+  return status;
+}
+
+/*
+ * Parse alternatives of a pattern separated by bars.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   pStart - receives the start node of the fragment
+ * 
+ *   pEnd - receives the end node of the fragment
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the pattern is invalid
+ */
+static int rfdict_re_alt(RFDICT_RE *pRe, long *pStart, long *pEnd) {
+  
+  long s = -1;
+  long e = -1;
+  long s2 = -1;
+  long e2 = -1;
+  long n = 0;
+  long m = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (pStart == NULL) || (pEnd == NULL)) {
+    abort();
+  }
+  
+  /* Join each further alternative to the ones before it */
+  status = rfdict_re_cat(pRe, &s, &e);
+  while (status && (pRe->pos < pRe->len) &&
+          ((pRe->pPat)[pRe->pos] == '|')) {
+    (pRe->pos)++;
+    status = rfdict_re_cat(pRe, &s2, &e2);
+    if (status) {
+      n = rfdict_re_node(pRe, RFDICT_RE_EPS);
+      m = rfdict_re_node(pRe, RFDICT_RE_EPS);
+      ((pRe->pNode)[n]).out1 = s;
+      ((pRe->pNode)[n]).out2 = s2;
+      ((pRe->pNode)[e]).out1 = m;
+      ((pRe->pNode)[e2]).out1 = m;
+      s = n;
+      e = m;
+    }
+  }
+  
+  *pStart = s;
+  *pEnd = e;
+  return status;
+}
+
+/*
+ * Find the state of the deterministic automaton for the set of nodes
+ * reachable from given nodes without matching anything, adding a new
+ * state if there is none yet.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ * 
+ *   pSeed - the nodes to start from
+ * 
+ *   nseed - the number of nodes to start from
+ * 
+ * Return:
+ * 
+ *   the state, or -1 if a new state was needed but there are already
+ *   RFDICT_RE_MAXSTATES
+ */
+static long rfdict_re_state(RFDICT_RE *pRe, const long *pSeed, long nseed) {
+  
+  RFDICT_RE_NODE *pN = NULL;
+  long *pNew = NULL;
+  int *pNewAccept = NULL;
+  unsigned long h = 0;
+  long top = 0;
+  long count = 0;
+  long slot = 0;
+  long s = 0;
+  long v = 0;
+  long i = 0;
+  long result = -1;
+  
+  /* Check parameters */
+  if ((pRe == NULL) || (pSeed == NULL) || (nseed < 0)) {
+    abort();
+  }
+  
+  /* Mark every node reachable from the seeds */
+  (pRe->gen)++;
+  for(i = 0; i < nseed; i++) {
+    if ((pRe->pMark)[pSeed[i]] != pRe->gen) {
+      (pRe->pMark)[pSeed[i]] = pRe->gen;
+      (pRe->pStack)[top++] = pSeed[i];
+    }
+  }
+  while (top > 0) {
+    pN = &((pRe->pNode)[(pRe->pStack)[--top]]);
+    if (pN->type == RFDICT_RE_EPS) {
+      v = pN->out1;
+      if ((v >= 0) && ((pRe->pMark)[v] != pRe->gen)) {
+        (pRe->pMark)[v] = pRe->gen;
+        (pRe->pStack)[top++] = v;
+      }
+      v = pN->out2;
+      if ((v >= 0) && ((pRe->pMark)[v] != pRe->gen)) {
+        (pRe->pMark)[v] = pRe->gen;
+        (pRe->pStack)[top++] = v;
+      }
+    }
+  }
+  
+  /* Make room for one more list and state */
+  if (pRe->list_len + pRe->nodes > pRe->list_cap) {
+    pRe->list_cap = (pRe->list_len + pRe->nodes) * 2;
+    pNew = (long *) realloc(
+              pRe->pList, ((size_t) pRe->list_cap) * sizeof(long));
+    if (pNew == NULL) {
+      abort();
+    }
+    pRe->pList = pNew;
+  }
+  if (pRe->dstates >= pRe->dcap) {
+    pRe->dcap = pRe->dcap * 2;
+    if (pRe->dcap < 16) {
+      pRe->dcap = 16;
+    }
+    pNew = (long *) realloc(
+              pRe->pOffset, ((size_t) pRe->dcap) * sizeof(long));
+    if (pNew == NULL) {
+      abort();
+    }
+    pRe->pOffset = pNew;
+    pNew = (long *) realloc(
+              pRe->pCount, ((size_t) pRe->dcap) * sizeof(long));
+    if (pNew == NULL) {
+      abort();
+    }
+    pRe->pCount = pNew;
+    pNew = (long *) realloc(
+              pRe->pTrans, ((size_t) pRe->dcap) * 256 * sizeof(long));
+    if (pNew == NULL) {
+      abort();
+    }
+    pRe->pTrans = pNew;
+    pNewAccept = (int *) realloc(
+              pRe->pAccept, ((size_t) pRe->dcap) * sizeof(int));
+    if (pNewAccept == NULL) {
+      abort();
+    }
+    pRe->pAccept = pNewAccept;
+  }
+  
+  /* List the marked set nodes and the final node in order at the end of
+   * the list array, and hash the list */
+  h = 2166136261UL;
+  for(v = 0; v < pRe->nodes; v++) {
+    if (((pRe->pMark)[v] == pRe->gen) &&
+        ((((pRe->pNode)[v]).type == RFDICT_RE_SET) ||
+          (v == pRe->final))) {
+      (pRe->pList)[pRe->list_len + count] = v;
+      count++;
+      h = ((h ^ ((unsigned long) v)) * 16777619UL) & 0xffffffffUL;
+    }
+  }
+  
+  /* Look for an existing state with the same list */
+  slot = (long) (h & ((unsigned long) (pRe->slots - 1)));
+  for( ; (pRe->pSlot)[slot] >= 0; slot = (slot + 1) & (pRe->slots - 1)) {
+    s = (pRe->pSlot)[slot];
+    if (((pRe->pCount)[s] == count) &&
+        (memcmp(pRe->pList + (pRe->pOffset)[s],
+                pRe->pList + pRe->list_len,
+                ((size_t) count) * sizeof(long)) == 0)) {
+      result = s;
+      break;
+    }
+  }
+  
+  /* Otherwise add a new state, if there is room */
+  if ((result < 0) && (pRe->dstates < RFDICT_RE_MAXSTATES)) {
+    result = pRe->dstates;
+    (pRe->pOffset)[result] = pRe->list_len;
+    (pRe->pCount)[result] = count;
+    (pRe->pAccept)[result] = ((pRe->pMark)[pRe->final] == pRe->gen);
+    (pRe->pSlot)[slot] = result;
+    pRe->list_len += count;
+    (pRe->dstates)++;
+  }
+  
+  return result;
+}
+
+/*
+ * Build the deterministic automaton for a parsed pattern by subset
+ * construction.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler, with start and final nodes set
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the automaton would have more than
+ *   RFDICT_RE_MAXSTATES states
+ */
+static int rfdict_re_compile(RFDICT_RE *pRe) {
+  
+  RFDICT_RE_NODE *pN = NULL;
+  long *pSwap = NULL;
+  long nmove = 0;
+  long nprev = 0;
+  long prev_t = -1;
+  long t = -1;
+  long s = 0;
+  long i = 0;
+  int c = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if (pRe == NULL) {
+    abort();
+  }
+  
+  /* Allocate work arrays; the hash table has room for the most states
+   * at half load */
+  pRe->pMark = (long *) calloc((size_t) pRe->nodes, sizeof(long));
+  pRe->pStack = (long *) malloc(((size_t) pRe->nodes) * sizeof(long));
+  pRe->pMove = (long *) malloc(((size_t) pRe->nodes) * sizeof(long));
+  pRe->pPrevMove = (long *) malloc(((size_t) pRe->nodes) * sizeof(long));
+  pRe->slots = 2 * RFDICT_RE_MAXSTATES;
+  pRe->pSlot = (long *) malloc(((size_t) pRe->slots) * sizeof(long));
+  if ((pRe->pMark == NULL) || (pRe->pStack == NULL) ||
+      (pRe->pMove == NULL) || (pRe->pPrevMove == NULL) ||
+      (pRe->pSlot == NULL)) {
+    abort();
+  }
+  for(i = 0; i < pRe->slots; i++) {
+    (pRe->pSlot)[i] = -1;
+  }
+  
+  /* Add the start state */
+  if (rfdict_re_state(pRe, &(pRe->start), 1) != 0) {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Compute the transitions of each state in turn, which adds the
+   * states they lead to; neighboring bytes usually move to the same
+   * nodes, so the last result is reused when they do */
+  for(s = 0; status && (s < pRe->dstates); s++) {
+    nprev = -1;
+    (pRe->pTrans)[s * 256] = -1;
+    for(c = 1; c < 256; c++) {
+      nmove = 0;
+      for(i = 0; i < (pRe->pCount)[s]; i++) {
+        pN = &((pRe->pNode)[(pRe->pList)[(pRe->pOffset)[s] + i]]);
+        if ((pN->type == RFDICT_RE_SET) &&
+            ((pN->aSet)[c >> 3] & (1 << (c & 7)))) {
+          (pRe->pMove)[nmove++] = pN->out1;
+        }
+      }
+      
+      if ((nmove == nprev) &&
+          (memcmp(pRe->pMove, pRe->pPrevMove,
+                  ((size_t) nmove) * sizeof(long)) == 0)) {
+        t = prev_t;
+      } else if (nmove == 0) {
+        t = -1;
+      } else {
+        t = rfdict_re_state(pRe, pRe->pMove, nmove);
+        if (t < 0) {
+          status = 0;
+          break;
+        }
+      }
+      (pRe->pTrans)[s * 256 + c] = t;
+      
+      pSwap = pRe->pPrevMove;
+      pRe->pPrevMove = pRe->pMove;
+      pRe->pMove = pSwap;
+      nprev = nmove;
+      prev_t = t;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Release the memory of a pattern compiler.
+ * 
+ * Parameters:
+ * 
+ *   pRe - the pattern compiler
+ */
+static void rfdict_re_release(RFDICT_RE *pRe) {
+  
+  /* Check parameters */
+  if (pRe == NULL) {
+    abort();
+  }
+  
+  free(pRe->pNode);
+  free(pRe->pMark);
+  free(pRe->pStack);
+  free(pRe->pMove);
+  free(pRe->pPrevMove);
+  free(pRe->pList);
+  free(pRe->pOffset);
+  free(pRe->pCount);
+  free(pRe->pTrans);
+  free(pRe->pAccept);
+  free(pRe->pSlot);
+  memset(pRe, 0, sizeof(RFDICT_RE));
+}
+
+/*
+ * Get a string from a string pool, adding it if it is not there yet,
+ * and take a reference to it.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ *   pKey - the string
+ * 
+ *   fold - non-zero to map lowercase letters in the string to uppercase
+ * 
+ * Return:
+ * 
+ *   the pooled copy of the string
+ */
+static const char *rfdict_pool_acquire(
+    RFDICT_POOL * pPool,
+    const char  * pKey,
+    int           fold) {
+  
+  RFDICT_POOL_ENTRY *pEntry = NULL;
+  RFDICT_POOL_ENTRY *pMove = NULL;
+  RFDICT_POOL_ENTRY *pNext = NULL;
+  RFDICT_POOL_ENTRY **ppNew = NULL;
+  const char *pa = NULL;
+  const char *pb = NULL;
+  unsigned long h = 0;
+  unsigned long h2 = 0;
+  unsigned long newslots = 0;
+  unsigned long i = 0;
+  size_t slen = 0;
+  char *pc = NULL;
+  
+  /* Check parameters */
+  if ((pPool == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Look for the string in its hash chain, folding as we compare */
+  rfdict_hash(pKey, !fold, &h, &h2);
+  for(pEntry = (pPool->ppSlot)[h & (pPool->slots - 1)];
+      pEntry != NULL;
+      pEntry = pEntry->pNext) {
+    if (pEntry->hash == h) {
+      pb = &((pEntry->str)[0]);
+      for(pa = pKey; *pa != 0; pa++) {
+        if (fold && (*pa >= ASCII_LOWER_A) && (*pa <= ASCII_LOWER_Z)) {
+          if (*pb != *pa - (ASCII_LOWER_A - ASCII_UPPER_A)) {
+            break;
+          }
+        } else if (*pb != *pa) {
+          break;
+        }
+        pb++;
+      }
+      if ((*pa == 0) && (*pb == 0)) {
+        break;
+      }
+    }
+  }
+  
+  if (pEntry == NULL) {
+    /* Add a new entry */
+    slen = strlen(pKey);
+    pEntry = (RFDICT_POOL_ENTRY *) malloc(
+                sizeof(RFDICT_POOL_ENTRY) + slen);
+    if (pEntry == NULL) {
+      abort();
+    }
+    memset(pEntry, 0, sizeof(RFDICT_POOL_ENTRY));
+    strcpy(&((pEntry->str)[0]), pKey);
+    if (fold) {
+      for(pc = &((pEntry->str)[0]); *pc != 0; pc++) {
+        if ((*pc >= ASCII_LOWER_A) && (*pc <= ASCII_LOWER_Z)) {
+          *pc = *pc - (ASCII_LOWER_A - ASCII_UPPER_A);
+        }
+      }
+    }
+    pEntry->pPool = pPool;
+    pEntry->hash = h;
+    pEntry->refs = 0;
+    pEntry->pNext = (pPool->ppSlot)[h & (pPool->slots - 1)];
+    (pPool->ppSlot)[h & (pPool->slots - 1)] = pEntry;
+    (pPool->count)++;
+    pPool->nbytes += slen + 1;
+    
+    /* Double the table when the chains get long */
+    if (((unsigned long) pPool->count) > pPool->slots) {
+      newslots = pPool->slots * 2;
+      ppNew = (RFDICT_POOL_ENTRY **) calloc(
+                (size_t) newslots, sizeof(RFDICT_POOL_ENTRY *));
+      if (ppNew == NULL) {
+        abort();
+      }
+      for(i = 0; i < pPool->slots; i++) {
+        for(pMove = (pPool->ppSlot)[i]; pMove != NULL; pMove = pNext) {
+          pNext = pMove->pNext;
+          pMove->pNext = ppNew[pMove->hash & (newslots - 1)];
+          ppNew[pMove->hash & (newslots - 1)] = pMove;
+        }
+      }
+      free(pPool->ppSlot);
+      pPool->ppSlot = ppNew;
+      pPool->slots = newslots;
+    }
+  }
+  
+  (pEntry->refs)++;
+  return &((pEntry->str)[0]);
+}
+
+/*
+ * Release a reference to a pooled string, freeing the string if it has
+ * no more references.
+ * 
+ * Parameters:
+ * 
+ *   pKey - the pooled string
+ */
+static void rfdict_pool_release(const char *pKey) {
+  
+  RFDICT_POOL_ENTRY *pEntry = NULL;
+  RFDICT_POOL_ENTRY **ppLink = NULL;
+  RFDICT_POOL *pPool = NULL;
+  
+  /* Check parameters */
+  if (pKey == NULL) {
+    abort();
+  }
+  
+  /* Get the entry from its string */
+  pEntry = (RFDICT_POOL_ENTRY *)
+              (pKey - offsetof(RFDICT_POOL_ENTRY, str));
+  if (pEntry->refs < 1) {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Drop the reference, and unlink and free the entry if it was the
+   * last one */
+  (pEntry->refs)--;
+  if (pEntry->refs == 0) {
+    pPool = pEntry->pPool;
+    for(ppLink = &((pPool->ppSlot)[pEntry->hash & (pPool->slots - 1)]);
+        *ppLink != pEntry;
+        ppLink = &((*ppLink)->pNext)) {
+      if (*ppLink == NULL) {
+        abort();  /* shouldn't happen */
+      }
+    }
+    *ppLink = pEntry->pNext;
+    (pPool->count)--;
+    pPool->nbytes -= strlen(pKey) + 1;
+    free(pEntry);
+  }
+}
+
+/*
+ * Release a handle to a string pool, freeing the pool if it has no
+ * more handles.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ */
+static void rfdict_pool_drop(RFDICT_POOL *pPool) {
+  
+  /* Check parameters */
+  if ((pPool == NULL) || (pPool->refs < 1)) {
+    abort();
+  }
+  
+  (pPool->refs)--;
+  if (pPool->refs == 0) {
+    if (pPool->count != 0) {
+      abort();  /* shouldn't happen */
+    }
+    free(pPool->ppSlot);
+    free(pPool);
+  }
+}
+
+/*
+ * Set the key of a node that is not linked into the tree.
+ * 
+ * If the dictionary has a string pool, the node points to the pooled
+ * copy of the key.  Otherwise, the key is copied into the node, which
+ * must have room for it.  In case-insensitive dictionaries, lowercase
+ * letters are mapped to uppercase.  Fixed-width keys are copied as
+ * they are, and followed by a null.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the node
+ * 
+ *   pKey - the key
+ * 
+ *   pooled - non-zero if pKey is itself a pooled string, which may
+ *   belong to any pool
+ */
+static void rfdict_setkey(
+    RFDICT      * pDict,
+    RFDICT_NODE * pNode,
+    const char  * pKey,
+    int           pooled) {
+  
+  RFDICT_POOL_ENTRY *pEntry = NULL;
+  const char *pa = NULL;
+  char *pc = NULL;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pNode == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  if (pDict->pPool != NULL) {
+    /* Share the string directly if it is already in the same pool and
+     * needs no case mapping, else look it up */
+    if (pooled) {
+      pEntry = (RFDICT_POOL_ENTRY *)
+                  (pKey - offsetof(RFDICT_POOL_ENTRY, str));
+      if (pEntry->pPool != pDict->pPool) {
+        pEntry = NULL;
+      }
+    }
+    if ((pEntry != NULL) && (pDict->sensitive == 0)) {
+      for(pa = pKey; *pa != 0; pa++) {
+        if ((*pa >= ASCII_LOWER_A) && (*pa <= ASCII_LOWER_Z)) {
+          pEntry = NULL;
+          break;
+        }
+      }
+    }
+    if (pEntry != NULL) {
+      (pEntry->refs)++;
+      pNode->pKey = pKey;
+    } else {
+      pNode->pKey = rfdict_pool_acquire(
+                      pDict->pPool, pKey, (pDict->sensitive == 0));
+    }
+    
+  } else if (pDict->width > 0) {
+    /* Copy the bytes into the node */
+    memcpy(&((pNode->key)[0]), pKey, pDict->width);
+    (pNode->key)[pDict->width] = 0;
+    pNode->pKey = &((pNode->key)[0]);
+    
+  } else {
+    /* Copy the string into the node */
+    strcpy(&((pNode->key)[0]), pKey);
+    if (pDict->sensitive == 0) {
+      for(pc = &((pNode->key)[0]); *pc != 0; pc++) {
+        if ((*pc >= ASCII_LOWER_A) && (*pc <= ASCII_LOWER_Z)) {
+          *pc = *pc - (ASCII_LOWER_A - ASCII_UPPER_A);
+        }
+      }
+    }
+    pNode->pKey = &((pNode->key)[0]);
+  }
+}
+
+/*
+ * Determine the size class of a node from its key.
+ * 
+ * Nodes with a pooled key do not hold the key, so they are always in
+ * the smallest class.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the node
+ * 
+ * Return:
+ * 
+ *   the size class index
+ */
+static int rfdict_nodeclass(RFDICT *pDict, RFDICT_NODE *pNode) {
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pNode == NULL)) {
+    abort();
+  }
+  
+  if (pNode->pKey != &((pNode->key)[0])) {
+    return rfdict_class(0);
+  }
+  if (pDict->width > 0) {
+    return rfdict_class(pDict->width);
+  }
+  return rfdict_class(strlen(pNode->pKey));
+}
+
+/*
+ * Determine the size of a node that would hold a key in a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key
+ * 
+ * Return:
+ * 
+ *   the node size in bytes
+ */
+static size_t rfdict_nodesize(RFDICT *pDict, const char *pKey) {
+  
+  size_t slen = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  if (pDict->width > 0) {
+    slen = pDict->width;
+  } else if (pDict->pPool == NULL) {
+    slen = strlen(pKey);
+  }
+  return (size_t) (RFDICT_CLASS_MIN << rfdict_class(slen));
+}
+
+/*
+ * Release the pooled keys of all nodes in the tree of a dictionary.
+ * 
+ * This does nothing if the dictionary has no string pool.  The tree is
+ * left unchanged, but its nodes must not be used afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ */
+static void rfdict_release_keys(RFDICT *pDict) {
+  
+  RFDICT_NODE *pNode = NULL;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  if (pDict->pPool != NULL) {
+    for(pNode = rfdict_first(pDict);
+        pNode != NULL;
+        pNode = rfdict_next(pNode)) {
+      rfdict_pool_release(pNode->pKey);
+    }
+  }
+}
+
+/*
+ * Check the fields of one node for rfdict_verify(), and its links to
+ * its children.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pNode - the node
+ * 
+ * Return:
+ * 
+ *   non-zero if the node is valid, zero if not
+ */
+static int rfdict_verify_node(RFDICT *pDict, RFDICT_NODE *pNode) {
+  
+  const char *pc = NULL;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pNode == NULL)) {
+    abort();
+  }
+  
+  /* Children must point back to the node, and a red node may not have a
+   * red child */
+  if (pNode->pLeft != NULL) {
+    if (((pNode->pLeft)->pParent != pNode) ||
+        (pNode->red && (pNode->pLeft)->red)) {
+      status = 0;
+    }
+  }
+  if (pNode->pRight != NULL) {
+    if (((pNode->pRight)->pParent != pNode) ||
+        (pNode->red && (pNode->pRight)->red)) {
+      status = 0;
+    }
+  }
+  
+  /* The key must be in the pool exactly when the dictionary has one,
+   * must not be too long, and must be case-mapped if necessary; the
+   * bytes of fixed-width keys may be anything */
+  if (status) {
+    if ((pNode->pKey == NULL) ||
+        ((pNode->pKey != &((pNode->key)[0])) != (pDict->pPool != NULL))) {
+      status = 0;
+    }
+  }
+  if (status && (pDict->width == 0)) {
+    for(pc = pNode->pKey; *pc != 0; pc++) {
+      if ((pc - pNode->pKey >= RFDICT_MAXKEY) ||
+          ((!(pDict->sensitive)) &&
+            (*pc >= ASCII_LOWER_A) && (*pc <= ASCII_LOWER_Z))) {
+        status = 0;
+        break;
+      }
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Verify one part of a tree for rfdict_verify().
+ * 
+ * The subtree is walked in order with an explicit stack, so the walk
+ * does not recurse however deep the tree is.  If limit is not negative,
+ * nodes at that depth below the root of the subtree are not walked;
+ * instead, the results of verifying their subtrees are taken in order
+ * from pSub.
+ * 
+ * Parameters:
+ * 
+ *   pPart - the part, with pRoot and pDict set, which receives the
+ *   results
+ * 
+ *   limit - the depth at which results are taken from pSub, or -1
+ * 
+ *   pSub - the results for nodes at the limit depth, or NULL
+ * 
+ *   nsub - the number of elements of pSub
+ */
+static void rfdict_verify_walk(
+    RFDICT_VERIFY_PART * pPart,
+    int                  limit,
+    RFDICT_VERIFY_PART * pSub,
+    long                 nsub) {
+  
+  RFDICT_NODE *apStack[RFDICT_VERIFY_MAXDEPTH];
+  int aAbove[RFDICT_VERIFY_MAXDEPTH];
+  int aDepth[RFDICT_VERIFY_MAXDEPTH];
+  RFDICT *pDict = NULL;
+  RFDICT_NODE *pNode = NULL;
+  const char *pPrev = NULL;
+  long isub = 0;
+  int exit_black = -1;
+  int above = 0;
+  int depth = 0;
+  int top = 0;
+  int v = 0;
+  int ok = 1;
+  
+  /* Check parameters */
+  if ((pPart == NULL) || (pPart->pDict == NULL) || (nsub < 0)) {
+    abort();
+  }
+  if ((pSub == NULL) && (nsub > 0)) {
+    abort();
+  }
+  
+  pDict = pPart->pDict;
+  pPart->count = 0;
+  pPart->nbytes = 0;
+  pPart->pFirst = NULL;
+  pPart->pLast = NULL;
+  
+  pNode = pPart->pRoot;
+  above = 0;
+  depth = 0;
+  while (ok) {
+    
+    /* Push the left spine, stopping at the limit depth; above is the
+     * number of black nodes above each node in the subtree */
+    while (pNode != NULL) {
+      if (top >= RFDICT_VERIFY_MAXDEPTH) {
+        ok = 0;
+        break;
+      }
+      apStack[top] = pNode;
+      aAbove[top] = above;
+      aDepth[top] = depth;
+      top++;
+      if (depth == limit) {
+        break;
+      }
+      if (!(pNode->red)) {
+        above++;
+      }
+      pNode = pNode->pLeft;
+      depth++;
+    }
+    if ((!ok) || (top < 1)) {
+      break;
+    }
+    
+    /* Take the next node in order */
+    top--;
+    pNode = apStack[top];
+    above = aAbove[top];
+    depth = aDepth[top];
+    
+    if (depth == limit) {
+      /* Merge the results of a subtree verified separately */
+      if ((isub >= nsub) || (pSub[isub].pRoot != pNode)) {
+        abort();  /* shouldn't happen */
+      }
+      if (!(pSub[isub].ok)) {
+        ok = 0;
+        break;
+      }
+      pPart->count += pSub[isub].count;
+      pPart->nbytes += pSub[isub].nbytes;
+      if (pPrev != NULL) {
+        if (rfdict_dictcmp(pDict, pPrev, pSub[isub].pFirst) >= 0) {
+          ok = 0;
+        }
+      }
+      if (pPart->pFirst == NULL) {
+        pPart->pFirst = pSub[isub].pFirst;
+      }
+      pPrev = pSub[isub].pLast;
+      v = above + pSub[isub].black;
+      isub++;
+      
+      /* Nothing else to walk below this node */
+      pNode = NULL;
+      
+    } else {
+      /* Check the node itself and its order after the previous key */
+      if (!rfdict_verify_node(pDict, pNode)) {
+        ok = 0;
+        break;
+      }
+      if (pPrev != NULL) {
+        if (rfdict_dictcmp(pDict, pPrev, pNode->pKey) >= 0) {
+          ok = 0;
+        }
+      }
+      if (pPart->pFirst == NULL) {
+        pPart->pFirst = pNode->pKey;
+      }
+      pPrev = pNode->pKey;
+      (pPart->count)++;
+      pPart->nbytes += (size_t) (RFDICT_CLASS_MIN <<
+                                  rfdict_nodeclass(pDict, pNode));
+      
+      /* Black depth of any missing child, then continue on the right */
+      v = -1;
+      if (!(pNode->red)) {
+        above++;
+      }
+      if ((pNode->pLeft == NULL) || (pNode->pRight == NULL)) {
+        v = above;
+      }
+      pNode = pNode->pRight;
+      depth++;
+    }
+    
+    /* All paths to a missing child must have the same black depth */
+    if (v >= 0) {
+      if (exit_black < 0) {
+        exit_black = v;
+      } else if (exit_black != v) {
+        ok = 0;
+      }
+    }
+    
+    /* A tree can not have more nodes than the dictionary counts, which
+     * also stops the walk if the links form a cycle */
+    if (pPart->count > pDict->count) {
+      ok = 0;
+    }
+  }
+  
+  pPart->pLast = pPrev;
+  pPart->black = exit_black;
+  if (exit_black < 0) {
+    pPart->black = 0;
+  }
+  pPart->ok = ok;
+}
+
+#ifdef RFDICT_THREADS
+/*
+ * Thread entrypoint for verifying one part of a tree.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the RFDICT_VERIFY_PART to verify
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *rfdict_verify_thread(void *pArg) {
+  rfdict_verify_walk((RFDICT_VERIFY_PART *) pArg, -1, NULL, 0);
+  return NULL;
+}
+#endif
+
+/*
+ * Build part of the image of a freeze handle.
+ * 
+ * Up to n nodes of the dictionary are visited.  Once the image is
+ * complete, its values are packed and the phase becomes
+ * RFDICT_FREEZE_BUILT, but lookups are not switched over to it here,
+ * so this may run on a thread of its own while the dictionary serves
+ * lookups.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ *   n - the maximum number of nodes to visit
+ */
+static void rfdict_freeze_move(RFDICT_FREEZE *pFreeze, long n) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_NODE *pNode = NULL;
+  size_t slen = 0;
+  
+  /* Check parameters */
+  if ((pFreeze == NULL) || (n < 0)) {
+    abort();
+  }
+  
+  pDict = pFreeze->pDict;
+  for( ; (n > 0) && ((pFreeze->phase == RFDICT_FREEZE_COUNT) ||
+                      (pFreeze->phase == RFDICT_FREEZE_COPY)); n--) {
+    pNode = pFreeze->pNode;
+    
+    if (pFreeze->phase == RFDICT_FREEZE_COUNT) {
+      /* Count the key bytes, and allocate the image at the end */
+      if (pNode != NULL) {
+        pFreeze->keybytes += strlen(pNode->pKey) + 1;
+        pFreeze->pNode = rfdict_next(pNode);
+        
+      } else {
+        pFreeze->pBuild = rfdict_frozen_new(
+                            pDict->sensitive, 0, pDict->count,
+                            pFreeze->keybytes, 0);
+        if (pDict->count > 0) {
+          pFreeze->pVal = (long *) malloc(
+                            ((size_t) pDict->count) * sizeof(long));
+          if (pFreeze->pVal == NULL) {
+            abort();
+          }
+        }
+        pFreeze->phase = RFDICT_FREEZE_COPY;
+        pFreeze->pNode = rfdict_first(pDict);
+        pFreeze->keybytes = 0;
+        pFreeze->i = 0;
+      }
+      
+    } else {
+      /* Copy the keys and values, and pack the values at the end */
+      if (pNode != NULL) {
+        slen = strlen(pNode->pKey) + 1;
+        memcpy((pFreeze->pBuild)->pKeys + pFreeze->keybytes,
+                pNode->pKey, slen);
+        ((pFreeze->pBuild)->pOffset)[pFreeze->i] = pFreeze->keybytes;
+        (pFreeze->pVal)[pFreeze->i] = pNode->val;
+        pFreeze->keybytes += slen;
+        (pFreeze->i)++;
+        pFreeze->pNode = rfdict_next(pNode);
+        
+      } else {
+        rfdict_pack_init(&((pFreeze->pBuild)->val),
+                          pFreeze->pVal, (pFreeze->pBuild)->count);
+        free(pFreeze->pVal);
+        pFreeze->pVal = NULL;
+        pFreeze->phase = RFDICT_FREEZE_BUILT;
+      }
+    }
+  }
+}
+
+#ifdef RFDICT_THREADS
+/*
+ * Thread entrypoint for building the whole image of a freeze handle.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the RFDICT_FREEZE whose image to build
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *rfdict_freeze_thread(void *pArg) {
+  
+  RFDICT_FREEZE *pFreeze = NULL;
+  
+  pFreeze = (RFDICT_FREEZE *) pArg;
+  rfdict_freeze_move(pFreeze, LONG_MAX);
+  
+  if (pthread_mutex_lock(&(pFreeze->lock)) != 0) {
+    abort();
+  }
+  pFreeze->finished = 1;
+  if (pthread_mutex_unlock(&(pFreeze->lock)) != 0) {
+    abort();
+  }
+  
+  return NULL;
+}
+#endif
+
+/*
+ * Find the hash table slot of a key in an adaptive dictionary.
+ * 
+ * The hash table must be allocated.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   pKey - the key to look for
+ * 
+ * Return:
+ * 
+ *   the slot holding the node of the key, or the empty slot where it
+ *   would be stored if it is not in the table
+ */
+static RFDICT_NODE **rfdict_adapt_slot(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey) {
+  
+  RFDICT_NODE **ppSlot = NULL;
+  unsigned long h1 = 0;
+  unsigned long h2 = 0;
+  unsigned long mask = 0;
+  
+  /* Check parameters */
+  if ((pAdapt == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  if (pAdapt->ppSlot == NULL) {
+    abort();
+  }
+  
+  /* Probe linearly from the home slot; the table is never more than
+   * half full, so an empty slot is always reached */
+  rfdict_hash(pKey, pAdapt->sensitive, &h1, &h2);
+  mask = pAdapt->slots - 1;
+  for(h1 &= mask; ; h1 = (h1 + 1) & mask) {
+    ppSlot = &((pAdapt->ppSlot)[h1]);
+    if (*ppSlot == NULL) {
+      break;
+    }
+    if (rfdict_keycmp((*ppSlot)->pKey, pKey, pAdapt->sensitive) == 0) {
+      break;
+    }
+  }
+  
+  return ppSlot;
+}
+
+/*
+ * Discard the hash table of an adaptive dictionary, and if requested,
+ * start a new one sized for the current tree.
+ * 
+ * The new table is filled by later calls to rfdict_adapt_step().
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   rebuild - non-zero to start a new table, zero to leave none
+ */
+static void rfdict_adapt_index(RFDICT_ADAPT *pAdapt, int rebuild) {
+  
+  unsigned long slots = 0;
+  
+  /* Check parameters */
+  if (pAdapt == NULL) {
+    abort();
+  }
+  
+  /* Discard the current table */
+  free(pAdapt->ppSlot);
+  pAdapt->ppSlot = NULL;
+  pAdapt->slots = 0;
+  pAdapt->filled = 0;
+  pAdapt->pIndex = NULL;
+  
+  /* Start a new table at most a quarter full, so that it serves at
+   * least as many inserts as the walk takes steps to fill it */
+  if (rebuild) {
+    slots = 16;
+    while (slots < 4 * ((unsigned long) (pAdapt->pTree)->count)) {
+      slots *= 2;
+    }
+    pAdapt->ppSlot = (RFDICT_NODE **) calloc(
+                        (size_t) slots, sizeof(RFDICT_NODE *));
+    if (pAdapt->ppSlot == NULL) {
+      abort();
+    }
+    pAdapt->slots = slots;
+    pAdapt->pIndex = rfdict_first(pAdapt->pTree);
+  }
+}
+
+/*
+ * Move an adaptive dictionary towards a given engine.
+ * 
+ * No move may be in progress.  Leaving the frozen engine always moves
+ * to the tree engine first.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   engine - the engine to move to
+ */
+static void rfdict_adapt_move(RFDICT_ADAPT *pAdapt, int engine) {
+  
+  /* Check parameters */
+  if (pAdapt == NULL) {
+    abort();
+  }
+  
+  if (pAdapt->engine == RFDICT_ENGINE_FROZEN) {
+    /* Free the frozen tree if that has not happened yet, then take the
+     * keys inserted since freezing as the new tree, and move the image
+     * into it */
+    rfdict_free(pAdapt->pTree);
+    pAdapt->pTree = (pAdapt->pFreeze)->pPending;
+    (pAdapt->pFreeze)->pPending = NULL;
+    pAdapt->thaw = 0;
+    pAdapt->engine = RFDICT_ENGINE_TREE;
+    
+  } else if (engine == RFDICT_ENGINE_FROZEN) {
+    rfdict_adapt_index(pAdapt, 0);
+    pAdapt->pFreeze = rfdict_freeze_async(
+                        pAdapt->pTree, RFDICT_FREEZE_QUEUE);
+    pAdapt->engine = RFDICT_ENGINE_FROZEN;
+    
+  } else if (engine == RFDICT_ENGINE_HASH) {
+    rfdict_adapt_index(pAdapt, 1);
+    pAdapt->engine = RFDICT_ENGINE_HASH;
+    
+  } else if (engine == RFDICT_ENGINE_TREE) {
+    rfdict_adapt_index(pAdapt, 0);
+    pAdapt->engine = RFDICT_ENGINE_TREE;
+    
+  } else {
+    abort();  /* shouldn't happen */
+  }
+  
+  ((pAdapt->stats).migrations)++;
+}
+
+/*
+ * Advance any move in progress in an adaptive dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ */
+static void rfdict_adapt_step(RFDICT_ADAPT *pAdapt) {
+  
+  RFDICT_FROZEN *pImage = NULL;
+  RFDICT_NODE **ppSlot = NULL;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pAdapt == NULL) {
+    abort();
+  }
+  
+  /* Fill the hash table */
+  for(i = 0; (i < RFDICT_ADAPT_STEP) && (pAdapt->pIndex != NULL); i++) {
+    ppSlot = rfdict_adapt_slot(pAdapt, (pAdapt->pIndex)->pKey);
+    if (*ppSlot != NULL) {
+      abort();  /* shouldn't happen */
+    }
+    *ppSlot = pAdapt->pIndex;
+    (pAdapt->filled)++;
+    pAdapt->pIndex = rfdict_next(pAdapt->pIndex);
+  }
+  
+  /* Advance the image, and free the frozen tree once it is complete */
+  if ((pAdapt->pFreeze != NULL) && (pAdapt->thaw < 0) &&
+      (pAdapt->pTree != NULL)) {
+    if (rfdict_freeze_step(pAdapt->pFreeze, RFDICT_FREEZE_STEP)) {
+      rfdict_free(pAdapt->pTree);
+      pAdapt->pTree = NULL;
+    }
+  }
+  
+  /* Move the image into the new tree, and release it at the end */
+  if (pAdapt->thaw >= 0) {
+    pImage = rfdict_freeze_image(pAdapt->pFreeze);
+    for(i = 0; (i < RFDICT_ADAPT_STEP) &&
+                (pAdapt->thaw < pImage->count); i++) {
+      if (!rfdict_insert(
+            pAdapt->pTree,
+            pImage->pKeys + (pImage->pOffset)[pAdapt->thaw],
+            rfdict_pack_get(&(pImage->val), pAdapt->thaw))) {
+        abort();  /* shouldn't happen */
+      }
+      (pAdapt->thaw)++;
+    }
+    if (pAdapt->thaw >= pImage->count) {
+      rfdict_freeze_free(pAdapt->pFreeze);
+      pAdapt->pFreeze = NULL;
+      pAdapt->thaw = -1;
+    }
+  }
+}
+
+/*
+ * Account for an operation on an adaptive dictionary, and at the end
+ * of each window, choose the engine for the observed workload.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   write - non-zero for an insert, zero for a lookup
+ */
+static void rfdict_adapt_note(RFDICT_ADAPT *pAdapt, int write) {
+  
+  long ratio = 0;
+  int engine = 0;
+  
+  /* Check parameters */
+  if (pAdapt == NULL) {
+    abort();
+  }
+  
+  /* Update the statistics */
+  if (write) {
+    (pAdapt->writes)++;
+    ((pAdapt->stats).writes)++;
+  } else {
+    (pAdapt->reads)++;
+    ((pAdapt->stats).reads)++;
+  }
+  
+  /* At the end of each window, choose the engine */
+  if (pAdapt->reads + pAdapt->writes >= RFDICT_ADAPT_WINDOW) {
+    
+    /* Get the lookups per insert, or the window size if there were no
+     * inserts */
+    if (pAdapt->writes > 0) {
+      ratio = pAdapt->reads / pAdapt->writes;
+    } else {
+      ratio = RFDICT_ADAPT_WINDOW;
+    }
+    pAdapt->reads = 0;
+    pAdapt->writes = 0;
+    
+    /* Choose the engine */
+    if ((pAdapt->freeze_ratio > 0) &&
+        (ratio >= pAdapt->freeze_ratio)) {
+      engine = RFDICT_ENGINE_FROZEN;
+    } else if ((pAdapt->hash_ratio > 0) &&
+                (ratio >= pAdapt->hash_ratio)) {
+      engine = RFDICT_ENGINE_HASH;
+    } else {
+      engine = RFDICT_ENGINE_TREE;
+    }
+    
+    /* Start moving if the engine differs and no move is in progress */
+    if ((engine != pAdapt->engine) && (pAdapt->pIndex == NULL) &&
+        (pAdapt->thaw < 0) && ((pAdapt->pFreeze == NULL) ||
+          rfdict_freeze_done(pAdapt->pFreeze))) {
+      rfdict_adapt_move(pAdapt, engine);
+    }
+  }
+}
+
+/*
+ * Get the histogram bucket of a latency.
+ * 
+ * Latencies below 32 nanoseconds each have their own bucket.  Above
+ * that, each power of two range is split into 16 buckets of equal
+ * width, so each bucket is within about six percent of the latencies
+ * it counts.
+ * 
+ * Parameters:
+ * 
+ *   ns - the latency in nanoseconds, which must fit in 32 bits
+ * 
+ * Return:
+ * 
+ *   the bucket index
+ */
+static int rfdict_histogram_index(unsigned long ns) {
+  
+  int m = 0;
+  int result = 0;
+  
+  if (ns < 32) {
+    result = (int) ns;
+    
+  } else {
+    /* Find the position of the most significant bit, then take the
+     * four bits below it */
+    for(m = 5; (m < 31) && ((ns >> (m + 1)) != 0); m++);
+    result = 16 * (m - 3) + ((int) ((ns >> (m - 4)) & 0xf));
+  }
+  
+  return result;
+}
+
+/*
+ * Read the monotonic clock in nanoseconds.
+ * 
+ * This is only available when the library is compiled with
+ * RFDICT_TIMING defined; otherwise a fault occurs.
+ * 
+ * Return:
+ * 
+ *   the clock reading, which wraps around
+ */
+static unsigned long rfdict_clock(void) {
+  
+#ifdef RFDICT_TIMING
+  struct timespec ts;
+  
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    abort();
+  }
+  return ((unsigned long) ts.tv_sec) * 1000000000UL +
+          ((unsigned long) ts.tv_nsec);
+#else
+  abort();  /* shouldn't happen */
+  return 0;
+#endif
+}
+
+/*
+ * Decide whether to time an operation on a dictionary, and if so,
+ * read the clock.
+ * 
+ * One operation of each type in every sampling interval is timed.
+ * The countdown is not synchronized, which is why timed dictionaries
+ * do not allow concurrent lookups.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary, which must have a timer
+ * 
+ *   op - the RFDICT_OP_ constant of the operation
+ * 
+ *   pStart - receives the clock reading if the operation is timed
+ * 
+ * Return:
+ * 
+ *   non-zero if the operation is timed, zero if not
+ */
+static int rfdict_timer_start(
+    RFDICT        * pDict,
+    int             op,
+    unsigned long * pStart) {
+  
+  RFDICT_TIMER *pTimer = NULL;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pStart == NULL) ||
+      (op < 0) || (op >= RFDICT_NOPS)) {
+    abort();
+  }
+  
+  pTimer = pDict->pTimer;
+  ((pTimer->aCountdown)[op])--;
+  if ((pTimer->aCountdown)[op] <= 0) {
+    (pTimer->aCountdown)[op] = pTimer->sample;
+    *pStart = rfdict_clock();
+    result = 1;
+  }
+  
+  return result;
+}
+
+/*
+ * Record the latency of a timed operation on a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary, which must have a timer
+ * 
+ *   op - the RFDICT_OP_ constant of the operation
+ * 
+ *   start - the clock reading from rfdict_timer_start()
+ */
+static void rfdict_timer_stop(RFDICT *pDict, int op, unsigned long start) {
+  
+  RFDICT_HISTOGRAM *pHist = NULL;
+  unsigned long ns = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (op < 0) || (op >= RFDICT_NOPS)) {
+    abort();
+  }
+  
+  /* Latencies beyond the range of the histogram count in the last
+   * bucket */
+  ns = rfdict_clock() - start;
+  if (ns > 0xffffffffUL) {
+    ns = 0xffffffffUL;
+  }
+  pHist = &(((pDict->pTimer)->aHist)[op]);
+  (pHist->count)++;
+  ((pHist->buckets)[rfdict_histogram_index(ns)])++;
+}
+
+/*
+ * Hash a gram for the hash table of a codec.
+ * 
+ * Parameters:
+ * 
+ *   pGram - the bytes of the gram
+ * 
+ *   len - the length of the gram
+ * 
+ * Return:
+ * 
+ *   the hash value
+ */
+static unsigned long rfdict_codec_hash(
+    const unsigned char * pGram,
+    int                   len) {
+  
+  unsigned long h = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pGram == NULL) || (len < 0) || (len > RFDICT_CODEC_GRAMLEN)) {
+    abort();
+  }
+  
+  /* Combine the bytes and mix them */
+  h = (unsigned long) len;
+  for(i = 0; i < len; i++) {
+    h = ((h << 8) | ((unsigned long) pGram[i])) & 0xffffffffUL;
+  }
+  h = (h * 2654435761UL) & 0xffffffffUL;
+  h ^= h >> 15;
+  
+  return h;
+}
+
+/*
+ * Find a gram among the symbols of a codec.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ *   pGram - the bytes of the gram
+ * 
+ *   len - the length of the gram, at least two
+ * 
+ * Return:
+ * 
+ *   the symbol, or zero if the gram is not a symbol
+ */
+static long rfdict_codec_find(
+    RFDICT_CODEC        * pCodec,
+    const unsigned char * pGram,
+    int                   len) {
+  
+  unsigned long h = 0;
+  long s = 0;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pGram == NULL) ||
+      (len < 2) || (len > RFDICT_CODEC_GRAMLEN)) {
+    abort();
+  }
+  
+  /* Probe the slots from the hashed position */
+  for(h = rfdict_codec_hash(pGram, len) & (pCodec->slots - 1);
+      (pCodec->pSlot)[h] != 0;
+      h = (h + 1) & (pCodec->slots - 1)) {
+    s = (pCodec->pSlot)[h];
+    if ((((int) (pCodec->pSymLen)[s]) == len) &&
+        (memcmp(pCodec->pSymStr + s * RFDICT_CODEC_GRAMLEN,
+                pGram, (size_t) len) == 0)) {
+      result = s;
+      break;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Find the code for the start of a key in a codec.
+ * 
+ * The longest symbol that is a prefix of the key is found, and then
+ * the gap of that symbol that the key falls in, by comparing the key
+ * to the children of the symbol.  None of the children can be a prefix
+ * of the key, or it would be a longer symbol that is.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ *   pKey - the rest of the key, which may not be empty
+ * 
+ *   pUsed - receives the number of bytes of the key that the code
+ *   consumes
+ * 
+ * Return:
+ * 
+ *   the code index
+ */
+static long rfdict_codec_next(
+    RFDICT_CODEC * pCodec,
+    const char   * pKey,
+    size_t       * pUsed) {
+  
+  unsigned char a[RFDICT_CODEC_GRAMLEN];
+  long s = 0;
+  long g = 0;
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  int n = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pKey == NULL) || (pUsed == NULL)) {
+    abort();
+  }
+  if (*pKey == 0) {
+    abort();
+  }
+  
+  /* Take the next bytes with case mapping if necessary; bytes past the
+   * end of the key are null, which sorts before any symbol byte */
+  memset(a, 0, RFDICT_CODEC_GRAMLEN);
+  for(n = 0; (n < RFDICT_CODEC_GRAMLEN) && (pKey[n] != 0); n++) {
+    c = (int) ((unsigned char) pKey[n]);
+    if ((!(pCodec->sensitive)) &&
+        (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    a[n] = (unsigned char) c;
+  }
+  
+  /* Find the longest symbol that is a prefix, which is at least the
+   * first byte */
+  s = (long) a[0];
+  for( ; n >= 2; n--) {
+    g = rfdict_codec_find(pCodec, a, n);
+    if (g != 0) {
+      s = g;
+      break;
+    }
+  }
+  
+  /* Find the gap, which is the number of children less than the key;
+   * symbols are padded with nulls like the bytes of the key */
+  lo = (pCodec->pChildAt)[s];
+  hi = (pCodec->pChildAt)[s + 1];
+  while (lo < hi) {
+    mid = lo + ((hi - lo) / 2);
+    if (memcmp(a,
+          pCodec->pSymStr +
+            (pCodec->pChild)[mid] * RFDICT_CODEC_GRAMLEN,
+          RFDICT_CODEC_GRAMLEN) > 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  *pUsed = (size_t) (pCodec->pSymLen)[s];
+  return (pCodec->pGap)[
+            (pCodec->pChildAt)[s] + s + (lo - (pCodec->pChildAt)[s])];
+}
+
+/*
+ * Number the gaps of a symbol and all its descendants in a codec, in
+ * the order of their intervals.
+ * 
+ * The recursion is no deeper than the longest gram.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ *   s - the symbol
+ * 
+ *   pNext - the next code index, which is advanced past the gaps
+ */
+static void rfdict_codec_visit(
+    RFDICT_CODEC * pCodec,
+    long           s,
+    long         * pNext) {
+  
+  long base = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (s < 1) || (s >= pCodec->nsym) ||
+      (pNext == NULL)) {
+    abort();
+  }
+  
+  /* The gap before the first child, then each child followed by the
+   * gap after it */
+  base = (pCodec->pChildAt)[s] + s;
+  (pCodec->pGap)[base] = *pNext;
+  (pCodec->pCodeSym)[*pNext] = s;
+  (*pNext)++;
+  for(i = (pCodec->pChildAt)[s]; i < (pCodec->pChildAt)[s + 1]; i++) {
+    rfdict_codec_visit(pCodec, (pCodec->pChild)[i], pNext);
+    (pCodec->pGap)[base + (i - (pCodec->pChildAt)[s]) + 1] = *pNext;
+    (pCodec->pCodeSym)[*pNext] = s;
+    (*pNext)++;
+  }
+}
+
+/*
+ * Assign codes to a range of code indices in a codec.
+ * 
+ * The range is split where the weights on either side are closest to
+ * even, the left part taking a zero bit and the right part a one bit,
+ * and each part is split in turn.  This gives codes in the order of
+ * their indices, with lengths within two bits of the ideal for their
+ * weights, and they form a complete prefix code.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ *   pSum - the running totals of the weights, where the weight of
+ *   index i is pSum[i + 1] - pSum[i]
+ * 
+ *   lo - the first index of the range
+ * 
+ *   hi - one past the last index of the range
+ * 
+ *   code - the bits shared by the range
+ * 
+ *   len - the number of bits shared by the range
+ */
+static void rfdict_codec_split(
+    RFDICT_CODEC        * pCodec,
+    const unsigned long * pSum,
+    long                  lo,
+    long                  hi,
+    unsigned long         code,
+    int                   len) {
+  
+  unsigned long half = 0;
+  long a = 0;
+  long b = 0;
+  long mid = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pSum == NULL) || (lo < 0) || (hi <= lo)) {
+    abort();
+  }
+  
+  if (hi - lo == 1) {
+    /* Single index, which takes the code */
+    (pCodec->pCode)[lo] = code;
+    (pCodec->pLen)[lo] = (unsigned char) len;
+    
+  } else {
+    /* The weights are bounded so the codes can't get too long */
+    if (len >= RFDICT_CODEC_BITS) {
+      abort();  /* shouldn't happen */
+    }
+    
+    /* Find the first split at which the left part has at least half
+     * the weight, and take the split before it if that is closer */
+    half = pSum[lo] + ((pSum[hi] - pSum[lo]) / 2);
+    a = lo + 1;
+    b = hi - 1;
+    while (a < b) {
+      mid = a + ((b - a) / 2);
+      if (pSum[mid] >= half) {
+        b = mid;
+      } else {
+        a = mid + 1;
+      }
+    }
+    if ((a > lo + 1) && (pSum[a] > half) &&
+        (half - pSum[a - 1] < pSum[a] - half)) {
+      a--;
+    }
+    
+    /* Split the range */
+    rfdict_codec_split(pCodec, pSum, lo, a, code << 1, len + 1);
+    rfdict_codec_split(pCodec, pSum, a, hi, (code << 1) | 1, len + 1);
+  }
+}
+
+/*
+ * Release a handle to a codec, freeing the codec if it has no more
+ * handles.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ */
+static void rfdict_codec_drop(RFDICT_CODEC *pCodec) {
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pCodec->refs < 1)) {
+    abort();
+  }
+  
+  (pCodec->refs)--;
+  if (pCodec->refs == 0) {
+    free(pCodec->pSymStr);
+    free(pCodec->pSymLen);
+    free(pCodec->pSlot);
+    free(pCodec->pChild);
+    free(pCodec->pChildAt);
+    free(pCodec->pGap);
+    free(pCodec->pCode);
+    free(pCodec->pLen);
+    free(pCodec->pCodeSym);
+    free(pCodec);
+  }
+}
+
+/*
+ * Insert a key into a dictionary, or optionally replace its value if
+ * it is already present.
+ * 
+ * The key must already be in the stored form of the dictionary, that
+ * is, compressed if the dictionary has a codec.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the stored key
+ * 
+ *   val - the value
+ * 
+ *   replace - non-zero to replace the value of a key that is already
+ *   present, zero to leave it alone
+ * 
+ * Return:
+ * 
+ *   non-zero if the key was inserted, zero if it was already present
+ */
+static int rfdict_put(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val,
+    int          replace) {
+  
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_NODE *pParent = NULL;
+  int dir = 0;
+  int status = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Make sure key size isn't too large */
+  if ((pDict->width == 0) && (strlen(pKey) > RFDICT_MAXKEY)) {
+    abort();
+  }
+  
+  /* Search for the key, and either update it or insert it at the
+   * attachment point found by the same descent */
+  pNode = rfdict_seek(pDict, pKey, &pParent, &dir);
+  if (pNode != NULL) {
+    if (replace) {
+      pNode->val = val;
+    }
+    status = 0;
+    
+  } else {
+    rfdict_attach(pDict, pKey, val, pParent, dir);
+    status = 1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Compress a key with the codec of a dictionary, and insert it with
+ * rfdict_put().
+ * 
+ * The buffer for the compressed key is large, so it is kept out of
+ * the stack frames of the public functions, which only call this when
+ * the dictionary has a codec.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary, which must have a codec
+ * 
+ *   pKey - the uncompressed key
+ * 
+ *   val - the value
+ * 
+ *   replace - passed to rfdict_put()
+ * 
+ * Return:
+ * 
+ *   the return value of rfdict_put()
+ */
+static int rfdict_coded_put(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val,
+    int          replace) {
+  
+  char aCode[RFDICT_CODEC_MAXCODE + 1];
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (pDict->pCodec == NULL)) {
+    abort();
+  }
+  
+  rfdict_codec_encode(pDict->pCodec, pKey, aCode);
+  return rfdict_put(pDict, aCode, val, replace);
+}
+
+/*
+ * Compress a key with the codec of a dictionary, and search for it
+ * with rfdict_find().
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary, which must have a codec
+ * 
+ *   pKey - the uncompressed key
+ * 
+ * Return:
+ * 
+ *   the dictionary node matching the key, or NULL if no node matches
+ *   the key
+ */
+static RFDICT_NODE *rfdict_coded_find(RFDICT *pDict, const char *pKey) {
+  
+  char aCode[RFDICT_CODEC_MAXCODE + 1];
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (pDict->pCodec == NULL)) {
+    abort();
+  }
+  
+  rfdict_codec_encode(pDict->pCodec, pKey, aCode);
+  return rfdict_find(pDict, aCode);
+}
+
+/*
+ * Compress a key with the codec of a dictionary, and search for it
+ * with rfdict_finger().
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary, which must have a codec
+ * 
+ *   pKey - the uncompressed key
+ * 
+ *   pHint - the node to start from, or NULL
+ * 
+ *   ppLast - receives the last node visited
+ * 
+ * Return:
+ * 
+ *   the dictionary node matching the key, or NULL if no node matches
+ *   the key
+ */
+static RFDICT_NODE *rfdict_coded_finger(
+    RFDICT       *  pDict,
+    const char   *  pKey,
+    RFDICT_NODE  *  pHint,
+    RFDICT_NODE  ** ppLast) {
+  
+  char aCode[RFDICT_CODEC_MAXCODE + 1];
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (pDict->pCodec == NULL)) {
+    abort();
+  }
+  
+  rfdict_codec_encode(pDict->pCodec, pKey, aCode);
+  return rfdict_finger(pDict, aCode, pHint, ppLast);
+}
+
+/*
+ * Compress a key with the codec of a frozen image, and search for it
+ * with rfdict_frozen_find().
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image, which must have a codec
+ * 
+ *   pKey - the uncompressed key
+ * 
+ * Return:
+ * 
+ *   the index of the key, or -1 if it is not present
+ */
+static long rfdict_coded_frozen_find(
+    RFDICT_FROZEN * pFrozen,
+    const char    * pKey) {
+  
+  char aCode[RFDICT_CODEC_MAXCODE + 1];
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pKey == NULL) ||
+      (pFrozen->pCodec == NULL)) {
+    abort();
+  }
+  
+  rfdict_codec_encode(pFrozen->pCodec, pKey, aCode);
+  return rfdict_frozen_find(pFrozen, aCode);
+}
+
+/* 
+ * Public functions
+ * ================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * rfdict_alloc function.
+ */
+RFDICT *rfdict_alloc(int sensitive) {
+  
+  RFDICT *pDict = NULL;
+  int c = 0;
+  
+  /* Allocate dictionary structure and clear it */
+  pDict = (RFDICT *) malloc(sizeof(RFDICT));
+  if (pDict == NULL) {
+    abort();
+  }
+  memset(pDict, 0, sizeof(RFDICT));
+  
+  /* Initialize the dictionary */
+  pDict->pRoot = NULL;
+  pDict->sensitive = sensitive;
+  for(c = 0; c < RFDICT_NCLASS; c++) {
+    (pDict->apFree)[c] = NULL;
+  }
+  pDict->pBlock = NULL;
+  pDict->pSpare = NULL;
+  pDict->count = 0;
+  pDict->epoch = 0;
+  pDict->freezes = 0;
+  pDict->nbytes = 0;
+  pDict->pPool = NULL;
+  pDict->pTimer = NULL;
+  pDict->width = 0;
+  pDict->pCodec = NULL;
+  
+  /* Return the dictionary */
+  return pDict;
+}
+
+/*
+ * rfdict_free function.
+ */
+void rfdict_free(RFDICT *pDict) {
+  
+  RFDICT_BLOCK *pBlock = NULL;
+  
+  /* Only perform operation if point is non-NULL */
+  if (pDict != NULL) {
+    
+    /* Release the pooled keys and the pool handle */
+    rfdict_release_keys(pDict);
+    if (pDict->pPool != NULL) {
+      rfdict_pool_drop(pDict->pPool);
+      pDict->pPool = NULL;
+    }
+    free(pDict->pTimer);
+    if (pDict->pCodec != NULL) {
+      rfdict_codec_drop(pDict->pCodec);
+      pDict->pCodec = NULL;
+    }
+    
+    /* All nodes, including recycled nodes, live within the blocks, so
+     * release all the blocks */
+    while (pDict->pBlock != NULL) {
+      pBlock = pDict->pBlock;
+      pDict->pBlock = pBlock->pNext;
+      free(pBlock->pAlloc);
+    }
+    while (pDict->pSpare != NULL) {
+      pBlock = pDict->pSpare;
+      pDict->pSpare = pBlock->pNext;
+      free(pBlock->pAlloc);
+    }
+    
+    /* We've released all nodes; now release the dictionary object */
+    free(pDict);
+  }
+}
+
+/*
+ * rfdict_clear function.
+ */
+void rfdict_clear(RFDICT *pDict) {
+  
+  RFDICT_BLOCK *pBlock = NULL;
+  int c = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* The dictionary may not change while it is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Release the pooled keys, which visits every key, since the pool
+   * counts references per key */
+  rfdict_release_keys(pDict);
+  
+  /* Move all blocks onto the spare list */
+  while (pDict->pBlock != NULL) {
+    pBlock = pDict->pBlock;
+    pDict->pBlock = pBlock->pNext;
+    
+    pBlock->used = 0;
+    pBlock->pNext = pDict->pSpare;
+    pDict->pSpare = pBlock;
+  }
+  
+  /* The free lists pointed into the blocks, so empty them */
+  for(c = 0; c < RFDICT_NCLASS; c++) {
+    (pDict->apFree)[c] = NULL;
+  }
+  
+  /* Dictionary is now empty */
+  pDict->pRoot = NULL;
+  pDict->count = 0;
+  pDict->nbytes = 0;
+  (pDict->epoch)++;
+}
+
+/*
+ * rfdict_insert function.
+ */
+int rfdict_insert(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val) {
+  
+  unsigned long start = 0;
+  int timed = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* The dictionary may not change while it is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Start timing if sampled */
+  if (pDict->pTimer != NULL) {
+    timed = rfdict_timer_start(pDict, RFDICT_OP_INSERT, &start);
+  }
+  
+  /* Insert the key, compressing it first if the dictionary is
+   * compressed; fail if key already present */
+  if (pDict->pCodec != NULL) {
+    status = rfdict_coded_put(pDict, pKey, val, 0);
+  } else {
+    status = rfdict_put(pDict, pKey, val, 0);
+  }
+  
+  /* Record the latency */
+  if (timed) {
+    rfdict_timer_stop(pDict, RFDICT_OP_INSERT, start);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * rfdict_get function.
+ */
+long rfdict_get(RFDICT *pDict, const char *pKey, long dvalue) {
+
+  RFDICT_NODE *pNode = NULL;
+  unsigned long start = 0;
+  int timed = 0;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Start timing if sampled */
+  if (pDict->pTimer != NULL) {
+    timed = rfdict_timer_start(pDict, RFDICT_OP_GET, &start);
+  }
+  
+  /* Search for the node, compressing the key first if the dictionary
+   * is compressed */
+  if (pDict->pCodec != NULL) {
+    pNode = rfdict_coded_find(pDict, pKey);
+  } else {
+    pNode = rfdict_find(pDict, pKey);
+  }
+  
+  /* If node found, take value from that; else, use dvalue */
+  if (pNode != NULL) {
+    result = pNode->val;
+  } else {
+    result = dvalue;
+  }
+  
+  /* Record the latency */
+  if (timed) {
+    rfdict_timer_stop(pDict, RFDICT_OP_GET, start);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * rfdict_cursor_init function.
+ */
+void rfdict_cursor_init(RFDICT_CURSOR *pCursor) {
+  
+  /* Check parameters */
+  if (pCursor == NULL) {
+    abort();
+  }
+  
+  /* Clear the cursor */
+  memset(pCursor, 0, sizeof(RFDICT_CURSOR));
+  pCursor->pDict = NULL;
+  pCursor->pNode = NULL;
+  pCursor->epoch = 0;
+}
+
+/*
+ * rfdict_get_hint function.
+ */
+long rfdict_get_hint(
+    RFDICT        * pDict,
+    const char    * pKey,
+    long            dvalue,
+    RFDICT_CURSOR * pCursor) {
+  
+  RFDICT_NODE *pHint = NULL;
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_NODE *pLast = NULL;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (pCursor == NULL)) {
+    abort();
+  }
+  
+  /* Only use the cursor if it was set on this dictionary since the
+   * last time nodes were taken out of the tree */
+  if ((pCursor->pDict == pDict) && (pCursor->epoch == pDict->epoch)) {
+    pHint = (RFDICT_NODE *) pCursor->pNode;
+  }
+  
+  /* Search for the node starting at the hint, compressing the key
+   * first if the dictionary is compressed */
+  if (pDict->pCodec != NULL) {
+    pNode = rfdict_coded_finger(pDict, pKey, pHint, &pLast);
+  } else {
+    pNode = rfdict_finger(pDict, pKey, pHint, &pLast);
+  }
+  
+  /* Move the cursor to where the search ended */
+  pCursor->pDict = pDict;
+  pCursor->pNode = pLast;
+  pCursor->epoch = pDict->epoch;
+  
+  /* If node found, take value from that; else, use dvalue */
+  if (pNode != NULL) {
+    result = pNode->val;
+  } else {
+    result = dvalue;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * rfdict_remove function.
+ */
+int rfdict_remove(RFDICT *pDict, const char *pKey) {
+  
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_NODE *pSucc = NULL;
+  RFDICT_NODE *pFix = NULL;
+  RFDICT_NODE *pFixParent = NULL;
+  int removed_red = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* The dictionary may not change while it is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Search for the node, compressing the key first if the dictionary
+   * is compressed */
+  if (pDict->pCodec != NULL) {
+    pNode = rfdict_coded_find(pDict, pKey);
+  } else {
+    pNode = rfdict_find(pDict, pKey);
+  }
+  if (pNode == NULL) {
+    status = 0;
+  }
+  
+  /* 
+   * Unlink the node from the tree.
+   * 
+   * If the node has at most one child, the child (or nothing) takes
+   * the place of the node, and the node's color is the color that was
+   * removed from the tree.
+   * 
+   * If the node has two children, its in-order successor (the leftmost
+   * node of its right subtree, which has no left child) takes the place
+   * and color of the node, and the successor's right child takes the
+   * old place of the successor.  The successor's color is then the
+   * color that was removed from the tree.  We relink nodes rather than
+   * copying keys, because keys are stored inside the nodes.
+   */
+  if (status) {
+    if (pNode->pLeft == NULL) {
+      /* No left child */
+      removed_red = pNode->red;
+      pFix = pNode->pRight;
+      pFixParent = pNode->pParent;
+      rfdict_transplant(pDict, pNode, pNode->pRight);
+      
+    } else if (pNode->pRight == NULL) {
+      /* No right child */
+      removed_red = pNode->red;
+      pFix = pNode->pLeft;
+      pFixParent = pNode->pParent;
+      rfdict_transplant(pDict, pNode, pNode->pLeft);
+      
+    } else {
+      /* Two children -- find the successor */
+      for(pSucc = pNode->pRight;
+          pSucc->pLeft != NULL;
+          pSucc = pSucc->pLeft);
+      
+      removed_red = pSucc->red;
+      pFix = pSucc->pRight;
+      
+      /* Detach the successor, unless it is the right child of the node,
+       * in which case it keeps its right subtree */
+      if (pSucc->pParent == pNode) {
+        pFixParent = pSucc;
+        
+      } else {
+        pFixParent = pSucc->pParent;
+        rfdict_transplant(pDict, pSucc, pSucc->pRight);
+        pSucc->pRight = pNode->pRight;
+        (pSucc->pRight)->pParent = pSucc;
+      }
+      
+      /* Successor takes the place and color of the node */
+      rfdict_transplant(pDict, pNode, pSucc);
+      pSucc->pLeft = pNode->pLeft;
+      (pSucc->pLeft)->pParent = pSucc;
+      pSucc->red = pNode->red;
+    }
+  }
+  
+  /* If a black node was removed, restore the black depth; then recycle
+   * the node */
+  if (status) {
+    if (!removed_red) {
+      rfdict_fixdel(pDict, pFix, pFixParent);
+    }
+    (pDict->count)--;
+    (pDict->epoch)++;
+    pDict->nbytes -= (size_t) (RFDICT_CLASS_MIN <<
+                        rfdict_nodeclass(pDict, pNode));
+    rfdict_recycle(pDict, pNode);
+    pNode = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * rfdict_get_ref function.
+ */
+long *rfdict_get_ref(RFDICT *pDict, const char *pKey) {
+  
+  RFDICT_NODE *pNode = NULL;
+  long *pResult = NULL;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Values may not be written while the dictionary is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Search for the node, compressing the key first if the dictionary
+   * is compressed, and point to its value if found */
+  if (pDict->pCodec != NULL) {
+    pNode = rfdict_coded_find(pDict, pKey);
+  } else {
+    pNode = rfdict_find(pDict, pKey);
+  }
+  if (pNode != NULL) {
+    pResult = &(pNode->val);
+  }
+  
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * rfdict_longest_prefix function.
+ */
+long *rfdict_longest_prefix(
+    RFDICT     * pDict,
+    const char * pText,
+    size_t       len,
+    size_t     * pMatched) {
+  
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_NODE *pCand = NULL;
+  RFDICT_NODE *pBest = NULL;
+  long *result = NULL;
+  size_t cand_lcp = 0;
+  size_t best_len = 0;
+  size_t lcp = 0;
+  size_t tlen = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pText == NULL) || (pMatched == NULL)) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  
+  /* Values may not be written while the dictionary is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Keys can not contain null bytes, so only the text before the first
+   * null can match */
+  for(tlen = 0; (tlen < len) && (pText[tlen] != 0); tlen++);
+  
+  /* Find the greatest key that is less than or equal to the text.  If
+   * that key is a prefix of the text, it is the longest such prefix,
+   * since keys sort before their extensions.  Otherwise, any matching
+   * prefix must be shorter than the common prefix of the text and that
+   * key, so search again with the text cut down to it.  Keys passed on
+   * the way down that are prefixes of the text are remembered, and if
+   * the longest of them is as long as the cut-down text, it is the
+   * answer without another search. */
+  *pMatched = 0;
+  while (result == NULL) {
+    pCand = NULL;
+    cand_lcp = 0;
+    pNode = pDict->pRoot;
+    while (pNode != NULL) {
+      retval = rfdict_textcmp(pText, tlen, pNode->pKey,
+                              pDict->sensitive, &lcp);
+      if (retval >= 0) {
+        pCand = pNode;
+        cand_lcp = lcp;
+        if (((pNode->pKey)[lcp] == 0) &&
+            ((pBest == NULL) || (lcp > best_len))) {
+          pBest = pNode;
+          best_len = lcp;
+        }
+        if (retval == 0) {
+          break;
+        }
+        pNode = pNode->pRight;
+      } else {
+        pNode = pNode->pLeft;
+      }
+    }
+    
+    if (pCand == NULL) {
+      break;
+    }
+    if ((pCand->pKey)[cand_lcp] == 0) {
+      result = &(pCand->val);
+      *pMatched = cand_lcp;
+    } else if ((pBest != NULL) && (best_len >= cand_lcp)) {
+      result = &(pBest->val);
+      *pMatched = best_len;
+    } else {
+      tlen = cand_lcp;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_upsert function.
+ */
+int rfdict_upsert(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val) {
+  
+  int status = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* The dictionary may not change while it is being frozen */
+  if (pDict->freezes > 0) {
+    abort();
+  }
+  
+  /* Update or insert the key, compressing it first if the dictionary
+   * is compressed */
+  if (pDict->pCodec != NULL) {
+    status = rfdict_coded_put(pDict, pKey, val, 1);
+  } else {
+    status = rfdict_put(pDict, pKey, val, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * rfdict_clone function.
+ */
+RFDICT *rfdict_clone(RFDICT *pDict) {
+  
+  RFDICT *pCopy = NULL;
+  RFDICT_BLOCK *pBlock = NULL;
+  RFDICT_NODE *pSrc = NULL;
+  RFDICT_NODE *pDst = NULL;
+  RFDICT_NODE *pNew = NULL;
+  size_t nsize = 0;
+  int from_left = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Allocate an empty dictionary with the same case mode and pool */
+  pCopy = rfdict_alloc_pooled(pDict->sensitive, pDict->pPool);
+  pCopy->width = pDict->width;
+  if (pDict->pCodec != NULL) {
+    ((pDict->pCodec)->refs)++;
+    pCopy->pCodec = pDict->pCodec;
+  }
+  
+  /* If source isn't empty, allocate a single block that is exactly big
+   * enough for all its nodes */
+  if (pDict->pRoot != NULL) {
+    pBlock = rfdict_newblock(pCopy, pDict->nbytes, pDict->nbytes);
+  }
+  
+  /* 
+   * Walk the source tree in pre-order, without recursion, by following
+   * the parent pointers back up.  Each node is copied into the next
+   * position in the block as it is visited, so that each node is
+   * followed in memory by its left subtree.  pDst always points to the
+   * copy of pSrc.
+   */
+  pSrc = pDict->pRoot;
+  while (pSrc != NULL) {
+    
+    /* Copy the current node, linking it to the copy of its parent */
+    nsize = rfdict_nodesize(pCopy, pSrc->pKey);
+    pNew = (RFDICT_NODE *)
+              (((char *) pBlock) + RFDICT_BLOCK_HEAD + pBlock->used);
+    pBlock->used += nsize;
+    memset(pNew, 0, nsize);
+    pNew->val = pSrc->val;
+    pNew->red = pSrc->red;
+    rfdict_setkey(pCopy, pNew, pSrc->pKey,
+                  (pSrc->pKey != &((pSrc->key)[0])));
+    
+    pNew->pParent = pDst;
+    pNew->pLeft = NULL;
+    pNew->pRight = NULL;
+    if (pDst == NULL) {
+      pCopy->pRoot = pNew;
+    } else if (from_left) {
+      pDst->pLeft = pNew;
+    } else {
+      pDst->pRight = pNew;
+    }
+    pDst = pNew;
+    
+    /* Descend into the left subtree if there is one, else into the
+     * right subtree if there is one */
+    if (pSrc->pLeft != NULL) {
+      pSrc = pSrc->pLeft;
+      from_left = 1;
+      continue;
+    
+    } else if (pSrc->pRight != NULL) {
+      pSrc = pSrc->pRight;
+      from_left = 0;
+      continue;
+    }
+    
+    /* Leaf node -- climb until we come up from a left child whose
+     * parent has a right subtree, and descend into that, or until we
+     * climb past the root */
+    for( ; pSrc->pParent != NULL; pSrc = pSrc->pParent) {
+      pDst = pDst->pParent;
+      if (((pSrc->pParent)->pLeft == pSrc) &&
+            ((pSrc->pParent)->pRight != NULL)) {
+        break;
+      }
+    }
+    
+    if (pSrc->pParent != NULL) {
+      pSrc = (pSrc->pParent)->pRight;
+      from_left = 0;
+    } else {
+      pSrc = NULL;
+    }
+  }
+  
+  /* Copy statistics */
+  pCopy->count = pDict->count;
+  pCopy->nbytes = pDict->nbytes;
+  
+  /* Return the copy */
+  return pCopy;
+}
+
+/*
+ * rfdict_intersect function.
+ */
+RFDICT *rfdict_intersect(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  return rfdict_setop(pA, pB, RFDICT_SETOP_INTERSECT, fp, pCustom);
+}
+
+/*
+ * rfdict_difference function.
+ */
+RFDICT *rfdict_difference(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  return rfdict_setop(pA, pB, RFDICT_SETOP_DIFFERENCE, fp, pCustom);
+}
+
+/*
+ * rfdict_symdiff function.
+ */
+RFDICT *rfdict_symdiff(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  return rfdict_setop(pA, pB, RFDICT_SETOP_SYMDIFF, fp, pCustom);
+}
+
+/*
+ * rfdict_delta_alloc function.
+ */
+RFDICT_DELTA *rfdict_delta_alloc(long cap) {
+  
+  RFDICT_DELTA *pDelta = NULL;
+  long slots = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((cap < 1) || (cap > RFDICT_DELTA_MAXCAP)) {
+    abort();
+  }
+  
+  /* Number of slots is smallest power of two that is at least twice
+   * the capacity */
+  for(slots = 1; slots < cap * 2; slots *= 2);
+  
+  /* Allocate the structure and clear it */
+  pDelta = (RFDICT_DELTA *) malloc(sizeof(RFDICT_DELTA));
+  if (pDelta == NULL) {
+    abort();
+  }
+  memset(pDelta, 0, sizeof(RFDICT_DELTA));
+  
+  /* Allocate the arrays */
+  pDelta->ppRef = (long **) malloc(((size_t) slots) * sizeof(long *));
+  pDelta->pAmount = (long *) malloc(((size_t) slots) * sizeof(long));
+  pDelta->pUsed = (long *) malloc(((size_t) cap) * sizeof(long));
+  if ((pDelta->ppRef == NULL) || (pDelta->pAmount == NULL) ||
+      (pDelta->pUsed == NULL)) {
+    abort();
+  }
+  
+  /* Initialize the structure with all slots empty */
+  pDelta->cap = cap;
+  pDelta->slots = slots;
+  pDelta->count = 0;
+  for(i = 0; i < slots; i++) {
+    (pDelta->ppRef)[i] = NULL;
+    (pDelta->pAmount)[i] = 0;
+  }
+  
+  /* Return the table */
+  return pDelta;
+}
+
+/*
+ * rfdict_delta_free function.
+ */
+void rfdict_delta_free(RFDICT_DELTA *pDelta) {
+  if (pDelta != NULL) {
+    free(pDelta->ppRef);
+    free(pDelta->pAmount);
+    free(pDelta->pUsed);
+    free(pDelta);
+  }
+}
+
+/*
+ * rfdict_delta_add function.
+ */
+int rfdict_delta_add(RFDICT_DELTA *pDelta, long *pRef, long amount) {
+  
+  unsigned char abRef[sizeof(long *)];
+  unsigned long h = 0;
+  size_t j = 0;
+  long i = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDelta == NULL) || (pRef == NULL)) {
+    abort();
+  }
+  
+  /* Hash the bytes of the pointer with FNV-1a, since there may be no
+   * integer type as wide as a pointer, and then mix the high bits down
+   * with a multiplicative constant */
+  memcpy(&(abRef[0]), &pRef, sizeof(long *));
+  h = 2166136261UL;
+  for(j = 0; j < sizeof(long *); j++) {
+    h = ((h ^ ((unsigned long) abRef[j])) * 16777619UL) & 0xffffffffUL;
+  }
+  h = ((h * 2654435761UL) & 0xffffffffUL) ^ (h >> 16);
+  i = (long) (h & ((unsigned long) (pDelta->slots - 1)));
+  
+  /* Linear probe for the pointer or an empty slot; the table is never
+   * more than half full, so this always terminates */
+  while (((pDelta->ppRef)[i] != NULL) && ((pDelta->ppRef)[i] != pRef)) {
+    i = (i + 1) & (pDelta->slots - 1);
+  }
+  
+  /* If slot is empty, claim it unless the table is full */
+  if ((pDelta->ppRef)[i] == NULL) {
+    if (pDelta->count < pDelta->cap) {
+      (pDelta->ppRef)[i] = pRef;
+      (pDelta->pAmount)[i] = 0;
+      (pDelta->pUsed)[pDelta->count] = i;
+      (pDelta->count)++;
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Accumulate the increment */
+  if (status) {
+    (pDelta->pAmount)[i] += amount;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * rfdict_delta_flush function.
+ */
+void rfdict_delta_flush(RFDICT_DELTA *pDelta) {
+  
+  long j = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pDelta == NULL) {
+    abort();
+  }
+  
+  /* Apply each pending increment and empty its slot */
+  for(j = 0; j < pDelta->count; j++) {
+    i = (pDelta->pUsed)[j];
+    *((pDelta->ppRef)[i]) += (pDelta->pAmount)[i];
+    (pDelta->ppRef)[i] = NULL;
+    (pDelta->pAmount)[i] = 0;
+  }
+  
+  /* Table is now empty */
+  pDelta->count = 0;
+}
+
+/*
+ * rfdict_disk_create function.
+ */
+RFDICT_DISK *rfdict_disk_create(
+    const char * pPath,
+    int          sensitive,
+    long         pool_pages) {
+  
+  RFDICT_DISK *pDisk = NULL;
+  FILE *pFile = NULL;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* Create the file, truncating any existing file */
+  pFile = fopen(pPath, "w+b");
+  
+  /* Set up the structure and write the header of an empty
+   * dictionary */
+  if (pFile != NULL) {
+    pDisk = rfdict_disk_new(pFile, pool_pages);
+    if (sensitive) {
+      pDisk->sensitive = 1;
+    } else {
+      pDisk->sensitive = 0;
+    }
+    if (!rfdict_disk_writehdr(pDisk)) {
+      rfdict_disk_release(pDisk);
+      pDisk = NULL;
+    }
+  }
+  
+  return pDisk;
+}
+
+/*
+ * rfdict_disk_open function.
+ */
+RFDICT_DISK *rfdict_disk_open(const char *pPath, long pool_pages) {
+  
+  RFDICT_DISK *pDisk = NULL;
+  FILE *pFile = NULL;
+  unsigned char *pg = NULL;
+  long flen = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* Open the existing file */
+  pFile = fopen(pPath, "r+b");
+  if (pFile == NULL) {
+    status = 0;
+  }
+  
+  /* Set up the structure and read the header */
+  if (status) {
+    pDisk = rfdict_disk_new(pFile, pool_pages);
+    pg = &((pDisk->scratch)[0]);
+    status = rfdict_disk_rdwr(pDisk, 0, pg, 0);
+  }
+  
+  /* Verify the signature, version and page size */
+  if (status) {
+    if ((memcmp(pg + RFDICT_DISK_HDR_SIG, RFDICT_DISK_SIG, 8) != 0) ||
+        (rfdict_disk_get16(pg + RFDICT_DISK_HDR_VERSION) != 0) ||
+        (rfdict_disk_get16(pg + RFDICT_DISK_HDR_VERSION + 2) !=
+          RFDICT_DISK_VERSION) ||
+        (rfdict_disk_get16(pg + RFDICT_DISK_HDR_PAGE) !=
+          (RFDICT_DISK_PAGE >> 16)) ||
+        (rfdict_disk_get16(pg + RFDICT_DISK_HDR_PAGE + 2) !=
+          (RFDICT_DISK_PAGE & 0xffff)) ||
+        (pg[RFDICT_DISK_HDR_SENS] > 1)) {
+      status = 0;
+    }
+  }
+  
+  /* Read the fields and check they are consistent */
+  if (status) {
+    pDisk->sensitive = pg[RFDICT_DISK_HDR_SENS];
+    pDisk->root = rfdict_disk_get64(pg + RFDICT_DISK_HDR_ROOT);
+    pDisk->npages = rfdict_disk_get64(pg + RFDICT_DISK_HDR_NPAGES);
+    pDisk->nkeys = rfdict_disk_get64(pg + RFDICT_DISK_HDR_NKEYS);
+    if ((pDisk->npages < 1) || (pDisk->root < 0) ||
+        (pDisk->root >= pDisk->npages) || (pDisk->nkeys < 0) ||
+        ((pDisk->root == 0) && (pDisk->nkeys != 0))) {
+      status = 0;
+    }
+  }
+  
+  /* Reject a file that has been cut short, rather than failing later
+   * on the first lookup that reaches a missing page */
+  if (status) {
+    if ((pDisk->npages > LONG_MAX / RFDICT_DISK_PAGE) ||
+        fseek(pFile, 0L, SEEK_END)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    flen = ftell(pFile);
+    if ((flen < 0) || (flen < pDisk->npages * RFDICT_DISK_PAGE)) {
+      status = 0;
+    }
+  }
+  
+  /* Clean up on failure */
+  if ((!status) && (pDisk != NULL)) {
+    rfdict_disk_release(pDisk);
+    pDisk = NULL;
+  } else if ((!status) && (pFile != NULL)) {
+    fclose(pFile);
+  }
+  
+  return pDisk;
+}
+
+/*
+ * rfdict_disk_sync function.
+ */
+int rfdict_disk_sync(RFDICT_DISK *pDisk) {
+  
+  RFDICT_DISK_FRAME *pf = NULL;
+  long f = 0;
+  
+  /* Check parameters */
+  if (pDisk == NULL) {
+    abort();
+  }
+  
+  /* Write all dirty pages */
+  for(f = 0; (!(pDisk->failed)) && (f < pDisk->nframes); f++) {
+    pf = &((pDisk->pFrames)[f]);
+    if (pf->dirty) {
+      if (rfdict_disk_rdwr(pDisk, pf->pgno, pf->pData, 1)) {
+        pf->dirty = 0;
+      }
+    }
+  }
+  
+  /* Write the header if it changed */
+  if ((!(pDisk->failed)) && pDisk->hdr_dirty) {
+    rfdict_disk_writehdr(pDisk);
+  }
+  
+  /* Flush the file */
+  if (!(pDisk->failed)) {
+    if (fflush(pDisk->pFile)) {
+      pDisk->failed = 1;
+    }
+  }
+  
+  return !(pDisk->failed);
+}
+
+/*
+ * rfdict_disk_close function.
+ */
+int rfdict_disk_close(RFDICT_DISK *pDisk) {
+  
+  int status = 1;
+  
+  if (pDisk != NULL) {
+    if (!rfdict_disk_sync(pDisk)) {
+      status = 0;
+    }
+    if (!rfdict_disk_release(pDisk)) {
+      status = 0;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * rfdict_disk_ok function.
+ */
+int rfdict_disk_ok(RFDICT_DISK *pDisk) {
+  if (pDisk == NULL) {
+    abort();
+  }
+  return !(pDisk->failed);
+}
+
+/*
+ * rfdict_disk_count function.
+ */
+long rfdict_disk_count(RFDICT_DISK *pDisk) {
+  if (pDisk == NULL) {
+    abort();
+  }
+  return pDisk->nkeys;
+}
+
+/*
+ * rfdict_disk_insert function.
+ */
+int rfdict_disk_insert(
+    RFDICT_DISK * pDisk,
+    const char  * pKey,
+    long          val) {
+  
+  long path[RFDICT_DISK_MAXDEPTH];
+  const unsigned char *pk = NULL;
+  unsigned char *pg = NULL;
+  long pgno = 0;
+  long child = 0;
+  long right = 0;
+  long f = 0;
+  long payload = 0;
+  int depth = 0;
+  int slot = 0;
+  int found = 0;
+  int klen = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Set the search key, and fail if there was an error earlier */
+  rfdict_disk_setkey(pDisk, pKey);
+  if (pDisk->failed) {
+    status = 0;
+  }
+  
+  /* If dictionary is empty, allocate a leaf page for the root */
+  if (status && (pDisk->root == 0)) {
+    pDisk->root = pDisk->npages;
+    (pDisk->npages)++;
+    pDisk->hdr_dirty = 1;
+    f = rfdict_disk_fetch(pDisk, pDisk->root, 1);
+    if (f >= 0) {
+      rfdict_disk_initpage(
+        (pDisk->pFrames)[f].pData, RFDICT_DISK_LEAF, 0);
+      rfdict_disk_unpin(pDisk, f, 1);
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Descend to the leaf, remembering the internal pages on the path */
+  if (status) {
+    pgno = pDisk->root;
+    for(depth = 0; depth < RFDICT_DISK_MAXDEPTH; depth++) {
+      f = rfdict_disk_fetch(pDisk, pgno, 0);
+      if (f < 0) {
+        status = 0;
+        break;
+      }
+      pg = (pDisk->pFrames)[f].pData;
+      if (!rfdict_disk_check(pDisk, pg)) {
+        rfdict_disk_unpin(pDisk, f, 0);
+        status = 0;
+        break;
+      }
+      if (pg[RFDICT_DISK_PG_TYPE] == RFDICT_DISK_LEAF) {
+        break;
+      }
+      path[depth] = pgno;
+      child = rfdict_disk_child(pDisk, pg);
+      rfdict_disk_unpin(pDisk, f, 0);
+      if (child < 1) {
+        pDisk->failed = 1;
+        status = 0;
+        break;
+      }
+      pgno = child;
+    }
+    if (status && (depth >= RFDICT_DISK_MAXDEPTH)) {
+      pDisk->failed = 1;
+      status = 0;
+    }
+  }
+  
+  /* Leaf page is now pinned in frame f -- fail if key already there */
+  if (status) {
+    slot = rfdict_disk_search(pg, pDisk->qkey, pDisk->qlen, &found);
+    if (found) {
+      rfdict_disk_unpin(pDisk, f, 0);
+      status = 0;
+    }
+  }
+  
+  /* Insert the entry, splitting pages up the path as necessary; on
+   * each iteration the page in frame f is pinned, and the entry is
+   * either the new key and value or a separator and the new sibling
+   * page */
+  if (status) {
+    pk = &((pDisk->qkey)[0]);
+    klen = pDisk->qlen;
+    payload = val;
+    for(;;) {
+      /* Done if the entry fits */
+      if (rfdict_disk_place(pg, slot, pk, klen, payload)) {
+        rfdict_disk_unpin(pDisk, f, 1);
+        break;
+      }
+      
+      /* Split the page */
+      if (!rfdict_disk_split(pDisk, pg, slot, pk, klen, payload,
+                              &right)) {
+        rfdict_disk_unpin(pDisk, f, 1);
+        status = 0;
+        break;
+      }
+      rfdict_disk_unpin(pDisk, f, 1);
+      pk = &((pDisk->sep)[0]);
+      klen = pDisk->seplen;
+      payload = right;
+      
+      if (depth < 1) {
+        /* Split the root, so make a new root above it */
+        child = pDisk->root;
+        pDisk->root = pDisk->npages;
+        (pDisk->npages)++;
+        pDisk->hdr_dirty = 1;
+        f = rfdict_disk_fetch(pDisk, pDisk->root, 1);
+        if (f < 0) {
+          status = 0;
+          break;
+        }
+        pg = (pDisk->pFrames)[f].pData;
+        rfdict_disk_initpage(pg, RFDICT_DISK_INTERNAL, child);
+        slot = 0;
+        
+      } else {
+        /* Move up to the parent page */
+        depth--;
+        f = rfdict_disk_fetch(pDisk, path[depth], 0);
+        if (f < 0) {
+          status = 0;
+          break;
+        }
+        pg = (pDisk->pFrames)[f].pData;
+        slot = rfdict_disk_search(pg, pk, klen, &found);
+      }
+    }
+  }
+  
+  /* Update key count */
+  if (status) {
+    (pDisk->nkeys)++;
+    pDisk->hdr_dirty = 1;
+  }
+  
+  return status;
+}
+
+/*
+ * rfdict_disk_get function.
+ */
+long rfdict_disk_get(RFDICT_DISK *pDisk, const char *pKey, long dvalue) {
+  
+  unsigned char *pg = NULL;
+  long pgno = 0;
+  long child = 0;
+  long f = 0;
+  long result = 0;
+  int depth = 0;
+  int slot = 0;
+  int found = 0;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Set the search key */
+  rfdict_disk_setkey(pDisk, pKey);
+  result = dvalue;
+  
+  /* Descend from the root to the leaf */
+  pgno = pDisk->root;
+  for(depth = 0;
+      (pgno > 0) && (depth < RFDICT_DISK_MAXDEPTH) && (!(pDisk->failed));
+      depth++) {
+    
+    f = rfdict_disk_fetch(pDisk, pgno, 0);
+    if (f < 0) {
+      break;
+    }
+    pg = (pDisk->pFrames)[f].pData;
+    if (!rfdict_disk_check(pDisk, pg)) {
+      rfdict_disk_unpin(pDisk, f, 0);
+      break;
+    }
+    
+    if (pg[RFDICT_DISK_PG_TYPE] == RFDICT_DISK_LEAF) {
+      /* Leaf -- look for the key */
+      slot = rfdict_disk_search(pg, pDisk->qkey, pDisk->qlen, &found);
+      if (found) {
+        result = rfdict_disk_get64(
+                  rfdict_disk_payload(rfdict_disk_entry(pg, slot)));
+      }
+      rfdict_disk_unpin(pDisk, f, 0);
+      break;
+    }
+    
+    /* Internal -- move to child */
+    child = rfdict_disk_child(pDisk, pg);
+    rfdict_disk_unpin(pDisk, f, 0);
+    if (child < 1) {
+      pDisk->failed = 1;
+      break;
+    }
+    pgno = child;
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_freeze function.
+ */
+RFDICT_FROZEN *rfdict_freeze(RFDICT *pDict) {
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  return rfdict_frozen_build(pDict, 0);
+}
+
+/*
+ * rfdict_frozen_free function.
+ */
+void rfdict_frozen_free(RFDICT_FROZEN *pFrozen) {
+  if (pFrozen != NULL) {
+    free(pFrozen->pKeys);
+    free(pFrozen->pOffset);
+    free((pFrozen->val).pWord);
+    free(pFrozen->pFilter);
+    if (pFrozen->pCodec != NULL) {
+      rfdict_codec_drop(pFrozen->pCodec);
+    }
+    free(pFrozen);
+  }
+}
+
+/*
+ * rfdict_frozen_count function.
+ */
+long rfdict_frozen_count(RFDICT_FROZEN *pFrozen) {
+  if (pFrozen == NULL) {
+    abort();
+  }
+  return pFrozen->count;
+}
+
+/*
+ * rfdict_frozen_get function.
+ */
+long rfdict_frozen_get(
+    RFDICT_FROZEN * pFrozen,
+    const char    * pKey,
+    long            dvalue) {
+  
+  long i = 0;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Search for the key, compressing it first if the image is
+   * compressed */
+  if (pFrozen->pCodec != NULL) {
+    i = rfdict_coded_frozen_find(pFrozen, pKey);
+  } else {
+    i = rfdict_frozen_find(pFrozen, pKey);
+  }
+  if (i >= 0) {
+    result = rfdict_pack_get(&(pFrozen->val), i);
+  } else {
+    result = dvalue;
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_lsm_alloc function.
+ */
+RFDICT_LSM *rfdict_lsm_alloc(int sensitive, long memcap) {
+  
+  RFDICT_LSM *pLsm = NULL;
+  int i = 0;
+  
+  /* Check parameters */
+  if (memcap < 1) {
+    abort();
+  }
+  
+  /* Allocate and clear structure */
+  pLsm = (RFDICT_LSM *) malloc(sizeof(RFDICT_LSM));
+  if (pLsm == NULL) {
+    abort();
+  }
+  memset(pLsm, 0, sizeof(RFDICT_LSM));
+  
+  /* Initialize */
+  pLsm->sensitive = sensitive;
+  pLsm->pMem = rfdict_alloc(sensitive);
+  pLsm->memcap = memcap;
+  for(i = 0; i < RFDICT_LSM_MAXRUNS; i++) {
+    (pLsm->apRun)[i] = NULL;
+  }
+  pLsm->nruns = 0;
+  pLsm->merge_at = -1;
+  pLsm->pOut = NULL;
+  pLsm->pMergeVal = NULL;
+#ifdef RFDICT_THREADS
+  pLsm->running = 0;
+#endif
+  
+  return pLsm;
+}
+
+/*
+ * rfdict_lsm_free function.
+ */
+void rfdict_lsm_free(RFDICT_LSM *pLsm) {
+  
+  int i = 0;
+  
+  if (pLsm != NULL) {
+#ifdef RFDICT_THREADS
+    if (pLsm->running) {
+      if (pthread_join(pLsm->worker, NULL) != 0) {
+        abort();
+      }
+    }
+#endif
+    rfdict_free(pLsm->pMem);
+    for(i = 0; i < pLsm->nruns; i++) {
+      rfdict_frozen_free((pLsm->apRun)[i]);
+    }
+    rfdict_frozen_free(pLsm->pOut);
+    free(pLsm->pMergeVal);
+    free(pLsm);
+  }
+}
+
+/*
+ * rfdict_lsm_insert function.
+ */
+int rfdict_lsm_insert(RFDICT_LSM *pLsm, const char *pKey, long val) {
+  
+  long remaining = 0;
+  long space = 0;
+  int status = 1;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pLsm == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Fail if the key is in any run, checking the filter first */
+  for(i = 0; i < pLsm->nruns; i++) {
+    if (rfdict_filter_test((pLsm->apRun)[i], pKey)) {
+      if (rfdict_frozen_find((pLsm->apRun)[i], pKey) >= 0) {
+        status = 0;
+        break;
+      }
+    }
+  }
+  
+  /* Insert into the memtable, which fails if the key is there */
+  if (status) {
+    status = rfdict_insert(pLsm->pMem, pKey, val);
+  }
+  
+  if (status) {
+    /* Advance the merge in progress so that it finishes by the time
+     * the memtable is full, unless it is running on its own thread */
+#ifdef RFDICT_THREADS
+    if ((pLsm->merge_at >= 0) && (!(pLsm->running))) {
+#else
+    if (pLsm->merge_at >= 0) {
+#endif
+      remaining = (pLsm->pOut)->count - pLsm->io;
+      space = pLsm->memcap - (pLsm->pMem)->count;
+      if (space < 1) {
+        space = 1;
+      }
+      rfdict_lsm_step(pLsm, (remaining / space) + 1);
+    }
+    
+    /* Flush the memtable if full */
+    if ((pLsm->pMem)->count >= pLsm->memcap) {
+      rfdict_lsm_flush(pLsm);
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * rfdict_lsm_get function.
+ */
+long rfdict_lsm_get(RFDICT_LSM *pLsm, const char *pKey, long dvalue) {
+  
+  RFDICT_NODE *pNode = NULL;
+  long result = 0;
+  long k = -1;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pLsm == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Check the memtable, then the runs newest first; the key is in at
+   * most one place */
+  result = dvalue;
+  pNode = rfdict_find(pLsm->pMem, pKey);
+  if (pNode != NULL) {
+    result = pNode->val;
+    
+  } else {
+    for(i = 0; i < pLsm->nruns; i++) {
+      if (rfdict_filter_test((pLsm->apRun)[i], pKey)) {
+        k = rfdict_frozen_find((pLsm->apRun)[i], pKey);
+        if (k >= 0) {
+          result = rfdict_pack_get(&(((pLsm->apRun)[i])->val), k);
+          break;
+        }
+      }
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_lsm_count function.
+ */
+long rfdict_lsm_count(RFDICT_LSM *pLsm) {
+  
+  long result = 0;
+  int i = 0;
+  
+  if (pLsm == NULL) {
+    abort();
+  }
+  
+  result = (pLsm->pMem)->count;
+  for(i = 0; i < pLsm->nruns; i++) {
+    result += (pLsm->apRun)[i]->count;
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_lsm_compact function.
+ */
+void rfdict_lsm_compact(RFDICT_LSM *pLsm) {
+  
+  /* Check parameters */
+  if (pLsm == NULL) {
+    abort();
+  }
+  
+  /* Flush the memtable, which also finishes any merge in progress */
+  rfdict_lsm_flush(pLsm);
+  while (pLsm->merge_at >= 0) {
+    rfdict_lsm_step(pLsm, LONG_MAX);
+  }
+  
+  /* Merge the two newest runs until only one is left */
+  while (pLsm->nruns > 1) {
+    rfdict_lsm_schedule(pLsm, 1);
+    while (pLsm->merge_at >= 0) {
+      rfdict_lsm_step(pLsm, LONG_MAX);
+    }
+  }
+}
+
+/*
+ * rfdict_louds_build function.
+ */
+RFDICT_LOUDS *rfdict_louds_build(RFDICT *pDict) {
+  
+  RFDICT_LOUDS *pLouds = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  const char *pKey = NULL;
+  const char *pPrev = NULL;
+  long *pRange = NULL;
+  long *pNext = NULL;
+  long *pSwap = NULL;
+  long *pVal = NULL;
+  long nrange = 0;
+  long nnext = 0;
+  long nodes = 0;
+  long nval = 0;
+  long v = 0;
+  long r = 0;
+  long i = 0;
+  long iend = 0;
+  unsigned long pos = 0;
+  size_t d = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  
+  /* Get the keys in order */
+  pFrozen = rfdict_frozen_build(pDict, 0);
+  
+  /* Count the trie nodes; each key adds the nodes for the part of it
+   * that does not match the previous key */
+  nodes = 1;
+  for(i = 0; i < pFrozen->count; i++) {
+    pKey = pFrozen->pKeys + (pFrozen->pOffset)[i];
+    d = 0;
+    if (pPrev != NULL) {
+      for( ; (pKey[d] != 0) && (pKey[d] == pPrev[d]); d++);
+    }
+    nodes += (long) (strlen(pKey) - d);
+    pPrev = pKey;
+  }
+  
+  /* Allocate and clear structure */
+  pLouds = (RFDICT_LOUDS *) malloc(sizeof(RFDICT_LOUDS));
+  if (pLouds == NULL) {
+    abort();
+  }
+  memset(pLouds, 0, sizeof(RFDICT_LOUDS));
+  
+  pLouds->sensitive = pDict->sensitive;
+  pLouds->count = pFrozen->count;
+  pLouds->nodes = nodes;
+  rfdict_bits_alloc(&(pLouds->tree), (unsigned long) (2 * nodes - 1));
+  rfdict_bits_alloc(&(pLouds->term), (unsigned long) nodes);
+  pLouds->pLabel = (unsigned char *) malloc((size_t) nodes);
+  if (pLouds->pLabel == NULL) {
+    abort();
+  }
+  
+  /* Allocate work arrays; each level of the trie has at most one node
+   * per key, and each node is a range of key indices */
+  pRange = (long *) malloc(((size_t) (2 * pFrozen->count + 2)) *
+                            sizeof(long));
+  pNext = (long *) malloc(((size_t) (2 * pFrozen->count + 2)) *
+                            sizeof(long));
+  pVal = (long *) malloc(((size_t) (pFrozen->count + 1)) * sizeof(long));
+  if ((pRange == NULL) || (pNext == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  
+  /* Start with the root, covering all keys */
+  pRange[0] = 0;
+  pRange[1] = pFrozen->count;
+  nrange = 1;
+  
+  /* Generate the nodes level by level; the children of a node are the
+   * groups of its keys that share the same byte at the current depth,
+   * except that a key ending at the current depth makes the node
+   * terminal instead */
+  v = 0;
+  pos = 0;
+  for(d = 0; nrange > 0; d++) {
+    nnext = 0;
+    for(r = 0; r < nrange; r++) {
+      for(i = pRange[2 * r]; i < pRange[2 * r + 1]; i = iend) {
+        pKey = pFrozen->pKeys + (pFrozen->pOffset)[i];
+        c = (int) ((unsigned char) pKey[d]);
+        
+        /* Find the end of the group */
+        for(iend = i + 1; iend < pRange[2 * r + 1]; iend++) {
+          if ((pFrozen->pKeys + (pFrozen->pOffset)[iend])[d] != pKey[d]) {
+            break;
+          }
+        }
+        
+        if (c == 0) {
+          /* Key ends here */
+          (pLouds->term).pWord[v / RFDICT_WORD_BITS] |=
+                              1UL << (v % RFDICT_WORD_BITS);
+          pVal[nval] = rfdict_pack_get(&(pFrozen->val), i);
+          nval++;
+          
+        } else {
+          /* Child node */
+          (pLouds->tree).pWord[pos / RFDICT_WORD_BITS] |=
+                              1UL << (pos % RFDICT_WORD_BITS);
+          pos++;
+          pNext[2 * nnext] = i;
+          pNext[2 * nnext + 1] = iend;
+          nnext++;
+        }
+      }
+      
+      /* End of the node */
+      pos++;
+      v++;
+    }
+    
+    /* Label the children, whose numbers follow this level in order */
+    for(r = 0; r < nnext; r++) {
+      (pLouds->pLabel)[v + r - 1] = (unsigned char)
+        (pFrozen->pKeys + (pFrozen->pOffset)[pNext[2 * r]])[d];
+    }
+    
+    pSwap = pRange;
+    pRange = pNext;
+    pNext = pSwap;
+    nrange = nnext;
+  }
+  if ((v != nodes) || (pos != (pLouds->tree).nbits) ||
+      (nval != pFrozen->count)) {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Build the directories and pack the values */
+  rfdict_bits_index(&(pLouds->tree), 1);
+  rfdict_bits_index(&(pLouds->term), 0);
+  rfdict_pack_init(&(pLouds->val), pVal, nval);
+  
+  /* Release work memory */
+  free(pRange);
+  free(pNext);
+  free(pVal);
+  rfdict_frozen_free(pFrozen);
+  
+  return pLouds;
+}
+
+/*
+ * rfdict_louds_free function.
+ */
+void rfdict_louds_free(RFDICT_LOUDS *pLouds) {
+  if (pLouds != NULL) {
+    rfdict_bits_release(&(pLouds->tree));
+    rfdict_bits_release(&(pLouds->term));
+    free(pLouds->pLabel);
+    free((pLouds->val).pWord);
+    free(pLouds);
+  }
+}
+
+/*
+ * rfdict_louds_count function.
+ */
+long rfdict_louds_count(RFDICT_LOUDS *pLouds) {
+  if (pLouds == NULL) {
+    abort();
+  }
+  return pLouds->count;
+}
+
+/*
+ * rfdict_louds_size function.
+ */
+size_t rfdict_louds_size(RFDICT_LOUDS *pLouds) {
+  
+  size_t result = 0;
+  
+  /* Check parameters */
+  if (pLouds == NULL) {
+    abort();
+  }
+  
+  /* Add up the structure, the bit vectors with their directories, the
+   * labels, and the packed values */
+  result = sizeof(RFDICT_LOUDS);
+  result += ((size_t) ((pLouds->tree).nwords + 1)) *
+              sizeof(unsigned long);
+  result += ((size_t) ((pLouds->tree).nwords / RFDICT_RANK_WORDS + 2)) *
+              sizeof(unsigned long);
+  result += ((size_t) ((pLouds->tree).nzero / RFDICT_SELECT_SAMPLE + 2)) *
+              sizeof(unsigned long);
+  result += ((size_t) ((pLouds->term).nwords + 1)) *
+              sizeof(unsigned long);
+  result += ((size_t) ((pLouds->term).nwords / RFDICT_RANK_WORDS + 2)) *
+              sizeof(unsigned long);
+  result += (size_t) pLouds->nodes;
+  result += ((size_t) ((((unsigned long) pLouds->count) *
+                ((unsigned long) (pLouds->val).bits)) /
+                  RFDICT_WORD_BITS + 2)) * sizeof(unsigned long);
+  
+  return result;
+}
+
+/*
+ * rfdict_louds_get function.
+ */
+long rfdict_louds_get(
+    RFDICT_LOUDS * pLouds,
+    const char   * pKey,
+    long           dvalue) {
+  
+  const unsigned char *pHit = NULL;
+  unsigned long v = 0;
+  unsigned long start = 0;
+  unsigned long end = 0;
+  unsigned long first = 0;
+  long result = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pLouds == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Descend the trie one byte at a time */
+  result = dvalue;
+  v = 0;
+  for( ; *pKey != 0; pKey++) {
+    c = (int) ((unsigned char) *pKey);
+    if ((!(pLouds->sensitive)) &&
+        (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    
+    /* The bits of node v start after zero bit v - 1, and end at the
+     * next zero bit, which is usually close */
+    if (v > 0) {
+      start = rfdict_bits_select0(&(pLouds->tree), v - 1) + 1;
+    } else {
+      start = 0;
+    }
+    for(end = start;
+        ((pLouds->tree).pWord[end / RFDICT_WORD_BITS] >>
+          (end % RFDICT_WORD_BITS)) & 1;
+        end++);
+    if (start >= end) {
+      break;
+    }
+    
+    /* Search the labels of the children */
+    first = rfdict_bits_rank1(&(pLouds->tree), start) + 1;
+    pHit = (const unsigned char *) memchr(
+                pLouds->pLabel + (first - 1), c, (size_t) (end - start));
+    if (pHit == NULL) {
+      break;
+    }
+    v = first + ((unsigned long) (pHit - (pLouds->pLabel + (first - 1))));
+  }
+  
+  /* Look up the value if the whole key matched a terminal node */
+  if (*pKey == 0) {
+    if (((pLouds->term).pWord[v / RFDICT_WORD_BITS] >>
+          (v % RFDICT_WORD_BITS)) & 1) {
+      result = rfdict_pack_get(
+                &(pLouds->val),
+                (long) rfdict_bits_rank1(&(pLouds->term), v));
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_fst_build function.
+ */
+RFDICT_FST *rfdict_fst_build(RFDICT *pDict) {
+  
+  RFDICT_FST_BUILD build;
+  RFDICT_FROZEN *pFrozen = NULL;
+  RFDICT_FST_STATE *pStates = NULL;
+  RFDICT_FST *pFst = NULL;
+  const char *pKey = NULL;
+  const char *pPrev = NULL;
+  unsigned long u = 0;
+  unsigned long common = 0;
+  unsigned long suffix = 0;
+  size_t maxlen = 0;
+  size_t prevlen = 0;
+  size_t klen = 0;
+  size_t p = 0;
+  size_t d = 0;
+  size_t root = 0;
+  long i = 0;
+  int a = 0;
+  
+  /* Initialize structures */
+  memset(&build, 0, sizeof(RFDICT_FST_BUILD));
+  build.pImage = NULL;
+  build.pCanon = NULL;
+  build.pSlotOff = NULL;
+  build.pSlotLen = NULL;
+  build.pSlotNode = NULL;
+  build.pScratch = NULL;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  
+  /* Get the keys and values in order, and the longest key length */
+  pFrozen = rfdict_frozen_build(pDict, 0);
+  for(i = 0; i < pFrozen->count; i++) {
+    klen = strlen(pFrozen->pKeys + (pFrozen->pOffset)[i]);
+    if (klen > maxlen) {
+      maxlen = klen;
+    }
+  }
+  
+  /* Allocate a node under construction for each depth */
+  pStates = (RFDICT_FST_STATE *) calloc(
+              maxlen + 1, sizeof(RFDICT_FST_STATE));
+  if (pStates == NULL) {
+    abort();
+  }
+  
+  /* Start the image with room for the header, and allocate the node
+   * table */
+  build.cap = 4096;
+  build.pImage = (unsigned char *) malloc(build.cap);
+  build.len = RFDICT_FST_HDR_SIZE;
+  build.slots = 1024;
+  build.pSlotOff = (size_t *) malloc(build.slots * sizeof(size_t));
+  build.pSlotLen = (size_t *) calloc(build.slots, sizeof(size_t));
+  build.pSlotNode = (size_t *) malloc(build.slots * sizeof(size_t));
+  if ((build.pImage == NULL) || (build.pSlotOff == NULL) ||
+      (build.pSlotLen == NULL) || (build.pSlotNode == NULL)) {
+    abort();
+  }
+  
+  /* Add the keys in order; the nodes along the path of the previous
+   * key stay under construction, and are completed once a key leaves
+   * that path */
+  for(i = 0; i < pFrozen->count; i++) {
+    pKey = pFrozen->pKeys + (pFrozen->pOffset)[i];
+    klen = strlen(pKey);
+    
+    /* Find the length of the prefix shared with the previous key */
+    p = 0;
+    if (pPrev != NULL) {
+      for( ; (pKey[p] != 0) && (pKey[p] == pPrev[p]); p++);
+    }
+    
+    /* Complete the nodes past the shared prefix */
+    for(d = prevlen; d > p; d--) {
+      (pStates[d - 1].pTarget)[pStates[d - 1].narcs - 1] =
+        rfdict_fst_compile(&build, &(pStates[d]));
+    }
+    
+    /* Extend the path with the rest of the key */
+    for(d = p; d < klen; d++) {
+      rfdict_fst_addarc(&(pStates[d]), (int) ((unsigned char) pKey[d]));
+    }
+    pStates[klen].final = 1;
+    pStates[klen].fout = 0;
+    
+    /* Move the output along the shared prefix, leaving on each arc the
+     * part common to this key and the keys before, and pushing the rest
+     * of the arc's old output down to the next node */
+    u = rfdict_fst_tou(rfdict_pack_get(&(pFrozen->val), i));
+    for(d = 1; d <= p; d++) {
+      a = pStates[d - 1].narcs - 1;
+      common = (pStates[d - 1].pOut)[a];
+      if (u < common) {
+        common = u;
+      }
+      suffix = (pStates[d - 1].pOut)[a] - common;
+      (pStates[d - 1].pOut)[a] = common;
+      
+      if (suffix != 0) {
+        for(a = 0; a < pStates[d].narcs; a++) {
+          (pStates[d].pOut)[a] += suffix;
+        }
+        if (pStates[d].final) {
+          pStates[d].fout += suffix;
+        }
+      }
+      u -= common;
+    }
+    
+    /* Put the rest on the first new arc, or the final output if the key
+     * added no arcs, which only happens for an empty first key */
+    if (klen > p) {
+      (pStates[p].pOut)[pStates[p].narcs - 1] = u;
+    } else {
+      pStates[klen].fout = u;
+    }
+    
+    pPrev = pKey;
+    prevlen = klen;
+  }
+  
+  /* Complete the remaining nodes and the root */
+  for(d = prevlen; d > 0; d--) {
+    (pStates[d - 1].pTarget)[pStates[d - 1].narcs - 1] =
+      rfdict_fst_compile(&build, &(pStates[d]));
+  }
+  root = rfdict_fst_compile(&build, &(pStates[0]));
+  
+  /* Write the header */
+  memcpy(build.pImage + RFDICT_FST_HDR_SIG, RFDICT_FST_SIG, 8);
+  rfdict_disk_put16(build.pImage + RFDICT_FST_HDR_VERSION, 0);
+  rfdict_disk_put16(build.pImage + RFDICT_FST_HDR_VERSION + 2,
+    RFDICT_FST_VERSION);
+  rfdict_disk_put16(build.pImage + RFDICT_FST_HDR_SENS, 0);
+  if (pDict->sensitive) {
+    rfdict_disk_put16(build.pImage + RFDICT_FST_HDR_SENS + 2, 1);
+  } else {
+    rfdict_disk_put16(build.pImage + RFDICT_FST_HDR_SENS + 2, 0);
+  }
+  rfdict_disk_put64(build.pImage + RFDICT_FST_HDR_COUNT, pFrozen->count);
+  rfdict_disk_put64(build.pImage + RFDICT_FST_HDR_MAXLEN, (long) maxlen);
+  rfdict_disk_put64(build.pImage + RFDICT_FST_HDR_ROOT, (long) root);
+  rfdict_disk_put64(build.pImage + RFDICT_FST_HDR_DATALEN,
+                    (long) (build.len - RFDICT_FST_HDR_SIZE));
+  
+  /* Wrap the image, trimmed to size */
+  build.pImage = (unsigned char *) realloc(build.pImage, build.len);
+  if (build.pImage == NULL) {
+    abort();
+  }
+  pFst = rfdict_fst_map(build.pImage, build.len);
+  if (pFst == NULL) {
+    abort();  /* shouldn't happen */
+  }
+  pFst->owned = 1;
+  
+  /* Release work memory */
+  for(d = 0; d <= maxlen; d++) {
+    free(pStates[d].pLabel);
+    free(pStates[d].pOut);
+    free(pStates[d].pTarget);
+  }
+  free(pStates);
+  free(build.pCanon);
+  free(build.pSlotOff);
+  free(build.pSlotLen);
+  free(build.pSlotNode);
+  free(build.pScratch);
+  rfdict_frozen_free(pFrozen);
+  
+  return pFst;
+}
+
+/*
+ * rfdict_fst_map function.
+ */
+RFDICT_FST *rfdict_fst_map(const void *pImage, size_t len) {
+  
+  const unsigned char *pb = NULL;
+  RFDICT_FST *pFst = NULL;
+  long count = 0;
+  long maxlen = 0;
+  long root = 0;
+  long dlen = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if (pImage == NULL) {
+    abort();
+  }
+  pb = (const unsigned char *) pImage;
+  
+  /* Check the header */
+  if (len < RFDICT_FST_HDR_SIZE) {
+    status = 0;
+  }
+  if (status) {
+    if ((memcmp(pb + RFDICT_FST_HDR_SIG, RFDICT_FST_SIG, 8) != 0) ||
+        (rfdict_disk_get16(pb + RFDICT_FST_HDR_VERSION) != 0) ||
+        (rfdict_disk_get16(pb + RFDICT_FST_HDR_VERSION + 2) !=
+          RFDICT_FST_VERSION) ||
+        (rfdict_disk_get16(pb + RFDICT_FST_HDR_SENS) != 0) ||
+        (rfdict_disk_get16(pb + RFDICT_FST_HDR_SENS + 2) > 1)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    count = rfdict_disk_get64(pb + RFDICT_FST_HDR_COUNT);
+    maxlen = rfdict_disk_get64(pb + RFDICT_FST_HDR_MAXLEN);
+    root = rfdict_disk_get64(pb + RFDICT_FST_HDR_ROOT);
+    dlen = rfdict_disk_get64(pb + RFDICT_FST_HDR_DATALEN);
+    if ((count < 0) || (maxlen < 0) || (maxlen > RFDICT_MAXKEY) ||
+        (dlen < 1) || ((unsigned long) dlen > len - RFDICT_FST_HDR_SIZE) ||
+        (root < 0) || (root >= dlen)) {
+      status = 0;
+    }
+  }
+  
+  /* Wrap the image */
+  if (status) {
+    pFst = (RFDICT_FST *) malloc(sizeof(RFDICT_FST));
+    if (pFst == NULL) {
+      abort();
+    }
+    memset(pFst, 0, sizeof(RFDICT_FST));
+    
+    pFst->pImage = pb;
+    pFst->len = RFDICT_FST_HDR_SIZE + (size_t) dlen;
+    pFst->owned = 0;
+    pFst->sensitive = (int) rfdict_disk_get16(
+                            pb + RFDICT_FST_HDR_SENS + 2);
+    pFst->count = count;
+    pFst->maxlen = maxlen;
+    pFst->root = (size_t) root;
+    pFst->pData = pb + RFDICT_FST_HDR_SIZE;
+    pFst->dlen = (size_t) dlen;
+  }
+  
+  return pFst;
+}
+
+/*
+ * rfdict_fst_free function.
+ */
+void rfdict_fst_free(RFDICT_FST *pFst) {
+  if (pFst != NULL) {
+    if (pFst->owned) {
+      free((void *) pFst->pImage);
+    }
+    free(pFst);
+  }
+}
+
+/*
+ * rfdict_fst_image function.
+ */
+const void *rfdict_fst_image(RFDICT_FST *pFst, size_t *pLen) {
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pLen == NULL)) {
+    abort();
+  }
+  
+  *pLen = pFst->len;
+  return pFst->pImage;
+}
+
+/*
+ * rfdict_fst_count function.
+ */
+long rfdict_fst_count(RFDICT_FST *pFst) {
+  if (pFst == NULL) {
+    abort();
+  }
+  return pFst->count;
+}
+
+/*
+ * rfdict_fst_get function.
+ */
+long rfdict_fst_get(RFDICT_FST *pFst, const char *pKey, long dvalue) {
+  
+  unsigned long acc = 0;
+  unsigned long fout = 0;
+  unsigned long narcs = 0;
+  unsigned long out = 0;
+  size_t node = 0;
+  size_t pos = 0;
+  size_t target = 0;
+  long result = 0;
+  int final = 0;
+  int label = 0;
+  int c = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Follow the arcs for each byte, adding up the outputs */
+  result = dvalue;
+  pos = pFst->root;
+  for( ; status && (*pKey != 0); pKey++) {
+    c = (int) ((unsigned char) *pKey);
+    if ((!(pFst->sensitive)) &&
+        (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    
+    node = pos;
+    status = rfdict_fst_node(pFst, node, &final, &fout, &narcs, &pos);
+    for( ; status && (narcs > 0); narcs--) {
+      status = rfdict_fst_arc(pFst, node, &pos, &label, &out, &target);
+      if (label >= c) {
+        break;
+      }
+    }
+    if (status && (narcs > 0) && (label == c)) {
+      acc += out;
+      pos = target;
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* The key is present if it ends on a final node */
+  if (status) {
+    status = rfdict_fst_node(pFst, pos, &final, &fout, &narcs, &target);
+  }
+  if (status && final) {
+    result = rfdict_tolong((acc + fout) ^ (1UL << (RFDICT_WORD_BITS - 1)));
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_fst_prefix function.
+ */
+void rfdict_fst_prefix(
+    RFDICT_FST      * pFst,
+    const char      * pPrefix,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  
+  char *pKey = NULL;
+  size_t *pNode = NULL;
+  size_t *pArcs = NULL;
+  unsigned long *pLeft = NULL;
+  unsigned long *pAcc = NULL;
+  unsigned long acc = 0;
+  unsigned long fout = 0;
+  unsigned long narcs = 0;
+  unsigned long out = 0;
+  size_t plen = 0;
+  size_t depth = 0;
+  size_t node = 0;
+  size_t pos = 0;
+  size_t target = 0;
+  int final = 0;
+  int label = 0;
+  int c = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pPrefix == NULL) || (fp == NULL)) {
+    abort();
+  }
+  
+  /* Nothing matches a prefix longer than every key */
+  plen = strlen(pPrefix);
+  if (plen > (size_t) pFst->maxlen) {
+    status = 0;
+  }
+  
+  /* Allocate the key buffer and a stack entry for each depth, holding
+   * the node, the next arc to visit, the number of arcs left, and the
+   * output sum so far */
+  if (status) {
+    pKey = (char *) malloc((size_t) pFst->maxlen + 1);
+    pNode = (size_t *) malloc(
+              ((size_t) pFst->maxlen + 1) * sizeof(size_t));
+    pArcs = (size_t *) malloc(
+              ((size_t) pFst->maxlen + 1) * sizeof(size_t));
+    pLeft = (unsigned long *) malloc(
+              ((size_t) pFst->maxlen + 1) * sizeof(unsigned long));
+    pAcc = (unsigned long *) malloc(
+              ((size_t) pFst->maxlen + 1) * sizeof(unsigned long));
+    if ((pKey == NULL) || (pNode == NULL) || (pArcs == NULL) ||
+        (pLeft == NULL) || (pAcc == NULL)) {
+      abort();
+    }
+  }
+  
+  /* Follow the prefix */
+  pos = pFst->root;
+  for(depth = 0; status && (depth < plen); depth++) {
+    c = (int) ((unsigned char) pPrefix[depth]);
+    if ((!(pFst->sensitive)) &&
+        (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    pKey[depth] = (char) c;
+    
+    node = pos;
+    status = rfdict_fst_node(pFst, node, &final, &fout, &narcs, &pos);
+    for( ; status && (narcs > 0); narcs--) {
+      status = rfdict_fst_arc(pFst, node, &pos, &label, &out, &target);
+      if (label >= c) {
+        break;
+      }
+    }
+    if (status && (narcs > 0) && (label == c)) {
+      acc += out;
+      pos = target;
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Visit the node at the end of the prefix */
+  node = pos;
+  if (status) {
+    status = rfdict_fst_node(pFst, node, &final, &fout, &narcs, &pos);
+  }
+  if (status && final) {
+    pKey[depth] = 0;
+    status = fp(pCustom, pKey,
+                rfdict_tolong((acc + fout) ^
+                              (1UL << (RFDICT_WORD_BITS - 1))));
+  }
+  if (status) {
+    pNode[depth] = node;
+    pArcs[depth] = pos;
+    pLeft[depth] = narcs;
+    pAcc[depth] = acc;
+  }
+  
+  /* Walk the nodes below depth-first, visiting arcs in label order so
+   * that keys are reported in ascending order of unsigned bytes */
+  while (status) {
+    if (pLeft[depth] < 1) {
+      /* All arcs of this node visited */
+      if (depth <= plen) {
+        break;
+      }
+      depth--;
+      continue;
+    }
+    
+    /* Follow the next arc */
+    status = rfdict_fst_arc(pFst, pNode[depth], &(pArcs[depth]),
+                            &label, &out, &target);
+    if (status) {
+      (pLeft[depth])--;
+      if (depth >= (size_t) pFst->maxlen) {
+        status = 0;  /* corrupt, deeper than the longest key */
+      }
+    }
+    if (status) {
+      pKey[depth] = (char) label;
+      acc = pAcc[depth] + out;
+      depth++;
+      
+      node = target;
+      status = rfdict_fst_node(pFst, node, &final, &fout, &narcs, &pos);
+    }
+    if (status && final) {
+      pKey[depth] = 0;
+      status = fp(pCustom, pKey,
+                  rfdict_tolong((acc + fout) ^
+                                (1UL << (RFDICT_WORD_BITS - 1))));
+    }
+    if (status) {
+      pNode[depth] = node;
+      pArcs[depth] = pos;
+      pLeft[depth] = narcs;
+      pAcc[depth] = acc;
+    }
+  }
+  
+  /* Release work memory */
+  free(pKey);
+  free(pNode);
+  free(pArcs);
+  free(pLeft);
+  free(pAcc);
+}
+
+/*
+ * rfdict_compile_scanner function.
+ */
+RFDICT_SCANNER *rfdict_compile_scanner(RFDICT *pDict) {
+  
+  RFDICT_SCANNER *pScanner = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  const char *pKey = NULL;
+  const char *pPrev = NULL;
+  long *pRange = NULL;
+  long *pNext = NULL;
+  long *pSwap = NULL;
+  long *pLen = NULL;
+  long *pVal = NULL;
+  long nrange = 0;
+  long nnext = 0;
+  long nodes = 0;
+  long nterm = 0;
+  long next_id = 0;
+  long v = 0;
+  long u = 0;
+  long f = 0;
+  long x = 0;
+  long r = 0;
+  long i = 0;
+  long iend = 0;
+  size_t d = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  
+  /* Get the keys in order */
+  pFrozen = rfdict_frozen_build(pDict, 0);
+  
+  /* Count the trie nodes, as for rfdict_louds_build() */
+  nodes = 1;
+  for(i = 0; i < pFrozen->count; i++) {
+    pKey = pFrozen->pKeys + (pFrozen->pOffset)[i];
+    d = 0;
+    if (pPrev != NULL) {
+      for( ; (pKey[d] != 0) && (pKey[d] == pPrev[d]); d++);
+    }
+    nodes += (long) (strlen(pKey) - d);
+    pPrev = pKey;
+  }
+  
+  /* Allocate and clear structure */
+  pScanner = (RFDICT_SCANNER *) malloc(sizeof(RFDICT_SCANNER));
+  if (pScanner == NULL) {
+    abort();
+  }
+  memset(pScanner, 0, sizeof(RFDICT_SCANNER));
+  
+  pScanner->sensitive = pDict->sensitive;
+  pScanner->nodes = nodes;
+  pScanner->pFirst = (long *) malloc(((size_t) (nodes + 1)) *
+                                      sizeof(long));
+  pScanner->pLabel = (unsigned char *) malloc((size_t) nodes);
+  pScanner->pFail = (long *) malloc(((size_t) nodes) * sizeof(long));
+  pScanner->pTerm = (long *) malloc(((size_t) nodes) * sizeof(long));
+  pScanner->pDict = (long *) malloc(((size_t) nodes) * sizeof(long));
+  if ((pScanner->pFirst == NULL) || (pScanner->pLabel == NULL) ||
+      (pScanner->pFail == NULL) || (pScanner->pTerm == NULL) ||
+      (pScanner->pDict == NULL)) {
+    abort();
+  }
+  for(c = 0; c < 256; c++) {
+    (pScanner->aRoot)[c] = 0;
+  }
+  
+  /* Allocate work arrays, as for rfdict_louds_build() */
+  pRange = (long *) malloc(((size_t) (2 * pFrozen->count + 2)) *
+                            sizeof(long));
+  pNext = (long *) malloc(((size_t) (2 * pFrozen->count + 2)) *
+                            sizeof(long));
+  pLen = (long *) malloc(((size_t) (pFrozen->count + 1)) * sizeof(long));
+  pVal = (long *) malloc(((size_t) (pFrozen->count + 1)) * sizeof(long));
+  if ((pRange == NULL) || (pNext == NULL) || (pLen == NULL) ||
+      (pVal == NULL)) {
+    abort();
+  }
+  
+  /* Generate the trie level by level, numbering the children of each
+   * node in turn; an empty key can not be matched, so it is left out */
+  pRange[0] = 0;
+  pRange[1] = pFrozen->count;
+  nrange = 1;
+  v = 0;
+  next_id = 1;
+  for(d = 0; nrange > 0; d++) {
+    nnext = 0;
+    for(r = 0; r < nrange; r++) {
+      (pScanner->pFirst)[v] = next_id;
+      (pScanner->pTerm)[v] = -1;
+      for(i = pRange[2 * r]; i < pRange[2 * r + 1]; i = iend) {
+        pKey = pFrozen->pKeys + (pFrozen->pOffset)[i];
+        c = (int) ((unsigned char) pKey[d]);
+        
+        /* Find the end of the group */
+        for(iend = i + 1; iend < pRange[2 * r + 1]; iend++) {
+          if ((pFrozen->pKeys + (pFrozen->pOffset)[iend])[d] != pKey[d]) {
+            break;
+          }
+        }
+        
+        if (c == 0) {
+          /* Key ends here */
+          if (d > 0) {
+            (pScanner->pTerm)[v] = nterm;
+            pLen[nterm] = (long) d;
+            pVal[nterm] = rfdict_pack_get(&(pFrozen->val), i);
+            nterm++;
+          }
+          
+        } else {
+          /* Child node */
+          (pScanner->pLabel)[next_id] = (unsigned char) c;
+          if (v == 0) {
+            (pScanner->aRoot)[c] = next_id;
+          }
+          next_id++;
+          pNext[2 * nnext] = i;
+          pNext[2 * nnext + 1] = iend;
+          nnext++;
+        }
+      }
+      v++;
+    }
+    
+    pSwap = pRange;
+    pRange = pNext;
+    pNext = pSwap;
+    nrange = nnext;
+  }
+  (pScanner->pFirst)[nodes] = nodes;
+  if ((v != nodes) || (next_id != nodes)) {
+    abort();  /* shouldn't happen */
+  }
+  (pScanner->pLabel)[0] = 0;
+  pScanner->count = nterm;
+  
+  /* Compute the failure and dictionary links in breadth-first order,
+   * so that the links of shorter strings are ready when needed */
+  (pScanner->pFail)[0] = 0;
+  (pScanner->pDict)[0] = 0;
+  for(v = 0; v < nodes; v++) {
+    for(u = (pScanner->pFirst)[v]; u < (pScanner->pFirst)[v + 1]; u++) {
+      c = (int) (pScanner->pLabel)[u];
+      
+      /* Follow the failure links of the parent until a node has a child
+       * with the same label */
+      x = 0;
+      if (v > 0) {
+        for(f = (pScanner->pFail)[v]; ; f = (pScanner->pFail)[f]) {
+          x = rfdict_scan_child(pScanner, f, c);
+          if ((x != 0) || (f == 0)) {
+            break;
+          }
+        }
+      }
+      (pScanner->pFail)[u] = x;
+      
+      if ((pScanner->pTerm)[x] >= 0) {
+        (pScanner->pDict)[u] = x;
+      } else {
+        (pScanner->pDict)[u] = (pScanner->pDict)[x];
+      }
+    }
+  }
+  
+  /* Pack the key lengths and values */
+  rfdict_pack_init(&(pScanner->len), pLen, nterm);
+  rfdict_pack_init(&(pScanner->val), pVal, nterm);
+  
+  /* Release work memory */
+  free(pRange);
+  free(pNext);
+  free(pLen);
+  free(pVal);
+  rfdict_frozen_free(pFrozen);
+  
+  return pScanner;
+}
+
+/*
+ * rfdict_scanner_free function.
+ */
+void rfdict_scanner_free(RFDICT_SCANNER *pScanner) {
+  if (pScanner != NULL) {
+    free(pScanner->pFirst);
+    free(pScanner->pLabel);
+    free(pScanner->pFail);
+    free(pScanner->pTerm);
+    free(pScanner->pDict);
+    free((pScanner->len).pWord);
+    free((pScanner->val).pWord);
+    free(pScanner);
+  }
+}
+
+/*
+ * rfdict_scanner_count function.
+ */
+long rfdict_scanner_count(RFDICT_SCANNER *pScanner) {
+  if (pScanner == NULL) {
+    abort();
+  }
+  return pScanner->count;
+}
+
+/*
+ * rfdict_scanpos_init function.
+ */
+void rfdict_scanpos_init(RFDICT_SCANPOS *pPos) {
+  
+  /* Check parameters */
+  if (pPos == NULL) {
+    abort();
+  }
+  
+  /* Clear the position */
+  memset(pPos, 0, sizeof(RFDICT_SCANPOS));
+  pPos->node = 0;
+  pPos->offset = 0;
+}
+
+/*
+ * rfdict_scan function.
+ */
+int rfdict_scan(
+    RFDICT_SCANNER  * pScanner,
+    RFDICT_SCANPOS  * pPos,
+    const char      * pBuf,
+    size_t            len,
+    rfdict_fp_match   fp,
+    void            * pCustom) {
+  
+  long node = 0;
+  long x = 0;
+  long t = 0;
+  long klen = 0;
+  size_t i = 0;
+  int c = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pScanner == NULL) || (pPos == NULL) || (fp == NULL)) {
+    abort();
+  }
+  if ((pBuf == NULL) && (len > 0)) {
+    abort();
+  }
+  if ((pPos->node < 0) || (pPos->node >= pScanner->nodes) ||
+      (pPos->offset < 0)) {
+    abort();
+  }
+  
+  /* Resume from the saved node */
+  node = pPos->node;
+  for(i = 0; status && (i < len); i++) {
+    c = (int) ((unsigned char) pBuf[i]);
+    if ((!(pScanner->sensitive)) &&
+        (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+      c -= (ASCII_LOWER_A - ASCII_UPPER_A);
+    }
+    
+    /* Follow failure links until the byte can be matched, or the root
+     * is reached */
+    for( ; ; node = (pScanner->pFail)[node]) {
+      x = rfdict_scan_child(pScanner, node, c);
+      if ((x != 0) || (node == 0)) {
+        break;
+      }
+    }
+    node = x;
+    
+    /* Report every key ending here, longest first */
+    if ((pScanner->pTerm)[node] >= 0) {
+      t = node;
+    } else {
+      t = (pScanner->pDict)[node];
+    }
+    for( ; status && (t != 0); t = (pScanner->pDict)[t]) {
+      klen = rfdict_pack_get(&(pScanner->len), (pScanner->pTerm)[t]);
+      status = fp(pCustom,
+                  pPos->offset + ((long) i) + 1 - klen,
+                  klen,
+                  rfdict_pack_get(&(pScanner->val), (pScanner->pTerm)[t]));
+    }
+  }
+  
+  /* Save the position */
+  pPos->node = node;
+  pPos->offset += (long) i;
+  
+  return status;
+}
+
+/*
+ * rfdict_fuzzy function.
+ */
+void rfdict_fuzzy(
+    RFDICT          * pDict,
+    const char      * pKey,
+    int               max_edits,
+    rfdict_fp_fuzzy   fp,
+    void            * pCustom) {
+  
+  RFDICT_NODE *pNode = NULL;
+  const char *pPrev = NULL;
+  const char *pCand = NULL;
+  char *pQuery = NULL;
+  char *pTarget = NULL;
+  int *pRows = NULL;
+  long n = 0;
+  long have = 0;
+  long d = 0;
+  long width = 0;
+  long j = 0;
+  int k = 0;
+  int c = 0;
+  int b = 0;
+  int dist = 0;
+  int status = 1;
+  size_t i = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL) || (fp == NULL)) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  if ((max_edits < 0) || (max_edits > RFDICT_MAXEDITS)) {
+    abort();
+  }
+  n = (long) strlen(pKey);
+  if (n > RFDICT_MAXKEY) {
+    abort();
+  }
+  k = max_edits;
+  width = 2 * ((long) k) + 1;
+  
+  /* Copy the query, mapping it in the same way as stored keys */
+  pQuery = (char *) malloc((size_t) (n + 1));
+  if (pQuery == NULL) {
+    abort();
+  }
+  for(i = 0; i <= (size_t) n; i++) {
+    pQuery[i] = pKey[i];
+    if ((!(pDict->sensitive)) &&
+        (pQuery[i] >= ASCII_LOWER_A) && (pQuery[i] <= ASCII_LOWER_Z)) {
+      pQuery[i] = (char) (pQuery[i] - (ASCII_LOWER_A - ASCII_UPPER_A));
+    }
+  }
+  
+  /* Allocate rows for every depth at which a key can still match,
+   * since no prefix longer than (n + k) can */
+  pRows = (int *) malloc(((size_t) ((n + k + 2) * width)) * sizeof(int));
+  pTarget = (char *) malloc((size_t) (n + k + 2));
+  if ((pRows == NULL) || (pTarget == NULL)) {
+    abort();
+  }
+  rfdict_fuzzy_row(pRows, NULL, 0, 0, pQuery, n, k);
+  
+  /* Visit the keys in order, reusing the rows of the prefix that each
+   * key shares with the previous one, and skipping every key with a
+   * prefix that is already too far from the query */
+  have = 0;
+  pNode = rfdict_first(pDict);
+  while (status && (pNode != NULL)) {
+    pCand = pNode->pKey;
+    
+    /* Find the rows that are still valid */
+    d = 0;
+    if (pPrev != NULL) {
+      for( ; (d < have) && (pCand[d] == pPrev[d]); d++);
+    }
+    
+    /* Extend the rows over the rest of the key */
+    for( ; pCand[d] != 0; d++) {
+      dist = rfdict_fuzzy_row(
+                pRows + (d + 1) * width,
+                pRows + d * width,
+                d + 1,
+                (int) ((unsigned char) pCand[d]),
+                pQuery, n, k);
+      if (dist > k) {
+        break;
+      }
+    }
+    
+    if (pCand[d] != 0) {
+      /* The prefix failed at byte c.  If c does not occur in the query
+       * within the band, then neither can any other such byte, so the
+       * next byte must be the least query byte in the band after c;
+       * otherwise, skip just the keys that start with the failed
+       * prefix */
+      c = (int) ((unsigned char) pCand[d]);
+      b = 256;
+      for(j = d + 1 - k; j <= d + 1 + k; j++) {
+        if ((j >= 1) && (j <= n)) {
+          if (((unsigned char) pQuery[j - 1]) == c) {
+            break;
+          }
+          if ((((unsigned char) pQuery[j - 1]) > c) &&
+              (((unsigned char) pQuery[j - 1]) < b)) {
+            b = (unsigned char) pQuery[j - 1];
+          }
+        }
+      }
+      
+      have = d;
+      pPrev = pCand;
+      if (j <= d + 1 + k) {
+        pNode = rfdict_bound(pDict, pCand, (size_t) (d + 1), 1);
+        
+      } else if (b < 256) {
+        memcpy(pTarget, pCand, (size_t) d);
+        pTarget[d] = (char) b;
+        pNode = rfdict_bound(pDict, pTarget, (size_t) (d + 1), 0);
+        
+      } else {
+        pNode = rfdict_bound(pDict, pCand, (size_t) d, 1);
+      }
+      
+    } else {
+      /* Whole key read, so report it if it is close enough */
+      if ((n >= d - k) && (n <= d + k)) {
+        dist = (pRows + d * width)[n - d + k];
+        if (dist <= k) {
+          status = fp(pCustom, pCand, pNode->val, dist);
+        }
+      }
+      have = d;
+      pPrev = pCand;
+      pNode = rfdict_next(pNode);
+    }
+  }
+  
+  /* Release work memory */
+  free(pQuery);
+  free(pTarget);
+  free(pRows);
+}
+
+/*
+ * rfdict_match function.
+ */
+int rfdict_match(
+    RFDICT          * pDict,
+    const char      * pPattern,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  
+  RFDICT_RE re;
+  RFDICT_NODE *pNode = NULL;
+  const char *pPrev = NULL;
+  const char *pCand = NULL;
+  char *pTarget = NULL;
+  long *pState = NULL;
+  long s = -1;
+  long e = -1;
+  long have = 0;
+  long d = 0;
+  long t = 0;
+  size_t n = 0;
+  int c = 0;
+  int b = 0;
+  int cont = 1;
+  int status = 1;
+  
+  /* Initialize structures */
+  memset(&re, 0, sizeof(RFDICT_RE));
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pPattern == NULL) || (fp == NULL)) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  
+  /* Remove the anchors at either end, unless the last one is escaped */
+  re.sensitive = pDict->sensitive;
+  re.pPat = (const unsigned char *) pPattern;
+  re.len = strlen(pPattern);
+  if ((re.len > 0) && ((re.pPat)[0] == '^')) {
+    (re.pPat)++;
+    (re.len)--;
+  }
+  if ((re.len > 0) && ((re.pPat)[re.len - 1] == '$')) {
+    for(n = re.len - 1; (n > 0) && ((re.pPat)[n - 1] == '\\'); n--);
+    if (((re.len - 1 - n) % 2) == 0) {
+      (re.len)--;
+    }
+  }
+  
+  /* Parse and compile the pattern */
+  status = rfdict_re_alt(&re, &s, &e);
+  if (status && (re.pos != re.len)) {
+    status = 0;
+  }
+  if (status) {
+    re.start = s;
+    re.final = rfdict_re_node(&re, RFDICT_RE_EPS);
+    ((re.pNode)[e]).out1 = re.final;
+    status = rfdict_re_compile(&re);
+  }
+  
+  if (status) {
+    /* Allocate the state at each depth, and a buffer for seeking */
+    pState = (long *) malloc((RFDICT_MAXKEY + 2) * sizeof(long));
+    pTarget = (char *) malloc(RFDICT_MAXKEY + 2);
+    if ((pState == NULL) || (pTarget == NULL)) {
+      abort();
+    }
+    pState[0] = 0;
+    
+    /* Visit the keys in order, reusing the states of the prefix that
+     * each key shares with the previous one, and seeking past every
+     * key with a prefix that the automaton rejects */
+    have = 0;
+    pNode = rfdict_first(pDict);
+    while (cont && (pNode != NULL)) {
+      pCand = pNode->pKey;
+      
+      /* Find the states that are still valid */
+      d = 0;
+      if (pPrev != NULL) {
+        for( ; (d < have) && (pCand[d] == pPrev[d]); d++);
+      }
+      
+      /* Run the automaton over the rest of the key */
+      for( ; pCand[d] != 0; d++) {
+        t = (re.pTrans)[pState[d] * 256 + ((unsigned char) pCand[d])];
+        if (t < 0) {
+          break;
+        }
+        pState[d + 1] = t;
+      }
+      
+      have = d;
+      pPrev = pCand;
+      if (pCand[d] != 0) {
+        /* Seek to the least byte after the rejected one that the
+         * automaton accepts, or past the whole prefix if none */
+        c = (int) ((unsigned char) pCand[d]);
+        for(b = c + 1; b < 256; b++) {
+          if ((re.pTrans)[pState[d] * 256 + b] >= 0) {
+            break;
+          }
+        }
+        if (b < 256) {
+          memcpy(pTarget, pCand, (size_t) d);
+          pTarget[d] = (char) b;
+          pNode = rfdict_bound(pDict, pTarget, (size_t) (d + 1), 0);
+        } else {
+          pNode = rfdict_bound(pDict, pCand, (size_t) d, 1);
+        }
+        
+      } else {
+        /* Whole key read, so report it if the automaton accepts it */
+        if ((re.pAccept)[pState[d]]) {
+          cont = fp(pCustom, pCand, pNode->val);
+        }
+        pNode = rfdict_next(pNode);
+      }
+    }
+  }
+  
+  /* Release work memory */
+  free(pState);
+  free(pTarget);
+  rfdict_re_release(&re);
+  
+  return status;
+}
+
+/*
+ * rfdict_pool_alloc function.
+ */
+RFDICT_POOL *rfdict_pool_alloc(void) {
+  
+  RFDICT_POOL *pPool = NULL;
+  
+  /* Allocate pool structure and clear it */
+  pPool = (RFDICT_POOL *) malloc(sizeof(RFDICT_POOL));
+  if (pPool == NULL) {
+    abort();
+  }
+  memset(pPool, 0, sizeof(RFDICT_POOL));
+  
+  /* Initialize the pool, holding the client's handle */
+  pPool->slots = 64;
+  pPool->ppSlot = (RFDICT_POOL_ENTRY **) calloc(
+                    (size_t) pPool->slots, sizeof(RFDICT_POOL_ENTRY *));
+  if (pPool->ppSlot == NULL) {
+    abort();
+  }
+  pPool->count = 0;
+  pPool->nbytes = 0;
+  pPool->refs = 1;
+  
+  return pPool;
+}
+
+/*
+ * rfdict_pool_free function.
+ */
+void rfdict_pool_free(RFDICT_POOL *pPool) {
+  if (pPool != NULL) {
+    rfdict_pool_drop(pPool);
+  }
+}
+
+/*
+ * rfdict_pool_count function.
+ */
+long rfdict_pool_count(RFDICT_POOL *pPool) {
+  if (pPool == NULL) {
+    abort();
+  }
+  return pPool->count;
+}
+
+/*
+ * rfdict_pool_bytes function.
+ */
+size_t rfdict_pool_bytes(RFDICT_POOL *pPool) {
+  if (pPool == NULL) {
+    abort();
+  }
+  return pPool->nbytes;
+}
+
+/*
+ * rfdict_alloc_pooled function.
+ */
+RFDICT *rfdict_alloc_pooled(int sensitive, RFDICT_POOL *pPool) {
+  
+  RFDICT *pDict = NULL;
+  
+  /* Allocate an ordinary dictionary */
+  pDict = rfdict_alloc(sensitive);
+  
+  /* Attach it to the pool, if any */
+  if (pPool != NULL) {
+    if (pPool->refs < 1) {
+      abort();
+    }
+    (pPool->refs)++;
+    pDict->pPool = pPool;
+  }
+  
+  return pDict;
+}
+
+/*
+ * rfdict_get_key function.
+ */
+const char *rfdict_get_key(RFDICT *pDict, const char *pKey) {
+  
+  RFDICT_NODE *pNode = NULL;
+  const char *pResult = NULL;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Search for the node, compressing the key first if the dictionary
+   * is compressed, and point to its key if found */
+  if (pDict->pCodec != NULL) {
+    pNode = rfdict_coded_find(pDict, pKey);
+  } else {
+    pNode = rfdict_find(pDict, pKey);
+  }
+  if (pNode != NULL) {
+    pResult = pNode->pKey;
+  }
+  
+  return pResult;
+}
+
+/*
+ * rfdict_verify function.
+ */
+int rfdict_verify(RFDICT *pDict, int nthreads) {
+  
+  RFDICT_VERIFY_PART aPart[RFDICT_VERIFY_MAXPARTS];
+  RFDICT_NODE *apLevel[RFDICT_VERIFY_MAXPARTS];
+  RFDICT_VERIFY_PART whole;
+#ifdef RFDICT_THREADS
+  pthread_t aThread[RFDICT_VERIFY_MAXPARTS];
+  int aStarted[RFDICT_VERIFY_MAXPARTS];
+#endif
+  RFDICT_NODE *pNode = NULL;
+  long nlevel = 0;
+  long nnext = 0;
+  long i = 0;
+  int limit = 0;
+  int d = 0;
+  int status = 1;
+  
+  /* Initialize structures */
+  memset(&(aPart[0]), 0, sizeof(aPart));
+  memset(&whole, 0, sizeof(RFDICT_VERIFY_PART));
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+  if (nthreads > RFDICT_VERIFY_MAXPARTS) {
+    nthreads = RFDICT_VERIFY_MAXPARTS;
+  }
+  
+  /* The root must be black and have no parent */
+  if (pDict->pRoot != NULL) {
+    if (((pDict->pRoot)->pParent != NULL) || (pDict->pRoot)->red) {
+      status = 0;
+    }
+  }
+  
+  /* Split the tree at the deepest level with no more nodes than
+   * threads, collecting that level in order */
+  for(limit = 0; (2L << limit) <= (long) nthreads; limit++);
+  if (status && (pDict->pRoot != NULL)) {
+    apLevel[0] = pDict->pRoot;
+    nlevel = 1;
+    for(d = 0; d < limit; d++) {
+      nnext = 0;
+      for(i = 0; i < nlevel; i++) {
+        pNode = apLevel[i];
+        if (pNode->pLeft != NULL) {
+          aPart[nnext++].pRoot = pNode->pLeft;
+        }
+        if (pNode->pRight != NULL) {
+          aPart[nnext++].pRoot = pNode->pRight;
+        }
+      }
+      for(i = 0; i < nnext; i++) {
+        apLevel[i] = aPart[i].pRoot;
       }
-      
-      /* Comparison */
-      if (c1 != c2) {
-        break;
+      nlevel = nnext;
+    }
+    for(i = 0; i < nlevel; i++) {
+      aPart[i].pRoot = apLevel[i];
+      aPart[i].pDict = pDict;
+    }
+  }
+  
+  /* Verify the parts, on their own threads if threads are enabled and
+   * more than one was asked for */
+#ifdef RFDICT_THREADS
+  for(i = 0; i < nlevel; i++) {
+    aStarted[i] = 0;
+    if ((nthreads > 1) && (pthread_create(
+          &(aThread[i]), NULL, &rfdict_verify_thread, &(aPart[i])) == 0)) {
+      aStarted[i] = 1;
+    } else {
+      rfdict_verify_walk(&(aPart[i]), -1, NULL, 0);
+    }
+  }
+  for(i = 0; i < nlevel; i++) {
+    if (aStarted[i]) {
+      if (pthread_join(aThread[i], NULL) != 0) {
+        abort();
+      }
+    }
+  }
+#else
+  for(i = 0; i < nlevel; i++) {
+    rfdict_verify_walk(&(aPart[i]), -1, NULL, 0);
+  }
+#endif
+  
+  /* Verify the levels above the parts, merging in their results */
+  if (status) {
+    whole.pRoot = pDict->pRoot;
+    whole.pDict = pDict;
+    rfdict_verify_walk(&whole, limit, &(aPart[0]), nlevel);
+    if (!(whole.ok)) {
+      status = 0;
+    }
+  }
+  
+  /* The statistics must match the tree */
+  if (status) {
+    if ((whole.count != pDict->count) || (whole.nbytes != pDict->nbytes)) {
+      status = 0;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * rfdict_freeze_async function.
+ */
+RFDICT_FREEZE *rfdict_freeze_async(RFDICT *pDict, int policy) {
+  
+  RFDICT_FREEZE *pFreeze = NULL;
+  
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
+  }
+  
+  /* Fixed-width and compressed keys are not text */
+  if ((pDict->width > 0) || (pDict->pCodec != NULL)) {
+    abort();
+  }
+  if ((policy != RFDICT_FREEZE_REJECT) && (policy != RFDICT_FREEZE_QUEUE)) {
+    abort();
+  }
+  
+  /* Allocate and clear structure */
+  pFreeze = (RFDICT_FREEZE *) malloc(sizeof(RFDICT_FREEZE));
+  if (pFreeze == NULL) {
+    abort();
+  }
+  memset(pFreeze, 0, sizeof(RFDICT_FREEZE));
+  
+  /* Start counting from the first node */
+  pFreeze->pDict = pDict;
+  pFreeze->count = pDict->count;
+  pFreeze->epoch = pDict->epoch;
+  pFreeze->policy = policy;
+  pFreeze->phase = RFDICT_FREEZE_COUNT;
+  pFreeze->pNode = rfdict_first(pDict);
+  pFreeze->i = 0;
+  pFreeze->keybytes = 0;
+  pFreeze->pBuild = NULL;
+  pFreeze->pVal = NULL;
+  pFreeze->pReady = NULL;
+  pFreeze->pPending = NULL;
+  if (policy == RFDICT_FREEZE_QUEUE) {
+    pFreeze->pPending = rfdict_alloc(pDict->sensitive);
+  }
+  
+  /* Hold off changes to the dictionary until the image is ready */
+  (pDict->freezes)++;
+  
+  /* Build the image on its own thread if threads are enabled; if the
+   * thread can not be started, steps build the image instead */
+#ifdef RFDICT_THREADS
+  pFreeze->running = 0;
+  pFreeze->finished = 0;
+  if (pthread_mutex_init(&(pFreeze->lock), NULL) != 0) {
+    abort();
+  }
+  if (pthread_create(
+        &(pFreeze->worker), NULL, &rfdict_freeze_thread, pFreeze) == 0) {
+    pFreeze->running = 1;
+  }
+#endif
+  
+  return pFreeze;
+}
+
+/*
+ * rfdict_freeze_free function.
+ */
+void rfdict_freeze_free(RFDICT_FREEZE *pFreeze) {
+  if (pFreeze != NULL) {
+#ifdef RFDICT_THREADS
+    if (pFreeze->running) {
+      if (pthread_join(pFreeze->worker, NULL) != 0) {
+        abort();
       }
     }
+    if (pthread_mutex_destroy(&(pFreeze->lock)) != 0) {
+      abort();
+    }
+#endif
+    if (pFreeze->pDict != NULL) {
+      ((pFreeze->pDict)->freezes)--;
+    }
+    rfdict_frozen_free(pFreeze->pBuild);
+    rfdict_frozen_free(pFreeze->pReady);
+    free(pFreeze->pVal);
+    rfdict_free(pFreeze->pPending);
+    free(pFreeze);
+  }
+}
+
+/*
+ * rfdict_freeze_done function.
+ */
+int rfdict_freeze_done(RFDICT_FREEZE *pFreeze) {
+  if (pFreeze == NULL) {
+    abort();
+  }
+  return (pFreeze->pReady != NULL);
+}
+
+/*
+ * rfdict_freeze_step function.
+ */
+int rfdict_freeze_step(RFDICT_FREEZE *pFreeze, long n) {
+  
+  RFDICT *pDict = NULL;
+  int busy = 0;
+  
+  /* Check parameters */
+  if ((pFreeze == NULL) || (n < 0)) {
+    abort();
+  }
+  
+  /* Nothing to do once the image is ready; the phase is not read
+   * until then, since a build thread may be changing it */
+  if (pFreeze->pReady == NULL) {
     
-    /* If we stopped on null termination, fetch the characters */
-    if ((pKey1[i] == 0) || (pKey2[i] == 0)) {
-      c1 = pKey1[i];
-      c2 = pKey2[i];
+    /* The dictionary must not have changed since the freeze began */
+    pDict = pFreeze->pDict;
+    if ((pDict->count != pFreeze->count) ||
+        (pDict->epoch != pFreeze->epoch)) {
+      abort();
     }
     
-    /* Result is comparison of c1 and c2 */
-    if (c1 == c2) {
-      result = 0;
-    } else if (c1 > c2) {
-      result = 1;
-    } else if (c1 < c2) {
-      result = -1;
+    /* Leave the build to its thread until the thread has finished,
+     * then take the image back from it */
+#ifdef RFDICT_THREADS
+    if (pFreeze->running) {
+      if (pthread_mutex_lock(&(pFreeze->lock)) != 0) {
+        abort();
+      }
+      busy = !(pFreeze->finished);
+      if (pthread_mutex_unlock(&(pFreeze->lock)) != 0) {
+        abort();
+      }
+      if (!busy) {
+        if (pthread_join(pFreeze->worker, NULL) != 0) {
+          abort();
+        }
+        pFreeze->running = 0;
+      }
+    }
+#endif
+    
+    if (!busy) {
+      rfdict_freeze_move(pFreeze, n);
+      
+      /* Switch lookups over to the image, and let go of the
+       * dictionary */
+      if (pFreeze->phase == RFDICT_FREEZE_BUILT) {
+        pFreeze->pReady = pFreeze->pBuild;
+        pFreeze->pBuild = NULL;
+        (pDict->freezes)--;
+        pFreeze->pDict = NULL;
+        pFreeze->phase = RFDICT_FREEZE_READY;
+      }
+    }
+  }
+  
+  return (pFreeze->pReady != NULL);
+}
+
+/*
+ * rfdict_freeze_finish function.
+ */
+void rfdict_freeze_finish(RFDICT_FREEZE *pFreeze) {
+  
+  /* Check parameters */
+  if (pFreeze == NULL) {
+    abort();
+  }
+  
+  /* Wait for the build thread, if there is one */
+#ifdef RFDICT_THREADS
+  if (pFreeze->running) {
+    if (pthread_join(pFreeze->worker, NULL) != 0) {
+      abort();
+    }
+    pFreeze->running = 0;
+  }
+#endif
+  
+  /* Each node is visited twice, and the end of each phase takes one
+   * more step */
+  while (pFreeze->pReady == NULL) {
+    rfdict_freeze_step(pFreeze, 2 * pFreeze->count + 2);
+  }
+}
+
+/*
+ * rfdict_freeze_image function.
+ */
+RFDICT_FROZEN *rfdict_freeze_image(RFDICT_FREEZE *pFreeze) {
+  if (pFreeze == NULL) {
+    abort();
+  }
+  return pFreeze->pReady;
+}
+
+/*
+ * rfdict_freeze_get function.
+ */
+long rfdict_freeze_get(
+    RFDICT_FREEZE * pFreeze,
+    const char    * pKey,
+    long            dvalue) {
+  
+  long *pv = NULL;
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pFreeze == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Check the keys inserted since the freeze began, then the image if
+   * it is ready, else the dictionary */
+  if (pFreeze->pPending != NULL) {
+    pv = rfdict_get_ref(pFreeze->pPending, pKey);
+  }
+  if (pv != NULL) {
+    result = *pv;
+  } else if (pFreeze->pReady != NULL) {
+    result = rfdict_frozen_get(pFreeze->pReady, pKey, dvalue);
+  } else {
+    result = rfdict_get(pFreeze->pDict, pKey, dvalue);
+  }
+  
+  return result;
+}
+
+/*
+ * rfdict_freeze_insert function.
+ */
+int rfdict_freeze_insert(
+    RFDICT_FREEZE * pFreeze,
+    const char    * pKey,
+    long            val) {
+  
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pFreeze == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Fail if inserts are rejected, or if the key is already present in
+   * the frozen contents */
+  if (pFreeze->pPending == NULL) {
+    status = 0;
+  }
+  if (status) {
+    if (pFreeze->pReady != NULL) {
+      if (rfdict_frozen_find(pFreeze->pReady, pKey) >= 0) {
+        status = 0;
+      }
     } else {
-      abort();  /* shouldn't happen */
+      if (rfdict_find(pFreeze->pDict, pKey) != NULL) {
+        status = 0;
+      }
     }
   }
   
-  /* Return result */
+  /* Queue the key, which fails if it has already been queued */
+  if (status) {
+    status = rfdict_insert(pFreeze->pPending, pKey, val);
+  }
+  
+  return status;
+}
+
+/*
+ * rfdict_freeze_pending function.
+ */
+long rfdict_freeze_pending(RFDICT_FREEZE *pFreeze) {
+  
+  long result = 0;
+  
+  /* Check parameters */
+  if (pFreeze == NULL) {
+    abort();
+  }
+  
+  if (pFreeze->pPending != NULL) {
+    result = (pFreeze->pPending)->count;
+  }
+  
   return result;
 }
 
 /*
- * Find a node in the dictionary matching the given key.
- * 
- * NULL is returned if no node in the dictionary matches that key.
- * Comparisons are case-sensitive or case-insensitive depending on the
- * setting of the sensitive flag in the dictionary.
- * 
- * pDict is the dictionary to search.
- * 
- * pKey is the null-terminated key to find.
- * 
- * Parameters:
- * 
- *   pDict - the dictionary
- * 
- *   pKey - the key to search for
- * 
- * Return:
- * 
- *   the dictionary node matching the key, or NULL if no node matches
- *   the key
+ * rfdict_adapt_alloc function.
+ */
+RFDICT_ADAPT *rfdict_adapt_alloc(
+    int  sensitive,
+    long hash_ratio,
+    long freeze_ratio) {
+  
+  RFDICT_ADAPT *pAdapt = NULL;
+  
+  /* Allocate and clear structure */
+  pAdapt = (RFDICT_ADAPT *) malloc(sizeof(RFDICT_ADAPT));
+  if (pAdapt == NULL) {
+    abort();
+  }
+  memset(pAdapt, 0, sizeof(RFDICT_ADAPT));
+  
+  /* Start with an empty tree */
+  if (sensitive) {
+    pAdapt->sensitive = 1;
+  } else {
+    pAdapt->sensitive = 0;
+  }
+  if (hash_ratio > 0) {
+    pAdapt->hash_ratio = hash_ratio;
+  } else {
+    pAdapt->hash_ratio = 0;
+  }
+  if (freeze_ratio > 0) {
+    pAdapt->freeze_ratio = freeze_ratio;
+  } else {
+    pAdapt->freeze_ratio = 0;
+  }
+  pAdapt->engine = RFDICT_ENGINE_TREE;
+  pAdapt->pTree = rfdict_alloc(sensitive);
+  pAdapt->ppSlot = NULL;
+  pAdapt->slots = 0;
+  pAdapt->filled = 0;
+  pAdapt->pIndex = NULL;
+  pAdapt->pFreeze = NULL;
+  pAdapt->thaw = -1;
+  pAdapt->reads = 0;
+  pAdapt->writes = 0;
+  
+  return pAdapt;
+}
+
+/*
+ * rfdict_adapt_free function.
+ */
+void rfdict_adapt_free(RFDICT_ADAPT *pAdapt) {
+  if (pAdapt != NULL) {
+    free(pAdapt->ppSlot);
+    rfdict_freeze_free(pAdapt->pFreeze);
+    rfdict_free(pAdapt->pTree);
+    free(pAdapt);
+  }
+}
+
+/*
+ * rfdict_adapt_insert function.
  */
-static RFDICT_NODE *rfdict_find(RFDICT *pDict, const char *pKey) {
+int rfdict_adapt_insert(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey,
+    long           val) {
   
-  RFDICT_NODE *pCurrent = NULL;
-  int retval = 0;
+  RFDICT_NODE *pParent = NULL;
+  RFDICT_NODE *pNode = NULL;
+  int dir = 0;
+  int status = 1;
   
   /* Check parameters */
-  if ((pDict == NULL) || (pKey == NULL)) {
+  if ((pAdapt == NULL) || (pKey == NULL)) {
     abort();
   }
   
-  /* Start at root (or NULL if dictionary is empty) */
-  pCurrent = pDict->pRoot;
+  /* Make sure key size isn't too large */
+  if (strlen(pKey) > RFDICT_MAXKEY) {
+    abort();
+  }
   
-  /* Search until node found or we've gone through everything */
-  while (pCurrent != NULL) {
-    
-    /* Compare to current node */
-    retval = rfdict_keycmp(
-              pKey, &((pCurrent->key)[0]), pDict->sensitive);
+  /* Advance any move in progress */
+  rfdict_adapt_step(pAdapt);
+  
+  if (pAdapt->thaw >= 0) {
+    /* Moving back from the frozen engine, so keys are in the image or
+     * the new tree */
+    if (rfdict_frozen_find(
+          rfdict_freeze_image(pAdapt->pFreeze), pKey) >= 0) {
+      status = 0;
+    } else {
+      status = rfdict_insert(pAdapt->pTree, pKey, val);
+    }
     
-    /* Done if equal, else go down appropriate branch */
-    if (retval == 0) {
-      /* Equal -- done */
-      break;
+  } else if (pAdapt->pFreeze != NULL) {
+    /* Frozen engine, which queues new keys */
+    status = rfdict_freeze_insert(pAdapt->pFreeze, pKey, val);
     
-    } else if (retval < 0) {
-      /* Key less than current node */
-      pCurrent = pCurrent->pLeft;
-      
-    } else if (retval > 0) {
-      /* Key greater than current node */
-      pCurrent = pCurrent->pRight;
+  } else {
+    /* Tree engine, possibly with a hash table */
+    if (rfdict_seek(pAdapt->pTree, pKey, &pParent, &dir) != NULL) {
+      status = 0;
+    }
+    if (status) {
+      pNode = rfdict_attach(pAdapt->pTree, pKey, val, pParent, dir);
       
-    } else {
-      abort();  /* shouldn't happen */
+      /* Add the node to the hash table unless the walk filling the
+       * table has yet to reach it */
+      if (pAdapt->ppSlot != NULL) {
+        if ((pAdapt->pIndex == NULL) ||
+            (rfdict_keycmp(pNode->pKey, (pAdapt->pIndex)->pKey,
+                            pAdapt->sensitive) < 0)) {
+          *(rfdict_adapt_slot(pAdapt, pNode->pKey)) = pNode;
+          (pAdapt->filled)++;
+        }
+        
+        /* Start a larger table once this one is half full */
+        if (2 * pAdapt->filled > pAdapt->slots) {
+          rfdict_adapt_index(pAdapt, 1);
+        }
+      }
     }
   }
   
-  /* Return the matching node or NULL */
-  return pCurrent;
+  /* Account for the operation */
+  rfdict_adapt_note(pAdapt, 1);
+  
+  return status;
 }
 
 /*
- * Check whether a given node is red.
- * 
- * NULL may be passed.  This function returns non-zero only if the
- * passed node is not NULL and it is red.
- * 
- * Parameters:
- * 
- *   pNode - the node to check, or NULL
- * 
- * Return:
- * 
- *   non-zero if the node exists and is red, zero otherwise
+ * rfdict_adapt_get function.
  */
-static int rfdict_isred(RFDICT_NODE *pNode) {
+long rfdict_adapt_get(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey,
+    long           dvalue) {
   
-  int result = 0;
+  RFDICT_NODE *pNode = NULL;
+  long result = 0;
   
-  if (pNode != NULL) {
-    if (pNode->red) {
-      result = 1;
+  /* Check parameters */
+  if ((pAdapt == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Advance any move in progress */
+  rfdict_adapt_step(pAdapt);
+  
+  if (pAdapt->thaw >= 0) {
+    /* Moving back from the frozen engine */
+    pNode = rfdict_find(pAdapt->pTree, pKey);
+    if (pNode != NULL) {
+      result = pNode->val;
     } else {
-      result = 0;
+      result = rfdict_frozen_get(
+                  rfdict_freeze_image(pAdapt->pFreeze), pKey, dvalue);
     }
-  
+    
+  } else if (pAdapt->pFreeze != NULL) {
+    /* Frozen engine */
+    result = rfdict_freeze_get(pAdapt->pFreeze, pKey, dvalue);
+    
   } else {
-    result = 0;
+    /* Tree engine, using the hash table once it is complete */
+    if ((pAdapt->ppSlot != NULL) && (pAdapt->pIndex == NULL)) {
+      pNode = *(rfdict_adapt_slot(pAdapt, pKey));
+    } else {
+      pNode = rfdict_find(pAdapt->pTree, pKey);
+    }
+    if (pNode != NULL) {
+      result = pNode->val;
+    } else {
+      result = dvalue;
+    }
   }
   
+  /* Account for the operation */
+  rfdict_adapt_note(pAdapt, 0);
+  
   return result;
 }
 
 /*
- * Check whether a given node is black or doesn't exist.
- * 
- * NULL may be passed.  This function returns non-zero if the passed
- * node is not NULL and it is black, or if the passed node is NULL.
- * 
- * Parameters:
- * 
- *   pNode - the node to check, or NULL
- * 
- * Return:
- * 
- *   non-zero if the node does not exist or it exists and is black, zero
- *   otherwise
+ * rfdict_adapt_count function.
  */
-static int rfdict_isblack(RFDICT_NODE *pNode) {
+long rfdict_adapt_count(RFDICT_ADAPT *pAdapt) {
   
-  int result = 0;
+  RFDICT_FREEZE *pFreeze = NULL;
+  long result = 0;
   
-  if (pNode != NULL) {
-    if (pNode->red) {
-      result = 0;
-    } else {
-      result = 1;
-    }
+  /* Check parameters */
+  if (pAdapt == NULL) {
+    abort();
+  }
   
+  pFreeze = pAdapt->pFreeze;
+  if (pAdapt->thaw >= 0) {
+    result = (pAdapt->pTree)->count +
+              (rfdict_freeze_image(pFreeze))->count - pAdapt->thaw;
+  } else if (pFreeze != NULL) {
+    result = pFreeze->count + rfdict_freeze_pending(pFreeze);
   } else {
-    result = 1;
+    result = (pAdapt->pTree)->count;
   }
   
   return result;
 }
 
 /*
- * Rotate a node left.
- * 
- * The provided node may not be NULL.  The right child of the node must
- * exist or a fault will occur.
- * 
- * Let N be the provided node, and R be its right child.  R's left
- * subtree becomes N's right subtree, and N becomes R's left child.
- * Both nodes swap parents in the process.
- * 
- * If the provided node was originally the root node of the dictionary,
- * the dictionary is updated so that R becomes the new root.
- * 
- * Parameters:
- * 
- *   pNode - the node to rotate
- * 
- *   pDict - the dictionary
+ * rfdict_adapt_engine function.
  */
-static void rfdict_rol(RFDICT_NODE *pNode, RFDICT *pDict) {
-  
-  RFDICT_NODE *pR = NULL;
-  
-  /* Check parameter */
-  if ((pNode == NULL) || (pDict == NULL)) {
+int rfdict_adapt_engine(RFDICT_ADAPT *pAdapt) {
+  if (pAdapt == NULL) {
     abort();
   }
-  if (pNode->pRight == NULL) {
+  return pAdapt->engine;
+}
+
+/*
+ * rfdict_adapt_stats function.
+ */
+void rfdict_adapt_stats(RFDICT_ADAPT *pAdapt, RFDICT_ADAPT_STATS *pStats) {
+  if ((pAdapt == NULL) || (pStats == NULL)) {
     abort();
   }
+  memcpy(pStats, &(pAdapt->stats), sizeof(RFDICT_ADAPT_STATS));
+}
+
+/*
+ * rfdict_latency_enable function.
+ */
+int rfdict_latency_enable(RFDICT *pDict, long sample) {
   
-  /* Define right child */
-  pR = pNode->pRight;
-  
-  /* Perform rotation */
-  pNode->pRight = pR->pLeft;
-  pR->pLeft = pNode;
+  int status = 1;
+  int op = 0;
   
-  /* Update parent of the swapped subtree, if it isn't empty */
-  if (pNode->pRight != NULL) {
-    (pNode->pRight)->pParent = pNode;
+  /* Check parameters */
+  if (pDict == NULL) {
+    abort();
   }
   
-  /* Swap parents of the two nodes */
-  pR->pParent = pNode->pParent;
-  pNode->pParent = pR;
+  /* Drop any current timer */
+  free(pDict->pTimer);
+  pDict->pTimer = NULL;
   
-  /* Update new parent, or root node */
-  if (pR->pParent != NULL) {
-    /* Update parent */
-    if ((pR->pParent)->pLeft == pNode) {
-      (pR->pParent)->pLeft = pR;
-      
-    } else if ((pR->pParent)->pRight == pNode) {
-      (pR->pParent)->pRight = pR;
-      
-    } else {
-      abort();  /* shouldn't happen */
-    }
+  /* Timing needs the clock, which is only compiled in on request */
+#ifndef RFDICT_TIMING
+  if (sample > 0) {
+    status = 0;
+  }
+#endif
   
-  } else {
-    /* Update root */
-    pDict->pRoot = pR;
+  /* Start a new timer with empty histograms */
+  if (status && (sample > 0)) {
+    pDict->pTimer = (RFDICT_TIMER *) malloc(sizeof(RFDICT_TIMER));
+    if (pDict->pTimer == NULL) {
+      abort();
+    }
+    memset(pDict->pTimer, 0, sizeof(RFDICT_TIMER));
+    (pDict->pTimer)->sample = sample;
+    for(op = 0; op < RFDICT_NOPS; op++) {
+      ((pDict->pTimer)->aCountdown)[op] = sample;
+    }
   }
+  
+  return status;
 }
 
 /*
- * Rotate a node right.
- * 
- * The provided node may not be NULL.  The left child of the node must
- * exist or a fault will occur.
- * 
- * Let N be the provided node, and L be its left child.  L's right
- * subtree becomes N's left subtree, and N becomes L's right child.
- * Both nodes swap parents in the process.
- * 
- * If the provided node was originally the root node of the dictionary,
- * the dictionary is updated so that L becomes the new root.
- * 
- * Parameters:
- * 
- *   pNode - the node to rotate
- * 
- *   pDict - the dictionary
+ * rfdict_latency_snapshot function.
  */
-static void rfdict_ror(RFDICT_NODE *pNode, RFDICT *pDict) {
+int rfdict_latency_snapshot(
+    RFDICT           * pDict,
+    int                op,
+    RFDICT_HISTOGRAM * pHist) {
   
-  RFDICT_NODE *pL = NULL;
+  int status = 1;
   
   /* Check parameters */
-  if ((pNode == NULL) || (pDict == NULL)) {
+  if ((pDict == NULL) || (pHist == NULL)) {
     abort();
   }
-  if (pNode->pLeft == NULL) {
+  if ((op < 0) || (op >= RFDICT_NOPS)) {
     abort();
   }
   
-  /* Define left child */
-  pL = pNode->pLeft;
-  
-  /* Perform rotation */
-  pNode->pLeft = pL->pRight;
-  pL->pRight = pNode;
-  
-  /* Update parent of the swapped subtree, if it isn't empty */
-  if (pNode->pLeft != NULL) {
-    (pNode->pLeft)->pParent = pNode;
+  /* Copy the histogram, or clear it if timing is disabled */
+  if (pDict->pTimer != NULL) {
+    memcpy(pHist, &(((pDict->pTimer)->aHist)[op]),
+            sizeof(RFDICT_HISTOGRAM));
+  } else {
+    memset(pHist, 0, sizeof(RFDICT_HISTOGRAM));
+    status = 0;
   }
   
-  /* Swap parents of the two nodes */
-  pL->pParent = pNode->pParent;
-  pNode->pParent = pL;
+  return status;
+}
+
+/*
+ * rfdict_histogram_bound function.
+ */
+unsigned long rfdict_histogram_bound(int bucket) {
   
-  /* Update new parent, or root node */
-  if (pL->pParent != NULL) {
-    /* Update parent */
-    if ((pL->pParent)->pLeft == pNode) {
-      (pL->pParent)->pLeft = pL;
-      
-    } else if ((pL->pParent)->pRight == pNode) {
-      (pL->pParent)->pRight = pL;
-      
-    } else {
-      abort();  /* shouldn't happen */
-    }
+  unsigned long result = 0;
   
+  /* Check parameters */
+  if ((bucket < 0) || (bucket >= RFDICT_HISTOGRAM_BUCKETS)) {
+    abort();
+  }
+  
+  /* Invert rfdict_histogram_index() */
+  if (bucket < 32) {
+    result = (unsigned long) bucket;
   } else {
-    /* Update root */
-    pDict->pRoot = pL;
+    result = ((unsigned long) (16 + (bucket % 16))) <<
+                ((bucket / 16) - 1);
   }
+  
+  return result;
 }
 
-/* 
- * Public functions
- * ================
- * 
- * See the header for specifications.
+/*
+ * rfdict_histogram_quantile function.
  */
+unsigned long rfdict_histogram_quantile(
+    RFDICT_HISTOGRAM * pHist,
+    long               ppm) {
+  
+  unsigned long rank = 0;
+  unsigned long seen = 0;
+  unsigned long result = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pHist == NULL) || (ppm < 0) || (ppm > 1000000L)) {
+    abort();
+  }
+  
+  /* Find the rank of the quantile, rounding up, without overflowing
+   * for large counts */
+  if (pHist->count > 0) {
+    rank = (((unsigned long) pHist->count) / 1000000UL) *
+              ((unsigned long) ppm);
+    rank += ((((unsigned long) pHist->count) % 1000000UL) *
+              ((unsigned long) ppm) + 999999UL) / 1000000UL;
+    if (rank < 1) {
+      rank = 1;
+    }
+    
+    /* Find the bucket holding that rank, and report the top of it */
+    for(i = 0; i < RFDICT_HISTOGRAM_BUCKETS; i++) {
+      seen += (unsigned long) (pHist->buckets)[i];
+      if (seen >= rank) {
+        break;
+      }
+    }
+    if (i >= RFDICT_HISTOGRAM_BUCKETS - 1) {
+      result = rfdict_histogram_bound(RFDICT_HISTOGRAM_BUCKETS - 1);
+    } else {
+      result = rfdict_histogram_bound(i + 1) - 1;
+    }
+  }
+  
+  return result;
+}
 
 /*
- * rfdict_alloc function.
+ * rfdict_alloc_fixed function.
  */
-RFDICT *rfdict_alloc(int sensitive) {
+RFDICT *rfdict_alloc_fixed(size_t width) {
   
   RFDICT *pDict = NULL;
   
-  /* Allocate dictionary structure and clear it */
-  pDict = (RFDICT *) malloc(sizeof(RFDICT));
-  if (pDict == NULL) {
+  /* Check parameters */
+  if ((width < 1) || (width > RFDICT_MAXKEY)) {
     abort();
   }
-  memset(pDict, 0, sizeof(RFDICT));
   
-  /* Initialize the dictionary */
-  pDict->pRoot = NULL;
-  pDict->sensitive = sensitive;
+  /* Allocate an ordinary case-sensitive dictionary and set the width;
+   * no case mapping is done on fixed-width keys */
+  pDict = rfdict_alloc(1);
+  pDict->width = width;
   
-  /* Return the dictionary */
   return pDict;
 }
 
 /*
- * rfdict_free function.
+ * rfdict_codec_train function.
  */
-void rfdict_free(RFDICT *pDict) {
+RFDICT_CODEC *rfdict_codec_train(
+    const char * const * ppSample,
+    long                 n,
+    int                  sensitive) {
   
+  RFDICT_CODEC *pCodec = NULL;
+  RFDICT *pCount = NULL;
+  RFDICT *pRank = NULL;
+  RFDICT *pGrams = NULL;
   RFDICT_NODE *pNode = NULL;
-  RFDICT_NODE *pParent = NULL;
+  unsigned long *pSum = NULL;
+  long *pParent = NULL;
+  long *pAt = NULL;
+  long *pRef = NULL;
+  const char *pc = NULL;
+  unsigned char gram[RFDICT_CODEC_GRAMLEN + 1];
+  unsigned char rank[4 + RFDICT_CODEC_GRAMLEN];
+  unsigned long score = 0;
+  unsigned long total = 0;
+  unsigned long h = 0;
+  size_t used = 0;
+  long ngram = 0;
+  long next = 0;
+  long i = 0;
+  long s = 0;
+  long p = 0;
+  int len = 0;
+  int shift = 0;
+  int c = 0;
   
-  /* Only perform operation if point is non-NULL */
-  if (pDict != NULL) {
-    
-    /* Start at the root node (if there is one) */
-    pNode = pDict->pRoot;
-    
-    /* Keep releasing nodes until there are none left */
-    while (pNode != NULL) {
-      
-      /* We can only release nodes that have no child nodes, so keep
-       * iterating nodes until we reach a node with no children */
-      while((pNode->pLeft != NULL) || (pNode->pRight != NULL)) {
-        
-        if (pNode->pLeft != NULL) {
-          pNode = pNode->pLeft;
-        
-        } else if (pNode->pRight != NULL) {
-          pNode = pNode->pRight;
-          
-        } else {
-          abort();  /* shouldn't happen */
+  /* Check parameters */
+  if ((n < 0) || ((n > 0) && (ppSample == NULL))) {
+    abort();
+  }
+  if (sensitive) {
+    sensitive = 1;
+  }
+  
+  /* Count every gram of the sample, with case mapping if necessary */
+  pCount = rfdict_alloc(1);
+  for(i = 0; i < n; i++) {
+    if (ppSample[i] == NULL) {
+      abort();
+    }
+    for(pc = ppSample[i]; *pc != 0; pc++) {
+      for(len = 1;
+          (len <= RFDICT_CODEC_GRAMLEN) && (pc[len - 1] != 0);
+          len++) {
+        c = (int) ((unsigned char) pc[len - 1]);
+        if ((!sensitive) &&
+            (c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_Z)) {
+          c -= (ASCII_LOWER_A - ASCII_UPPER_A);
         }
-      }
-      
-      /* We're now at a childless node -- get the parent node, or
-       * NULL */
-      pParent = pNode->pParent;
-      
-      /* If there is a parent node, unlink this node from the parent */
-      if (pParent != NULL) {
-        if (pParent->pLeft == pNode) {
-          pParent->pLeft = NULL;
-        
-        } else if (pParent->pRight == pNode) {
-          pParent->pRight = NULL;
-          
-        } else {
-          abort();  /* shouldn't happen */
+        gram[len - 1] = (unsigned char) c;
+        gram[len] = 0;
+        if (len >= 2) {
+          pRef = rfdict_get_ref(pCount, (const char *) gram);
+          if (pRef != NULL) {
+            (*pRef)++;
+          } else {
+            rfdict_insert(pCount, (const char *) gram, 1);
+          }
         }
       }
-      
-      /* Release current node and set new current node to parent, or
-       * NULL if we just released the root node */
-      free(pNode);
-      pNode = pParent;
     }
-    
-    /* We've released all nodes; now release the dictionary object */
-    free(pDict);
   }
-}
-
-/*
- * rfdict_insert function.
- */
-int rfdict_insert(
-    RFDICT     * pDict,
-    const char * pKey,
-    long         val) {
-  
-  size_t slen = 0;
-  RFDICT_NODE *pNode = NULL;
-  RFDICT_NODE *pCurrent = NULL;
-  RFDICT_NODE *pParent = NULL;
-  RFDICT_NODE *pGrand = NULL;
-  char *pc = NULL;
-  int status = 1;
-  int retval = 0;
   
-  /* Check parameters */
-  if ((pDict == NULL) || (pKey == NULL)) {
-    abort();
+  /* Rank the grams seen more than once by the bytes they would save,
+   * most first, in a fixed-width dictionary keyed by the inverted score
+   * followed by the gram padded with nulls */
+  pRank = rfdict_alloc_fixed(4 + RFDICT_CODEC_GRAMLEN);
+  for(pNode = rfdict_first(pCount);
+      pNode != NULL;
+      pNode = rfdict_next(pNode)) {
+    if (pNode->val > 1) {
+      score = (unsigned long) pNode->val;
+      if (score > 0x3fffffffUL) {
+        score = 0x3fffffffUL;
+      }
+      score = 0xffffffffUL -
+                score * ((unsigned long) (strlen(pNode->pKey) - 1));
+      rank[0] = (unsigned char) ((score >> 24) & 0xff);
+      rank[1] = (unsigned char) ((score >> 16) & 0xff);
+      rank[2] = (unsigned char) ((score >> 8) & 0xff);
+      rank[3] = (unsigned char) (score & 0xff);
+      memset(&(rank[4]), 0, RFDICT_CODEC_GRAMLEN);
+      memcpy(&(rank[4]), pNode->pKey, strlen(pNode->pKey));
+      rfdict_insert(pRank, (const char *) rank, 0);
+    }
   }
+  rfdict_free(pCount);
+  pCount = NULL;
   
-  /* Get size of string, not including terminating null */
-  slen = strlen(pKey);
+  /* Take the best grams, ordered by their bytes; the nulls that pad
+   * them sort before any other byte */
+  pGrams = rfdict_alloc_fixed(RFDICT_CODEC_GRAMLEN);
+  for(pNode = rfdict_first(pRank);
+      (pNode != NULL) && (pGrams->count < RFDICT_CODEC_GRAMS);
+      pNode = rfdict_next(pNode)) {
+    rfdict_insert(pGrams, pNode->pKey + 4, 0);
+  }
+  rfdict_free(pRank);
+  pRank = NULL;
   
-  /* Make sure key size isn't too large */
-  if (slen > RFDICT_MAXKEY) {
+  /* Allocate the codec */
+  pCodec = (RFDICT_CODEC *) malloc(sizeof(RFDICT_CODEC));
+  if (pCodec == NULL) {
     abort();
   }
+  memset(pCodec, 0, sizeof(RFDICT_CODEC));
   
-  /* Allocate a new node */
-  pNode = (RFDICT_NODE *) malloc(sizeof(RFDICT_NODE) + slen);
-  if (pNode == NULL) {
+  ngram = pGrams->count;
+  pCodec->sensitive = sensitive;
+  pCodec->refs = 1;
+  pCodec->nsym = 256 + ngram;
+  pCodec->ncode = pCodec->nsym + ngram;
+  pCodec->slots = 16;
+  while (pCodec->slots < 2 * ((unsigned long) ngram)) {
+    pCodec->slots *= 2;
+  }
+  
+  pCodec->pSymStr = (unsigned char *) malloc(
+                      ((size_t) pCodec->nsym) * RFDICT_CODEC_GRAMLEN);
+  pCodec->pSymLen = (unsigned char *) malloc((size_t) pCodec->nsym);
+  pCodec->pSlot = (long *) malloc(
+                      ((size_t) pCodec->slots) * sizeof(long));
+  pCodec->pChild = (long *) malloc(
+                      ((size_t) (ngram + 1)) * sizeof(long));
+  pCodec->pChildAt = (long *) malloc(
+                      ((size_t) (pCodec->nsym + 1)) * sizeof(long));
+  pCodec->pGap = (long *) malloc(
+                      ((size_t) (pCodec->nsym + ngram)) * sizeof(long));
+  pCodec->pCode = (unsigned long *) malloc(
+                      ((size_t) pCodec->ncode) * sizeof(unsigned long));
+  pCodec->pLen = (unsigned char *) malloc((size_t) pCodec->ncode);
+  pCodec->pCodeSym = (long *) malloc(
+                      ((size_t) pCodec->ncode) * sizeof(long));
+  pParent = (long *) malloc(((size_t) pCodec->nsym) * sizeof(long));
+  pAt = (long *) malloc(((size_t) pCodec->nsym) * sizeof(long));
+  pSum = (unsigned long *) malloc(
+            ((size_t) (pCodec->ncode + 1)) * sizeof(unsigned long));
+  if ((pCodec->pSymStr == NULL) || (pCodec->pSymLen == NULL) ||
+      (pCodec->pSlot == NULL) || (pCodec->pChild == NULL) ||
+      (pCodec->pChildAt == NULL) || (pCodec->pGap == NULL) ||
+      (pCodec->pCode == NULL) || (pCodec->pLen == NULL) ||
+      (pCodec->pCodeSym == NULL) || (pParent == NULL) ||
+      (pAt == NULL) || (pSum == NULL)) {
     abort();
   }
-  memset(pNode, 0, sizeof(RFDICT_NODE) + slen);
+  memset(pCodec->pSymStr, 0,
+          ((size_t) pCodec->nsym) * RFDICT_CODEC_GRAMLEN);
+  memset(pCodec->pSymLen, 0, (size_t) pCodec->nsym);
+  for(h = 0; h < pCodec->slots; h++) {
+    (pCodec->pSlot)[h] = 0;
+  }
+  for(s = 0; s <= pCodec->nsym; s++) {
+    (pCodec->pChildAt)[s] = 0;
+  }
+  for(i = 0; i <= pCodec->ncode; i++) {
+    pSum[i] = 0;
+  }
   
-  /* Initialize node */
-  pNode->pParent = NULL;
-  pNode->pLeft = NULL;
-  pNode->pRight = NULL;
-  pNode->val = val;
-  pNode->red = 0;
-  strcpy(&((pNode->key)[0]), pKey);
+  /* Single bytes are symbols 1 to 255, and the grams follow in order */
+  for(s = 1; s < 256; s++) {
+    (pCodec->pSymStr)[s * RFDICT_CODEC_GRAMLEN] = (unsigned char) s;
+    (pCodec->pSymLen)[s] = 1;
+  }
+  s = 256;
+  for(pNode = rfdict_first(pGrams);
+      pNode != NULL;
+      pNode = rfdict_next(pNode)) {
+    memcpy(pCodec->pSymStr + s * RFDICT_CODEC_GRAMLEN,
+            pNode->pKey, RFDICT_CODEC_GRAMLEN);
+    (pCodec->pSymLen)[s] = (unsigned char) strlen(pNode->pKey);
+    s++;
+  }
+  rfdict_free(pGrams);
+  pGrams = NULL;
   
-  /* If dictionary is case-insensitive, map lowercase letters to
-   * uppercase */
-  if (pDict->sensitive == 0) {
-    for(pc = &((pNode->key)[0]); *pc != 0; pc++) {
-      if ((*pc >= ASCII_LOWER_A) && (*pc <= ASCII_LOWER_Z)) {
-        *pc = *pc - (ASCII_LOWER_A - ASCII_UPPER_A);
-      }
-    }
+  /* Hash the grams */
+  for(s = 256; s < pCodec->nsym; s++) {
+    for(h = rfdict_codec_hash(
+              pCodec->pSymStr + s * RFDICT_CODEC_GRAMLEN,
+              (int) (pCodec->pSymLen)[s]) & (pCodec->slots - 1);
+        (pCodec->pSlot)[h] != 0;
+        h = (h + 1) & (pCodec->slots - 1));
+    (pCodec->pSlot)[h] = s;
   }
   
-  /* We now have to insert the new node into the search tree */
-  if (pDict->pRoot == NULL) {
-    
-    /* Search tree is currently empty, so set the color of the node to
-     * black and set it as the root node */
-    pDict->pRoot = pNode;
-    pNode->pParent = NULL;
-    pNode->red = 0;
-    
-  } else {
-    /* Search tree is not empty, so we need to find the appropriate
-     * position */
-    pCurrent = pDict->pRoot;
-    for(retval = strcmp(&((pCurrent->key)[0]), &((pNode->key)[0]));
-        retval != 0;
-        retval = strcmp(&((pCurrent->key)[0]), &((pNode->key)[0]))) {
-      
-      /* We are done if current node is greater than new node and the
-       * left branch of current node is empty, or if current node is
-       * less than new node and the right branch of current node is
-       * empty; otherwise, proceed down the appropriate branch */
-      if (((pCurrent->pLeft == NULL) && (retval > 0)) ||
-          ((pCurrent->pRight == NULL) && (retval < 0))) {
-        /* Done */
+  /* The parent of each gram is the longest shorter symbol that is a
+   * prefix of it, which is at least its first byte */
+  for(s = 256; s < pCodec->nsym; s++) {
+    p = 0;
+    for(len = ((int) (pCodec->pSymLen)[s]) - 1; len >= 2; len--) {
+      p = rfdict_codec_find(
+            pCodec, pCodec->pSymStr + s * RFDICT_CODEC_GRAMLEN, len);
+      if (p != 0) {
         break;
-      
-      } else {
-        /* Not done yet -- proceed down appropriate branch */
-        if (retval > 0) {
-          pCurrent = pCurrent->pLeft;
-        
-        } else if (retval < 0) {
-          pCurrent = pCurrent->pRight;
-          
-        } else {
-          abort();  /* shouldn't happen */
-        }
       }
     }
-    
-    /* Insert the new node into the search tree, or free the new node
-     * and set error status if a duplicate key already exists in the
-     * tree */
-    if (retval > 0) {
-      /* Set the node in the left branch of current, and set color to
-       * red */
-      pCurrent->pLeft = pNode;
-      pNode->pParent = pCurrent;
-      pNode->red = 1;
-    
-    } else if (retval < 0) {
-      /* Set the node in the right branch of current, and set color to
-       * red */
-      pCurrent->pRight = pNode;
-      pNode->pParent = pCurrent;
-      pNode->red = 1;
-    
-    } else {
-      /* Duplicate key error -- set error status and free node new */
-      status = 0;
-      free(pNode);
-      pNode = NULL;
+    if (p == 0) {
+      p = (long) (pCodec->pSymStr)[s * RFDICT_CODEC_GRAMLEN];
     }
+    pParent[s] = p;
+    ((pCodec->pChildAt)[p + 1])++;
   }
   
-  /* 
-   * If new node is red, it is not the root of the tree.  In this case,
-   * check whether the parent is red.  If the parent is red, then the
-   * tree needs to be rebalanced because red nodes are not allowed to
-   * have red parents.
-   * 
-   * If the parent is red, then the parent of the parent (the
-   * grandparent) must also exist, because root nodes are black, and so
-   * the parent couldn't be a root node.  The grandparent must
-   * furthermore be black, because red nodes can't have red parents.
-   * 
-   * The first case we're going to handle is the (black) grandparent
-   * with two red children.  In this case, change both of the
-   * grandparent's children to black and change the grandparent to red.
-   * Set the grandparent as the new current node and apply the
-   * rebalancing procedures again, unless the new current nde is the
-   * root node, in which case color it black and no further rebalancing.
-   */
-  if (status) {
-    if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
-      
-      /* Get the grandparent node, which much exist */
-      pGrand = (pNode->pParent)->pParent;
-      if (pGrand == NULL) {
-        abort();
+  /* List the children of each symbol; the grams are taken in order, so
+   * each list is in order too */
+  for(s = 0; s < pCodec->nsym; s++) {
+    (pCodec->pChildAt)[s + 1] += (pCodec->pChildAt)[s];
+    pAt[s] = (pCodec->pChildAt)[s];
+  }
+  for(s = 256; s < pCodec->nsym; s++) {
+    (pCodec->pChild)[pAt[pParent[s]]] = s;
+    (pAt[pParent[s]])++;
+  }
+  
+  /* Number the gaps in the order of their intervals, after the unused
+   * code zero */
+  (pCodec->pCodeSym)[0] = 0;
+  next = 1;
+  for(s = 1; s < 256; s++) {
+    rfdict_codec_visit(pCodec, s, &next);
+  }
+  if (next != pCodec->ncode) {
+    abort();  /* shouldn't happen */
+  }
+  
+  /* Count how often each code is used in the sample */
+  for(i = 0; i < n; i++) {
+    for(pc = ppSample[i]; *pc != 0; pc += used) {
+      (pSum[rfdict_codec_next(pCodec, pc, &used) + 1])++;
+    }
+  }
+  
+  /* Scale the counts down to bound the total, and make every weight at
+   * least one so that every code has a bounded length */
+  for(i = 1; i <= pCodec->ncode; i++) {
+    total += pSum[i];
+  }
+  for(shift = 0;
+      (total >> shift) > (unsigned long) RFDICT_CODEC_WEIGHT;
+      shift++);
+  for(i = 1; i <= pCodec->ncode; i++) {
+    pSum[i] = pSum[i - 1] + (pSum[i] >> shift) + 1;
+  }
+  
+  /* Assign the codes */
+  rfdict_codec_split(pCodec, pSum, 0, pCodec->ncode, 0, 0);
+  
+  /* Release temporary arrays */
+  free(pParent);
+  free(pAt);
+  free(pSum);
+  
+  return pCodec;
+}
+
+/*
+ * rfdict_codec_free function.
+ */
+void rfdict_codec_free(RFDICT_CODEC *pCodec) {
+  if (pCodec != NULL) {
+    rfdict_codec_drop(pCodec);
+  }
+}
+
+/*
+ * rfdict_codec_encode function.
+ */
+size_t rfdict_codec_encode(
+    RFDICT_CODEC * pCodec,
+    const char   * pKey,
+    char         * pOut) {
+  
+  unsigned char *po = NULL;
+  unsigned long code = 0;
+  unsigned long acc = 0;
+  size_t used = 0;
+  size_t o = 0;
+  long i = 0;
+  int nacc = 0;
+  int step = 0;
+  int k = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pKey == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  if (strlen(pKey) > RFDICT_CODEC_MAXKEY) {
+    abort();
+  }
+  
+  /* Append the code bits seven at a time, taking each code in pieces
+   * so the accumulator never holds more than twenty bits */
+  po = (unsigned char *) pOut;
+  while (*pKey != 0) {
+    i = rfdict_codec_next(pCodec, pKey, &used);
+    code = (pCodec->pCode)[i];
+    for(k = (int) (pCodec->pLen)[i]; k > 0; k -= step) {
+      step = k;
+      if (step > 14) {
+        step = 14;
       }
-      
-      /* Rebalance while both of grandparent's children are red */
-      while(rfdict_isred(pGrand->pLeft) &&
-            rfdict_isred(pGrand->pRight)) {
-        
-        /* Set grandparent's children to black color */
-        (pGrand->pLeft)->red = 0;
-        (pGrand->pRight)->red = 0;
-        
-        /* If grandparent is the root node, set it to black; else, set
-         * it to red */
-        if (pGrand->pParent == NULL) {
-          pGrand->red = 0;
-        } else {
-          pGrand->red = 1;
-        }
-        
-        /* Set new node to grandparent node to continue process */
-        pNode = pGrand;
-        
-        /* If new node is red and its parent is red, update grandparent
-         * and continue rebalancing loop; else, done with this
-         * rebalancing step */
-        if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
-          pGrand = (pNode->pParent)->pParent;
-          if (pGrand == NULL) {
-            abort();
-          }
-        } else {
-          break;
-        }
+      acc = (acc << step) |
+              ((code >> (k - step)) & ((1UL << step) - 1));
+      nacc += step;
+      while (nacc >= 7) {
+        po[o] = (unsigned char) (0x80 | ((acc >> (nacc - 7)) & 0x7f));
+        o++;
+        nacc -= 7;
       }
+      acc &= (1UL << nacc) - 1;
     }
+    pKey += used;
+  }
+  
+  /* Pad the last byte with zero bits */
+  if (nacc > 0) {
+    po[o] = (unsigned char) (0x80 | ((acc << (7 - nacc)) & 0x7f));
+    o++;
+  }
+  po[o] = 0;
+  
+  return o;
+}
+
+/*
+ * rfdict_codec_decode function.
+ */
+size_t rfdict_codec_decode(
+    RFDICT_CODEC * pCodec,
+    const char   * pCode,
+    char         * pOut) {
+  
+  const unsigned char *pc = NULL;
+  unsigned long nbits = 0;
+  unsigned long pos = 0;
+  unsigned long bit = 0;
+  unsigned long v = 0;
+  size_t o = 0;
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  long s = 0;
+  int k = 0;
+  
+  /* Check parameters */
+  if ((pCodec == NULL) || (pCode == NULL) || (pOut == NULL)) {
+    abort();
   }
+  
+  pc = (const unsigned char *) pCode;
+  nbits = 7 * ((unsigned long) strlen(pCode));
+  while (pos < nbits) {
     
-  /* 
-   * We've now handled all rebalancing cases where the grandparent has
-   * two red children.
-   * 
-   * We now must handle the cases where the grandparent has one black
-   * child, or a child that is missing.  We'll handle these cases with
-   * rotations, and unlike the former rebalancing case, we don't need to
-   * process this in a loop going back up to the root.
-   * 
-   * We only need to rebalance if the parent of the current node is red.
-   * If the parent of the current node is black, then there is no
-   * violation of the red node rules to fix.
-   */
-  if (status) {
-    if (rfdict_isred(pNode) && rfdict_isred(pNode->pParent)) {
-      
-      /* Get the grandparent node, which much exist */
-      pGrand = (pNode->pParent)->pParent;
-      if (pGrand == NULL) {
-        abort();
+    /* Read the next bits, padding with zeros past the end */
+    v = 0;
+    for(k = 0; k < RFDICT_CODEC_BITS; k++) {
+      bit = 0;
+      if (pos + k < nbits) {
+        bit = (pc[(pos + k) / 7] >> (6 - ((pos + k) % 7))) & 1;
       }
-      
-      /* Rebalance if one of the grandparent's children is black or
-       * missing */
-      if (rfdict_isblack(pGrand->pLeft) ||
-          rfdict_isblack(pGrand->pRight)) {
-        
-        /* Get parent node */
-        pParent = pNode->pParent;
-        
-        /* Handle rebalancing cases */
-        if ((pNode == pParent->pRight) && (pParent == pGrand->pLeft)) {
-          /* New node is right child of parent and parent is left child
-           * of grandparent */
-          pNode->red = 0;
-          pGrand->red = 1;
-          rfdict_rol(pParent, pDict);
-          rfdict_ror(pGrand, pDict);
-          
-        } else if ((pNode == pParent->pLeft) &&
-                    (pParent == pGrand->pRight)) {
-          /* New node is left child of parent and parent is right child
-           * of grandparent */
-          pNode->red = 0;
-          pGrand->red = 1;
-          rfdict_ror(pParent, pDict);
-          rfdict_rol(pGrand, pDict);
-          
-        } else if ((pNode == pParent->pLeft) &&
-                    (pParent == pGrand->pLeft)) {
-            /* New node is left child of parent and parent is left child
-             * of grandparent */
-            pParent->red = 0;
-            pGrand->red = 1;
-            rfdict_ror(pGrand, pDict);
-            
-        } else if ((pNode == pParent->pRight) &&
-                    (pParent == pGrand->pRight)) {
-            /* New node is right child of parent and parent is right
-             * child of grandparent */
-            pParent->red = 0;
-            pGrand->red = 1;
-            rfdict_rol(pGrand, pDict);
-            
-        } else {
-          abort();  /* shouldn't happen */
-        }
-        
+      v = (v << 1) | bit;
+    }
+    
+    /* Find the last code that starts at or below them */
+    lo = 0;
+    hi = pCodec->ncode - 1;
+    while (lo < hi) {
+      mid = lo + ((hi - lo + 1) / 2);
+      if (((pCodec->pCode)[mid] <<
+            (RFDICT_CODEC_BITS - (pCodec->pLen)[mid])) <= v) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
       }
     }
+    
+    /* Code zero only comes from the padding */
+    if ((lo == 0) || (pos + (pCodec->pLen)[lo] > nbits)) {
+      break;
+    }
+    
+    /* Copy the symbol */
+    s = (pCodec->pCodeSym)[lo];
+    if (o + (pCodec->pSymLen)[s] > RFDICT_CODEC_MAXKEY) {
+      abort();
+    }
+    memcpy(pOut + o, pCodec->pSymStr + s * RFDICT_CODEC_GRAMLEN,
+            (size_t) (pCodec->pSymLen)[s]);
+    o += (size_t) (pCodec->pSymLen)[s];
+    pos += (pCodec->pLen)[lo];
   }
+  pOut[o] = 0;
   
-  /* Return status */
-  return status;
+  return o;
 }
 
 /*
- * rfdict_get function.
+ * rfdict_alloc_coded function.
  */
-long rfdict_get(RFDICT *pDict, const char *pKey, long dvalue) {
-
-  RFDICT_NODE *pNode = NULL;
-  long result = 0;
+RFDICT *rfdict_alloc_coded(RFDICT_CODEC *pCodec) {
+  
+  RFDICT *pDict = NULL;
   
   /* Check parameters */
-  if ((pDict == NULL) || (pKey == NULL)) {
+  if ((pCodec == NULL) || (pCodec->refs < 1)) {
     abort();
   }
   
-  /* Search for the node */
-  pNode = rfdict_find(pDict, pKey);
-  
-  /* If node found, take value from that; else, use dvalue */
-  if (pNode != NULL) {
-    result = pNode->val;
-  } else {
-    result = dvalue;
-  }
+  /* Compressed keys are compared byte by byte, so the dictionary
+   * itself is case-sensitive; the codec does any case mapping */
+  pDict = rfdict_alloc(1);
+  (pCodec->refs)++;
+  pDict->pCodec = pCodec;
   
-  /* Return result */
-  return result;
+  return pDict;
 }
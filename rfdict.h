@@ -11,6 +11,108 @@
 struct RFDICT_TAG;
 typedef struct RFDICT_TAG RFDICT;
 
+struct RFDICT_DELTA_TAG;
+typedef struct RFDICT_DELTA_TAG RFDICT_DELTA;
+
+struct RFDICT_DISK_TAG;
+typedef struct RFDICT_DISK_TAG RFDICT_DISK;
+
+struct RFDICT_FROZEN_TAG;
+typedef struct RFDICT_FROZEN_TAG RFDICT_FROZEN;
+
+struct RFDICT_LSM_TAG;
+typedef struct RFDICT_LSM_TAG RFDICT_LSM;
+
+struct RFDICT_LOUDS_TAG;
+typedef struct RFDICT_LOUDS_TAG RFDICT_LOUDS;
+
+struct RFDICT_FST_TAG;
+typedef struct RFDICT_FST_TAG RFDICT_FST;
+
+struct RFDICT_SCANNER_TAG;
+typedef struct RFDICT_SCANNER_TAG RFDICT_SCANNER;
+
+struct RFDICT_POOL_TAG;
+typedef struct RFDICT_POOL_TAG RFDICT_POOL;
+
+struct RFDICT_FREEZE_TAG;
+typedef struct RFDICT_FREEZE_TAG RFDICT_FREEZE;
+
+struct RFDICT_ADAPT_TAG;
+typedef struct RFDICT_ADAPT_TAG RFDICT_ADAPT;
+
+struct RFDICT_CODEC_TAG;
+typedef struct RFDICT_CODEC_TAG RFDICT_CODEC;
+
+/*
+ * Cursor structure for rfdict_get_hint().
+ * 
+ * The cursor remembers where the previous search ended, so that the
+ * next search can start from there.  Cursors must be initialized with
+ * rfdict_cursor_init() before use.  The fields are private to the
+ * implementation.
+ */
+typedef struct {
+  RFDICT *pDict;
+  void *pNode;
+  unsigned long epoch;
+} RFDICT_CURSOR;
+
+/*
+ * Position structure for rfdict_scan().
+ * 
+ * The position holds the state of a scan between calls, so that a
+ * stream can be scanned one buffer at a time and matches that span
+ * buffers are found.  Positions must be initialized with
+ * rfdict_scanpos_init() before use.  The fields are private to the
+ * implementation.
+ */
+typedef struct {
+  long node;
+  long offset;
+} RFDICT_SCANPOS;
+
+/*
+ * Statistics structure for rfdict_adapt_stats().
+ * 
+ * reads and writes are the number of lookups and inserts made on the
+ * adaptive dictionary.  migrations is the number of times the
+ * dictionary has started moving to a different engine.
+ */
+typedef struct {
+  long reads;
+  long writes;
+  long migrations;
+} RFDICT_ADAPT_STATS;
+
+/*
+ * The number of buckets in a latency histogram.
+ * 
+ * Latencies below 32 nanoseconds each have their own bucket.  Above
+ * that, each power of two range is split into 16 buckets of equal
+ * width, up to about four seconds.
+ */
+#define RFDICT_HISTOGRAM_BUCKETS (464)
+
+/*
+ * Operation types for latency histograms.
+ */
+#define RFDICT_OP_GET    (0)
+#define RFDICT_OP_INSERT (1)
+#define RFDICT_NOPS      (2)
+
+/*
+ * Latency histogram structure for rfdict_latency_snapshot().
+ * 
+ * count is the number of timed operations.  Each element of buckets is
+ * the number of those operations with a latency in the range of that
+ * bucket, which starts at rfdict_histogram_bound() nanoseconds.
+ */
+typedef struct {
+  long count;
+  long buckets[RFDICT_HISTOGRAM_BUCKETS];
+} RFDICT_HISTOGRAM;
+
 /*
  * The maximum length of a dictionary key in bytes, not including the
  * terminating null.
@@ -22,6 +124,100 @@ typedef struct RFDICT_TAG RFDICT;
  */
 #define RFDICT_MAXKEY (16384)
 
+/*
+ * The maximum length of a key in a disk dictionary in bytes, not
+ * including the terminating null.
+ * 
+ * This is smaller than RFDICT_MAXKEY because keys are stored within
+ * fixed-size pages of the file.
+ */
+#define RFDICT_DISK_MAXKEY (1024)
+
+/*
+ * The maximum number of edits allowed in a fuzzy lookup.
+ * 
+ * Fuzzy lookups take time and memory in proportion to this limit, and
+ * with many edits almost every short key matches anyway.
+ */
+#define RFDICT_MAXEDITS (16)
+
+/*
+ * The maximum length of a key that a codec compresses, and the maximum
+ * length of the compressed key, in bytes, not including the terminating
+ * null.
+ */
+#define RFDICT_CODEC_MAXKEY (1024)
+#define RFDICT_CODEC_MAXCODE (4 * RFDICT_CODEC_MAXKEY)
+
+/*
+ * Insert policies for rfdict_freeze_async().
+ * 
+ * With RFDICT_FREEZE_REJECT, inserts through the freeze handle always
+ * fail.  With RFDICT_FREEZE_QUEUE, inserted keys are kept in a small
+ * dictionary beside the frozen contents.
+ */
+#define RFDICT_FREEZE_REJECT (0)
+#define RFDICT_FREEZE_QUEUE  (1)
+
+/*
+ * Engines of an adaptive dictionary.
+ * 
+ * RFDICT_ENGINE_TREE holds the keys in a red-black tree, which suits
+ * frequent inserts.  RFDICT_ENGINE_HASH adds a hash table over the
+ * tree, which makes lookups faster at some cost to inserts.
+ * RFDICT_ENGINE_FROZEN holds the keys in a frozen image, which is
+ * compact and fast to search, with new keys kept in a small tree
+ * beside it.
+ */
+#define RFDICT_ENGINE_TREE   (0)
+#define RFDICT_ENGINE_HASH   (1)
+#define RFDICT_ENGINE_FROZEN (2)
+
+/*
+ * Callback for functions that report keys to the client.
+ * 
+ * pCustom is passed through from the function that invokes the
+ * callback.  pKey is the key, which is only valid during the callback.
+ * In case-insensitive dictionaries, lowercase letters in the key have
+ * been mapped to uppercase.  val is the value associated with the key.
+ * 
+ * The callback returns non-zero to continue receiving keys, or zero to
+ * stop early.
+ */
+typedef int (*rfdict_fp_visit)(void *pCustom, const char *pKey, long val);
+
+/*
+ * Callback for functions that report matches of keys within text.
+ * 
+ * pCustom is passed through from the function that invokes the
+ * callback.  offset is the byte offset of the start of the match, and
+ * length is the length of the matching key in bytes.  val is the value
+ * associated with the key.
+ * 
+ * The callback returns non-zero to continue receiving matches, or zero
+ * to stop early.
+ */
+typedef int (*rfdict_fp_match)(
+    void * pCustom,
+    long   offset,
+    long   length,
+    long   val);
+
+/*
+ * Callback for functions that report keys close to a query.
+ * 
+ * pCustom, pKey and val are the same as for rfdict_fp_visit.  edits is
+ * the edit distance between the key and the query.
+ * 
+ * The callback returns non-zero to continue receiving keys, or zero to
+ * stop early.
+ */
+typedef int (*rfdict_fp_fuzzy)(
+    void        * pCustom,
+    const char  * pKey,
+    long          val,
+    int           edits);
+
 /*
  * Allocate a new dictionary object.
  * 
@@ -45,7 +241,9 @@ RFDICT *rfdict_alloc(int sensitive);
 /*
  * Free a dictionary object.
  * 
- * The call is ignored if the passed pointer is NULL.
+ * The call is ignored if the passed pointer is NULL.  All memory held
+ * by the dictionary is released, including nodes that were recycled by
+ * rfdict_remove().
  * 
  * Parameters:
  * 
@@ -53,6 +251,28 @@ RFDICT *rfdict_alloc(int sensitive);
  */
 void rfdict_free(RFDICT *pDict);
 
+/*
+ * Remove all keys from a dictionary, keeping its memory for reuse.
+ * 
+ * After this call, the dictionary is empty, and it keeps its case
+ * sensitivity setting.  Unlike freeing the dictionary and allocating a
+ * new one, the memory that held the keys is not released but is rather
+ * reused by subsequent insertions.  The time taken is proportional to
+ * the number of large blocks of memory the dictionary holds, rather
+ * than to the number of keys, except for a dictionary that uses a
+ * string pool (see rfdict_alloc_pooled()).  Such a dictionary must
+ * release its reference to each of its keys in the pool, so clearing it
+ * takes time proportional to the number of keys.
+ * 
+ * All value pointers returned by rfdict_get_ref() for this dictionary
+ * become invalid.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary to clear
+ */
+void rfdict_clear(RFDICT *pDict);
+
 /*
  * Insert a new key/value pair into a given dictionary.
  * 
@@ -122,4 +342,1916 @@ int rfdict_insert(
  */
 long rfdict_get(RFDICT *pDict, const char *pKey, long dvalue);
 
+/*
+ * Get a pointer to the value associated with a given key in a
+ * dictionary.
+ * 
+ * pDict is the dictionary to query.
+ * 
+ * pKey is the null-terminated key to check for.  Comparisons will be
+ * case-sensitive or case-insensitive depending on the dictionary
+ * setting.
+ * 
+ * The returned pointer points into the dictionary's storage for the
+ * key, so the value may be read and modified through it in place.  The
+ * pointer remains valid until the key is removed from the dictionary or
+ * the dictionary is freed.  Inserting other keys does not invalidate
+ * it.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key string
+ * 
+ * Return:
+ * 
+ *   pointer to the value associated with the key, or NULL if the key
+ *   is not present in the dictionary
+ */
+long *rfdict_get_ref(RFDICT *pDict, const char *pKey);
+
+/*
+ * Find the longest key in a dictionary that is a prefix of some text.
+ * 
+ * pText points to len bytes of text, which need not be null-terminated.
+ * Keys are matched against the start of the text, case-sensitively or
+ * case-insensitively depending on the dictionary setting.  Since keys
+ * can not contain null bytes, a null byte in the text ends the part
+ * that can match.
+ * 
+ * The dictionary is searched for the greatest key that is not after the
+ * text.  If that key is a prefix of the text, it is the answer, which
+ * takes a single search in the common case where the dictionary has
+ * most prefixes of its keys, such as a tokenizer vocabulary.  Otherwise
+ * the search is repeated with the text cut down to its common prefix
+ * with that key, unless a key of that length was passed on the way
+ * down.  Each repeat cuts the text shorter, so in the worst case there
+ * is one search for each byte of the text that can match.
+ * 
+ * The returned pointer has the same meaning as for rfdict_get_ref().
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pText - the text
+ * 
+ *   len - the length of the text in bytes
+ * 
+ *   pMatched - receives the length of the matching key, or zero if
+ *   there is no match
+ * 
+ * Return:
+ * 
+ *   pointer to the value associated with the longest matching key, or
+ *   NULL if no key is a prefix of the text
+ */
+long *rfdict_longest_prefix(
+    RFDICT     * pDict,
+    const char * pText,
+    size_t       len,
+    size_t     * pMatched);
+
+/*
+ * Insert a key/value pair into a dictionary, or change the value of
+ * the key if it is already present.
+ * 
+ * The parameters are the same as for rfdict_insert().  Unlike that
+ * function, an existing key is not an error; instead, the value
+ * associated with the existing key is replaced with val.
+ * 
+ * Only a single search through the dictionary is performed, whether
+ * the key is inserted or updated.
+ * 
+ * The length of the key may not exceed RFDICT_MAXKEY or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary object
+ * 
+ *   pKey - the key string
+ * 
+ *   val - the value to associate with the key
+ * 
+ * Return:
+ * 
+ *   non-zero if a new key was inserted, zero if the value of an
+ *   existing key was changed
+ */
+int rfdict_upsert(
+    RFDICT     * pDict,
+    const char * pKey,
+    long         val);
+
+/*
+ * Initialize a cursor for rfdict_get_hint().
+ * 
+ * The cursor does not hold any resources, so it does not need to be
+ * freed.  Calling this function again on an existing cursor resets it.
+ * 
+ * Parameters:
+ * 
+ *   pCursor - the cursor to initialize
+ */
+void rfdict_cursor_init(RFDICT_CURSOR *pCursor);
+
+/*
+ * Get the value associated with a given key in a dictionary, starting
+ * the search from where the previous search with the same cursor ended.
+ * 
+ * This works the same way as rfdict_get(), except for where the search
+ * starts.  When queries arrive in sorted or clustered order, each
+ * search only needs to climb from the previous position as far as
+ * necessary to reach the new key, so the cost is logarithmic in the
+ * distance between the keys rather than in the size of the dictionary.
+ * 
+ * pCursor is the cursor, which is updated to the position where the
+ * search ended.  Each cursor should only be used by one thread at a
+ * time.  If the cursor was last used with a different dictionary, or if
+ * keys have been removed from the dictionary since then, the search
+ * starts from the root as usual.  Inserting keys does not affect
+ * cursors.  A cursor may not be used after its dictionary has been
+ * freed.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ *   pCursor - the cursor
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the dictionary
+ */
+long rfdict_get_hint(
+    RFDICT        * pDict,
+    const char    * pKey,
+    long            dvalue,
+    RFDICT_CURSOR * pCursor);
+
+/*
+ * Remove a key and its associated value from a dictionary.
+ * 
+ * pDict is the dictionary to remove the key from.
+ * 
+ * pKey is the null-terminated key to remove.  Comparisons will be
+ * case-sensitive or case-insensitive depending on the dictionary
+ * setting.
+ * 
+ * The tree is rebalanced after the removal, so the dictionary stays
+ * efficient to access.  The memory of the removed key is not released
+ * but is rather kept by the dictionary, sorted into size classes by key
+ * length, and later calls to rfdict_insert() reuse it for keys in the
+ * same size class.  This keeps the memory footprint steady when keys
+ * are continually inserted and removed.  All retained memory is
+ * released by rfdict_free().
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key string
+ * 
+ * Return:
+ * 
+ *   non-zero if the key was removed, zero if the key was not present in
+ *   the dictionary
+ */
+int rfdict_remove(RFDICT *pDict, const char *pKey);
+
+/*
+ * Make a copy of a dictionary.
+ * 
+ * The new dictionary has the same case sensitivity setting and the same
+ * key/value pairs as the given dictionary.  The two dictionaries are
+ * independent afterwards.
+ * 
+ * The copy is made in a single pass over the tree, copying the tree
+ * structure and node colors directly, which is much faster than
+ * inserting every key into a new dictionary.  All the keys of the copy
+ * are placed within a single allocation, laid out in the order of a
+ * depth-first traversal, so the copy may have better memory locality
+ * than the original.  The copy is freed with rfdict_free() as usual.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary to copy
+ * 
+ * Return:
+ * 
+ *   a new dictionary that is a copy of the given one
+ */
+RFDICT *rfdict_clone(RFDICT *pDict);
+
+/*
+ * Compute the intersection of two dictionaries.
+ * 
+ * The result consists of all keys that are present in both pA and pB,
+ * with the values they have in pA.
+ * 
+ * Both dictionaries must have the same case sensitivity setting, or a
+ * fault occurs.  Keys are matched according to that setting.
+ * 
+ * The dictionaries are walked simultaneously in key order, so the time
+ * taken is proportional to the total number of keys in both.  Neither
+ * dictionary is modified.
+ * 
+ * If fp is NULL, the result is returned as a new dictionary with the
+ * same case sensitivity setting, which must be freed with
+ * rfdict_free().  The new dictionary is built in linear time, with all
+ * its keys in a single allocation.
+ * 
+ * If fp is not NULL, no dictionary is built.  Instead, the callback is
+ * invoked for each key of the result in ascending key order, and NULL
+ * is returned.  If the callback returns zero, the operation stops
+ * early.
+ * 
+ * Parameters:
+ * 
+ *   pA - the first dictionary
+ * 
+ *   pB - the second dictionary
+ * 
+ *   fp - the callback, or NULL
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   the new result dictionary, or NULL if fp is not NULL
+ */
+RFDICT *rfdict_intersect(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom);
+
+/*
+ * Compute the difference of two dictionaries.
+ * 
+ * The result consists of all keys that are present in pA but not in
+ * pB, with the values they have in pA.
+ * 
+ * Otherwise, this function works the same way as rfdict_intersect().
+ * 
+ * Parameters:
+ * 
+ *   pA - the first dictionary
+ * 
+ *   pB - the second dictionary
+ * 
+ *   fp - the callback, or NULL
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   the new result dictionary, or NULL if fp is not NULL
+ */
+RFDICT *rfdict_difference(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom);
+
+/*
+ * Compute the symmetric difference of two dictionaries.
+ * 
+ * The result consists of all keys that are present in exactly one of
+ * pA and pB, with the values they have in the dictionary they are
+ * present in.
+ * 
+ * Otherwise, this function works the same way as rfdict_intersect().
+ * 
+ * Parameters:
+ * 
+ *   pA - the first dictionary
+ * 
+ *   pB - the second dictionary
+ * 
+ *   fp - the callback, or NULL
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   the new result dictionary, or NULL if fp is not NULL
+ */
+RFDICT *rfdict_symdiff(
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom);
+
+/*
+ * Allocate a new delta table.
+ * 
+ * A delta table accumulates increments to dictionary values privately,
+ * and applies them to the dictionary in a batch when it is flushed.
+ * This is intended for counting workloads where many threads increment
+ * the values of a shared dictionary.  Each thread owns its own delta
+ * table, so recording an increment only touches memory that belongs to
+ * the thread, and the shared dictionary is only written during a
+ * flush.  After all tables have been flushed, the values in the
+ * dictionary are exact.
+ * 
+ * Increments are keyed by the value pointers returned from
+ * rfdict_get_ref(), so recording an increment does not search the
+ * dictionary.
+ * 
+ * No locks are needed while counting, because the only shared memory
+ * written is the dictionary, and only flushes write it.  Any number of
+ * threads may call rfdict_get(), rfdict_get_ref() and
+ * rfdict_delta_add() at the same time, provided that each thread uses
+ * its own delta table, that latency timing is not enabled on the
+ * dictionary, and that nothing modifies the dictionary in the
+ * meantime.  Calls that modify the dictionary, including
+ * rfdict_delta_flush(), must be serialized by the caller against each
+ * other and against all other access to the dictionary.  The caller
+ * chooses how, typically by flushing all tables at the end of each
+ * counting phase, or under a lock it already holds for writers, so the
+ * cost of serializing is paid once per flush rather than once per
+ * increment.
+ * 
+ * cap is the maximum number of distinct value pointers that the table
+ * can hold before it must be flushed.  It must be in range 1 up to
+ * 16777216 or a fault occurs.
+ * 
+ * Delta tables must be freed with rfdict_delta_free().
+ * 
+ * Parameters:
+ * 
+ *   cap - the capacity of the table
+ * 
+ * Return:
+ * 
+ *   a new, empty delta table
+ */
+RFDICT_DELTA *rfdict_delta_alloc(long cap);
+
+/*
+ * Free a delta table.
+ * 
+ * Any increments that have not been flushed are discarded.  The call
+ * is ignored if the passed pointer is NULL.
+ * 
+ * Parameters:
+ * 
+ *   pDelta - the delta table to free
+ */
+void rfdict_delta_free(RFDICT_DELTA *pDelta);
+
+/*
+ * Record an increment to a dictionary value in a delta table.
+ * 
+ * pRef is the value pointer, as returned by rfdict_get_ref().  The key
+ * must remain in the dictionary until the table is flushed.
+ * 
+ * amount is added to any increment already pending for the same value
+ * pointer.  The sum of all pending increments and the value itself must
+ * remain within the range of a long.
+ * 
+ * If the table already holds its full capacity of distinct value
+ * pointers and pRef is not one of them, the increment is not recorded
+ * and the function fails.  In that case, the table should be flushed
+ * and the call repeated.
+ * 
+ * Parameters:
+ * 
+ *   pDelta - the delta table
+ * 
+ *   pRef - the value pointer
+ * 
+ *   amount - the increment to record
+ * 
+ * Return:
+ * 
+ *   non-zero if the increment was recorded, zero if the table is full
+ */
+int rfdict_delta_add(RFDICT_DELTA *pDelta, long *pRef, long amount);
+
+/*
+ * Apply all pending increments of a delta table to the dictionary
+ * values, and empty the table.
+ * 
+ * This writes to the dictionary, so it must be serialized against all
+ * other access to the dictionary, as described for rfdict_delta_alloc().
+ * 
+ * Parameters:
+ * 
+ *   pDelta - the delta table
+ */
+void rfdict_delta_flush(RFDICT_DELTA *pDelta);
+
+/*
+ * Create a new, empty disk dictionary.
+ * 
+ * A disk dictionary maps string keys to long values like an RFDICT,
+ * but it is stored in a local file as a B+tree of fixed-size pages, so
+ * it may be much larger than memory.  Only a bounded number of pages
+ * are kept in memory at any time, in a buffer pool that evicts the
+ * least recently used pages.  Each lookup reads at most one page per
+ * level of the tree, and the tree is very shallow because each page
+ * holds many keys.
+ * 
+ * Disk dictionaries support insertion and lookup with the same
+ * semantics as rfdict_insert() and rfdict_get(), except that keys may
+ * not be longer than RFDICT_DISK_MAXKEY.  They are intended for
+ * dictionaries that are larger than physical memory; otherwise, an
+ * RFDICT is faster.
+ * 
+ * The file at pPath is created, or truncated if it already exists.
+ * NULL is returned if the file can not be created.
+ * 
+ * sensitive selects case-sensitive or case-insensitive comparisons, as
+ * for rfdict_alloc().  The setting is stored in the file.
+ * 
+ * pool_pages is the number of pages in the buffer pool.  Each page
+ * takes 8 KiB of memory.  It must be at least 8 or a fault occurs.
+ * 
+ * File offsets are held in a long, so on platforms with a 32-bit long,
+ * the file is limited to 2 GiB.
+ * 
+ * Modified pages are only written to the file when they are evicted
+ * from the pool, or when rfdict_disk_sync() or rfdict_disk_close() is
+ * called.  If the process ends without closing the dictionary, the
+ * file may be left inconsistent.
+ * 
+ * Disk dictionaries must be closed with rfdict_disk_close().  A disk
+ * dictionary may only be used by one thread at a time, and that
+ * includes lookups, which modify the buffer pool.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the file
+ * 
+ *   sensitive - non-zero for case-sensitive comparisons, zero for
+ *   case-insensitive comparisons
+ * 
+ *   pool_pages - the number of pages in the buffer pool
+ * 
+ * Return:
+ * 
+ *   the new disk dictionary, or NULL if the file could not be created
+ */
+RFDICT_DISK *rfdict_disk_create(
+    const char * pPath,
+    int          sensitive,
+    long         pool_pages);
+
+/*
+ * Open an existing disk dictionary.
+ * 
+ * The file at pPath must have been created by rfdict_disk_create().
+ * NULL is returned if the file can not be opened or is not a valid
+ * disk dictionary, which includes a file shorter than the page count
+ * in its header.  The case sensitivity setting is read from the file.
+ * 
+ * pool_pages is the number of pages in the buffer pool, as for
+ * rfdict_disk_create().
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the file
+ * 
+ *   pool_pages - the number of pages in the buffer pool
+ * 
+ * Return:
+ * 
+ *   the disk dictionary, or NULL if the file could not be opened
+ */
+RFDICT_DISK *rfdict_disk_open(const char *pPath, long pool_pages);
+
+/*
+ * Write all modified pages of a disk dictionary to the file, then
+ * close the file and free the dictionary object.
+ * 
+ * The call is ignored if the passed pointer is NULL.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if an I/O error occurred at any time
+ *   while the dictionary was open
+ */
+int rfdict_disk_close(RFDICT_DISK *pDisk);
+
+/*
+ * Write all modified pages of a disk dictionary to the file.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if an I/O error occurred at any time
+ *   while the dictionary was open
+ */
+int rfdict_disk_sync(RFDICT_DISK *pDisk);
+
+/*
+ * Check whether a disk dictionary is still usable.
+ * 
+ * If an I/O error occurs, or the file turns out to be corrupt, the
+ * disk dictionary enters an error state, and all further insertions
+ * and lookups fail without accessing the file.  This function reports
+ * whether that has happened.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ * Return:
+ * 
+ *   non-zero if no error has occurred, zero if the dictionary is in the
+ *   error state
+ */
+int rfdict_disk_ok(RFDICT_DISK *pDisk);
+
+/*
+ * Get the number of keys in a disk dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_disk_count(RFDICT_DISK *pDisk);
+
+/*
+ * Insert a new key/value pair into a disk dictionary.
+ * 
+ * This has the same semantics as rfdict_insert(), except that the
+ * length of the key may not exceed RFDICT_DISK_MAXKEY or a fault
+ * occurs.  The function also fails if the dictionary is in the error
+ * state, or if an I/O error occurs, which can be checked with
+ * rfdict_disk_ok().
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pKey - the key string
+ * 
+ *   val - the value to associate with the key
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the key was already present or
+ *   there was an error
+ */
+int rfdict_disk_insert(
+    RFDICT_DISK * pDisk,
+    const char  * pKey,
+    long          val);
+
+/*
+ * Get the value associated with a given key in a disk dictionary.
+ * 
+ * This has the same semantics as rfdict_get(), except that the length
+ * of the key may not exceed RFDICT_DISK_MAXKEY or a fault occurs.  If
+ * the dictionary is in the error state or an I/O error occurs, dvalue
+ * is returned, which can be checked with rfdict_disk_ok().
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the dictionary
+ */
+long rfdict_disk_get(RFDICT_DISK *pDisk, const char *pKey, long dvalue);
+
+/*
+ * Make a frozen image of a dictionary.
+ * 
+ * A frozen image is a read-only copy of the dictionary in which all
+ * keys are stored in sorted order in contiguous arrays.  Lookups in
+ * the image are a binary search, which is more compact and cache
+ * friendly than searching the tree.  Values are bit-packed at the
+ * minimum width needed for their range.  If the values never decrease
+ * in key order, such as IDs assigned in sorted order, only their
+ * deviation from a fixed step per key is stored, which often needs no
+ * bits at all.  The image has the same case sensitivity as the
+ * dictionary.  Later changes to the dictionary do not affect the
+ * image.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ * Return:
+ * 
+ *   a new frozen image
+ */
+RFDICT_FROZEN *rfdict_freeze(RFDICT *pDict);
+
+/*
+ * Release a frozen image.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image to release, or NULL
+ */
+void rfdict_frozen_free(RFDICT_FROZEN *pFrozen);
+
+/*
+ * Get the number of keys in a frozen image.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_frozen_count(RFDICT_FROZEN *pFrozen);
+
+/*
+ * Get the value associated with a given key in a frozen image.
+ * 
+ * This has the same semantics as rfdict_get().
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the image
+ */
+long rfdict_frozen_get(
+    RFDICT_FROZEN * pFrozen,
+    const char    * pKey,
+    long            dvalue);
+
+/*
+ * Allocate a new, empty LSM dictionary.
+ * 
+ * An LSM dictionary is optimized for loading large numbers of keys.
+ * New keys go into an in-memory dictionary, the memtable.  When the
+ * memtable holds memcap keys, it is frozen into an immutable sorted
+ * run and emptied.  Runs of similar size are merged into larger runs a
+ * few keys at a time during later insertions, so that the cost of
+ * merging is spread evenly and the number of runs stays logarithmic in
+ * the number of keys.  When the library is compiled with RFDICT_THREADS
+ * defined, each merge runs on a thread of its own instead, and an
+ * insertion only waits for it when the memtable is next frozen.
+ * 
+ * Each run has a membership filter, so lookups and the duplicate check
+ * on insertion usually skip runs that do not contain the key without
+ * searching them.
+ * 
+ * The sensitive parameter has the same meaning as for rfdict_alloc().
+ * memcap must be at least one.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - non-zero for case sensitive, zero for case insensitive
+ * 
+ *   memcap - the number of keys the memtable holds before it is frozen
+ * 
+ * Return:
+ * 
+ *   a new LSM dictionary
+ */
+RFDICT_LSM *rfdict_lsm_alloc(int sensitive, long memcap);
+
+/*
+ * Release an LSM dictionary.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary to release, or NULL
+ */
+void rfdict_lsm_free(RFDICT_LSM *pLsm);
+
+/*
+ * Insert a new key/value pair into an LSM dictionary.
+ * 
+ * This has the same semantics as rfdict_insert().
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ *   pKey - the key string
+ * 
+ *   val - the value to associate with the key
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the key was already present
+ */
+int rfdict_lsm_insert(RFDICT_LSM *pLsm, const char *pKey, long val);
+
+/*
+ * Get the value associated with a given key in an LSM dictionary.
+ * 
+ * This has the same semantics as rfdict_get().
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the dictionary
+ */
+long rfdict_lsm_get(RFDICT_LSM *pLsm, const char *pKey, long dvalue);
+
+/*
+ * Get the number of keys in an LSM dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_lsm_count(RFDICT_LSM *pLsm);
+
+/*
+ * Merge all the keys of an LSM dictionary into a single run.
+ * 
+ * The memtable is frozen, and all runs are merged immediately.  This is
+ * useful once loading is complete, so that lookups only need to search
+ * one run.
+ * 
+ * Parameters:
+ * 
+ *   pLsm - the LSM dictionary
+ */
+void rfdict_lsm_compact(RFDICT_LSM *pLsm);
+
+/*
+ * Build a succinct trie of the keys and values of a dictionary.
+ * 
+ * The trie is encoded in level-order unary degree sequence (LOUDS)
+ * form, which takes about two bits per trie node for the structure and
+ * one byte per node for the label, plus small rank and select
+ * directories.  Values are bit-packed in the same way as in frozen
+ * images.  This is the most compact form of a large vocabulary, at the
+ * cost of a few rank and select operations per byte of the key on
+ * lookup.
+ * 
+ * The trie has the same case sensitivity as the dictionary.  Later
+ * changes to the dictionary do not affect the trie.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ * Return:
+ * 
+ *   a new succinct trie
+ */
+RFDICT_LOUDS *rfdict_louds_build(RFDICT *pDict);
+
+/*
+ * Release a succinct trie.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pLouds - the succinct trie to release, or NULL
+ */
+void rfdict_louds_free(RFDICT_LOUDS *pLouds);
+
+/*
+ * Get the number of keys in a succinct trie.
+ * 
+ * Parameters:
+ * 
+ *   pLouds - the succinct trie
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_louds_count(RFDICT_LOUDS *pLouds);
+
+/*
+ * Get the approximate number of bytes of memory used by a succinct
+ * trie.
+ * 
+ * Parameters:
+ * 
+ *   pLouds - the succinct trie
+ * 
+ * Return:
+ * 
+ *   the size in bytes
+ */
+size_t rfdict_louds_size(RFDICT_LOUDS *pLouds);
+
+/*
+ * Get the value associated with a given key in a succinct trie.
+ * 
+ * This has the same semantics as rfdict_get().
+ * 
+ * Parameters:
+ * 
+ *   pLouds - the succinct trie
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the trie
+ */
+long rfdict_louds_get(
+    RFDICT_LOUDS * pLouds,
+    const char   * pKey,
+    long           dvalue);
+
+/*
+ * Compile the keys and values of a dictionary into a minimal finite
+ * state transducer.
+ * 
+ * The transducer is an acyclic graph in which keys are paths of
+ * labeled arcs, and values are produced as the sum of outputs along
+ * the path.  Identical subgraphs are stored once, so both common
+ * prefixes and common suffixes of keys are shared.
+ * 
+ * The transducer is stored in a single image of bytes, which can be
+ * obtained with rfdict_fst_image(), written to a file, and later used
+ * in place with rfdict_fst_map(), for example after mapping the file
+ * into memory.  The image does not depend on the byte order or word
+ * size of the machine, except that values must be in range of a long.
+ * 
+ * The transducer has the same case sensitivity as the dictionary.
+ * Later changes to the dictionary do not affect the transducer.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ * Return:
+ * 
+ *   a new transducer
+ */
+RFDICT_FST *rfdict_fst_build(RFDICT *pDict);
+
+/*
+ * Use a transducer image in place.
+ * 
+ * pImage points to an image of len bytes, as returned by
+ * rfdict_fst_image().  The image is not copied, and it must remain
+ * valid and unchanged until the returned transducer is freed.  Bytes
+ * past the end of the image are ignored.
+ * 
+ * The header of the image is checked, and lookups check that they stay
+ * within the image, so a corrupt image produces wrong results but does
+ * not cause memory to be read outside the image.
+ * 
+ * Parameters:
+ * 
+ *   pImage - the image
+ * 
+ *   len - the number of bytes available at pImage
+ * 
+ * Return:
+ * 
+ *   a new transducer, or NULL if the image is not valid
+ */
+RFDICT_FST *rfdict_fst_map(const void *pImage, size_t len);
+
+/*
+ * Release a transducer.
+ * 
+ * If the transducer was returned by rfdict_fst_build(), its image is
+ * also released.  If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer to release, or NULL
+ */
+void rfdict_fst_free(RFDICT_FST *pFst);
+
+/*
+ * Get the image of a transducer.
+ * 
+ * The image remains valid until the transducer is freed.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pLen - receives the length of the image in bytes
+ * 
+ * Return:
+ * 
+ *   pointer to the image
+ */
+const void *rfdict_fst_image(RFDICT_FST *pFst, size_t *pLen);
+
+/*
+ * Get the number of keys in a transducer.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_fst_count(RFDICT_FST *pFst);
+
+/*
+ * Get the value associated with a given key in a transducer.
+ * 
+ * This has the same semantics as rfdict_get().
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pKey - the key string
+ * 
+ *   dvalue - the default value to return if key not found
+ * 
+ * Return:
+ * 
+ *   the value associated with the key, or dvalue if the key is not
+ *   present in the transducer
+ */
+long rfdict_fst_get(RFDICT_FST *pFst, const char *pKey, long dvalue);
+
+/*
+ * Report all keys in a transducer that start with a given prefix.
+ * 
+ * The callback is invoked for each matching key, including the prefix
+ * itself if it is a key.  Keys are reported in ascending order of
+ * their bytes compared as unsigned values.  In case-insensitive
+ * transducers, the prefix is matched case-insensitively.  If the
+ * callback returns zero, the enumeration stops early.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pPrefix - the prefix, which may be empty to report all keys
+ * 
+ *   fp - the callback
+ * 
+ *   pCustom - passed through to the callback
+ */
+void rfdict_fst_prefix(
+    RFDICT_FST      * pFst,
+    const char      * pPrefix,
+    rfdict_fp_visit   fp,
+    void            * pCustom);
+
+/*
+ * Compile the keys of a dictionary into a scanner that finds all
+ * occurrences of any key within text.
+ * 
+ * The scanner is an Aho-Corasick automaton, which reads each byte of
+ * the text once no matter how many keys there are, so the time taken
+ * is proportional to the length of the text plus the number of
+ * matches.  The scanner has the same case sensitivity as the
+ * dictionary.  An empty key is never reported.  Later changes to the
+ * dictionary do not affect the scanner.
+ * 
+ * The scanner is not modified by scanning, so one scanner may be used
+ * with any number of positions at once.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ * Return:
+ * 
+ *   a new scanner
+ */
+RFDICT_SCANNER *rfdict_compile_scanner(RFDICT *pDict);
+
+/*
+ * Release a scanner.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pScanner - the scanner to release, or NULL
+ */
+void rfdict_scanner_free(RFDICT_SCANNER *pScanner);
+
+/*
+ * Get the number of keys a scanner can report.
+ * 
+ * This is the number of keys in the dictionary it was compiled from,
+ * not counting any empty key.
+ * 
+ * Parameters:
+ * 
+ *   pScanner - the scanner
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_scanner_count(RFDICT_SCANNER *pScanner);
+
+/*
+ * Initialize a scan position to the start of a stream.
+ * 
+ * Parameters:
+ * 
+ *   pPos - the position to initialize
+ */
+void rfdict_scanpos_init(RFDICT_SCANPOS *pPos);
+
+/*
+ * Scan a buffer of text for occurrences of keys.
+ * 
+ * The buffer continues the stream at the given position, and the
+ * position is advanced past it.  Every occurrence of every key is
+ * reported, including overlapping occurrences, in order of the offset
+ * of the end of the match.  Matches that end at the same offset are
+ * reported longest first.  Offsets are counted from the start of the
+ * stream.
+ * 
+ * If the callback returns zero, scanning stops early.  The position is
+ * then left after the byte at which it stopped, and any further
+ * matches ending at that byte are not reported.
+ * 
+ * The buffer may contain any bytes, including nulls, which never match
+ * since keys can not contain them.
+ * 
+ * Parameters:
+ * 
+ *   pScanner - the scanner
+ * 
+ *   pPos - the scan position
+ * 
+ *   pBuf - the buffer, which may be NULL if len is zero
+ * 
+ *   len - the length of the buffer in bytes
+ * 
+ *   fp - the callback
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   non-zero if the whole buffer was scanned, zero if the callback
+ *   stopped the scan
+ */
+int rfdict_scan(
+    RFDICT_SCANNER  * pScanner,
+    RFDICT_SCANPOS  * pPos,
+    const char      * pBuf,
+    size_t            len,
+    rfdict_fp_match   fp,
+    void            * pCustom);
+
+/*
+ * Report all keys in a dictionary within a given edit distance of a
+ * query.
+ * 
+ * The edit distance is the Levenshtein distance, which counts the
+ * fewest single-byte insertions, deletions and substitutions that turn
+ * one string into the other.  In case-insensitive dictionaries, letters
+ * that differ only in case are not counted as different.
+ * 
+ * The lookup runs a Levenshtein automaton for the query along the keys
+ * in order, sharing work between keys with common prefixes and skipping
+ * straight past every key with a prefix that is already too far from
+ * the query, so that only the neighborhood of the query is visited.
+ * 
+ * Keys are reported in ascending order.  If the callback returns zero,
+ * the lookup stops early.  The dictionary must not be modified during
+ * the lookup.
+ * 
+ * The length of the query may not exceed RFDICT_MAXKEY, and max_edits
+ * must be in the range zero to RFDICT_MAXEDITS, or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the query
+ * 
+ *   max_edits - the greatest edit distance to report
+ * 
+ *   fp - the callback
+ * 
+ *   pCustom - passed through to the callback
+ */
+void rfdict_fuzzy(
+    RFDICT          * pDict,
+    const char      * pKey,
+    int               max_edits,
+    rfdict_fp_fuzzy   fp,
+    void            * pCustom);
+
+/*
+ * Report all keys in a dictionary that match a pattern.
+ * 
+ * Patterns are regular expressions over bytes, which must match the
+ * whole key.  A ^ at the start and a $ at the end of the pattern are
+ * allowed and have no further effect.  Patterns are made of:
+ * 
+ *   - ordinary bytes, which match themselves
+ *   - a period, which matches any byte
+ *   - a bracket expression such as [a-z_] or [^0-9], which matches any
+ *     byte in (or with ^, not in) the listed bytes and ranges
+ *   - a backslash, which makes the next byte an ordinary byte
+ *   - parentheses for grouping, and a bar between alternatives
+ *   - *, + and ? after an item, for zero or more, one or more, and zero
+ *     or one of the item
+ * 
+ * In case-insensitive dictionaries, letters in the pattern match both
+ * cases.
+ * 
+ * The pattern is compiled to a deterministic automaton, which is run
+ * along the keys in order, sharing work between keys with common
+ * prefixes and seeking straight past every key with a prefix that the
+ * automaton rejects, so that the time taken depends on the number of
+ * keys that can still match rather than on the size of the dictionary.
+ * 
+ * Keys are reported in ascending order.  If the callback returns zero,
+ * the enumeration stops early.  The dictionary must not be modified
+ * during the enumeration.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pPattern - the pattern
+ * 
+ *   fp - the callback
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the pattern is invalid or too
+ *   complex, in which case no keys are reported
+ */
+int rfdict_match(
+    RFDICT          * pDict,
+    const char      * pPattern,
+    rfdict_fp_visit   fp,
+    void            * pCustom);
+
+/*
+ * Allocate a new string pool.
+ * 
+ * A string pool holds one copy of each distinct key of the dictionaries
+ * that use it, so dictionaries with many keys in common store each key
+ * only once.  Each pooled string is freed when no dictionary holds it
+ * anymore.
+ * 
+ * Dictionaries using a pool report keys through pointers to the pooled
+ * strings, so two such dictionaries have the same key exactly when the
+ * key pointers they report are equal (see rfdict_get_key()).
+ * 
+ * The pool is shared state of all the dictionaries using it, so if
+ * they are used from more than one thread, the client must make sure
+ * that only one of them is used at a time.
+ * 
+ * Release the pool with rfdict_pool_free().
+ * 
+ * Return:
+ * 
+ *   a new pool
+ */
+RFDICT_POOL *rfdict_pool_alloc(void);
+
+/*
+ * Release a string pool.
+ * 
+ * The pool is not freed until all dictionaries using it have also been
+ * freed, so this may be called as soon as the client has allocated all
+ * the dictionaries that should use the pool.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool to release, or NULL
+ */
+void rfdict_pool_free(RFDICT_POOL *pPool);
+
+/*
+ * Get the number of distinct strings in a string pool.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ * Return:
+ * 
+ *   the number of strings
+ */
+long rfdict_pool_count(RFDICT_POOL *pPool);
+
+/*
+ * Get the total size of the strings in a string pool.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ * Return:
+ * 
+ *   the total length of the strings in bytes, including terminating
+ *   nulls
+ */
+size_t rfdict_pool_bytes(RFDICT_POOL *pPool);
+
+/*
+ * Allocate a new dictionary object that keeps its keys in a string
+ * pool.
+ * 
+ * This is the same as rfdict_alloc(), except that keys are stored in
+ * the given pool rather than within the dictionary.  If pPool is NULL,
+ * this is the same as rfdict_alloc().  The pool must not have been
+ * released with rfdict_pool_free() yet.
+ * 
+ * Dictionaries made from this one by rfdict_clone() and the set
+ * operations use the same pool.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - non-zero for case-sensitive comparisons, zero for
+ *   case-insensitive comparisons
+ * 
+ *   pPool - the string pool, or NULL
+ * 
+ * Return:
+ * 
+ *   a new dictionary
+ */
+RFDICT *rfdict_alloc_pooled(int sensitive, RFDICT_POOL *pPool);
+
+/*
+ * Get the stored copy of a key in a dictionary.
+ * 
+ * In case-insensitive dictionaries, lowercase letters in the stored key
+ * have been mapped to uppercase.  The pointer remains valid until the
+ * key is removed from the dictionary.  For dictionaries using the same
+ * string pool, equal keys have equal pointers.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pKey - the key to look for
+ * 
+ * Return:
+ * 
+ *   the stored key, or NULL if the key is not in the dictionary
+ */
+const char *rfdict_get_key(RFDICT *pDict, const char *pKey);
+
+/*
+ * Check that a dictionary is intact.
+ * 
+ * This checks that the tree is in order with no duplicate keys, that
+ * the links between nodes agree, that the red-black rules hold, that
+ * keys are stored as the dictionary expects, and that the count and
+ * size of the dictionary match the tree.  It may be used before
+ * serving a dictionary that may have been damaged, for example by a
+ * fault in the client.  The check does not recurse, so it works on
+ * trees of any depth.
+ * 
+ * The tree is split into up to nthreads subtrees that are checked
+ * separately.  If the library is compiled with RFDICT_THREADS defined,
+ * each subtree is checked on its own POSIX thread; otherwise, they are
+ * checked one after another.  The dictionary must not be modified
+ * during the check.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   nthreads - the number of threads to use, where values less than
+ *   one mean one
+ * 
+ * Return:
+ * 
+ *   non-zero if the dictionary is intact, zero if not
+ */
+int rfdict_verify(RFDICT *pDict, int nthreads);
+
+/*
+ * Begin converting a dictionary to a frozen image while still serving
+ * lookups.
+ * 
+ * If the library is compiled with RFDICT_THREADS defined, the image is
+ * built on a POSIX thread of its own, which only reads the dictionary.
+ * Lookups through the handle and in the dictionary carry on while it
+ * runs, and none of them wait for it.  The next call to
+ * rfdict_freeze_step() after the thread is done switches the handle
+ * over to the image, which takes constant time.
+ * 
+ * Otherwise, or if the thread can not be started, the image is built
+ * only by calls to rfdict_freeze_step() and rfdict_freeze_finish(), so
+ * the caller decides when the build work is done and how much of it is
+ * done at a time.
+ * 
+ * Until the handle switches over, lookups through it search the
+ * dictionary; afterwards, they use the image and no longer use the
+ * dictionary.  The image is the same as rfdict_freeze() would make.
+ * 
+ * Lookups through the handle do not change it, so any number of them
+ * may run at the same time, and at the same time as a build thread.
+ * Steps, inserts and the other calls on the handle do change it, and
+ * must not run at the same time as any other call on the handle.
+ * 
+ * Keys can not be added to the dictionary while it is being frozen,
+ * so inserts through the handle are handled according to policy,
+ * which is RFDICT_FREEZE_REJECT or RFDICT_FREEZE_QUEUE.
+ * 
+ * The dictionary must not be modified or freed until
+ * rfdict_freeze_done() returns non-zero, or the handle is freed.  Until
+ * then, rfdict_insert(), rfdict_upsert(), rfdict_remove() and
+ * rfdict_clear() fault on the dictionary, and so do rfdict_get_ref()
+ * and rfdict_longest_prefix(), since a value may be written through the
+ * pointers they return.  Values must also not be written through
+ * pointers obtained before the freeze began, which can not be
+ * detected.  Afterwards, the dictionary may be freed or used
+ * independently.
+ * 
+ * The handle must be freed with rfdict_freeze_free().
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   policy - the insert policy
+ * 
+ * Return:
+ * 
+ *   a new freeze handle
+ */
+RFDICT_FREEZE *rfdict_freeze_async(RFDICT *pDict, int policy);
+
+/*
+ * Release a freeze handle, along with its image and any keys inserted
+ * through it.
+ * 
+ * The dictionary being frozen is not affected.  If NULL is passed, the
+ * call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the handle to release, or NULL
+ */
+void rfdict_freeze_free(RFDICT_FREEZE *pFreeze);
+
+/*
+ * Check whether a freeze handle has switched over to its image.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ * Return:
+ * 
+ *   non-zero if the image is complete, zero if lookups still use the
+ *   dictionary
+ */
+int rfdict_freeze_done(RFDICT_FREEZE *pFreeze);
+
+/*
+ * Advance the image of a freeze handle by up to a given number of
+ * nodes.
+ * 
+ * Each node of the dictionary is visited twice, once to size the image
+ * and once to copy it, so about twice the count of the dictionary in
+ * steps completes the image.  Once the image is complete, the handle
+ * switches lookups over to it, and further calls do nothing.
+ * 
+ * If the image is being built on its own thread, n is ignored, and the
+ * call only checks whether the thread is done, switching lookups over
+ * to the image if so.  It never waits for the thread.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ *   n - the most nodes to visit, which may not be negative
+ * 
+ * Return:
+ * 
+ *   non-zero if the image is complete, zero if not
+ */
+int rfdict_freeze_step(RFDICT_FREEZE *pFreeze, long n);
+
+/*
+ * Complete the image of a freeze handle immediately.
+ * 
+ * If the image is being built on its own thread, this waits for the
+ * thread.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ */
+void rfdict_freeze_finish(RFDICT_FREEZE *pFreeze);
+
+/*
+ * Get the image of a freeze handle.
+ * 
+ * The image remains owned by the handle, and holds only the keys that
+ * were in the dictionary when the freeze began.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ * Return:
+ * 
+ *   the image, or NULL if it is not complete yet
+ */
+RFDICT_FROZEN *rfdict_freeze_image(RFDICT_FREEZE *pFreeze);
+
+/*
+ * Look up a key through a freeze handle.
+ * 
+ * Keys inserted through the handle are found as well as the keys of
+ * the dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ *   pKey - the key to look for
+ * 
+ *   dvalue - the value to return if the key is not found
+ * 
+ * Return:
+ * 
+ *   the value of the key, or dvalue if the key is not found
+ */
+long rfdict_freeze_get(
+    RFDICT_FREEZE * pFreeze,
+    const char    * pKey,
+    long            dvalue);
+
+/*
+ * Insert a key through a freeze handle.
+ * 
+ * With the RFDICT_FREEZE_QUEUE policy, the key is kept by the handle
+ * beside the frozen contents.  With the RFDICT_FREEZE_REJECT policy,
+ * this always fails.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ *   pKey - the key to insert
+ * 
+ *   val - the value to associate with the key
+ * 
+ * Return:
+ * 
+ *   non-zero if the key was inserted, zero if inserts are rejected or
+ *   the key is already present
+ */
+int rfdict_freeze_insert(
+    RFDICT_FREEZE * pFreeze,
+    const char    * pKey,
+    long            val);
+
+/*
+ * Get the number of keys inserted through a freeze handle.
+ * 
+ * Parameters:
+ * 
+ *   pFreeze - the freeze handle
+ * 
+ * Return:
+ * 
+ *   the number of queued keys
+ */
+long rfdict_freeze_pending(RFDICT_FREEZE *pFreeze);
+
+/*
+ * Allocate a new, empty adaptive dictionary.
+ * 
+ * An adaptive dictionary counts its lookups and inserts, and every
+ * 1024 operations, chooses the engine that suits the number of lookups
+ * per insert during those operations.  If there were at least
+ * freeze_ratio lookups per insert, the frozen engine is chosen; else
+ * if there were at least hash_ratio, the hash engine is chosen; else
+ * the tree engine is chosen.  A ratio of zero or less means the engine
+ * is never chosen.
+ * 
+ * Moving to another engine is done a few keys at a time during later
+ * operations, so no single operation takes the cost of the whole move.
+ * When threads are enabled, the image of the frozen engine is built on
+ * a thread of its own instead, as for rfdict_freeze_async().  A new
+ * move is only started once the last one is complete.
+ * 
+ * The dictionary starts with the tree engine.  It must eventually be
+ * freed with rfdict_adapt_free().
+ * 
+ * Parameters:
+ * 
+ *   sensitive - non-zero for case-sensitive keys, zero for
+ *   case-insensitive keys
+ * 
+ *   hash_ratio - the lookups per insert at which to use the hash engine
+ * 
+ *   freeze_ratio - the lookups per insert at which to use the frozen
+ *   engine
+ * 
+ * Return:
+ * 
+ *   a new adaptive dictionary
+ */
+RFDICT_ADAPT *rfdict_adapt_alloc(
+    int  sensitive,
+    long hash_ratio,
+    long freeze_ratio);
+
+/*
+ * Free an adaptive dictionary.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary to free, or NULL
+ */
+void rfdict_adapt_free(RFDICT_ADAPT *pAdapt);
+
+/*
+ * Insert a key into an adaptive dictionary.
+ * 
+ * The length of the key may not exceed RFDICT_MAXKEY or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   pKey - the key to insert
+ * 
+ *   val - the value to associate with the key
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the key is already present
+ */
+int rfdict_adapt_insert(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey,
+    long           val);
+
+/*
+ * Look up a key in an adaptive dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   pKey - the key to look for
+ * 
+ *   dvalue - the value to return if the key is not found
+ * 
+ * Return:
+ * 
+ *   the value of the key, or dvalue if the key is not found
+ */
+long rfdict_adapt_get(
+    RFDICT_ADAPT * pAdapt,
+    const char   * pKey,
+    long           dvalue);
+
+/*
+ * Get the number of keys in an adaptive dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ * Return:
+ * 
+ *   the number of keys
+ */
+long rfdict_adapt_count(RFDICT_ADAPT *pAdapt);
+
+/*
+ * Get the engine of an adaptive dictionary.
+ * 
+ * If the dictionary is moving to another engine, that engine is
+ * reported.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ * Return:
+ * 
+ *   one of the RFDICT_ENGINE_ constants
+ */
+int rfdict_adapt_engine(RFDICT_ADAPT *pAdapt);
+
+/*
+ * Get the operation statistics of an adaptive dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   pStats - receives the statistics
+ */
+void rfdict_adapt_stats(RFDICT_ADAPT *pAdapt, RFDICT_ADAPT_STATS *pStats);
+
+/*
+ * Enable or disable latency histograms on a dictionary.
+ * 
+ * Once enabled, one in every sample calls of rfdict_get() and
+ * rfdict_insert() is timed, and its latency is counted in the
+ * histogram of that type of operation.  Calls that are not timed only
+ * pay for a countdown.  Enabling starts with empty histograms.
+ * 
+ * The countdown and the histograms are written by every call of
+ * rfdict_get() and rfdict_insert() without any synchronization, so
+ * while timing is enabled, rfdict_get() modifies the dictionary and
+ * may no longer be called from several threads at the same time.
+ * Timed dictionaries must serialize all access, including lookups, or
+ * leave timing disabled during concurrent phases such as counting
+ * with delta tables.
+ * 
+ * Timing uses the POSIX monotonic clock, so it is only available when
+ * the library is compiled with RFDICT_TIMING defined.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   sample - the sampling interval, or zero or less to disable timing
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if timing is not available
+ */
+int rfdict_latency_enable(RFDICT *pDict, long sample);
+
+/*
+ * Take a copy of a latency histogram of a dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   op - the type of operation, one of the RFDICT_OP_ constants
+ * 
+ *   pHist - receives the histogram, which is cleared if timing is not
+ *   enabled
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if timing is not enabled
+ */
+int rfdict_latency_snapshot(
+    RFDICT           * pDict,
+    int                op,
+    RFDICT_HISTOGRAM * pHist);
+
+/*
+ * Get the lowest latency counted in a histogram bucket.
+ * 
+ * Parameters:
+ * 
+ *   bucket - the bucket index
+ * 
+ * Return:
+ * 
+ *   the lowest latency of the bucket in nanoseconds
+ */
+unsigned long rfdict_histogram_bound(int bucket);
+
+/*
+ * Estimate a quantile of a latency histogram.
+ * 
+ * The quantile is given in parts per million, so that for example
+ * 999000 gives the 99.9th percentile.  The estimate is the highest
+ * latency of the bucket holding the quantile, so it is never below the
+ * true value and at most about six percent above it.
+ * 
+ * Parameters:
+ * 
+ *   pHist - the histogram
+ * 
+ *   ppm - the quantile in parts per million, from 0 to 1000000
+ * 
+ * Return:
+ * 
+ *   the estimated latency in nanoseconds, or zero if the histogram is
+ *   empty
+ */
+unsigned long rfdict_histogram_quantile(
+    RFDICT_HISTOGRAM * pHist,
+    long               ppm);
+
+/*
+ * Allocate a new dictionary object whose keys are fixed-width binary
+ * strings, such as UUIDs or hashes.
+ * 
+ * This is the same as rfdict_alloc(), except that every key passed to
+ * the dictionary is a pointer to exactly width bytes, which may take
+ * any values including zero.  Keys are ordered as by memcmp() over the
+ * full width, and are compared a machine word at a time rather than
+ * byte by byte.  Keys are stored at exactly the width, and frozen
+ * images made by rfdict_freeze() store them back to back with no
+ * offsets.
+ * 
+ * Keys reported to callbacks and returned by rfdict_get_key() point to
+ * width bytes, followed by a null that is not part of the key.
+ * rfdict_clone() and the set operations keep the width, and both
+ * dictionaries of a set operation must have the same width.  The
+ * functions that treat keys as text, which are rfdict_longest_prefix(),
+ * rfdict_louds_build(), rfdict_fst_build(), rfdict_compile_scanner(),
+ * rfdict_fuzzy(), rfdict_match() and rfdict_freeze_async(), may not be
+ * used on these dictionaries.
+ * 
+ * Parameters:
+ * 
+ *   width - the key width in bytes, from 1 up to RFDICT_MAXKEY
+ * 
+ * Return:
+ * 
+ *   a new dictionary
+ */
+RFDICT *rfdict_alloc_fixed(size_t width);
+
+/*
+ * Train a key compression codec on a sample of keys.
+ * 
+ * The codec replaces the bytes and common short strings of the sample
+ * with variable-length bit codes, so that keys similar to the sample
+ * take less space.  The codes are chosen so that compressed keys
+ * compare with strcmp() in the same order as the original keys, which
+ * lets the dictionary search and order compressed keys without
+ * expanding them.
+ * 
+ * If sensitive is zero, the codec maps letters to uppercase, and
+ * compressed keys are in the same order as for a case-insensitive
+ * dictionary.  Keys that differ only in case compress to the same
+ * string.
+ * 
+ * Training is done once, and the codec does not change afterwards.  Any
+ * key may be compressed, including keys that were not in the sample,
+ * but keys unlike the sample may not be shorter once compressed.  The
+ * codec must eventually be released with rfdict_codec_free().
+ * 
+ * Parameters:
+ * 
+ *   ppSample - the sample keys, which may be NULL only if n is zero
+ * 
+ *   n - the number of sample keys
+ * 
+ *   sensitive - non-zero for case-sensitive keys, zero for
+ *   case-insensitive
+ * 
+ * Return:
+ * 
+ *   a new codec
+ */
+RFDICT_CODEC *rfdict_codec_train(
+    const char * const * ppSample,
+    long                 n,
+    int                  sensitive);
+
+/*
+ * Release a codec.
+ * 
+ * Dictionaries and frozen images that use the codec hold their own
+ * handles to it, so the codec may be released while they are still in
+ * use.  The memory is freed when the last of them is released.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec to release, or NULL
+ */
+void rfdict_codec_free(RFDICT_CODEC *pCodec);
+
+/*
+ * Compress a key with a codec.
+ * 
+ * The length of the key may not exceed RFDICT_CODEC_MAXKEY or a fault
+ * occurs.  The compressed key is a null-terminated string of at most
+ * RFDICT_CODEC_MAXCODE bytes, none of which are null.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ *   pKey - the key to compress
+ * 
+ *   pOut - the buffer that receives the compressed key, which must
+ *   have room for RFDICT_CODEC_MAXCODE + 1 bytes
+ * 
+ * Return:
+ * 
+ *   the length of the compressed key, not including the terminating
+ *   null
+ */
+size_t rfdict_codec_encode(
+    RFDICT_CODEC * pCodec,
+    const char   * pKey,
+    char         * pOut);
+
+/*
+ * Expand a key compressed with a codec.
+ * 
+ * If the codec is not case-sensitive, the letters of the expanded key
+ * are in uppercase.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec that compressed the key
+ * 
+ *   pCode - the compressed key
+ * 
+ *   pOut - the buffer that receives the expanded key, which must have
+ *   room for RFDICT_CODEC_MAXKEY + 1 bytes
+ * 
+ * Return:
+ * 
+ *   the length of the expanded key, not including the terminating null
+ */
+size_t rfdict_codec_decode(
+    RFDICT_CODEC * pCodec,
+    const char   * pCode,
+    char         * pOut);
+
+/*
+ * Allocate a new dictionary object whose keys are compressed with a
+ * codec.
+ * 
+ * This is the same as rfdict_alloc(), except that every key passed to
+ * the dictionary is compressed with the codec before it is stored or
+ * searched for, and the case sensitivity is that of the codec.  The
+ * length of the keys may not exceed RFDICT_CODEC_MAXKEY or a fault
+ * occurs.  The dictionary holds its own handle to the codec.
+ * 
+ * Keys reported to callbacks and returned by rfdict_get_key() are the
+ * compressed keys, which may be expanded with rfdict_codec_decode().
+ * rfdict_clone(), the set operations and rfdict_freeze() keep the
+ * codec, and both dictionaries of a set operation must use the same
+ * codec.  The functions that may not be used on dictionaries made by
+ * rfdict_alloc_fixed() may not be used on these dictionaries either.
+ * 
+ * Parameters:
+ * 
+ *   pCodec - the codec
+ * 
+ * Return:
+ * 
+ *   a new dictionary
+ */
+RFDICT *rfdict_alloc_coded(RFDICT_CODEC *pCodec);
+
 #endif
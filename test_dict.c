@@ -26,20 +26,3726 @@
  *   returned, or a report that the requested key is not in the
  *   dictionary.
  * 
+ *   Before the query, the rest of the interface is tested against a
+ *   sorted reference list of the loaded keys, and against generated
+ *   keys.  The loaded dictionary itself is not changed by the tests.
+ *   Any failure is reported, and the program then fails.
+ * 
  * Compilation:
  * 
- *   - Compile with rfdict.c
+ *   - Compile with rfdict.c
+ */
+
+#include "rfdict.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_MAXLINE (1024)
+
+/*
+ * A key of the reference list, along with its value.
+ */
+typedef struct {
+  char *pKey;
+  long val;
+} TEST_KEY;
+
+/*
+ * A reference list of keys, which the tests compare the dictionary
+ * structures against.
+ * 
+ * Keys are stored the way a dictionary with the same sensitivity
+ * reports them, with lowercase letters mapped to uppercase in
+ * case-insensitive mode, so that once sorted, the list is in the same
+ * order as the dictionary.
+ */
+typedef struct {
+  TEST_KEY *pKey;
+  long count;
+  long cap;
+  int sensitive;
+} TEST_LIST;
+
+/*
+ * State of a callback that checks reported keys against a sorted
+ * reference list.
+ * 
+ * next is the index of the next key expected, and ok is cleared if any
+ * key does not match.
+ */
+typedef struct {
+  TEST_LIST *pExpect;
+  long next;
+  int ok;
+} TEST_VISIT;
+
+/*
+ * Copy a key, mapping lowercase letters to uppercase if the copy is
+ * for a case-insensitive dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pDest - the buffer that receives the copy
+ * 
+ *   pSrc - the key to copy
+ * 
+ *   sensitive - the case sensitivity flag
+ */
+static void fold_key(char *pDest, const char *pSrc, int sensitive) {
+  
+  /* Check parameters */
+  if ((pDest == NULL) || (pSrc == NULL)) {
+    abort();
+  }
+  
+  for( ; *pSrc != 0; pSrc++) {
+    *pDest = *pSrc;
+    if ((!sensitive) && (*pDest >= 'a') && (*pDest <= 'z')) {
+      *pDest = (char) (*pDest - 'a' + 'A');
+    }
+    pDest++;
+  }
+  *pDest = 0;
+}
+
+/*
+ * Initialize an empty reference list.
+ * 
+ * Parameters:
+ * 
+ *   pList - the list to initialize
+ * 
+ *   sensitive - the case sensitivity flag
+ */
+static void list_init(TEST_LIST *pList, int sensitive) {
+  if (pList == NULL) {
+    abort();
+  }
+  pList->pKey = NULL;
+  pList->count = 0;
+  pList->cap = 0;
+  pList->sensitive = sensitive;
+}
+
+/*
+ * Add a key to a reference list.
+ * 
+ * The list is not sorted by this call.
+ * 
+ * Parameters:
+ * 
+ *   pList - the list
+ * 
+ *   pKey - the key, which is copied
+ * 
+ *   val - the value of the key
+ */
+static void list_add(TEST_LIST *pList, const char *pKey, long val) {
+  
+  TEST_KEY *pNew = NULL;
+  
+  /* Check parameters */
+  if ((pList == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  /* Grow the array if necessary */
+  if (pList->count >= pList->cap) {
+    if (pList->cap < 1) {
+      pList->cap = 64;
+    } else {
+      pList->cap *= 2;
+    }
+    pNew = (TEST_KEY *) realloc(
+              pList->pKey, ((size_t) pList->cap) * sizeof(TEST_KEY));
+    if (pNew == NULL) {
+      abort();
+    }
+    pList->pKey = pNew;
+  }
+  
+  /* Copy the key as the dictionary would store it */
+  ((pList->pKey)[pList->count]).pKey = (char *) malloc(strlen(pKey) + 1);
+  if (((pList->pKey)[pList->count]).pKey == NULL) {
+    abort();
+  }
+  fold_key(((pList->pKey)[pList->count]).pKey, pKey, pList->sensitive);
+  ((pList->pKey)[pList->count]).val = val;
+  (pList->count)++;
+}
+
+/*
+ * Compare two reference list entries by key, for qsort().
+ */
+static int list_cmp(const void *pA, const void *pB) {
+  return strcmp(((const TEST_KEY *) pA)->pKey,
+                ((const TEST_KEY *) pB)->pKey);
+}
+
+/*
+ * Sort a reference list into dictionary order.
+ * 
+ * Parameters:
+ * 
+ *   pList - the list
+ */
+static void list_sort(TEST_LIST *pList) {
+  if (pList == NULL) {
+    abort();
+  }
+  if (pList->count > 1) {
+    qsort(pList->pKey, (size_t) pList->count, sizeof(TEST_KEY),
+          &list_cmp);
+  }
+}
+
+/*
+ * Find a key in a sorted reference list.
+ * 
+ * The key is matched as the dictionary would match it.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted list
+ * 
+ *   pKey - the key to look for, no longer than INPUT_MAXLINE bytes
+ * 
+ * Return:
+ * 
+ *   the index of the key, or -1 if it is not in the list
+ */
+static long list_find(TEST_LIST *pList, const char *pKey) {
+  
+  char buf[INPUT_MAXLINE + 1];
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  int retval = 0;
+  
+  /* Check parameters */
+  if ((pList == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  if (strlen(pKey) > INPUT_MAXLINE) {
+    abort();
+  }
+  
+  fold_key(&(buf[0]), pKey, pList->sensitive);
+  lo = 0;
+  hi = pList->count - 1;
+  while (lo <= hi) {
+    mid = lo + ((hi - lo) / 2);
+    retval = strcmp(((pList->pKey)[mid]).pKey, &(buf[0]));
+    if (retval == 0) {
+      return mid;
+    } else if (retval < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  
+  return -1;
+}
+
+/*
+ * Release the keys of a reference list, leaving it empty.
+ * 
+ * Parameters:
+ * 
+ *   pList - the list
+ */
+static void list_free(TEST_LIST *pList) {
+  
+  long i = 0;
+  
+  if (pList == NULL) {
+    abort();
+  }
+  for(i = 0; i < pList->count; i++) {
+    free(((pList->pKey)[i]).pKey);
+  }
+  free(pList->pKey);
+  pList->pKey = NULL;
+  pList->count = 0;
+  pList->cap = 0;
+}
+
+/*
+ * Build a new dictionary holding the keys of a reference list.
+ * 
+ * Parameters:
+ * 
+ *   pList - the list
+ * 
+ * Return:
+ * 
+ *   a new dictionary
+ */
+static RFDICT *list_build(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  long i = 0;
+  
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = rfdict_alloc(pList->sensitive);
+  for(i = 0; i < pList->count; i++) {
+    if (!rfdict_insert(pDict, ((pList->pKey)[i]).pKey,
+                        ((pList->pKey)[i]).val)) {
+      abort();  /* reference lists have no duplicates */
+    }
+  }
+  
+  return pDict;
+}
+
+/*
+ * Make a key that is not in a sorted reference list, derived from the
+ * key at a given index or from the index alone if the list is empty.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted list
+ * 
+ *   i - the index of the key to derive from
+ * 
+ *   pBuf - the buffer that receives the key, of INPUT_MAXLINE + 1
+ *   bytes
+ */
+static void list_absent(TEST_LIST *pList, long i, char *pBuf) {
+  
+  long n = 0;
+  size_t x = 0;
+  
+  /* Check parameters */
+  if ((pList == NULL) || (pBuf == NULL)) {
+    abort();
+  }
+  
+  /* Start from a prefix of the key, so the new key falls between
+   * existing keys, then add characters until it is not in the list */
+  pBuf[0] = 0;
+  if ((i >= 0) && (i < pList->count)) {
+    strncat(pBuf, ((pList->pKey)[i]).pKey, INPUT_MAXLINE / 2);
+    pBuf[strlen(pBuf) / 2] = 0;
+  }
+  for(n = i; list_find(pList, pBuf) >= 0; n /= 7) {
+    if (strlen(pBuf) >= INPUT_MAXLINE) {
+      abort();  /* shouldn't happen */
+    }
+    x = strlen(pBuf);
+    pBuf[x] = "#0123456"[(n < 0) ? 0 : (n % 7) + 1];
+    pBuf[x + 1] = 0;
+  }
+}
+
+/*
+ * Callback that checks each reported key against the next key of a
+ * sorted reference list.
+ */
+static int visit_check(void *pCustom, const char *pKey, long val) {
+  
+  TEST_VISIT *pVisit = NULL;
+  TEST_KEY *pExpect = NULL;
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  pVisit = (TEST_VISIT *) pCustom;
+  
+  if (pVisit->next >= (pVisit->pExpect)->count) {
+    pVisit->ok = 0;
+  } else {
+    pExpect = &(((pVisit->pExpect)->pKey)[pVisit->next]);
+    if ((strcmp(pExpect->pKey, pKey) != 0) || (pExpect->val != val)) {
+      pVisit->ok = 0;
+    }
+  }
+  (pVisit->next)++;
+  
+  return 1;
+}
+
+/*
+ * Check that a dictionary holds exactly the keys and values of a
+ * sorted reference list, in the same order.
+ * 
+ * The keys are enumerated by intersecting the dictionary with itself.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pList - the sorted list
+ * 
+ * Return:
+ * 
+ *   non-zero if the dictionary matches the list, zero if not
+ */
+static int same_keys(RFDICT *pDict, TEST_LIST *pList) {
+  
+  TEST_VISIT visit;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pList == NULL)) {
+    abort();
+  }
+  
+  visit.pExpect = pList;
+  visit.next = 0;
+  visit.ok = 1;
+  rfdict_intersect(pDict, pDict, &visit_check, &visit);
+  
+  return (visit.ok && (visit.next == pList->count) &&
+            rfdict_verify(pDict, 2));
+}
+
+/*
+ * Copy a key with uppercase letters mapped to lowercase, which a
+ * case-insensitive structure must still match.
+ * 
+ * Parameters:
+ * 
+ *   pDest - the buffer that receives the copy
+ * 
+ *   pSrc - the key to copy
+ */
+static void lower_key(char *pDest, const char *pSrc) {
+  
+  /* Check parameters */
+  if ((pDest == NULL) || (pSrc == NULL)) {
+    abort();
+  }
+  
+  for( ; *pSrc != 0; pSrc++) {
+    *pDest = *pSrc;
+    if ((*pDest >= 'A') && (*pDest <= 'Z')) {
+      *pDest = (char) (*pDest - 'A' + 'a');
+    }
+    pDest++;
+  }
+  *pDest = 0;
+}
+
+/*
+ * Test rfdict_get_ref() and rfdict_upsert().
+ * 
+ * Values are changed through the pointers from rfdict_get_ref() and
+ * set back with rfdict_upsert(), and keys that are not in the list are
+ * added with rfdict_upsert() and removed again.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_refs(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  TEST_KEY *pKey = NULL;
+  long *pRef = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  
+  /* Change every value through its pointer, then set it back */
+  for(i = 0; status && (i < pList->count); i++) {
+    pKey = &((pList->pKey)[i]);
+    pRef = rfdict_get_ref(pDict, pKey->pKey);
+    if ((pRef == NULL) || (*pRef != pKey->val)) {
+      status = 0;
+    } else {
+      *pRef = -(pKey->val);
+      if (rfdict_get(pDict, pKey->pKey, 0) != -(pKey->val)) {
+        status = 0;
+      }
+    }
+    
+    /* In case-insensitive mode, the lowercase key finds the same
+     * value */
+    if (status && (!(pList->sensitive))) {
+      lower_key(&(buf[0]), pKey->pKey);
+      if (rfdict_get_ref(pDict, &(buf[0])) != pRef) {
+        status = 0;
+      }
+    }
+    
+    if (status) {
+      if (rfdict_upsert(pDict, pKey->pKey, pKey->val) ||
+          (*pRef != pKey->val) ||
+          (rfdict_get_ref(pDict, pKey->pKey) != pRef)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Keys that are not present have no pointer, and are inserted by
+   * rfdict_upsert() and then updated by it */
+  for(i = -1; status && (i < pList->count); i++) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_get_ref(pDict, &(buf[0])) != NULL) {
+      status = 0;
+    }
+    if (status) {
+      if ((!rfdict_upsert(pDict, &(buf[0]), i)) ||
+          rfdict_upsert(pDict, &(buf[0]), i + 1) ||
+          (rfdict_get(pDict, &(buf[0]), -1) != i + 1)) {
+        status = 0;
+      }
+    }
+    if (status) {
+      if (!rfdict_remove(pDict, &(buf[0]))) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Nothing else changed */
+  if (status) {
+    status = same_keys(pDict, pList);
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Value reference test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test delta tables.
+ * 
+ * Repeated increments to the same value must take a single entry of a
+ * table, a full table must refuse new values while still taking
+ * increments to the ones it holds, and flushing must apply every
+ * pending increment and leave the table empty for further use.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_delta(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_DELTA *pDelta = NULL;
+  long *apRef[1000];
+  char buf[32];
+  int status = 1;
+  long i = 0;
+  long j = 0;
+  
+  pDict = rfdict_alloc(1);
+  for(i = 0; i < 1000; i++) {
+    sprintf(&(buf[0]), "Key%ld", i);
+    rfdict_insert(pDict, &(buf[0]), i);
+    apRef[i] = rfdict_get_ref(pDict, &(buf[0]));
+  }
+  
+  /* Three values fill a table of three, however often they are
+   * incremented, and a fourth is refused until the table is flushed */
+  pDelta = rfdict_delta_alloc(3);
+  for(j = 0; status && (j < 5); j++) {
+    for(i = 0; i < 3; i++) {
+      if (!rfdict_delta_add(pDelta, apRef[i], i - 1)) {
+        status = 0;
+      }
+    }
+  }
+  if (status) {
+    if (rfdict_delta_add(pDelta, apRef[3], 1) ||
+        (*(apRef[0]) != 0) || (*(apRef[1]) != 1) ||
+        (*(apRef[2]) != 2)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    rfdict_delta_flush(pDelta);
+    if ((*(apRef[0]) != -5) || (*(apRef[1]) != 1) ||
+        (*(apRef[2]) != 7) || (*(apRef[3]) != 3)) {
+      status = 0;
+    }
+  }
+  
+  /* After the flush, the table takes new values, and flushing it again
+   * does not apply the earlier increments twice */
+  for(i = 3; status && (i < 6); i++) {
+    if (!rfdict_delta_add(pDelta, apRef[i], 10)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    if (rfdict_delta_add(pDelta, apRef[0], 10)) {
+      status = 0;
+    }
+    rfdict_delta_flush(pDelta);
+    rfdict_delta_flush(pDelta);
+    if ((*(apRef[0]) != -5) || (*(apRef[2]) != 7) ||
+        (rfdict_get(pDict, "Key3", -1) != 13) ||
+        (rfdict_get(pDict, "Key5", -1) != 15) ||
+        (rfdict_get(pDict, "Key6", -1) != 6)) {
+      status = 0;
+    }
+  }
+  rfdict_delta_free(pDelta);
+  pDelta = NULL;
+  
+  /* Many values in a table that holds them all, with increments that
+   * come back to every value several times */
+  pDelta = rfdict_delta_alloc(1000);
+  for(j = 0; status && (j < 3); j++) {
+    for(i = 0; i < 1000; i++) {
+      if (!rfdict_delta_add(pDelta, apRef[(i * 7) % 1000], 1)) {
+        status = 0;
+      }
+    }
+  }
+  if (status) {
+    rfdict_delta_flush(pDelta);
+    for(i = 6; i < 1000; i++) {
+      sprintf(&(buf[0]), "Key%ld", i);
+      if (rfdict_get(pDict, &(buf[0]), -1) != i + 3) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Unflushed increments are discarded */
+  if (status) {
+    rfdict_delta_add(pDelta, apRef[999], 1);
+  }
+  rfdict_delta_free(pDelta);
+  if (status) {
+    if ((*(apRef[999]) != 1002) || (!rfdict_verify(pDict, 2))) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Delta table test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test rfdict_clone().
+ * 
+ * A copy must hold the same keys as the dictionary it was made from,
+ * and after that the two must be independent of each other.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_clone(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT *pCopy = NULL;
+  RFDICT *pEmpty = NULL;
+  TEST_LIST half;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  pCopy = rfdict_clone(pDict);
+  if (!same_keys(pCopy, pList)) {
+    status = 0;
+  }
+  
+  /* Remove every other key from the copy, change the values of the
+   * rest, and add keys that the original does not have */
+  list_init(&half, pList->sensitive);
+  for(i = 0; status && (i < pList->count); i++) {
+    if ((i % 2) == 0) {
+      if (!rfdict_remove(pCopy, ((pList->pKey)[i]).pKey)) {
+        status = 0;
+      }
+    } else {
+      if (rfdict_upsert(pCopy, ((pList->pKey)[i]).pKey, -i)) {
+        status = 0;
+      }
+      list_add(&half, ((pList->pKey)[i]).pKey, -i);
+    }
+  }
+  for(i = 0; status && (i < pList->count); i += 5) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_insert(pCopy, &(buf[0]), i)) {
+      list_add(&half, &(buf[0]), i);
+    }
+  }
+  list_sort(&half);
+  
+  /* The copy has the changes and the original has none of them */
+  if (status) {
+    if ((!same_keys(pCopy, &half)) || (!same_keys(pDict, pList))) {
+      status = 0;
+    }
+  }
+  
+  /* Freeing the original leaves the copy intact, and a copy of the
+   * copy matches it */
+  rfdict_free(pDict);
+  pDict = NULL;
+  if (status) {
+    pDict = rfdict_clone(pCopy);
+    if ((!same_keys(pCopy, &half)) || (!same_keys(pDict, &half))) {
+      status = 0;
+    }
+  }
+  
+  /* An empty dictionary copies to an empty dictionary that keeps the
+   * sensitivity setting */
+  if (status) {
+    pEmpty = rfdict_alloc(pList->sensitive);
+    rfdict_free(pCopy);
+    pCopy = rfdict_clone(pEmpty);
+    if ((!rfdict_insert(pCopy, "key", 1)) ||
+        (rfdict_get(pCopy, "KEY", 0) != (pList->sensitive ? 0 : 1)) ||
+        (rfdict_get(pEmpty, "key", 0) != 0)) {
+      status = 0;
+    }
+    rfdict_free(pEmpty);
+  }
+  
+  rfdict_free(pDict);
+  rfdict_free(pCopy);
+  list_free(&half);
+  if (!status) {
+    fprintf(stderr, "Dictionary copy test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Add the keys of a sorted reference list that fall into a set of
+ * classes to another list.
+ * 
+ * Key i is in class (i % 6), and is added if bit (i % 6) of mask is
+ * set.  The list added to is not sorted by this call.
+ * 
+ * Parameters:
+ * 
+ *   pDest - the list to add to
+ * 
+ *   pSrc - the list to take keys from
+ * 
+ *   mask - the classes to add
+ * 
+ *   sign - 1 to keep the values, -1 to negate them
+ */
+static void list_pick(
+    TEST_LIST * pDest,
+    TEST_LIST * pSrc,
+    int         mask,
+    long        sign) {
+  
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pDest == NULL) || (pSrc == NULL)) {
+    abort();
+  }
+  
+  for(i = 0; i < pSrc->count; i++) {
+    if ((mask >> ((int) (i % 6))) & 1) {
+      list_add(pDest, ((pSrc->pKey)[i]).pKey,
+                sign * ((pSrc->pKey)[i]).val);
+    }
+  }
+}
+
+/*
+ * Callback that counts the keys it is given, and asks to stop after
+ * the third one.
+ */
+static int visit_stop(void *pCustom, const char *pKey, long val) {
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  
+  (void) val;
+  (*((long *) pCustom))++;
+  return (*((long *) pCustom) < 3);
+}
+
+/*
+ * Run one of the set operations.
+ * 
+ * Parameters:
+ * 
+ *   op - 0 for rfdict_intersect(), 1 for rfdict_difference(), 2 for
+ *   rfdict_symdiff()
+ * 
+ *   pA, pB, fp, pCustom - passed through to the operation
+ * 
+ * Return:
+ * 
+ *   the result of the operation
+ */
+static RFDICT *set_op(
+    int               op,
+    RFDICT          * pA,
+    RFDICT          * pB,
+    rfdict_fp_visit   fp,
+    void            * pCustom) {
+  
+  RFDICT *pResult = NULL;
+  
+  if (op == 0) {
+    pResult = rfdict_intersect(pA, pB, fp, pCustom);
+  } else if (op == 1) {
+    pResult = rfdict_difference(pA, pB, fp, pCustom);
+  } else if (op == 2) {
+    pResult = rfdict_symdiff(pA, pB, fp, pCustom);
+  } else {
+    abort();
+  }
+  
+  return pResult;
+}
+
+/*
+ * Test rfdict_intersect(), rfdict_difference() and rfdict_symdiff().
+ * 
+ * Two overlapping dictionaries are made from the reference list, with
+ * the values of the second negated so that the results show which
+ * dictionary each value came from.  Each operation is checked both
+ * when it builds a dictionary and when it reports to a callback.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_sets(TEST_LIST *pList) {
+  
+  TEST_LIST a;
+  TEST_LIST b;
+  TEST_LIST expect;
+  TEST_LIST none;
+  TEST_VISIT visit;
+  RFDICT *pA = NULL;
+  RFDICT *pB = NULL;
+  RFDICT *pEmpty = NULL;
+  RFDICT *pResult = NULL;
+  RFDICT *pX = NULL;
+  RFDICT *pY = NULL;
+  int status = 1;
+  int op = 0;
+  int swap = 0;
+  long count = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* Classes 0-3 go into A, classes 2-5 go into B, and both stay
+   * sorted */
+  list_init(&none, pList->sensitive);
+  list_init(&a, pList->sensitive);
+  list_init(&b, pList->sensitive);
+  list_pick(&a, pList, 0x0f, 1);
+  list_pick(&b, pList, 0x3c, -1);
+  pA = list_build(&a);
+  pB = list_build(&b);
+  pEmpty = rfdict_alloc(pList->sensitive);
+  
+  /* Check each operation in both directions */
+  for(op = 0; status && (op < 3); op++) {
+    for(swap = 0; status && (swap < 2); swap++) {
+      pX = swap ? pB : pA;
+      pY = swap ? pA : pB;
+      
+      /* Work out the expected result */
+      list_init(&expect, pList->sensitive);
+      if (op == 0) {
+        list_pick(&expect, pList, 0x0c, swap ? -1 : 1);
+      } else if (op == 1) {
+        if (swap) {
+          list_pick(&expect, pList, 0x30, -1);
+        } else {
+          list_pick(&expect, pList, 0x03, 1);
+        }
+      } else {
+        list_pick(&expect, pList, 0x03, 1);
+        list_pick(&expect, pList, 0x30, -1);
+      }
+      list_sort(&expect);
+      
+      /* Build the result as a dictionary */
+      pResult = set_op(op, pX, pY, NULL, NULL);
+      if ((pResult == NULL) || (!same_keys(pResult, &expect))) {
+        status = 0;
+      }
+      rfdict_free(pResult);
+      pResult = NULL;
+      
+      /* Report the result to a callback instead */
+      visit.pExpect = &expect;
+      visit.next = 0;
+      visit.ok = 1;
+      pResult = set_op(op, pX, pY, &visit_check, &visit);
+      if ((pResult != NULL) || (!(visit.ok)) ||
+          (visit.next != expect.count)) {
+        status = 0;
+      }
+      
+      /* A callback that returns zero stops the operation */
+      count = 0;
+      set_op(op, pX, pY, &visit_stop, &count);
+      if (count != ((expect.count < 3) ? expect.count : 3)) {
+        status = 0;
+      }
+      
+      list_free(&expect);
+    }
+  }
+  
+  /* With an empty dictionary, intersection is empty and the other two
+   * operations give back the keys of the non-empty one */
+  if (status) {
+    pResult = rfdict_intersect(pA, pEmpty, NULL, NULL);
+    if (!same_keys(pResult, &none)) {
+      status = 0;
+    }
+    rfdict_free(pResult);
+    pResult = NULL;
+  }
+  if (status) {
+    pResult = rfdict_difference(pA, pEmpty, NULL, NULL);
+    if (!same_keys(pResult, &a)) {
+      status = 0;
+    }
+    rfdict_free(pResult);
+    pResult = NULL;
+  }
+  if (status) {
+    pResult = rfdict_symdiff(pEmpty, pA, NULL, NULL);
+    if (!same_keys(pResult, &a)) {
+      status = 0;
+    }
+    rfdict_free(pResult);
+    pResult = NULL;
+  }
+  
+  /* None of this changed the operands */
+  if (status) {
+    if ((!same_keys(pA, &a)) || (!same_keys(pB, &b)) ||
+        (!same_keys(pEmpty, &none))) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pA);
+  rfdict_free(pB);
+  rfdict_free(pEmpty);
+  list_free(&a);
+  list_free(&b);
+  list_free(&none);
+  if (!status) {
+    fprintf(stderr, "Set operation test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test rfdict_clear().
+ * 
+ * A cleared dictionary must be empty and usable, and when the same
+ * keys are inserted again in the same order, they must be placed in
+ * the memory the dictionary already holds.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_clear(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  TEST_LIST none;
+  const char **ppKey = NULL;
+  int status = 1;
+  int round = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* Remember where each key is stored */
+  pDict = list_build(pList);
+  ppKey = (const char **) malloc(
+            ((size_t) pList->count + 1) * sizeof(const char *));
+  if (ppKey == NULL) {
+    abort();
+  }
+  for(i = 0; i < pList->count; i++) {
+    ppKey[i] = rfdict_get_key(pDict, ((pList->pKey)[i]).pKey);
+  }
+  
+  list_init(&none, pList->sensitive);
+  for(round = 0; status && (round < 2); round++) {
+    
+    /* Clear the dictionary, and check that none of the keys is left */
+    rfdict_clear(pDict);
+    if (!same_keys(pDict, &none)) {
+      status = 0;
+    }
+    for(i = 0; status && (i < pList->count); i++) {
+      if (rfdict_get_ref(pDict, ((pList->pKey)[i]).pKey) != NULL) {
+        status = 0;
+      }
+    }
+    
+    /* Insert the keys again, and check that they reuse the memory */
+    for(i = 0; status && (i < pList->count); i++) {
+      if (!rfdict_insert(pDict, ((pList->pKey)[i]).pKey,
+                          ((pList->pKey)[i]).val)) {
+        status = 0;
+      } else if (rfdict_get_key(pDict, ((pList->pKey)[i]).pKey) !=
+                  ppKey[i]) {
+        status = 0;
+      }
+    }
+    if (status) {
+      if (!same_keys(pDict, pList)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Clearing an empty dictionary is allowed */
+  if (status) {
+    rfdict_clear(pDict);
+    rfdict_clear(pDict);
+    if ((!same_keys(pDict, &none)) || (!rfdict_insert(pDict, "k", 1)) ||
+        (rfdict_get(pDict, "k", 0) != 1)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  free(ppKey);
+  list_free(&none);
+  if (!status) {
+    fprintf(stderr, "Dictionary clear test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test rfdict_get_hint() and cursors.
+ * 
+ * Keys are looked up in sorted order, in scattered order, after keys
+ * have been removed, and with one cursor shared between dictionaries,
+ * and the results must always be those of rfdict_get().  Absent keys
+ * between the present ones are looked up along the way.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_hint(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT *pOther = NULL;
+  RFDICT_CURSOR cursor;
+  RFDICT_CURSOR other;
+  TEST_KEY *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  long j = 0;
+  long r = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  rfdict_cursor_init(&cursor);
+  
+  /* Sorted order, with an absent key before each present one, then
+   * the same in reverse */
+  for(r = 0; status && (r < 2); r++) {
+    for(j = 0; status && (j < pList->count); j++) {
+      i = (r == 0) ? j : (pList->count - 1 - j);
+      pKey = &((pList->pKey)[i]);
+      list_absent(pList, i, &(buf[0]));
+      if ((rfdict_get_hint(pDict, &(buf[0]), -1, &cursor) != -1) ||
+          (rfdict_get_hint(pDict, pKey->pKey, -1, &cursor) !=
+            pKey->val)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Scattered order, by a stride that is prime to most counts */
+  for(j = 0; status && (j < pList->count); j++) {
+    pKey = &((pList->pKey)[(j * 7919) % pList->count]);
+    if (rfdict_get_hint(pDict, pKey->pKey, -1, &cursor) != pKey->val) {
+      status = 0;
+    }
+  }
+  
+  /* Remove every third key, keeping the cursor from before, and look
+   * around each hundredth removal */
+  for(i = 0; status && (i < pList->count); i += 3) {
+    if (!rfdict_remove(pDict, ((pList->pKey)[i]).pKey)) {
+      status = 0;
+    }
+    if (status && ((i % 300) == 0)) {
+      for(j = ((i < 300) ? 0 : (i - 300));
+          (j < pList->count) && (j < i + 300); j++) {
+        pKey = &((pList->pKey)[j]);
+        if (rfdict_get_hint(pDict, pKey->pKey, -1, &cursor) !=
+              (((j % 3) == 0) && (j <= i) ? -1 : pKey->val)) {
+          status = 0;
+        }
+      }
+    }
+  }
+  
+  /* One cursor moving between two dictionaries, and a second cursor
+   * left in the first dictionary while keys are inserted */
+  if (status) {
+    pOther = list_build(pList);
+    rfdict_cursor_init(&other);
+    if (pList->count > 0) {
+      rfdict_get_hint(pDict, ((pList->pKey)[1 % pList->count]).pKey, 0,
+                      &other);
+    }
+    for(i = 0; i < pList->count; i += 3) {
+      if (!rfdict_insert(pDict, ((pList->pKey)[i]).pKey, -i)) {
+        status = 0;
+      }
+    }
+    for(j = 0; status && (j < pList->count); j++) {
+      pKey = &((pList->pKey)[j]);
+      if ((rfdict_get_hint(pOther, pKey->pKey, -1, &cursor) !=
+            pKey->val) ||
+          (rfdict_get_hint(pDict, pKey->pKey, -1, &cursor) !=
+            (((j % 3) == 0) ? -j : pKey->val)) ||
+          (rfdict_get_hint(pDict, pKey->pKey, -1, &other) !=
+            (((j % 3) == 0) ? -j : pKey->val))) {
+        status = 0;
+      }
+    }
+    if (!rfdict_verify(pDict, 2)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  rfdict_free(pOther);
+  if (!status) {
+    fprintf(stderr, "Cursor lookup test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Copy the start of a file to another file.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the path of the file to copy
+ * 
+ *   pDest - the path of the copy, which is created or truncated
+ * 
+ *   len - the number of bytes to copy, or -1 for the whole file
+ * 
+ *   corrupt - non-zero to change the first byte of the copy
+ * 
+ * Return:
+ * 
+ *   the length of the source file, or -1 if there was an I/O error
+ */
+static long copy_file(
+    const char * pSrc,
+    const char * pDest,
+    long         len,
+    int          corrupt) {
+  
+  FILE *pIn = NULL;
+  FILE *pOut = NULL;
+  long total = 0;
+  int c = 0;
+  
+  /* Check parameters */
+  if ((pSrc == NULL) || (pDest == NULL)) {
+    abort();
+  }
+  
+  pIn = fopen(pSrc, "rb");
+  if (pIn == NULL) {
+    return -1;
+  }
+  pOut = fopen(pDest, "wb");
+  if (pOut == NULL) {
+    fclose(pIn);
+    return -1;
+  }
+  
+  for(c = getc(pIn); c != EOF; c = getc(pIn)) {
+    if ((total == 0) && corrupt) {
+      c ^= 0xff;
+    }
+    if ((len < 0) || (total < len)) {
+      if (putc(c, pOut) == EOF) {
+        total = -1;
+        break;
+      }
+    }
+    total++;
+  }
+  
+  if (ferror(pIn)) {
+    total = -1;
+  }
+  fclose(pIn);
+  if (fclose(pOut)) {
+    total = -1;
+  }
+  return total;
+}
+
+/*
+ * Check that a disk dictionary holds exactly the keys and values of a
+ * sorted reference list.
+ * 
+ * Parameters:
+ * 
+ *   pDisk - the disk dictionary
+ * 
+ *   pList - the sorted list
+ * 
+ * Return:
+ * 
+ *   non-zero if the disk dictionary matches the list, zero if not
+ */
+static int same_disk(RFDICT_DISK *pDisk, TEST_LIST *pList) {
+  
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pDisk == NULL) || (pList == NULL)) {
+    abort();
+  }
+  
+  if (rfdict_disk_count(pDisk) != pList->count) {
+    status = 0;
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    if (rfdict_disk_get(pDisk, ((pList->pKey)[i]).pKey, LONG_MIN) !=
+          ((pList->pKey)[i]).val) {
+      status = 0;
+    }
+  }
+  for(i = -1; status && (i < pList->count); i += 7) {
+    list_absent(pList, i, &(buf[0]));
+    if (strlen(&(buf[0])) <= RFDICT_DISK_MAXKEY) {
+      if (rfdict_disk_get(pDisk, &(buf[0]), LONG_MIN) != LONG_MIN) {
+        status = 0;
+      }
+    }
+  }
+  if (!rfdict_disk_ok(pDisk)) {
+    status = 0;
+  }
+  
+  return status;
+}
+
+/*
+ * Test disk dictionaries.
+ * 
+ * The loaded keys, generated short keys and keys of the maximum length
+ * are written to a disk dictionary with the smallest buffer pool, so
+ * that pages are evicted all the time.  The file is then closed,
+ * opened again and extended, and every time the contents must match
+ * the reference list.  Damaged copies of the file must be rejected.
+ * 
+ * The test uses files named test_dict.tmp and test_dict.bad in the
+ * current directory, and removes them afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_disk(TEST_LIST *pList) {
+  
+  RFDICT_DISK *pDisk = NULL;
+  TEST_LIST all;
+  TEST_LIST first;
+  TEST_KEY *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long len = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* The loaded keys, and generated keys that are not among them */
+  list_init(&all, pList->sensitive);
+  for(i = 0; i < pList->count; i++) {
+    if (strlen(((pList->pKey)[i]).pKey) <= RFDICT_DISK_MAXKEY) {
+      list_add(&all, ((pList->pKey)[i]).pKey, ((pList->pKey)[i]).val);
+    }
+  }
+  for(i = 0; i < 3000; i++) {
+    sprintf(&(buf[0]), "#%ld.%c",
+            (i * 7919L) % 3000, (char) ('a' + (i % 26)));
+    if (list_find(pList, &(buf[0])) < 0) {
+      list_add(&all, &(buf[0]), -i);
+    }
+  }
+  for(i = 0; i < 40; i++) {
+    memset(&(buf[0]), 'k', RFDICT_DISK_MAXKEY);
+    buf[RFDICT_DISK_MAXKEY - (i % 3)] = 0;
+    sprintf(&(buf[0]), "#%03ld", i);
+    buf[4] = '.';
+    if (list_find(pList, &(buf[0])) < 0) {
+      list_add(&all, &(buf[0]), 1000000L + i);
+    }
+  }
+  list_sort(&all);
+  
+  /* Half of the keys go in first */
+  list_init(&first, pList->sensitive);
+  for(i = 0; i < all.count; i++) {
+    if ((i % 4) < 2) {
+      list_add(&first, ((all.pKey)[i]).pKey, ((all.pKey)[i]).val);
+    }
+  }
+  
+  /* Write them to a new file, alternating between the two ends of the
+   * list so that pages split on both sides */
+  pDisk = rfdict_disk_create("test_dict.tmp", pList->sensitive, 8);
+  if (pDisk == NULL) {
+    status = 0;
+  }
+  for(j = 0; status && (j < first.count); j++) {
+    i = ((j % 2) == 0) ? (j / 2) : (first.count - 1 - (j / 2));
+    pKey = &((first.pKey)[i]);
+    if (!rfdict_disk_insert(pDisk, pKey->pKey, pKey->val)) {
+      status = 0;
+    }
+  }
+  
+  /* Duplicates are refused, and the first value is kept */
+  for(i = 0; status && (i < first.count); i += 3) {
+    if (rfdict_disk_insert(pDisk, ((first.pKey)[i]).pKey, 0)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    status = same_disk(pDisk, &first);
+  }
+  if ((pDisk != NULL) && (!rfdict_disk_close(pDisk))) {
+    status = 0;
+  }
+  pDisk = NULL;
+  
+  /* Open the file again, check it, and write the rest of the keys */
+  if (status) {
+    pDisk = rfdict_disk_open("test_dict.tmp", 8);
+    if (pDisk == NULL) {
+      status = 0;
+    }
+  }
+  if (status) {
+    status = same_disk(pDisk, &first);
+  }
+  for(i = 0; status && (i < all.count); i++) {
+    if ((i % 4) >= 2) {
+      pKey = &((all.pKey)[i]);
+      if (!rfdict_disk_insert(pDisk, pKey->pKey, pKey->val)) {
+        status = 0;
+      }
+    }
+  }
+  if (status) {
+    status = same_disk(pDisk, &all);
+  }
+  if ((pDisk != NULL) && (!rfdict_disk_close(pDisk))) {
+    status = 0;
+  }
+  pDisk = NULL;
+  
+  /* Open it with a larger pool, and check that the sensitivity setting
+   * was kept */
+  if (status) {
+    pDisk = rfdict_disk_open("test_dict.tmp", 64);
+    if (pDisk == NULL) {
+      status = 0;
+    }
+  }
+  if (status) {
+    status = same_disk(pDisk, &all);
+  }
+  if (status) {
+    if (rfdict_disk_get(pDisk, "#0.A", 1) != (pList->sensitive ? 1 : 0)) {
+      status = 0;
+    }
+  }
+  if ((pDisk != NULL) && (!rfdict_disk_close(pDisk))) {
+    status = 0;
+  }
+  pDisk = NULL;
+  
+  /* A copy that is cut short by a page, or that has a damaged
+   * signature, is rejected, while a whole copy is accepted */
+  if (status) {
+    len = copy_file("test_dict.tmp", "test_dict.bad", -1, 0);
+    pDisk = rfdict_disk_open("test_dict.bad", 8);
+    if ((len < 8192 * 2) || (pDisk == NULL)) {
+      status = 0;
+    }
+    rfdict_disk_close(pDisk);
+    pDisk = NULL;
+  }
+  if (status) {
+    copy_file("test_dict.tmp", "test_dict.bad", len - 8192, 0);
+    pDisk = rfdict_disk_open("test_dict.bad", 8);
+    if (pDisk != NULL) {
+      status = 0;
+    }
+    rfdict_disk_close(pDisk);
+    pDisk = NULL;
+  }
+  if (status) {
+    copy_file("test_dict.tmp", "test_dict.bad", -1, 1);
+    pDisk = rfdict_disk_open("test_dict.bad", 8);
+    if (pDisk != NULL) {
+      status = 0;
+    }
+    rfdict_disk_close(pDisk);
+    pDisk = NULL;
+  }
+  
+  remove("test_dict.tmp");
+  remove("test_dict.bad");
+  list_free(&all);
+  list_free(&first);
+  if (!status) {
+    fprintf(stderr, "Disk dictionary test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Choose a step for visiting every key of a list once in scattered
+ * order, by stepping through the indices modulo the count.
+ * 
+ * Parameters:
+ * 
+ *   count - the number of keys
+ * 
+ * Return:
+ * 
+ *   a step that is less than count and shares no factor with it, or
+ *   zero if count is less than one
+ */
+static long list_stride(long count) {
+  
+  long stride = 0;
+  long a = 0;
+  long b = 0;
+  long r = 0;
+  
+  if (count < 1) {
+    return 0;
+  }
+  
+  /* Start about two thirds of the way, and step down until the
+   * greatest common divisor is one */
+  for(stride = count - (count / 3); stride > 1; stride--) {
+    a = count;
+    b = stride;
+    while (b != 0) {
+      r = a % b;
+      a = b;
+      b = r;
+    }
+    if (a == 1) {
+      break;
+    }
+  }
+  
+  return stride % count;
+}
+
+/*
+ * Check that a frozen image holds exactly the keys and values of a
+ * sorted reference list.
+ * 
+ * Parameters:
+ * 
+ *   pFrozen - the frozen image
+ * 
+ *   pList - the sorted list
+ * 
+ * Return:
+ * 
+ *   non-zero if the image matches the list, zero if not
+ */
+static int same_frozen(RFDICT_FROZEN *pFrozen, TEST_LIST *pList) {
+  
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pFrozen == NULL) || (pList == NULL)) {
+    abort();
+  }
+  
+  if (rfdict_frozen_count(pFrozen) != pList->count) {
+    status = 0;
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    if (rfdict_frozen_get(pFrozen, ((pList->pKey)[i]).pKey, 1) !=
+          ((pList->pKey)[i]).val) {
+      status = 0;
+    }
+  }
+  for(i = -1; status && (i < pList->count); i++) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_frozen_get(pFrozen, &(buf[0]), 1) != 1) {
+      status = 0;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Test frozen images and LSM dictionaries.
+ * 
+ * A frozen image must match the reference list, and go on matching it
+ * after the dictionary has been changed and freed.
+ * 
+ * The keys are then loaded into an LSM dictionary with a small
+ * memtable, in scattered order, so that many runs are frozen and
+ * merged.  After each insertion, keys that went in earlier are looked
+ * up again, so that lookups are made while runs are being merged.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_frozen(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  RFDICT_LSM *pLsm = NULL;
+  TEST_KEY *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  long *pos = NULL;
+  int status = 1;
+  long stride = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* Freeze, then change the dictionary and free it */
+  pDict = list_build(pList);
+  pFrozen = rfdict_freeze(pDict);
+  status = same_frozen(pFrozen, pList);
+  for(i = 0; i < pList->count; i++) {
+    pKey = &((pList->pKey)[i]);
+    if ((i % 2) == 0) {
+      rfdict_upsert(pDict, pKey->pKey, -1 - pKey->val);
+    } else {
+      rfdict_remove(pDict, pKey->pKey);
+    }
+  }
+  rfdict_free(pDict);
+  pDict = NULL;
+  if (status) {
+    status = same_frozen(pFrozen, pList);
+  }
+  rfdict_frozen_free(pFrozen);
+  pFrozen = NULL;
+  
+  /* Load the LSM dictionary in scattered order, and after each
+   * insertion look up the first key, the key just inserted and the key
+   * inserted halfway between them */
+  pos = (long *) malloc(((size_t) pList->count + 1) * sizeof(long));
+  if (pos == NULL) {
+    abort();
+  }
+  stride = list_stride(pList->count);
+  for(j = 0; j < pList->count; j++) {
+    pos[j] = (j == 0) ? 0 : ((pos[j - 1] + stride) % pList->count);
+  }
+  pLsm = rfdict_lsm_alloc(pList->sensitive, 7);
+  for(j = 0; status && (j < pList->count); j++) {
+    pKey = &((pList->pKey)[pos[j]]);
+    if ((!rfdict_lsm_insert(pLsm, pKey->pKey, pKey->val)) ||
+        rfdict_lsm_insert(pLsm, pKey->pKey, 0) ||
+        (rfdict_lsm_count(pLsm) != j + 1)) {
+      status = 0;
+    }
+    for(i = 0; status && (i < 3); i++) {
+      pKey = &((pList->pKey)[pos[(i == 0) ? 0 : ((i == 1) ? (j / 2) : j)]]);
+      if (rfdict_lsm_get(pLsm, pKey->pKey, 1) != pKey->val) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Check every key and absent keys, then do it again after
+   * compacting */
+  for(j = 0; status && (j < 2); j++) {
+    for(i = 0; status && (i < pList->count); i++) {
+      pKey = &((pList->pKey)[i]);
+      if ((rfdict_lsm_get(pLsm, pKey->pKey, 1) != pKey->val) ||
+          rfdict_lsm_insert(pLsm, pKey->pKey, 0)) {
+        status = 0;
+      }
+    }
+    for(i = -1; status && (i < pList->count); i++) {
+      list_absent(pList, i, &(buf[0]));
+      if (rfdict_lsm_get(pLsm, &(buf[0]), 1) != 1) {
+        status = 0;
+      }
+    }
+    if (rfdict_lsm_count(pLsm) != pList->count) {
+      status = 0;
+    }
+    rfdict_lsm_compact(pLsm);
+  }
+  
+  /* After compacting, new keys are still accepted and found */
+  for(i = -1; status && (i < pList->count); i += 5) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_lsm_insert(pLsm, &(buf[0]), i)) {
+      if (rfdict_lsm_get(pLsm, &(buf[0]), 1) != i) {
+        status = 0;
+      }
+    } else if (rfdict_lsm_get(pLsm, &(buf[0]), 1) == 1) {
+      status = 0;
+    }
+  }
+  
+  rfdict_lsm_free(pLsm);
+  free(pos);
+  if (!status) {
+    fprintf(stderr, "Frozen image or LSM test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Get the value of the key of a given rank in one of the value
+ * patterns used by test_pack().
+ * 
+ * Parameters:
+ * 
+ *   pattern - the pattern number, 0 to 6
+ * 
+ *   i - the rank of the key
+ * 
+ *   n - the number of keys
+ * 
+ * Return:
+ * 
+ *   the value
+ */
+static long pack_value(int pattern, long i, long n) {
+  
+  long result = 0;
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= n)) {
+    abort();
+  }
+  
+  switch (pattern) {
+    case 0:
+      /* All the same, which needs no bits */
+      result = -5;
+      break;
+    
+    case 1:
+      /* A constant step, which also needs no bits */
+      result = 1000 + (7 * i);
+      break;
+    
+    case 2:
+      /* Increasing at an uneven rate */
+      result = (i * i) / 3;
+      break;
+    
+    case 3:
+      /* A small range around zero, in no order */
+      result = ((i * 37) % 101) - 50;
+      break;
+    
+    case 4:
+      /* The whole range of a long, in no order */
+      switch (i % 4) {
+        case 0:
+          result = LONG_MIN;
+          break;
+        case 1:
+          result = LONG_MAX;
+          break;
+        case 2:
+          result = 0;
+          break;
+        default:
+          result = -1;
+      }
+      break;
+    
+    case 5:
+      /* Increasing over the whole range of a long */
+      if (i == 0) {
+        result = LONG_MIN;
+      } else if (i == n - 1) {
+        result = LONG_MAX;
+      } else {
+        result = i;
+      }
+      break;
+    
+    case 6:
+      /* Decreasing */
+      result = -i;
+      break;
+    
+    default:
+      abort();
+  }
+  
+  return result;
+}
+
+/*
+ * Test the packing of values in frozen images and LSM dictionaries.
+ * 
+ * Generated keys with values that follow each of the patterns of
+ * pack_value() are frozen and loaded into LSM dictionaries, for
+ * several key counts, and every value must come back unchanged.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_pack(void) {
+  
+  static const long an[7] = {0, 1, 2, 3, 64, 65, 1000};
+  RFDICT *pDict = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  RFDICT_LSM *pLsm = NULL;
+  char buf[32];
+  int status = 1;
+  int pattern = 0;
+  int c = 0;
+  long i = 0;
+  
+  for(pattern = 0; status && (pattern < 7); pattern++) {
+    for(c = 0; status && (c < 7); c++) {
+      
+      /* Keys sort in the order of their numbers */
+      pDict = rfdict_alloc(1);
+      pLsm = rfdict_lsm_alloc(1, 16);
+      for(i = 0; i < an[c]; i++) {
+        sprintf(&(buf[0]), "k%06ld", i);
+        rfdict_insert(pDict, &(buf[0]), pack_value(pattern, i, an[c]));
+        rfdict_lsm_insert(pLsm, &(buf[0]), pack_value(pattern, i, an[c]));
+      }
+      pFrozen = rfdict_freeze(pDict);
+      
+      /* Check the image and the LSM dictionary, then check the LSM
+       * dictionary again with all its keys in one run */
+      if ((rfdict_frozen_count(pFrozen) != an[c]) ||
+          (rfdict_lsm_count(pLsm) != an[c])) {
+        status = 0;
+      }
+      for(i = 0; status && (i < an[c]); i++) {
+        sprintf(&(buf[0]), "k%06ld", i);
+        if ((rfdict_frozen_get(pFrozen, &(buf[0]), 1) !=
+              pack_value(pattern, i, an[c])) ||
+            (rfdict_lsm_get(pLsm, &(buf[0]), 1) !=
+              pack_value(pattern, i, an[c]))) {
+          status = 0;
+        }
+      }
+      rfdict_lsm_compact(pLsm);
+      for(i = 0; status && (i < an[c]); i++) {
+        sprintf(&(buf[0]), "k%06ld", i);
+        if (rfdict_lsm_get(pLsm, &(buf[0]), 1) !=
+              pack_value(pattern, i, an[c])) {
+          status = 0;
+        }
+      }
+      if (status) {
+        if ((rfdict_frozen_get(pFrozen, "k", 1) != 1) ||
+            (rfdict_frozen_get(pFrozen, "k9999999", 1) != 1) ||
+            (rfdict_lsm_get(pLsm, "k", 1) != 1)) {
+          status = 0;
+        }
+      }
+      
+      rfdict_frozen_free(pFrozen);
+      rfdict_lsm_free(pLsm);
+      rfdict_free(pDict);
+    }
+  }
+  
+  if (!status) {
+    fprintf(stderr, "Value packing test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test succinct tries.
+ * 
+ * A trie of the loaded keys must match the reference list after the
+ * dictionary it came from is freed.  A trie of a few keys that are
+ * prefixes of each other, including the empty key, checks the paths
+ * that end inside other keys.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_louds(TEST_LIST *pList) {
+  
+  static const char *apKey[7] = {"", "a", "ab", "abc", "abd", "b", "ba"};
+  RFDICT *pDict = NULL;
+  RFDICT_LOUDS *pLouds = NULL;
+  TEST_KEY *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  pLouds = rfdict_louds_build(pDict);
+  rfdict_free(pDict);
+  pDict = NULL;
+  
+  if ((rfdict_louds_count(pLouds) != pList->count) ||
+      (rfdict_louds_size(pLouds) < 1)) {
+    status = 0;
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    pKey = &((pList->pKey)[i]);
+    if (rfdict_louds_get(pLouds, pKey->pKey, -1) != pKey->val) {
+      status = 0;
+    }
+    
+    /* The lowercase form is found if the list has it */
+    lower_key(&(buf[0]), pKey->pKey);
+    j = list_find(pList, &(buf[0]));
+    if (rfdict_louds_get(pLouds, &(buf[0]), -1) !=
+          ((j < 0) ? -1 : ((pList->pKey)[j]).val)) {
+      status = 0;
+    }
+  }
+  for(i = -1; status && (i < pList->count); i++) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_louds_get(pLouds, &(buf[0]), -1) != -1) {
+      status = 0;
+    }
+  }
+  rfdict_louds_free(pLouds);
+  pLouds = NULL;
+  
+  /* Keys that are prefixes of each other, leaving out "ab" so the path
+   * through it does not end in a key */
+  if (status) {
+    pDict = rfdict_alloc(1);
+    for(i = 0; i < 7; i++) {
+      if (i != 2) {
+        rfdict_insert(pDict, apKey[i], -i);
+      }
+    }
+    pLouds = rfdict_louds_build(pDict);
+    if (rfdict_louds_count(pLouds) != 6) {
+      status = 0;
+    }
+    for(i = 0; i < 7; i++) {
+      if (rfdict_louds_get(pLouds, apKey[i], 1) != ((i == 2) ? 1 : -i)) {
+        status = 0;
+      }
+    }
+    if ((rfdict_louds_get(pLouds, "abcd", 1) != 1) ||
+        (rfdict_louds_get(pLouds, "c", 1) != 1) ||
+        (rfdict_louds_get(pLouds, "A", 1) != 1)) {
+      status = 0;
+    }
+    rfdict_louds_free(pLouds);
+    pLouds = NULL;
+    
+    /* A trie of an empty dictionary has no keys */
+    rfdict_clear(pDict);
+    pLouds = rfdict_louds_build(pDict);
+    if ((rfdict_louds_count(pLouds) != 0) ||
+        (rfdict_louds_get(pLouds, "", 1) != 1) ||
+        (rfdict_louds_get(pLouds, "a", 1) != 1)) {
+      status = 0;
+    }
+    rfdict_louds_free(pLouds);
+    rfdict_free(pDict);
+  }
+  
+  if (!status) {
+    fprintf(stderr, "Succinct trie test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Check that a transducer holds exactly the keys and values of a
+ * sorted reference list.
+ * 
+ * Parameters:
+ * 
+ *   pFst - the transducer
+ * 
+ *   pList - the sorted list
+ * 
+ * Return:
+ * 
+ *   non-zero if the transducer matches the list, zero if not
+ */
+static int same_fst(RFDICT_FST *pFst, TEST_LIST *pList) {
+  
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if ((pFst == NULL) || (pList == NULL)) {
+    abort();
+  }
+  
+  if (rfdict_fst_count(pFst) != pList->count) {
+    status = 0;
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    if (rfdict_fst_get(pFst, ((pList->pKey)[i]).pKey, -1) !=
+          ((pList->pKey)[i]).val) {
+      status = 0;
+    }
+    lower_key(&(buf[0]), ((pList->pKey)[i]).pKey);
+    j = list_find(pList, &(buf[0]));
+    if (rfdict_fst_get(pFst, &(buf[0]), -1) !=
+          ((j < 0) ? -1 : ((pList->pKey)[j]).val)) {
+      status = 0;
+    }
+  }
+  for(i = -1; status && (i < pList->count); i++) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_fst_get(pFst, &(buf[0]), -1) != -1) {
+      status = 0;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Test minimal finite state transducers.
+ * 
+ * A transducer of the loaded keys is checked against the reference
+ * list, then its image is copied, the transducer is freed, and the
+ * copy is used in place and checked again.  Cut short or damaged
+ * copies of the image must be rejected.  Prefix enumeration is checked
+ * against the keys of the list that start with the prefix.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_fst(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_FST *pFst = NULL;
+  RFDICT_FST *pBad = NULL;
+  TEST_LIST expect;
+  TEST_VISIT visit;
+  unsigned char *pCopy = NULL;
+  char prefix[4];
+  size_t len = 0;
+  size_t plen = 0;
+  int status = 1;
+  long count = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  pFst = rfdict_fst_build(pDict);
+  rfdict_free(pDict);
+  pDict = NULL;
+  status = same_fst(pFst, pList);
+  
+  /* Copy the image, with bytes after it that must be ignored, and use
+   * the copy in place once the original is freed */
+  rfdict_fst_image(pFst, &len);
+  pCopy = (unsigned char *) malloc(len + 16);
+  if (pCopy == NULL) {
+    abort();
+  }
+  memcpy(pCopy, rfdict_fst_image(pFst, &len), len);
+  memset(pCopy + len, 0xff, 16);
+  rfdict_fst_free(pFst);
+  pFst = rfdict_fst_map(pCopy, len + 16);
+  if (pFst == NULL) {
+    status = 0;
+  }
+  if (status) {
+    status = same_fst(pFst, pList);
+  }
+  
+  /* Cut short or damaged images are refused */
+  if (status) {
+    for(i = 0; i < 4; i++) {
+      pBad = rfdict_fst_map(pCopy, (len * (size_t) i) / 4);
+      if (pBad != NULL) {
+        status = 0;
+      }
+      rfdict_fst_free(pBad);
+    }
+    pBad = rfdict_fst_map(pCopy, len - 1);
+    if (pBad != NULL) {
+      status = 0;
+    }
+    rfdict_fst_free(pBad);
+    
+    pCopy[0] ^= 0xff;
+    pBad = rfdict_fst_map(pCopy, len);
+    if (pBad != NULL) {
+      status = 0;
+    }
+    rfdict_fst_free(pBad);
+    pCopy[0] ^= 0xff;
+  }
+  
+  /* Enumerate the keys that start with prefixes of up to three bytes
+   * of every 37th key, including the empty prefix */
+  for(i = 0; status && (i < pList->count); i += 37) {
+    plen = strlen(((pList->pKey)[i]).pKey);
+    if (plen > (size_t) (i % 4)) {
+      plen = (size_t) (i % 4);
+    }
+    memcpy(&(prefix[0]), ((pList->pKey)[i]).pKey, plen);
+    prefix[plen] = 0;
+    
+    list_init(&expect, pList->sensitive);
+    for(j = 0; j < pList->count; j++) {
+      if (strncmp(((pList->pKey)[j]).pKey, &(prefix[0]), plen) == 0) {
+        list_add(&expect, ((pList->pKey)[j]).pKey,
+                  ((pList->pKey)[j]).val);
+      }
+    }
+    
+    /* In case-insensitive mode, the prefix may be given in lowercase */
+    if (!(pList->sensitive)) {
+      lower_key(&(prefix[0]), &(prefix[0]));
+    }
+    visit.pExpect = &expect;
+    visit.next = 0;
+    visit.ok = 1;
+    rfdict_fst_prefix(pFst, &(prefix[0]), &visit_check, &visit);
+    if ((!(visit.ok)) || (visit.next != expect.count)) {
+      status = 0;
+    }
+    list_free(&expect);
+  }
+  
+  /* A callback that returns zero stops the enumeration */
+  if (status) {
+    count = 0;
+    rfdict_fst_prefix(pFst, "", &visit_stop, &count);
+    if (count != ((pList->count < 3) ? pList->count : 3)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_fst_free(pFst);
+  free(pCopy);
+  if (!status) {
+    fprintf(stderr, "Transducer test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Get the next number from a simple pseudo-random generator.
+ * 
+ * The generator is the same on every platform, so the tests are
+ * repeatable.
+ * 
+ * Parameters:
+ * 
+ *   pState - the generator state, which is updated
+ * 
+ * Return:
+ * 
+ *   a number in range 0 to 32767
+ */
+static long test_rand(unsigned long *pState) {
+  *pState = ((*pState) * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return (long) (((*pState) >> 16) & 0x7fff);
+}
+
+/*
+ * Check one longest prefix lookup.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary
+ * 
+ *   pText - the text
+ * 
+ *   len - the length of the text
+ * 
+ *   expect - the length of the key expected to match, or -1 if no key
+ *   is expected to match
+ * 
+ *   val - the value expected for the matching key
+ * 
+ * Return:
+ * 
+ *   non-zero if the lookup gave the expected result, zero if not
+ */
+static int prefix_check(
+    RFDICT     * pDict,
+    const char * pText,
+    size_t       len,
+    long         expect,
+    long         val) {
+  
+  long *pVal = NULL;
+  size_t matched = 1;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pText == NULL)) {
+    abort();
+  }
+  
+  pVal = rfdict_longest_prefix(pDict, pText, len, &matched);
+  if (expect < 0) {
+    if ((pVal != NULL) || (matched != 0)) {
+      status = 0;
+    }
+  } else if ((pVal == NULL) || (matched != (size_t) expect) ||
+              (*pVal != val)) {
+    status = 0;
+  }
+  
+  return status;
+}
+
+/*
+ * Test longest prefix lookups.
+ * 
+ * A few hand-written keys are looked up with texts that match exactly,
+ * match a shorter key only, match nothing, or are cut short by their
+ * length or by a null byte, before and after the empty key is added.
+ * Then random keys over a small alphabet, which nest deeply, are
+ * looked up with random texts, and the results must be those of a
+ * brute-force search.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_prefix(int sensitive) {
+  
+  static const char *apKey[5] = {"a", "ab", "abcd", "b", "Foo"};
+  RFDICT *pDict = NULL;
+  char key[300][12];
+  char text[16];
+  char folded[16];
+  unsigned long seed = 63;
+  size_t matched = 0;
+  int status = 1;
+  long expect = 0;
+  long val = 0;
+  long len = 0;
+  long i = 0;
+  long j = 0;
+  long k = 0;
+  
+  pDict = rfdict_alloc(sensitive);
+  for(i = 0; i < 5; i++) {
+    rfdict_insert(pDict, apKey[i], i);
+  }
+  if (!(prefix_check(pDict, "abcd", 4, 4, 2) &&
+        prefix_check(pDict, "abc", 3, 2, 1) &&
+        prefix_check(pDict, "abcx", 4, 2, 1) &&
+        prefix_check(pDict, "abcdef", 3, 2, 1) &&
+        prefix_check(pDict, "ab\0cd", 5, 2, 1) &&
+        prefix_check(pDict, "bb", 2, 1, 3) &&
+        prefix_check(pDict, "zzz", 3, -1, 0) &&
+        prefix_check(pDict, "", 0, -1, 0) &&
+        prefix_check(pDict, "foobar", 6, sensitive ? -1 : 3, 4) &&
+        prefix_check(pDict, "Foobar", 6, 3, 4))) {
+    status = 0;
+  }
+  
+  /* The empty key matches any text */
+  if (status) {
+    rfdict_insert(pDict, "", 5);
+    if (!(prefix_check(pDict, "zzz", 3, 0, 5) &&
+          prefix_check(pDict, "", 0, 0, 5) &&
+          prefix_check(pDict, "abc", 3, 2, 1) &&
+          (rfdict_longest_prefix(pDict, "a", 1, &matched) ==
+            rfdict_get_ref(pDict, "a")))) {
+      status = 0;
+    }
+  }
+  rfdict_free(pDict);
+  
+  /* Random nested keys against a brute-force search */
+  pDict = rfdict_alloc(sensitive);
+  for(i = 0; i < 300; i++) {
+    len = test_rand(&seed) % 11;
+    for(j = 0; j < len; j++) {
+      (key[i])[j] = "abAB"[test_rand(&seed) % (sensitive ? 4 : 2)];
+    }
+    (key[i])[len] = 0;
+    if (!rfdict_insert(pDict, &((key[i])[0]), i)) {
+      (key[i])[0] = '#';
+      (key[i])[1] = 0;
+    }
+  }
+  for(k = 0; status && (k < 2000); k++) {
+    len = test_rand(&seed) % 14;
+    for(j = 0; j < len; j++) {
+      text[j] = "abAB\0"[test_rand(&seed) % 5];
+    }
+    text[len] = '#';
+    memcpy(&(folded[0]), &(text[0]), (size_t) len);
+    for(j = 0; j < len; j++) {
+      if ((!sensitive) && (folded[j] >= 'a') && (folded[j] <= 'z')) {
+        folded[j] = (char) (folded[j] - 'a' + 'A');
+      }
+    }
+    
+    expect = -1;
+    val = 0;
+    for(i = 0; i < 300; i++) {
+      for(j = 0; (key[i])[j] != 0; j++) {
+        if ((j >= len) || (folded[j] == 0) ||
+            (folded[j] != (((!sensitive) && ((key[i])[j] >= 'a') &&
+                            ((key[i])[j] <= 'z')) ?
+                              (key[i])[j] - 'a' + 'A' : (key[i])[j]))) {
+          break;
+        }
+      }
+      if (((key[i])[j] == 0) && (j > expect)) {
+        expect = j;
+        val = i;
+      }
+    }
+    if (!prefix_check(pDict, &(text[0]), (size_t) len, expect, val)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Longest prefix test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * A match reported by a scanner, or expected from one.
+ */
+typedef struct {
+  long offset;
+  long length;
+  long val;
+} TEST_MATCH;
+
+/*
+ * State of a callback that records the matches reported by a scanner.
+ * 
+ * stop is the number of matches after which the callback asks to
+ * stop, or -1 to never stop.
+ */
+typedef struct {
+  TEST_MATCH *pMatch;
+  long count;
+  long cap;
+  long stop;
+} TEST_SCAN;
+
+/*
+ * Callback that records a match.
+ */
+static int scan_record(
+    void * pCustom,
+    long   offset,
+    long   length,
+    long   val) {
+  
+  TEST_SCAN *pScan = NULL;
+  TEST_MATCH *pNew = NULL;
+  
+  /* Check parameters */
+  if (pCustom == NULL) {
+    abort();
+  }
+  pScan = (TEST_SCAN *) pCustom;
+  
+  /* Grow the array if necessary */
+  if (pScan->count >= pScan->cap) {
+    pScan->cap = (pScan->cap < 1) ? 64 : (pScan->cap * 2);
+    pNew = (TEST_MATCH *) realloc(
+              pScan->pMatch, ((size_t) pScan->cap) * sizeof(TEST_MATCH));
+    if (pNew == NULL) {
+      abort();
+    }
+    pScan->pMatch = pNew;
+  }
+  
+  ((pScan->pMatch)[pScan->count]).offset = offset;
+  ((pScan->pMatch)[pScan->count]).length = length;
+  ((pScan->pMatch)[pScan->count]).val = val;
+  (pScan->count)++;
+  
+  return ((pScan->stop < 0) || (pScan->count < pScan->stop));
+}
+
+/*
+ * Compare bytes of text with a key as a dictionary with the given
+ * sensitivity would.
+ * 
+ * Parameters:
+ * 
+ *   pText - the text
+ * 
+ *   pKey - the key, with exactly len bytes before its terminator
+ * 
+ *   len - the number of bytes to compare
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ * Return:
+ * 
+ *   non-zero if the bytes match the key, zero if not
+ */
+static int text_is_key(
+    const char * pText,
+    const char * pKey,
+    long         len,
+    int          sensitive) {
+  
+  char a[2];
+  char b[2];
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pText == NULL) || (pKey == NULL) || (len < 0)) {
+    abort();
+  }
+  
+  a[1] = 0;
+  b[1] = 0;
+  for(i = 0; i < len; i++) {
+    a[0] = pText[i];
+    b[0] = pKey[i];
+    fold_key(&(a[0]), &(a[0]), sensitive);
+    fold_key(&(b[0]), &(b[0]), sensitive);
+    if ((a[0] != b[0]) || (a[0] == 0)) {
+      return 0;
+    }
+  }
+  
+  return 1;
+}
+
+/*
+ * Check that a scanner reported the first matches expected of it, and
+ * no others.
+ * 
+ * Parameters:
+ * 
+ *   pFound - the matches reported
+ * 
+ *   pExpect - the matches expected
+ * 
+ *   n - the number of expected matches to check, no more than the
+ *   number expected
+ * 
+ * Return:
+ * 
+ *   non-zero if the matches are the same, zero if not
+ */
+static int same_matches(TEST_SCAN *pFound, TEST_SCAN *pExpect, long n) {
+  
+  TEST_MATCH *pA = NULL;
+  TEST_MATCH *pB = NULL;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pFound == NULL) || (pExpect == NULL) ||
+      (n < 0) || (n > pExpect->count)) {
+    abort();
+  }
+  
+  if (pFound->count != n) {
+    return 0;
+  }
+  for(i = 0; i < n; i++) {
+    pA = &((pFound->pMatch)[i]);
+    pB = &((pExpect->pMatch)[i]);
+    if ((pA->offset != pB->offset) || (pA->length != pB->length) ||
+        (pA->val != pB->val)) {
+      return 0;
+    }
+  }
+  
+  return 1;
+}
+
+/*
+ * Test scanners.
+ * 
+ * Keys that overlap and contain each other are compiled into a
+ * scanner, which is run over generated text made of the letters of the
+ * keys.  The text is fed in buffers of random lengths, including empty
+ * buffers, so that matches span buffers.  The matches must be exactly
+ * those found by comparing every key at every offset.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_scan(int sensitive) {
+  
+  static const char *apKey[12] = {
+    "", "a", "aa", "aaa", "he", "He", "she", "his", "hers", "ash",
+    "sha", "is"
+  };
+  static const char letters[10] = {
+    'a', 'h', 'e', 's', 'r', 'i', 'A', 'H', 'x', 0
+  };
+  RFDICT *pDict = NULL;
+  RFDICT_SCANNER *pScanner = NULL;
+  RFDICT_SCANPOS pos;
+  TEST_SCAN expect;
+  TEST_SCAN found;
+  char text[5000];
+  unsigned long seed = 64;
+  int status = 1;
+  long count = 0;
+  long len = 0;
+  long at = 0;
+  long i = 0;
+  long k = 0;
+  
+  /* Compile the keys that the dictionary takes, valued by index */
+  pDict = rfdict_alloc(sensitive);
+  for(k = 0; k < 12; k++) {
+    if (rfdict_insert(pDict, apKey[k], k) && (apKey[k][0] != 0)) {
+      count++;
+    }
+  }
+  pScanner = rfdict_compile_scanner(pDict);
+  if (rfdict_scanner_count(pScanner) != count) {
+    status = 0;
+  }
+  
+  /* Make the text, and work out the matches by brute force, ordered
+   * by end offset and then longest first */
+  for(i = 0; i < 5000; i++) {
+    text[i] = letters[test_rand(&seed) % 10];
+  }
+  expect.pMatch = NULL;
+  expect.count = 0;
+  expect.cap = 0;
+  expect.stop = -1;
+  for(i = 0; i < 5000; i++) {
+    for(len = ((i < 4) ? (i + 1) : 4); len > 0; len--) {
+      for(k = 1; k < 12; k++) {
+        if ((((long) strlen(apKey[k])) == len) &&
+            (rfdict_get(pDict, apKey[k], -1) == k) &&
+            text_is_key(&(text[i + 1 - len]), apKey[k], len, sensitive)) {
+          scan_record(&expect, i + 1 - len, len, k);
+        }
+      }
+    }
+  }
+  
+  /* Scan the text in pieces of up to 16 bytes */
+  found.pMatch = NULL;
+  found.count = 0;
+  found.cap = 0;
+  found.stop = -1;
+  rfdict_scanpos_init(&pos);
+  for(at = 0; status && (at < 5000); at += len) {
+    len = test_rand(&seed) % 17;
+    if (len > 5000 - at) {
+      len = 5000 - at;
+    }
+    if (!rfdict_scan(pScanner, &pos, &(text[at]), (size_t) len,
+                      &scan_record, &found)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    status = same_matches(&found, &expect, expect.count);
+  }
+  
+  /* Scan it again in one piece, stopping after the fifth match */
+  if (status) {
+    found.count = 0;
+    found.stop = 5;
+    rfdict_scanpos_init(&pos);
+    if (rfdict_scan(pScanner, &pos, &(text[0]), 5000,
+                    &scan_record, &found)) {
+      status = 0;
+    }
+    if (status) {
+      status = same_matches(&found, &expect,
+                            (expect.count < 5) ? expect.count : 5);
+    }
+  }
+  
+  rfdict_scanner_free(pScanner);
+  rfdict_free(pDict);
+  free(expect.pMatch);
+  free(found.pMatch);
+  if (!status) {
+    fprintf(stderr, "Scanner test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * State of a callback that checks the keys reported by a fuzzy lookup
+ * against a sorted list of the keys expected and their distances.
+ */
+typedef struct {
+  TEST_LIST *pExpect;
+  int *pEdits;
+  long next;
+  int ok;
+} TEST_FUZZY;
+
+/*
+ * Callback that checks a reported key and its distance against the
+ * next expected key.
+ */
+static int fuzzy_check(
+    void       * pCustom,
+    const char * pKey,
+    long         val,
+    int          edits) {
+  
+  TEST_FUZZY *pFuzzy = NULL;
+  TEST_KEY *pExpect = NULL;
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  pFuzzy = (TEST_FUZZY *) pCustom;
+  
+  if (pFuzzy->next >= (pFuzzy->pExpect)->count) {
+    pFuzzy->ok = 0;
+  } else {
+    pExpect = &(((pFuzzy->pExpect)->pKey)[pFuzzy->next]);
+    if ((strcmp(pExpect->pKey, pKey) != 0) || (pExpect->val != val) ||
+        ((pFuzzy->pEdits)[pFuzzy->next] != edits)) {
+      pFuzzy->ok = 0;
+    }
+  }
+  (pFuzzy->next)++;
+  
+  return 1;
+}
+
+/*
+ * Compute the Levenshtein distance between two strings the slow way,
+ * with the full dynamic programming table row by row.
+ * 
+ * Parameters:
+ * 
+ *   pA - the first string
+ * 
+ *   pB - the second string
+ * 
+ * Return:
+ * 
+ *   the distance
+ */
+static int edit_distance(const char *pA, const char *pB) {
+  
+  int *pRow = NULL;
+  size_t lb = 0;
+  size_t i = 0;
+  size_t j = 0;
+  int diag = 0;
+  int up = 0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  lb = strlen(pB);
+  pRow = (int *) malloc((lb + 1) * sizeof(int));
+  if (pRow == NULL) {
+    abort();
+  }
+  for(j = 0; j <= lb; j++) {
+    pRow[j] = (int) j;
+  }
+  
+  for(i = 0; pA[i] != 0; i++) {
+    diag = pRow[0];
+    pRow[0] = (int) (i + 1);
+    for(j = 1; j <= lb; j++) {
+      up = pRow[j];
+      pRow[j] = diag + ((pA[i] == pB[j - 1]) ? 0 : 1);
+      if (up + 1 < pRow[j]) {
+        pRow[j] = up + 1;
+      }
+      if (pRow[j - 1] + 1 < pRow[j]) {
+        pRow[j] = pRow[j - 1] + 1;
+      }
+      diag = up;
+    }
+  }
+  
+  result = pRow[lb];
+  free(pRow);
+  return result;
+}
+
+/*
+ * Run a fuzzy lookup for each distance limit from zero to three, and
+ * check the results against the distance from the query to every key
+ * of a sorted reference list.
+ * 
+ * Parameters:
+ * 
+ *   pDict - the dictionary holding the keys of the list
+ * 
+ *   pList - the sorted list
+ * 
+ *   pQuery - the query
+ * 
+ * Return:
+ * 
+ *   non-zero if the lookups gave the expected keys, zero if not
+ */
+static int check_fuzzy(
+    RFDICT     * pDict,
+    TEST_LIST  * pList,
+    const char * pQuery) {
+  
+  char buf[INPUT_MAXLINE + 1];
+  TEST_LIST expect;
+  TEST_FUZZY fuzzy;
+  int *pDist = NULL;
+  int *pEdits = NULL;
+  int status = 1;
+  int m = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pDict == NULL) || (pList == NULL) || (pQuery == NULL)) {
+    abort();
+  }
+  if (strlen(pQuery) > INPUT_MAXLINE) {
+    abort();
+  }
+  
+  /* Work out the distance to every key, comparing the query as the
+   * dictionary stores keys */
+  fold_key(&(buf[0]), pQuery, pList->sensitive);
+  pDist = (int *) malloc(((size_t) pList->count + 1) * sizeof(int));
+  pEdits = (int *) malloc(((size_t) pList->count + 1) * sizeof(int));
+  if ((pDist == NULL) || (pEdits == NULL)) {
+    abort();
+  }
+  for(i = 0; i < pList->count; i++) {
+    pDist[i] = edit_distance(((pList->pKey)[i]).pKey, &(buf[0]));
+  }
+  
+  for(m = 0; status && (m <= 3); m++) {
+    list_init(&expect, pList->sensitive);
+    for(i = 0; i < pList->count; i++) {
+      if (pDist[i] <= m) {
+        pEdits[expect.count] = pDist[i];
+        list_add(&expect, ((pList->pKey)[i]).pKey,
+                  ((pList->pKey)[i]).val);
+      }
+    }
+    
+    fuzzy.pExpect = &expect;
+    fuzzy.pEdits = pEdits;
+    fuzzy.next = 0;
+    fuzzy.ok = 1;
+    rfdict_fuzzy(pDict, pQuery, m, &fuzzy_check, &fuzzy);
+    if ((!(fuzzy.ok)) || (fuzzy.next != expect.count)) {
+      status = 0;
+    }
+    list_free(&expect);
+  }
+  
+  free(pDist);
+  free(pEdits);
+  return status;
+}
+
+/*
+ * Test fuzzy lookups.
+ * 
+ * Queries are made from the loaded keys by changing, adding and
+ * dropping bytes and changing case, and the keys reported within each
+ * distance must be exactly those a brute-force edit distance finds.
+ * The same is then done with a dictionary of every string of up to
+ * four letters from a three-letter alphabet, where most keys are close
+ * to each other.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_fuzzy(TEST_LIST *pList) {
+  
+  static const char alpha[4] = {'a', 'b', 'B', 0};
+  RFDICT *pDict = NULL;
+  TEST_LIST small;
+  char buf[INPUT_MAXLINE + 1];
+  unsigned long seed = 65;
+  size_t len = 0;
+  size_t x = 0;
+  int status = 1;
+  long i = 0;
+  long j = 0;
+  long n = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* Queries near the loaded keys */
+  pDict = list_build(pList);
+  for(i = 0; status && (i < pList->count); i += 1 + (pList->count / 25)) {
+    strcpy(&(buf[0]), ((pList->pKey)[i]).pKey);
+    lower_key(&(buf[0]), &(buf[0]));
+    len = strlen(&(buf[0]));
+    for(j = (long) (i % 4); j > 0; j--) {
+      n = test_rand(&seed);
+      x = (len > 0) ? (((size_t) n) % len) : 0;
+      if ((len > 0) && ((n % 3) == 0)) {
+        buf[x] = 'q';
+      } else if ((len > 0) && ((n % 3) == 1)) {
+        memmove(&(buf[x]), &(buf[x + 1]), len - x);
+        len--;
+      } else if (len < INPUT_MAXLINE) {
+        buf[len] = 'z';
+        len++;
+        buf[len] = 0;
+      }
+    }
+    status = check_fuzzy(pDict, pList, &(buf[0]));
+  }
+  if (status) {
+    status = check_fuzzy(pDict, pList, "");
+  }
+  rfdict_free(pDict);
+  pDict = NULL;
+  
+  /* Every string of up to four letters, queried with each of them and
+   * with some longer strings */
+  list_init(&small, pList->sensitive);
+  for(n = 1; n < 121; n++) {
+    j = n;
+    len = 0;
+    while (j > 0) {
+      j--;
+      buf[len] = alpha[j % 3];
+      len++;
+      j /= 3;
+    }
+    buf[len] = 0;
+    if (list_find(&small, &(buf[0])) < 0) {
+      list_add(&small, &(buf[0]), n);
+      list_sort(&small);
+    }
+  }
+  pDict = list_build(&small);
+  for(i = 0; status && (i < small.count); i++) {
+    status = check_fuzzy(pDict, &small, ((small.pKey)[i]).pKey);
+  }
+  if (status) {
+    status = (check_fuzzy(pDict, &small, "abBab") &&
+              check_fuzzy(pDict, &small, "bbbbbbb") &&
+              check_fuzzy(pDict, &small, "c"));
+  }
+  
+  rfdict_free(pDict);
+  list_free(&small);
+  if (!status) {
+    fprintf(stderr, "Fuzzy lookup test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test pattern matching.
+ * 
+ * A few keys with letters, digits and pattern characters are matched
+ * against hand-written patterns, and each result must be the set of
+ * keys written next to the pattern, in dictionary order.  Malformed
+ * patterns must be refused without reporting any keys.
+ * 
+ * Parameters:
+ * 
+ *   sensitive - the case sensitivity flag
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_match(int sensitive) {
+  
+  static const char *apKey[15] = {
+    "", "a", "ab", "abc", "abd", "b", "ba", "a.c", "a*", "x1", "x12",
+    "X9", "foo_bar", "fooBar", "q(z)"
+  };
+  
+  /* Each pattern, with the keys it matches as a bit mask over apKey,
+   * when case-sensitive and when case-insensitive */
+  static const struct {
+    const char *pPattern;
+    long sensitive;
+    long insensitive;
+  } aCase[20] = {
+    {"",              0x0001, 0x0001},
+    {"a",             0x0002, 0x0002},
+    {"^ab$",          0x0004, 0x0004},
+    {"ab.",           0x0018, 0x0018},
+    {"a.c",           0x0088, 0x0088},
+    {"a\\.c",         0x0080, 0x0080},
+    {"a\\*",          0x0100, 0x0100},
+    {"a*",            0x0003, 0x0003},
+    {"(a|b)+",        0x0066, 0x0066},
+    {"ab?",           0x0006, 0x0006},
+    {"ab[cd]",        0x0018, 0x0018},
+    {"ab[^c]",        0x0010, 0x0010},
+    {"x[0-9]+",       0x0600, 0x0e00},
+    {"[a-z]*",        0x007f, 0x207f},
+    {"foo.bar",       0x1000, 0x1000},
+    {"foo(_)?[bB]ar", 0x3000, 0x3000},
+    {".*",            0x7fff, 0x7fff},
+    {"q\\(z\\)",      0x4000, 0x4000},
+    {"(ab|x1)(c|2)?", 0x060c, 0x060c},
+    {"FOO.*",         0x0000, 0x3000}
+  };
+  static const char *apBad[8] = {
+    "(", "(ab", "a)", "[ab", "*", "+a", "a\\", "a|?"
+  };
+  RFDICT *pDict = NULL;
+  TEST_LIST expect;
+  TEST_VISIT visit;
+  int status = 1;
+  long mask = 0;
+  long count = 0;
+  long i = 0;
+  long k = 0;
+  
+  pDict = rfdict_alloc(sensitive);
+  for(k = 0; k < 15; k++) {
+    if (!rfdict_insert(pDict, apKey[k], k)) {
+      abort();  /* the keys differ in more than case */
+    }
+  }
+  
+  /* Each pattern gives exactly its keys, in order */
+  for(i = 0; status && (i < 20); i++) {
+    mask = sensitive ? aCase[i].sensitive : aCase[i].insensitive;
+    list_init(&expect, sensitive);
+    for(k = 0; k < 15; k++) {
+      if ((mask >> k) & 1) {
+        list_add(&expect, apKey[k], k);
+      }
+    }
+    list_sort(&expect);
+    
+    visit.pExpect = &expect;
+    visit.next = 0;
+    visit.ok = 1;
+    if ((!rfdict_match(pDict, aCase[i].pPattern, &visit_check, &visit)) ||
+        (!(visit.ok)) || (visit.next != expect.count)) {
+      status = 0;
+    }
+    list_free(&expect);
+  }
+  
+  /* Malformed patterns are refused and report nothing */
+  list_init(&expect, sensitive);
+  for(i = 0; status && (i < 8); i++) {
+    visit.pExpect = &expect;
+    visit.next = 0;
+    visit.ok = 1;
+    if (rfdict_match(pDict, apBad[i], &visit_check, &visit) ||
+        (visit.next != 0)) {
+      status = 0;
+    }
+  }
+  
+  /* A callback that returns zero stops the enumeration */
+  if (status) {
+    count = 0;
+    if ((!rfdict_match(pDict, ".*", &visit_stop, &count)) ||
+        (count != 3)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Pattern match test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test string pools.
+ * 
+ * Two dictionaries share a pool, one with all the loaded keys and one
+ * with half of them plus keys of its own, and a copy of the first uses
+ * the pool as well.  Equal keys must be stored once and reported
+ * through the same pointer, and the pool must count each distinct key
+ * once, until the last dictionary holding it lets go.  The pool is
+ * released before the dictionaries, which must go on working.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_pools(TEST_LIST *pList) {
+  
+  RFDICT_POOL *pPool = NULL;
+  RFDICT *pA = NULL;
+  RFDICT *pB = NULL;
+  RFDICT *pCopy = NULL;
+  RFDICT *pPlain = NULL;
+  TEST_LIST extra;
+  TEST_LIST half;
+  const char *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  size_t nbytes = 0;
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pPool = rfdict_pool_alloc();
+  pA = rfdict_alloc_pooled(pList->sensitive, pPool);
+  pB = rfdict_alloc_pooled(pList->sensitive, pPool);
+  pPlain = list_build(pList);
+  
+  /* A holds every key, and B every other key and keys of its own */
+  list_init(&extra, pList->sensitive);
+  list_init(&half, pList->sensitive);
+  for(i = 0; i < pList->count; i++) {
+    rfdict_insert(pA, ((pList->pKey)[i]).pKey, ((pList->pKey)[i]).val);
+    nbytes += strlen(((pList->pKey)[i]).pKey) + 1;
+    if ((i % 2) == 0) {
+      rfdict_insert(pB, ((pList->pKey)[i]).pKey, -i);
+      list_add(&half, ((pList->pKey)[i]).pKey, -i);
+    }
+  }
+  for(i = -1; i < pList->count; i += 5) {
+    list_absent(pList, i, &(buf[0]));
+    if (rfdict_insert(pB, &(buf[0]), i)) {
+      list_add(&extra, &(buf[0]), i);
+      list_add(&half, &(buf[0]), i);
+      nbytes += strlen(&(buf[0])) + 1;
+    }
+  }
+  list_sort(&extra);
+  list_sort(&half);
+  pCopy = rfdict_clone(pA);
+  
+  /* Each distinct key is stored once */
+  if ((rfdict_pool_count(pPool) != pList->count + extra.count) ||
+      (rfdict_pool_bytes(pPool) != nbytes) ||
+      (!same_keys(pA, pList)) || (!same_keys(pB, &half)) ||
+      (!same_keys(pCopy, pList))) {
+    status = 0;
+  }
+  
+  /* Shared keys have the same pointer in every pooled dictionary, but
+   * not in a dictionary without the pool */
+  for(i = 0; status && (i < pList->count); i++) {
+    pKey = rfdict_get_key(pA, ((pList->pKey)[i]).pKey);
+    if ((pKey == NULL) || (strcmp(pKey, ((pList->pKey)[i]).pKey) != 0) ||
+        (rfdict_get_key(pCopy, ((pList->pKey)[i]).pKey) != pKey) ||
+        (rfdict_get_key(pPlain, ((pList->pKey)[i]).pKey) == pKey)) {
+      status = 0;
+    }
+    if ((i % 2) == 0) {
+      if (rfdict_get_key(pB, ((pList->pKey)[i]).pKey) != pKey) {
+        status = 0;
+      }
+    } else if (rfdict_get_key(pB, ((pList->pKey)[i]).pKey) != NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Removing a key that another dictionary still holds keeps it in
+   * the pool, and removing the last holder drops it */
+  for(i = 0; status && (i < pList->count); i += 2) {
+    if ((!rfdict_remove(pA, ((pList->pKey)[i]).pKey)) ||
+        (rfdict_pool_count(pPool) != pList->count + extra.count)) {
+      status = 0;
+    }
+  }
+  if (status && (extra.count > 0)) {
+    nbytes -= strlen(((extra.pKey)[0]).pKey) + 1;
+    if ((!rfdict_remove(pB, ((extra.pKey)[0]).pKey)) ||
+        (rfdict_pool_count(pPool) != pList->count + extra.count - 1) ||
+        (rfdict_pool_bytes(pPool) != nbytes)) {
+      status = 0;
+    }
+  }
+  
+  /* Clearing B leaves only the keys that A or the copy hold */
+  if (status) {
+    rfdict_clear(pB);
+    if (rfdict_pool_count(pPool) != pList->count) {
+      status = 0;
+    }
+  }
+  
+  /* Release the pool first, then use and free the dictionaries */
+  rfdict_pool_free(pPool);
+  pPool = NULL;
+  if (status) {
+    for(i = 0; i < extra.count; i++) {
+      if ((!rfdict_insert(pB, ((extra.pKey)[i]).pKey,
+                          ((extra.pKey)[i]).val)) ||
+          (!rfdict_insert(pA, ((extra.pKey)[i]).pKey, 0)) ||
+          (rfdict_get_key(pA, ((extra.pKey)[i]).pKey) !=
+            rfdict_get_key(pB, ((extra.pKey)[i]).pKey))) {
+        status = 0;
+      }
+    }
+    if ((!same_keys(pB, &extra)) || (!same_keys(pCopy, pList))) {
+      status = 0;
+    }
+  }
+  rfdict_free(pA);
+  rfdict_free(pCopy);
+  if (status) {
+    if (!same_keys(pB, &extra)) {
+      status = 0;
+    }
+  }
+  rfdict_free(pB);
+  rfdict_free(pPlain);
+  
+  list_free(&extra);
+  list_free(&half);
+  if (!status) {
+    fprintf(stderr, "String pool test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test background freezing.
+ * 
+ * The image of the loaded keys is built a few nodes at a time, and
+ * between steps, lookups through the handle and directly in the
+ * dictionary must find every key, and keys are queued through the
+ * handle.  The finished image must match the reference list, and the
+ * dictionary must accept changes again once the image is done, or once
+ * a handle that has not finished is freed.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_freeze_async(TEST_LIST *pList) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_FREEZE *pFreeze = NULL;
+  TEST_LIST queued;
+  TEST_KEY *pKey = NULL;
+  char buf[INPUT_MAXLINE + 1];
+  int status = 1;
+  long steps = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  pDict = list_build(pList);
+  pFreeze = rfdict_freeze_async(pDict, RFDICT_FREEZE_QUEUE);
+  list_init(&queued, pList->sensitive);
+  
+  /* Build the image 17 nodes at a time, or with threads, wait for its
+   * thread to build it, which takes an unknown number of steps; with no
+   * keys to look up, just finish it */
+  for(steps = 0;
+      status && (pList->count > 0) && (!rfdict_freeze_step(pFreeze, 17));
+      steps++) {
+    if (rfdict_freeze_done(pFreeze) ||
+        (rfdict_freeze_image(pFreeze) != NULL)) {
+      status = 0;
+    }
+#ifndef RFDICT_THREADS
+    if (steps > (2 * pList->count) / 17 + 2) {
+      status = 0;
+    }
+#endif
+    
+    /* Look up a stretch of keys, which must not advance the build
+     * through the handle, though a thread may complete it */
+    for(j = 0; status && (j < 20); j++) {
+      pKey = &((pList->pKey)[(steps * 20 + j) % pList->count]);
+      if ((rfdict_freeze_get(pFreeze, pKey->pKey, -1) != pKey->val) ||
+          (rfdict_get(pDict, pKey->pKey, -1) != pKey->val)) {
+        status = 0;
+      }
+    }
+#ifndef RFDICT_THREADS
+    if (rfdict_freeze_step(pFreeze, 0)) {
+      status = 0;
+    }
+#endif
+    
+    /* Queue a key that is not in the list, and try a duplicate */
+    list_absent(pList, steps % pList->count, &(buf[0]));
+    if (rfdict_freeze_insert(pFreeze, &(buf[0]), -steps)) {
+      list_add(&queued, &(buf[0]), -steps);
+    }
+    pKey = &((pList->pKey)[steps % pList->count]);
+    if (rfdict_freeze_insert(pFreeze, pKey->pKey, 0)) {
+      status = 0;
+    }
+  }
+  rfdict_freeze_finish(pFreeze);
+  list_sort(&queued);
+  
+  /* The image holds the keys of the dictionary, and the handle finds
+   * the queued keys as well */
+  if (status) {
+    if ((!rfdict_freeze_done(pFreeze)) ||
+        (rfdict_freeze_image(pFreeze) == NULL) ||
+        (rfdict_freeze_pending(pFreeze) != queued.count)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    status = same_frozen(rfdict_freeze_image(pFreeze), pList);
+  }
+  for(i = 0; status && (i < queued.count); i++) {
+    pKey = &((queued.pKey)[i]);
+    if ((rfdict_freeze_get(pFreeze, pKey->pKey, 1) != pKey->val) ||
+        (rfdict_get(pDict, pKey->pKey, 1) != 1)) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    pKey = &((pList->pKey)[i]);
+    if (rfdict_freeze_get(pFreeze, pKey->pKey, -1) != pKey->val) {
+      status = 0;
+    }
+  }
+  
+  /* The dictionary can be changed now, without affecting the image */
+  if (status && (queued.count > 0)) {
+    if ((!rfdict_insert(pDict, ((queued.pKey)[0]).pKey, 0)) ||
+        (!same_frozen(rfdict_freeze_image(pFreeze), pList))) {
+      status = 0;
+    }
+    rfdict_remove(pDict, ((queued.pKey)[0]).pKey);
+  }
+  rfdict_freeze_free(pFreeze);
+  pFreeze = NULL;
+  
+  /* Freeing a handle before its image is done also lets the dictionary
+   * be changed, and a rejecting handle refuses inserts */
+  if (status) {
+    pFreeze = rfdict_freeze_async(pDict, RFDICT_FREEZE_REJECT);
+    rfdict_freeze_step(pFreeze, 1);
+    if (rfdict_freeze_insert(pFreeze, "#", 1) ||
+        (rfdict_freeze_pending(pFreeze) != 0)) {
+      status = 0;
+    }
+    rfdict_freeze_free(pFreeze);
+    pFreeze = NULL;
+    if (status && (pList->count > 0)) {
+      if (!rfdict_remove(pDict, ((pList->pKey)[0]).pKey)) {
+        status = 0;
+      }
+    }
+  }
+  
+  rfdict_free(pDict);
+  list_free(&queued);
+  if (!status) {
+    fprintf(stderr, "Background freeze test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * State of a callback that checks fixed-width keys against a sorted
+ * table of keys.
+ * 
+ * pKeys holds the keys back to back at the width, and pOrder gives the
+ * index of each key in ascending order, which is also its value.
  */
+typedef struct {
+  const unsigned char *pKeys;
+  const long *pOrder;
+  size_t width;
+  long count;
+  long next;
+  int ok;
+} TEST_FIXED;
 
-#include "rfdict.h"
+/*
+ * Callback that checks each reported fixed-width key against the next
+ * key of a sorted table.
+ */
+static int fixed_check(void *pCustom, const char *pKey, long val) {
+  
+  TEST_FIXED *pFixed = NULL;
+  long k = 0;
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  pFixed = (TEST_FIXED *) pCustom;
+  
+  if (pFixed->next >= pFixed->count) {
+    pFixed->ok = 0;
+  } else {
+    k = (pFixed->pOrder)[pFixed->next];
+    if ((memcmp(pKey, pFixed->pKeys + k * pFixed->width,
+                pFixed->width) != 0) ||
+        (pKey[pFixed->width] != 0) || (val != k)) {
+      pFixed->ok = 0;
+    }
+  }
+  (pFixed->next)++;
+  
+  return 1;
+}
 
-#include <limits.h>
-#include <stddef.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+/*
+ * Test fixed-width binary keys.
+ * 
+ * Keys of widths around the size of an unsigned long, many of them
+ * with zero bytes and long shared prefixes, are inserted in random
+ * order.  Enumeration must follow memcmp() order, and every key must be
+ * found by a plain lookup, by a cursor moving through the keys in order
+ * and back, and in a frozen image that outlives the dictionary.  Keys
+ * one bit away from the stored keys must not be found.  Half the keys
+ * are then removed and inserted again.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_fixed(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  RFDICT_CURSOR cursor;
+  TEST_FIXED fixed;
+  unsigned char *pKeys = NULL;
+  unsigned char key[64];
+  long order[300];
+  const char *pStored = NULL;
+  unsigned long seed = 74;
+  size_t widths[5];
+  size_t width = 0;
+  int status = 1;
+  int w = 0;
+  long n = 0;
+  long i = 0;
+  long j = 0;
+  long t = 0;
+  size_t b = 0;
+  
+  /* One byte, a word and a byte either side of it, and a few words */
+  widths[0] = 1;
+  widths[1] = sizeof(unsigned long) - 1;
+  widths[2] = sizeof(unsigned long);
+  widths[3] = sizeof(unsigned long) + 1;
+  widths[4] = 3 * sizeof(unsigned long) + 3;
+  
+  for(w = 0; status && (w < 5); w++) {
+    width = widths[w];
+    pDict = rfdict_alloc_fixed(width);
+    pKeys = (unsigned char *) malloc(300 * width);
+    if (pKeys == NULL) {
+      abort();
+    }
+    
+    /* Generate distinct keys whose last bit is clear, which are all the
+     * even bytes for a width of one */
+    n = 0;
+    for(i = 0; n < ((width > 1) ? 300 : 128); i++) {
+      for(b = 0; b < width; b++) {
+        if (width == 1) {
+          key[b] = (unsigned char) (i * 2);
+        } else if ((b < width / 2) || ((test_rand(&seed) % 4) == 0)) {
+          key[b] = (unsigned char) ((test_rand(&seed) % 5 == 0) ?
+                                      0xff : 0);
+        } else {
+          key[b] = (unsigned char) test_rand(&seed);
+        }
+      }
+      key[width - 1] = (unsigned char) (key[width - 1] & 0xfe);
+      if (rfdict_insert(pDict, (const char *) &(key[0]), n)) {
+        memcpy(pKeys + n * width, &(key[0]), width);
+        n++;
+      }
+    }
+    
+    /* Sort the key indices by memcmp() */
+    for(i = 0; i < n; i++) {
+      for(j = i; (j > 0) && (memcmp(pKeys + order[j - 1] * width,
+                                     pKeys + i * width, width) > 0); j--) {
+        order[j] = order[j - 1];
+      }
+      order[j] = i;
+    }
+    
+    /* Enumeration order */
+    if (!rfdict_verify(pDict, 2)) {
+      status = 0;
+    }
+    fixed.pKeys = pKeys;
+    fixed.pOrder = &(order[0]);
+    fixed.width = width;
+    fixed.count = n;
+    fixed.next = 0;
+    fixed.ok = 1;
+    rfdict_intersect(pDict, pDict, &fixed_check, &fixed);
+    if ((!(fixed.ok)) || (fixed.next != n)) {
+      status = 0;
+    }
+    
+    /* Plain lookups, present and absent, and the stored keys */
+    for(i = 0; status && (i < n); i++) {
+      memcpy(&(key[0]), pKeys + i * width, width);
+      pStored = rfdict_get_key(pDict, (const char *) &(key[0]));
+      if ((rfdict_get(pDict, (const char *) &(key[0]), -1) != i) ||
+          (pStored == NULL) ||
+          (memcmp(pStored, &(key[0]), width) != 0) ||
+          (pStored[width] != 0)) {
+        status = 0;
+      }
+      key[width - 1] = (unsigned char) (key[width - 1] | 1);
+      if ((rfdict_get(pDict, (const char *) &(key[0]), -1) != -1) ||
+          (rfdict_get_key(pDict, (const char *) &(key[0])) != NULL)) {
+        status = 0;
+      }
+    }
+    
+    /* Cursor lookups forward and back */
+    rfdict_cursor_init(&cursor);
+    for(t = 0; status && (t < 2 * n); t++) {
+      i = order[(t < n) ? t : (2 * n - 1 - t)];
+      if (rfdict_get_hint(pDict, (const char *) (pKeys + i * width), -1,
+                          &cursor) != i) {
+        status = 0;
+      }
+    }
+    
+    /* Remove and insert again the keys at odd positions */
+    for(t = 1; status && (t < n); t += 2) {
+      if (!rfdict_remove(pDict,
+                         (const char *) (pKeys + order[t] * width))) {
+        status = 0;
+      }
+    }
+    for(t = 0; status && (t < n); t++) {
+      if (rfdict_get(pDict, (const char *) (pKeys + order[t] * width), -1)
+            != (((t % 2) == 0) ? order[t] : -1)) {
+        status = 0;
+      }
+    }
+    if (status) {
+      if (!rfdict_verify(pDict, 2)) {
+        status = 0;
+      }
+    }
+    for(t = 1; status && (t < n); t += 2) {
+      if (!rfdict_insert(pDict, (const char *) (pKeys + order[t] * width),
+                          order[t])) {
+        status = 0;
+      }
+    }
+    if (status) {
+      fixed.next = 0;
+      rfdict_intersect(pDict, pDict, &fixed_check, &fixed);
+      if ((!rfdict_verify(pDict, 2)) || (!(fixed.ok)) ||
+          (fixed.next != n)) {
+        status = 0;
+      }
+    }
+    
+    /* Frozen image, checked after the dictionary is gone */
+    pFrozen = rfdict_freeze(pDict);
+    rfdict_free(pDict);
+    pDict = NULL;
+    if (rfdict_frozen_count(pFrozen) != n) {
+      status = 0;
+    }
+    for(i = 0; status && (i < n); i++) {
+      memcpy(&(key[0]), pKeys + i * width, width);
+      if (rfdict_frozen_get(pFrozen, (const char *) &(key[0]), -1) != i) {
+        status = 0;
+      }
+      key[width - 1] = (unsigned char) (key[width - 1] | 1);
+      if (rfdict_frozen_get(pFrozen, (const char *) &(key[0]), -1) != -1) {
+        status = 0;
+      }
+    }
+    rfdict_frozen_free(pFrozen);
+    pFrozen = NULL;
+    free(pKeys);
+    pKeys = NULL;
+  }
+  
+  if (!status) {
+    fprintf(stderr, "Fixed-width key test failed at width %lu!\n",
+            (unsigned long) width);
+  }
+  return status;
+}
 
-#define INPUT_MAXLINE (1024)
+/*
+ * State of a callback that expands reported compressed keys and checks
+ * them against a sorted reference list.
+ */
+typedef struct {
+  RFDICT_CODEC *pCodec;
+  TEST_VISIT visit;
+} TEST_CODED;
+
+/*
+ * Callback that expands a compressed key and checks it against the
+ * next key of a sorted reference list.
+ */
+static int coded_check(void *pCustom, const char *pKey, long val) {
+  
+  TEST_CODED *pCoded = NULL;
+  char buf[RFDICT_CODEC_MAXKEY + 1];
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pKey == NULL)) {
+    abort();
+  }
+  pCoded = (TEST_CODED *) pCustom;
+  
+  rfdict_codec_decode(pCoded->pCodec, pKey, &(buf[0]));
+  return visit_check(&(pCoded->visit), &(buf[0]), val);
+}
+
+/*
+ * Test key compression codecs.
+ * 
+ * A codec is trained on every other key of the reference list.  All the
+ * keys, and generated keys with bytes on both sides of the letters,
+ * must compress to strings in the same order as the keys, and expand
+ * back to the keys as a dictionary reports them.  A dictionary using
+ * the codec must match the reference list, and so must a frozen image
+ * of it after both the dictionary and the codec have been released.  A
+ * key of the greatest length a codec accepts must also go through.
+ * 
+ * Parameters:
+ * 
+ *   pList - the sorted reference list
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+static int test_codec(TEST_LIST *pList) {
+  
+  static const char *pAlpha = "\001 09AZ[_`az{~\177\200\377";
+  RFDICT_CODEC *pCodec = NULL;
+  RFDICT *pDict = NULL;
+  RFDICT_FROZEN *pFrozen = NULL;
+  TEST_CODED coded;
+  const char **ppSample = NULL;
+  char *pCode = NULL;
+  char *pPrev = NULL;
+  char key[200][16];
+  char code[200][64];
+  char buf[RFDICT_CODEC_MAXKEY + 1];
+  char plain[RFDICT_CODEC_MAXKEY + 1];
+  unsigned long seed = 75;
+  int status = 1;
+  int r1 = 0;
+  int r2 = 0;
+  size_t len = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameters */
+  if (pList == NULL) {
+    abort();
+  }
+  
+  /* Train on every other key */
+  ppSample = (const char **) malloc(
+                (size_t) (pList->count / 2 + 1) * sizeof(const char *));
+  pCode = (char *) malloc(RFDICT_CODEC_MAXCODE + 1);
+  pPrev = (char *) malloc(RFDICT_CODEC_MAXCODE + 1);
+  if ((ppSample == NULL) || (pCode == NULL) || (pPrev == NULL)) {
+    abort();
+  }
+  for(i = 0; i < pList->count; i += 2) {
+    ppSample[i / 2] = ((pList->pKey)[i]).pKey;
+  }
+  pCodec = rfdict_codec_train(ppSample, (pList->count + 1) / 2,
+                              pList->sensitive);
+  
+  /* The reference keys compress in order, and expand back */
+  for(i = 0; status && (i < pList->count); i++) {
+    len = rfdict_codec_encode(pCodec, ((pList->pKey)[i]).pKey, pCode);
+    if ((len > RFDICT_CODEC_MAXCODE) || (strlen(pCode) != len) ||
+        ((i > 0) && (strcmp(pPrev, pCode) >= 0))) {
+      status = 0;
+    }
+    if (status) {
+      len = rfdict_codec_decode(pCodec, pCode, &(buf[0]));
+      if ((strlen(&(buf[0])) != len) ||
+          (strcmp(&(buf[0]), ((pList->pKey)[i]).pKey) != 0)) {
+        status = 0;
+      }
+    }
+    strcpy(pPrev, pCode);
+  }
+  
+  /* Generated keys compare in the same order once compressed */
+  for(i = 0; status && (i < 200); i++) {
+    len = (size_t) (test_rand(&seed) % 12);
+    for(j = 0; j < (long) len; j++) {
+      (key[i])[j] = pAlpha[test_rand(&seed) % 16];
+    }
+    (key[i])[len] = 0;
+    if (rfdict_codec_encode(pCodec, &((key[i])[0]), pCode) >= 64) {
+      status = 0;
+    } else {
+      strcpy(&((code[i])[0]), pCode);
+    }
+    fold_key(&((key[i])[0]), &((key[i])[0]), pList->sensitive);
+    rfdict_codec_decode(pCodec, &((code[i])[0]), &(buf[0]));
+    if (strcmp(&(buf[0]), &((key[i])[0])) != 0) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < 200); i++) {
+    for(j = 0; j < 200; j++) {
+      r1 = strcmp(&((key[i])[0]), &((key[j])[0]));
+      r2 = strcmp(&((code[i])[0]), &((code[j])[0]));
+      if (((r1 > 0) - (r1 < 0)) != ((r2 > 0) - (r2 < 0))) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* A key of the greatest length */
+  if (status) {
+    for(i = 0; i < RFDICT_CODEC_MAXKEY; i++) {
+      plain[i] = (char) (1 + test_rand(&seed) % 255);
+    }
+    plain[RFDICT_CODEC_MAXKEY] = 0;
+    len = rfdict_codec_encode(pCodec, &(plain[0]), pCode);
+    rfdict_codec_decode(pCodec, pCode, &(buf[0]));
+    fold_key(&(plain[0]), &(plain[0]), pList->sensitive);
+    if ((len > RFDICT_CODEC_MAXCODE) || (strlen(pCode) != len) ||
+        (strcmp(&(buf[0]), &(plain[0])) != 0)) {
+      status = 0;
+    }
+  }
+  
+  /* A dictionary using the codec matches the list */
+  pDict = rfdict_alloc_coded(pCodec);
+  for(i = 0; i < pList->count; i++) {
+    rfdict_insert(pDict, ((pList->pKey)[i]).pKey, ((pList->pKey)[i]).val);
+  }
+  if (status) {
+    coded.pCodec = pCodec;
+    coded.visit.pExpect = pList;
+    coded.visit.next = 0;
+    coded.visit.ok = 1;
+    rfdict_intersect(pDict, pDict, &coded_check, &coded);
+    if ((!rfdict_verify(pDict, 2)) || (!(coded.visit.ok)) ||
+        (coded.visit.next != pList->count)) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < pList->count); i++) {
+    lower_key(&(buf[0]), ((pList->pKey)[i]).pKey);
+    if (rfdict_get(pDict, pList->sensitive ?
+                            ((pList->pKey)[i]).pKey : &(buf[0]), -1) !=
+          ((pList->pKey)[i]).val) {
+      status = 0;
+    }
+  }
+  if (status) {
+    if ((!rfdict_insert(pDict, &(plain[0]), -2)) ||
+        (rfdict_get(pDict, &(plain[0]), -1) != -2) ||
+        (!rfdict_remove(pDict, &(plain[0]))) ||
+        (!rfdict_verify(pDict, 2))) {
+      status = 0;
+    }
+  }
+  
+  /* A frozen image outlives the dictionary and the codec */
+  pFrozen = rfdict_freeze(pDict);
+  rfdict_free(pDict);
+  pDict = NULL;
+  rfdict_codec_free(pCodec);
+  pCodec = NULL;
+  if (status) {
+    status = same_frozen(pFrozen, pList);
+  }
+  rfdict_frozen_free(pFrozen);
+  pFrozen = NULL;
+  
+  free(ppSample);
+  free(pCode);
+  free(pPrev);
+  if (!status) {
+    fprintf(stderr, "Key compression test failed!\n");
+  }
+  return status;
+}
 
 /*
  * Program entrypoint.
@@ -47,6 +3753,7 @@
 int main(int argc, char *argv[]) {
   
   RFDICT *pDict = NULL;
+  TEST_LIST list;
   char buf[INPUT_MAXLINE];
   int status = 1;
   int x = 0;
@@ -93,10 +3800,11 @@ int main(int argc, char *argv[]) {
     }
   }
   
-  /* Allocate dictionary */
+  /* Allocate dictionary and reference list */
   if (status) {
     pDict = rfdict_alloc(sensitive);
   }
+  list_init(&list, sensitive);
   
   /* Read each line of input */
   while (status && (fgets(&(buf[0]), INPUT_MAXLINE, stdin) != NULL)) {
@@ -146,6 +3854,8 @@ int main(int argc, char *argv[]) {
       if (!rfdict_insert(pDict, &(buf[x]), line)) {
         fprintf(stderr, "Duplicate key!  Line %d\n", line);
         status = 0;
+      } else {
+        list_add(&list, &(buf[x]), line);
       }
     }
     
@@ -163,6 +3873,74 @@ int main(int argc, char *argv[]) {
     }
   }
   
+  /* Check that the loaded dictionary is intact */
+  if (status) {
+    if (!rfdict_verify(pDict, 4)) {
+      fprintf(stderr, "Dictionary failed verification!\n");
+      status = 0;
+    }
+  }
+  
+  /* Test the rest of the interface against the loaded keys */
+  if (status) {
+    list_sort(&list);
+    status = test_refs(&list);
+  }
+  if (status) {
+    status = test_delta();
+  }
+  if (status) {
+    status = test_clone(&list);
+  }
+  if (status) {
+    status = test_sets(&list);
+  }
+  if (status) {
+    status = test_clear(&list);
+  }
+  if (status) {
+    status = test_hint(&list);
+  }
+  if (status) {
+    status = test_disk(&list);
+  }
+  if (status) {
+    status = test_frozen(&list);
+  }
+  if (status) {
+    status = test_pack();
+  }
+  if (status) {
+    status = test_louds(&list);
+  }
+  if (status) {
+    status = test_fst(&list);
+  }
+  if (status) {
+    status = test_prefix(sensitive);
+  }
+  if (status) {
+    status = test_scan(sensitive);
+  }
+  if (status) {
+    status = test_fuzzy(&list);
+  }
+  if (status) {
+    status = test_match(sensitive);
+  }
+  if (status) {
+    status = test_pools(&list);
+  }
+  if (status) {
+    status = test_freeze_async(&list);
+  }
+  if (status) {
+    status = test_fixed();
+  }
+  if (status) {
+    status = test_codec(&list);
+  }
+  
   /* Copy passed key into buffer */
   if (status) {
     if (strlen(argv[2]) >= (INPUT_MAXLINE - 1)) {
@@ -209,9 +3987,10 @@ int main(int argc, char *argv[]) {
     }
   }
   
-  /* Free dictionary if allocated */
+  /* Free dictionary if allocated, and the reference list */
   rfdict_free(pDict);
   pDict = NULL;
+  list_free(&list);
   
   /* Return inverted status */
   if (status) {
@@ -9,6 +9,13 @@
  * standard input.  The tree is verified and printed to standard output.
  * The dictionary is constructed in case-insensitive mode.
  * 
+ * Afterwards, the keys are removed one by one, always removing the key
+ * at the root of the tree, and the tree is verified after each
+ * removal.
+ * 
+ * Finally, the internals of the other structures are tested on
+ * generated keys, verifying the trees they hold as they go.
+ * 
  * Compilation:
  * 
  *   - The source file of rfdict is included by this file, so just
@@ -247,6 +254,734 @@ void print_tree(RFDICT_NODE *pNode, int depth, FILE *pOut) {
   }
 }
 
+/*
+ * Check that an adaptive dictionary is intact, and whether it has
+ * finished moving to its engine.
+ * 
+ * The tree and the keys queued while freezing are verified, and once
+ * the hash table is complete, it must hold one slot for each key of
+ * the tree.
+ * 
+ * Parameters:
+ * 
+ *   pAdapt - the adaptive dictionary
+ * 
+ *   pSettled - receives non-zero if no move is in progress, zero if
+ *   one is
+ * 
+ * Return:
+ * 
+ *   non-zero if the dictionary is intact, zero if not
+ */
+int verify_adapt(RFDICT_ADAPT *pAdapt, int *pSettled) {
+  
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pAdapt == NULL) || (pSettled == NULL)) {
+    abort();
+  }
+  
+  if (pAdapt->pTree != NULL) {
+    if (!rfdict_verify(pAdapt->pTree, 2)) {
+      status = 0;
+    }
+  }
+  if (pAdapt->pFreeze != NULL) {
+    if ((pAdapt->pFreeze)->pPending != NULL) {
+      if (!rfdict_verify((pAdapt->pFreeze)->pPending, 2)) {
+        status = 0;
+      }
+    }
+  }
+  if ((pAdapt->ppSlot != NULL) && (pAdapt->pIndex == NULL)) {
+    if ((pAdapt->pTree == NULL) ||
+        (pAdapt->filled != (unsigned long) (pAdapt->pTree)->count)) {
+      status = 0;
+    }
+  }
+  
+  *pSettled = ((pAdapt->pIndex == NULL) && (pAdapt->thaw < 0) &&
+                ((pAdapt->engine == RFDICT_ENGINE_FROZEN) ?
+                  (pAdapt->pTree == NULL) : (pAdapt->pFreeze == NULL)) &&
+                ((pAdapt->engine == RFDICT_ENGINE_HASH) ==
+                  (pAdapt->ppSlot != NULL)));
+  
+  return status;
+}
+
+/*
+ * Test the engine switching of adaptive dictionaries.
+ * 
+ * Generated keys are inserted with no lookups, then used with a few
+ * lookups per insert, then only looked up, and then only inserted
+ * again, which must take the dictionary from the tree engine to the
+ * hash engine, the frozen engine and back to the tree.  Each phase
+ * runs until the move is complete, and every lookup along the way must
+ * give the right value.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+int test_adapt(void) {
+  
+  /* The engine each phase must end up with, and the lookups made per
+   * insert, where -1 means lookups only */
+  static const int aEngine[4] = {
+    RFDICT_ENGINE_TREE, RFDICT_ENGINE_HASH, RFDICT_ENGINE_FROZEN,
+    RFDICT_ENGINE_TREE
+  };
+  static const long aReads[4] = {0, 9, -1, 0};
+  
+  RFDICT_ADAPT *pAdapt = NULL;
+  RFDICT_ADAPT_STATS stats;
+  char buf[32];
+  int status = 1;
+  int settled = 0;
+  int phase = 0;
+  long reads = 0;
+  long writes = 0;
+  long count = 0;
+  long ops = 0;
+  long i = 0;
+  
+  pAdapt = rfdict_adapt_alloc(0, 4, 64);
+  
+  for(phase = 0; status && (phase < 4); phase++) {
+    settled = 0;
+    for(ops = 0; status && (ops < 200000) &&
+          ((ops < 2 * RFDICT_ADAPT_WINDOW) || (!settled) ||
+            (rfdict_adapt_engine(pAdapt) != aEngine[phase])); ops++) {
+      
+      /* Insert a new key, or look up one inserted before, in mixed
+       * case */
+      if ((aReads[phase] >= 0) && ((ops % (aReads[phase] + 1)) == 0)) {
+        sprintf(&(buf[0]), "Key%ld", count);
+        if (!rfdict_adapt_insert(pAdapt, &(buf[0]), count)) {
+          status = 0;
+        }
+        count++;
+        writes++;
+      } else {
+        i = (ops * 7919) % count;
+        sprintf(&(buf[0]), "kEY%ld", i);
+        if (rfdict_adapt_get(pAdapt, &(buf[0]), -1) != i) {
+          status = 0;
+        }
+        sprintf(&(buf[0]), "Key%ld!", i);
+        if (rfdict_adapt_get(pAdapt, &(buf[0]), -1) != -1) {
+          status = 0;
+        }
+        reads += 2;
+      }
+      
+      if ((ops % 97) == 0) {
+        if (!verify_adapt(pAdapt, &settled)) {
+          status = 0;
+        }
+      }
+    }
+    
+    /* The phase must have ended up on its engine */
+    if (status) {
+      if ((!verify_adapt(pAdapt, &settled)) || (!settled) ||
+          (rfdict_adapt_engine(pAdapt) != aEngine[phase]) ||
+          (rfdict_adapt_count(pAdapt) != count)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* The statistics add up, with one move per phase after the first,
+   * and every key is still there */
+  if (status) {
+    rfdict_adapt_stats(pAdapt, &stats);
+    if ((stats.reads != reads) || (stats.writes != writes) ||
+        (stats.migrations != 3)) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < count); i++) {
+    sprintf(&(buf[0]), "key%ld", i);
+    if (rfdict_adapt_get(pAdapt, &(buf[0]), -1) != i) {
+      status = 0;
+    }
+  }
+  
+  rfdict_adapt_free(pAdapt);
+  if (!status) {
+    fprintf(stderr, "Adaptive engine test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test latency histograms.
+ * 
+ * Every bucket of the histogram must map back to itself at both ends
+ * of its range, and quantiles of a made-up histogram must fall at the
+ * top of the right bucket.  When the library is compiled with
+ * RFDICT_TIMING, timed operations must be counted according to the
+ * sampling interval; otherwise, timing must refuse to start.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+int test_latency(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_HISTOGRAM hist;
+  char buf[32];
+  int status = 1;
+  int b = 0;
+  long total = 0;
+  long i = 0;
+  
+  /* Buckets and their bounds agree */
+  for(b = 0; b < RFDICT_HISTOGRAM_BUCKETS; b++) {
+    if (rfdict_histogram_index(rfdict_histogram_bound(b)) != b) {
+      status = 0;
+    }
+    if (b < RFDICT_HISTOGRAM_BUCKETS - 1) {
+      if ((rfdict_histogram_bound(b + 1) <= rfdict_histogram_bound(b)) ||
+          (rfdict_histogram_index(rfdict_histogram_bound(b + 1) - 1) !=
+            b)) {
+        status = 0;
+      }
+    }
+  }
+  if (rfdict_histogram_index(0xffffffffUL) !=
+        RFDICT_HISTOGRAM_BUCKETS - 1) {
+    status = 0;
+  }
+  
+  /* Half the operations in bucket 3 and half in bucket 40 */
+  memset(&hist, 0, sizeof(RFDICT_HISTOGRAM));
+  if (rfdict_histogram_quantile(&hist, 500000L) != 0) {
+    status = 0;
+  }
+  hist.count = 100;
+  (hist.buckets)[3] = 50;
+  (hist.buckets)[40] = 50;
+  if ((rfdict_histogram_quantile(&hist, 0) != 3) ||
+      (rfdict_histogram_quantile(&hist, 500000L) != 3) ||
+      (rfdict_histogram_quantile(&hist, 500001L) !=
+        rfdict_histogram_bound(41) - 1) ||
+      (rfdict_histogram_quantile(&hist, 1000000L) !=
+        rfdict_histogram_bound(41) - 1)) {
+    status = 0;
+  }
+  
+  pDict = rfdict_alloc(0);
+  
+#ifdef RFDICT_TIMING
+  /* Time every operation, then every tenth */
+  if (status) {
+    if (!rfdict_latency_enable(pDict, 1)) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < 1000); i++) {
+    sprintf(&(buf[0]), "Key%ld", i);
+    rfdict_insert(pDict, &(buf[0]), i);
+    rfdict_get(pDict, &(buf[0]), -1);
+    rfdict_get(pDict, "missing", -1);
+  }
+  if (status) {
+    if ((!rfdict_latency_snapshot(pDict, RFDICT_OP_INSERT, &hist)) ||
+        (hist.count != 1000)) {
+      status = 0;
+    }
+  }
+  if (status) {
+    if ((!rfdict_latency_snapshot(pDict, RFDICT_OP_GET, &hist)) ||
+        (hist.count != 2000)) {
+      status = 0;
+    }
+    for(b = 0; b < RFDICT_HISTOGRAM_BUCKETS; b++) {
+      total += (hist.buckets)[b];
+    }
+    if ((total != hist.count) ||
+        (rfdict_histogram_quantile(&hist, 500000L) >
+          rfdict_histogram_quantile(&hist, 999000L))) {
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!rfdict_latency_enable(pDict, 10)) {
+      status = 0;
+    }
+    for(i = 0; i < 1000; i++) {
+      rfdict_get(pDict, "Key1", -1);
+    }
+    if ((!rfdict_latency_snapshot(pDict, RFDICT_OP_GET, &hist)) ||
+        (hist.count != 100)) {
+      status = 0;
+    }
+  }
+#else
+  /* Timing is not available */
+  if (status) {
+    (hist.buckets)[0] = 1;
+    if (rfdict_latency_enable(pDict, 1) ||
+        rfdict_latency_snapshot(pDict, RFDICT_OP_GET, &hist) ||
+        (hist.count != 0) || ((hist.buckets)[0] != 0)) {
+      status = 0;
+    }
+  }
+  for(i = 0; status && (i < 1000); i++) {
+    sprintf(&(buf[0]), "Key%ld", i);
+    rfdict_insert(pDict, &(buf[0]), i);
+  }
+  (void) total;
+#endif
+  
+  /* Turning timing off always works, and leaves nothing to report */
+  if (status) {
+    if ((!rfdict_latency_enable(pDict, 0)) ||
+        rfdict_latency_snapshot(pDict, RFDICT_OP_INSERT, &hist) ||
+        (hist.count != 0) || (!rfdict_verify(pDict, 2)) ||
+        (rfdict_get(pDict, "key999", -1) != 999)) {
+      status = 0;
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Latency histogram test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test comparisons that skip a known common prefix.
+ * 
+ * Keys sharing long prefixes, some of them differing only in case, are
+ * compared in pairs by rfdict_lcpcmp() from several starting offsets,
+ * which must agree with rfdict_keycmp() and find the right common
+ * prefix.  A dictionary of such keys is then built in both case modes,
+ * and lookups, in-order traversal and prefix bounds are checked against
+ * a sorted copy of the keys.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+int test_lcp(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_NODE *pNode = NULL;
+  char base[300];
+  char keys[60][300];
+  char sorted[512][300];
+  char buf[300];
+  int status = 1;
+  int sensitive = 0;
+  int i = 0;
+  int j = 0;
+  int k = 0;
+  int r1 = 0;
+  int r2 = 0;
+  int c1 = 0;
+  int c2 = 0;
+  size_t expect = 0;
+  size_t lcp = 0;
+  size_t plen = 0;
+  
+  /* Base key of mixed case letters */
+  for(i = 0; i < 299; i++) {
+    base[i] = (char) ('a' + (i % 26));
+    if ((i % 3) == 0) {
+      base[i] = (char) ('A' + (i % 26));
+    }
+  }
+  base[299] = (char) 0;
+  
+  /* Keys that are prefixes of the base, some of them with a case change
+   * in the middle and some with a suffix that is not in the base */
+  for(i = 0; i < 60; i++) {
+    strcpy(&((keys[i])[0]), &(base[0]));
+    (keys[i])[240 + (i % 20)] = (char) 0;
+    if ((i % 5) == 0) {
+      (keys[i])[100] = (char) ((keys[i])[100] ^ 0x20);
+    }
+    if ((i % 4) == 1) {
+      strcat(&((keys[i])[0]), "x");
+    } else if ((i % 4) == 2) {
+      strcat(&((keys[i])[0]), "X");
+    } else if ((i % 4) == 3) {
+      strcat(&((keys[i])[0]), "[");
+    }
+  }
+  
+  /* Compare every pair in both case modes */
+  for(sensitive = 0; status && (sensitive <= 1); sensitive++) {
+    for(i = 0; status && (i < 60); i++) {
+      for(j = 0; j < 60; j++) {
+        
+        /* Expected common prefix */
+        for(expect = 0; (keys[i])[expect] != 0; expect++) {
+          c1 = (int) ((unsigned char) (keys[i])[expect]);
+          c2 = (int) ((unsigned char) (keys[j])[expect]);
+          if ((!sensitive) && (c1 != c2) && ((c1 ^ 0x20) == c2) &&
+              (((c1 | 0x20) >= 'a') && ((c1 | 0x20) <= 'z'))) {
+            c2 = c1;
+          }
+          if (c1 != c2) {
+            break;
+          }
+        }
+        
+        r1 = rfdict_keycmp(&((keys[i])[0]), &((keys[j])[0]), sensitive);
+        r1 = (r1 > 0) - (r1 < 0);
+        
+        /* Start from nothing, from part of the prefix, and from all of
+         * it */
+        for(k = 0; k < 3; k++) {
+          lcp = (expect * (size_t) k) / 2;
+          r2 = rfdict_lcpcmp(&((keys[i])[0]), &((keys[j])[0]), sensitive,
+                  RFDICT_MAXKEY + 1, &lcp);
+          r2 = (r2 > 0) - (r2 < 0);
+          if ((r1 != r2) || (lcp != expect)) {
+            status = 0;
+          }
+        }
+        
+        /* Stopping at the limit treats the keys as equal */
+        lcp = 0;
+        if ((rfdict_lcpcmp(&((keys[i])[0]), &((keys[j])[0]), sensitive,
+                expect / 2, &lcp) != 0) || (lcp != expect / 2)) {
+          status = 0;
+        }
+      }
+    }
+  }
+  
+  /* Sorted keys sharing the upper case base, with decimal suffixes of
+   * varying length */
+  for(i = 0; i < 299; i++) {
+    if ((base[i] >= 'a') && (base[i] <= 'z')) {
+      base[i] = (char) (base[i] - ('a' - 'A'));
+    }
+  }
+  for(i = 0; i < 512; i++) {
+    strcpy(&((sorted[i])[0]), &(base[0]));
+    (sorted[i])[200 + (i / 64)] = (char) 0;
+    sprintf(&(buf[0]), "%d", i % 64);
+    strcat(&((sorted[i])[0]), &(buf[0]));
+  }
+  for(i = 1; i < 512; i++) {
+    for(j = i; (j > 0) &&
+          (strcmp(&((sorted[j - 1])[0]), &((sorted[j])[0])) > 0); j--) {
+      strcpy(&(buf[0]), &((sorted[j])[0]));
+      strcpy(&((sorted[j])[0]), &((sorted[j - 1])[0]));
+      strcpy(&((sorted[j - 1])[0]), &(buf[0]));
+    }
+  }
+  
+  /* Build a dictionary in each case mode, inserting in scrambled order
+   * and looking keys up in lower case when case does not matter */
+  for(sensitive = 0; status && (sensitive <= 1); sensitive++) {
+    pDict = rfdict_alloc(sensitive);
+    for(i = 0; status && (i < 512); i++) {
+      k = (i * 193) % 512;
+      if (!rfdict_insert(pDict, &((sorted[k])[0]), k)) {
+        status = 0;
+      }
+    }
+    if (status) {
+      if (!rfdict_verify(pDict, 2)) {
+        status = 0;
+      }
+    }
+    for(i = 0; status && (i < 512); i++) {
+      strcpy(&(buf[0]), &((sorted[i])[0]));
+      if (!sensitive) {
+        for(j = 150; buf[j] != 0; j++) {
+          if ((buf[j] >= 'A') && (buf[j] <= 'Z')) {
+            buf[j] = (char) (buf[j] + ('a' - 'A'));
+          }
+        }
+      }
+      if (rfdict_get(pDict, &(buf[0]), -1) != i) {
+        status = 0;
+      }
+    }
+    
+    /* In-order traversal */
+    pNode = rfdict_first(pDict);
+    for(i = 0; status && (i < 512); i++) {
+      if (pNode == NULL) {
+        status = 0;
+      } else if (strcmp(pNode->pKey, &((sorted[i])[0])) != 0) {
+        status = 0;
+      } else {
+        pNode = rfdict_next(pNode);
+      }
+    }
+    if (status && (pNode != NULL)) {
+      status = 0;
+    }
+    
+    /* Prefix bounds, both inclusive and strict, at lengths around the
+     * end of the shared prefixes */
+    for(i = 0; status && (i < 512); i += 7) {
+      for(plen = 198; plen < strlen(&((sorted[i])[0])); plen++) {
+        for(k = 0; k <= 1; k++) {
+          for(j = 0; j < 512; j++) {
+            r1 = strncmp(&((sorted[j])[0]), &((sorted[i])[0]), plen);
+            if ((r1 > 0) || ((r1 == 0) && (!k))) {
+              break;
+            }
+          }
+          pNode = rfdict_bound(pDict, &((sorted[i])[0]), plen, k);
+          if (j >= 512) {
+            if (pNode != NULL) {
+              status = 0;
+            }
+          } else if ((pNode == NULL) ||
+                (strcmp(pNode->pKey, &((sorted[j])[0])) != 0)) {
+            status = 0;
+          }
+        }
+      }
+    }
+    
+    rfdict_free(pDict);
+    pDict = NULL;
+  }
+  
+  if (!status) {
+    fprintf(stderr, "LCP comparison test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test that short keys are held inline in nodes of the smallest size
+ * class.
+ * 
+ * Keys just below, at, and just above the longest length that fits in
+ * the smallest class are inserted and removed again, a length at a
+ * time, twice over.  Every node must be aligned to the smallest class
+ * size, hold its key within its class, and be recycled only within its
+ * class.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+int test_inline(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_NODE *pNode = NULL;
+  RFDICT_NODE *apNode[2][20];
+  char buf[64];
+  int status = 1;
+  int seen[2];
+  int lmax = 0;
+  int len = 0;
+  int pass = 0;
+  int c = 0;
+  int i = 0;
+  int j = 0;
+  
+  /* The longest key that fits the smallest class, and the boundaries
+   * of the next few classes */
+  lmax = RFDICT_CLASS_MIN - ((int) offsetof(RFDICT_NODE, key)) - 1;
+  if (lmax < 16) {
+    status = 0;
+  }
+  for(c = 0; status && (c < 4); c++) {
+    len = (RFDICT_CLASS_MIN << c) - ((int) offsetof(RFDICT_NODE, key)) -
+            1;
+    if ((rfdict_class((size_t) len) != c) ||
+        (rfdict_class((size_t) (len + 1)) != c + 1)) {
+      status = 0;
+    }
+  }
+  
+  /* Keys of lengths around the boundary */
+  seen[0] = 0;
+  seen[1] = 0;
+  pDict = rfdict_alloc(1);
+  for(pass = 0; status && (pass < 2); pass++) {
+    for(len = lmax - 2; status && (len <= lmax + 2); len++) {
+      c = rfdict_class((size_t) len);
+      if (c != ((len <= lmax) ? 0 : 1)) {
+        status = 0;
+      }
+      for(i = 0; status && (i < 20); i++) {
+        sprintf(&(buf[0]), "%0*d", len, i);
+        if (!rfdict_insert(pDict, &(buf[0]), (long) (len * 100 + i))) {
+          status = 0;
+        }
+        if (status) {
+          pNode = rfdict_find(pDict, &(buf[0]));
+          if ((pNode == NULL) ||
+              (pNode->pKey != &((pNode->key)[0])) ||
+              (rfdict_get_key(pDict, &(buf[0])) != pNode->pKey) ||
+              ((((unsigned long) pNode) % RFDICT_CLASS_MIN) != 0) ||
+              (offsetof(RFDICT_NODE, key) + len + 1 >
+                (size_t) (RFDICT_CLASS_MIN << c))) {
+            status = 0;
+          }
+        }
+        
+        /* The first keys of each class get new nodes, and later keys
+         * of the class must reuse them */
+        if (status) {
+          if (!(seen[c])) {
+            (apNode[c])[i] = pNode;
+          } else {
+            for(j = 0; j < 20; j++) {
+              if ((apNode[c])[j] == pNode) {
+                break;
+              }
+            }
+            if (j >= 20) {
+              status = 0;
+            }
+          }
+        }
+      }
+      seen[c] = 1;
+      
+      /* Check the values and the tree */
+      for(i = 0; status && (i < 20); i++) {
+        sprintf(&(buf[0]), "%0*d", len, i);
+        if (rfdict_get(pDict, &(buf[0]), -1) != (long) (len * 100 + i)) {
+          status = 0;
+        }
+      }
+      if (status) {
+        if (!rfdict_verify(pDict, 2)) {
+          status = 0;
+        }
+      }
+      
+      /* Remove the keys of this length, leaving their nodes for the
+       * next length of the same class */
+      for(i = 0; status && (i < 20); i++) {
+        sprintf(&(buf[0]), "%0*d", len, i);
+        if (!rfdict_remove(pDict, &(buf[0]))) {
+          status = 0;
+        }
+      }
+      if (status) {
+        if ((!rfdict_verify(pDict, 2)) || (pDict->pRoot != NULL)) {
+          status = 0;
+        }
+      }
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Inline key test failed!\n");
+  }
+  return status;
+}
+
+/*
+ * Test that dictionary verification finds damage.
+ * 
+ * A tree of generated keys is damaged in one way at a time, by flipping
+ * the color of a node, pointing a node at the wrong parent, swapping
+ * the keys of two nodes, and changing the count.  Each must be
+ * reported, checking the tree as a whole and split across threads, and
+ * once the damage is undone the tree must pass again.
+ * 
+ * Return:
+ * 
+ *   non-zero if the test passed, zero if it failed
+ */
+int test_verify(void) {
+  
+  RFDICT *pDict = NULL;
+  RFDICT_NODE *apNode[2];
+  RFDICT_NODE *pSave = NULL;
+  char buf[32];
+  int status = 1;
+  int damage = 0;
+  int pass = 0;
+  int nthreads = 0;
+  int n = 0;
+  long i = 0;
+  
+  /* Build the tree, then pick its first node and a node in the middle
+   * of it, both well below the levels where it is split for threads */
+  pDict = rfdict_alloc(1);
+  for(i = 0; i < 1000; i++) {
+    sprintf(&(buf[0]), "Key%04ld", (i * 7) % 1000);
+    rfdict_insert(pDict, &(buf[0]), i);
+  }
+  apNode[0] = rfdict_first(pDict);
+  apNode[1] = pDict->pRoot;
+  for(i = 0; i < 6; i++) {
+    apNode[1] = ((i % 2) == 0) ? (apNode[1])->pLeft : (apNode[1])->pRight;
+  }
+  
+  for(damage = 0; status && (damage < 7); damage++) {
+    for(pass = 0; pass < 2; pass++) {
+      
+      /* Do the damage on the first pass and undo it on the second */
+      switch (damage) {
+        case 0:
+        case 1:
+          n = damage;
+          (apNode[n])->red = (char) !((apNode[n])->red);
+          break;
+        case 2:
+        case 3:
+          n = damage - 2;
+          if (pass == 0) {
+            pSave = (apNode[n])->pParent;
+            (apNode[n])->pParent = pDict->pRoot;
+          } else {
+            (apNode[n])->pParent = pSave;
+          }
+          break;
+        case 4:
+          strcpy(&(buf[0]), &(((apNode[0])->key)[0]));
+          strcpy(&(((apNode[0])->key)[0]), &(((apNode[1])->key)[0]));
+          strcpy(&(((apNode[1])->key)[0]), &(buf[0]));
+          break;
+        case 5:
+          if (pass == 0) {
+            strcpy(&(buf[0]), &((((apNode[1])->pLeft)->key)[0]));
+            strcpy(&((((apNode[1])->pLeft)->key)[0]),
+                    &(((apNode[1])->key)[0]));
+          } else {
+            strcpy(&((((apNode[1])->pLeft)->key)[0]), &(buf[0]));
+          }
+          break;
+        case 6:
+          pDict->count += (pass == 0) ? 1 : -1;
+          break;
+        default:
+          abort();  /* shouldn't happen */
+      }
+      
+      /* Check the tree whole and in parts */
+      for(nthreads = 1; nthreads <= 8; nthreads *= 8) {
+        if ((rfdict_verify(pDict, nthreads) != 0) != (pass == 1)) {
+          status = 0;
+        }
+      }
+    }
+  }
+  
+  rfdict_free(pDict);
+  if (!status) {
+    fprintf(stderr, "Verification damage test failed at %d!\n",
+            damage - 1);
+  }
+  return status;
+}
+
 /*
  * Program entrypoint.
  */
@@ -361,6 +1096,60 @@ int main(int argc, char *argv[]) {
     }
   }
   
+  /* Remove keys one by one, verifying the tree after each removal */
+  while (status && (pDict->pRoot != NULL)) {
+    
+    /* Copy the key of the root node, which is never longer than an
+     * input line */
+    strcpy(&(buf[0]), &(((pDict->pRoot)->key)[0]));
+    
+    /* Remove the key */
+    if (!rfdict_remove(pDict, &(buf[0]))) {
+      fprintf(stderr, "Removal of key %s failed!\n", &(buf[0]));
+      status = 0;
+    }
+    
+    /* Make sure the key is gone */
+    if (status) {
+      if (rfdict_get(pDict, &(buf[0]), -1) != -1) {
+        fprintf(stderr, "Removed key %s still present!\n", &(buf[0]));
+        status = 0;
+      }
+    }
+    
+    /* Verify the tree */
+    if (status) {
+      exit_depth = -1;
+      if (!verify_tree(pDict->pRoot, NULL, 0, &exit_depth)) {
+        status = 0;
+        fprintf(stderr, "Removing %s: Tree verification failed!\n",
+                  &(buf[0]));
+        fprintf(stderr, "Erroneous tree:\n");
+        print_tree(pDict->pRoot, 0, stderr);
+      }
+    }
+  }
+  if (status) {
+    printf("\nAll keys removed, tree verified.\n");
+  }
+  
+  /* Test the other structures */
+  if (status) {
+    status = test_adapt();
+  }
+  if (status) {
+    status = test_latency();
+  }
+  if (status) {
+    status = test_lcp();
+  }
+  if (status) {
+    status = test_inline();
+  }
+  if (status) {
+    status = test_verify();
+  }
+  
   /* Free dictionary */
   rfdict_free(pDict);
   pDict = NULL;